@@ -93,6 +93,9 @@ namespace {
 
 		virtual void setupPlugin(openhat::AbstractOpenHAT* abstractOpenHAT, const std::string& node, openhat::ConfigurationView::Ptr nodeConfig, openhat::ConfigurationView::Ptr parentConfig, const std::string& driverPath) override;
 
+		// each instance uses its own Arducom master
+		virtual bool supportsParallelSetup(void) override { return true; }
+
 		virtual void terminate(void) override;
 	};
 
@@ -1,6 +1,14 @@
+#include <cmath>
+#include <cstdio>
+#include <memory>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "Poco/File.h"
+#include "Poco/Base64Encoder.h"
 #include "Poco/JSON/JSON.h"
 #include "Poco/JSON/Parser.h"
 #include "Poco/JSON/Object.h"
@@ -15,6 +23,203 @@
 
 namespace {
 
+////////////////////////////////////////////////////////////////////////
+// JSON writer
+////////////////////////////////////////////////////////////////////////
+
+/** Writes JSON text to a buffer without building a document tree.
+* Separators between members and array elements are inserted automatically.
+* The buffer keeps its capacity when the writer is cleared; a writer that is reused
+* for each response does not allocate memory once it has reached the size of the largest response. */
+class JSONWriter {
+	std::string buffer;
+	// for each open object or array: true if no element has been written yet
+	std::vector<bool> empty;
+	// true if a member name has been written and its value is expected
+	bool member;
+
+	// writes a separator if necessary
+	void separate(void) {
+		if (this->member) {
+			this->member = false;
+			return;
+		}
+		if (this->empty.empty())
+			return;
+		if (this->empty.back())
+			this->empty.back() = false;
+		else
+			this->buffer += ',';
+	}
+
+	void escape(const char* text) {
+		static const char* hex = "0123456789abcdef";
+		this->buffer += '"';
+		for (const char* c = text; *c != '\0'; c++) {
+			switch (*c) {
+			case '"': this->buffer += "\\\""; break;
+			case '\\': this->buffer += "\\\\"; break;
+			case '\b': this->buffer += "\\b"; break;
+			case '\f': this->buffer += "\\f"; break;
+			case '\n': this->buffer += "\\n"; break;
+			case '\r': this->buffer += "\\r"; break;
+			case '\t': this->buffer += "\\t"; break;
+			default:
+				if ((unsigned char)*c < 0x20) {
+					this->buffer += "\\u00";
+					this->buffer += hex[(*c >> 4) & 0x0f];
+					this->buffer += hex[*c & 0x0f];
+				} else
+					this->buffer += *c;
+			}
+		}
+		this->buffer += '"';
+	}
+
+public:
+	JSONWriter(): member(false) {};
+
+	/** Discards the written text; the allocated memory is kept. */
+	void clear(void) {
+		this->buffer.clear();
+		this->empty.clear();
+		this->member = false;
+	}
+
+	const std::string& str(void) const { return this->buffer; };
+
+	JSONWriter& beginObject(void) {
+		this->separate();
+		this->buffer += '{';
+		this->empty.push_back(true);
+		return *this;
+	}
+
+	JSONWriter& endObject(void) {
+		this->buffer += '}';
+		this->empty.pop_back();
+		return *this;
+	}
+
+	JSONWriter& beginArray(void) {
+		this->separate();
+		this->buffer += '[';
+		this->empty.push_back(true);
+		return *this;
+	}
+
+	JSONWriter& endArray(void) {
+		this->buffer += ']';
+		this->empty.pop_back();
+		return *this;
+	}
+
+	/** Writes the name of an object member. Must be followed by a value. */
+	JSONWriter& key(const char* name) {
+		this->separate();
+		this->escape(name);
+		this->buffer += ':';
+		this->member = true;
+		return *this;
+	}
+
+	/** Appends a value that has been rendered before. */
+	JSONWriter& raw(const std::string& json) {
+		this->separate();
+		this->buffer += json;
+		return *this;
+	}
+
+	/** Appends members of an object that have been rendered before (without the braces). */
+	JSONWriter& members(const std::string& json) {
+		if (json.empty())
+			return *this;
+		this->separate();
+		this->buffer += json;
+		return *this;
+	}
+
+	JSONWriter& null(void) {
+		this->separate();
+		this->buffer += "null";
+		return *this;
+	}
+
+	JSONWriter& value(const char* text) {
+		if (text == nullptr)
+			return this->null();
+		this->separate();
+		this->escape(text);
+		return *this;
+	}
+
+	JSONWriter& value(const std::string& text) {
+		return this->value(text.c_str());
+	}
+
+	JSONWriter& value(bool b) {
+		this->separate();
+		this->buffer += (b ? "true" : "false");
+		return *this;
+	}
+
+	JSONWriter& value(int i) {
+		return this->value((long long)i);
+	}
+
+	JSONWriter& value(unsigned int i) {
+		return this->value((unsigned long long)i);
+	}
+
+	JSONWriter& value(long i) {
+		return this->value((long long)i);
+	}
+
+	JSONWriter& value(unsigned long i) {
+		return this->value((unsigned long long)i);
+	}
+
+	JSONWriter& value(long long i) {
+		char text[24];
+		snprintf(text, sizeof(text), "%lld", i);
+		this->separate();
+		this->buffer += text;
+		return *this;
+	}
+
+	JSONWriter& value(unsigned long long i) {
+		char text[24];
+		snprintf(text, sizeof(text), "%llu", i);
+		this->separate();
+		this->buffer += text;
+		return *this;
+	}
+
+	JSONWriter& value(double d) {
+		// JSON does not support NaN and infinity
+		if (!std::isfinite(d))
+			return this->null();
+		char text[32];
+		snprintf(text, sizeof(text), "%.17g", d);
+		this->separate();
+		this->buffer += text;
+		return *this;
+	}
+
+	/** Writes a scalar value (e. g. the id of a JSON-RPC request). Other values are written as strings. */
+	JSONWriter& value(const Poco::Dynamic::Var& var) {
+		if (var.isEmpty())
+			return this->null();
+		if (var.isBoolean())
+			return this->value(var.convert<bool>());
+		if (var.isInteger())
+			return (var.isSigned() ? this->value(var.convert<Poco::Int64>()) : this->value(var.convert<Poco::UInt64>()));
+		if (var.isNumeric())
+			return this->value(var.convert<double>());
+		return this->value(var.convert<std::string>());
+	}
+};
+
 ////////////////////////////////////////////////////////////////////////
 // Plugin main class
 ////////////////////////////////////////////////////////////////////////
@@ -33,6 +238,18 @@ class WebServerPlugin : public IOpenHATPlugin, public opdi::DigitalPort {
 		explicit MethodNotFoundException(std::string message): Poco::Exception(message) {};
 	};
 
+	// pairs of port ID and error message
+	typedef std::vector<std::pair<std::string, std::string>> PortErrors;
+
+	// invalid parameters for several ports; the errors are returned as the data of the error response
+	class PortStatesException : public Poco::InvalidArgumentException
+	{
+	public:
+		PortErrors portErrors;
+
+		PortStatesException(std::string message, const PortErrors& portErrors): Poco::InvalidArgumentException(message), portErrors(portErrors) {};
+	};
+
 	openhat::AbstractOpenHAT* openhat;
 	// web server management structures
 	mg_mgr mgr;
@@ -49,6 +266,49 @@ class WebServerPlugin : public IOpenHATPlugin, public opdi::DigitalPort {
 	std::string ipACL;
 
 	std::string jsonRpcUrl;
+
+	// static information about a port as JSON object members (without the braces)
+	struct PortInfoFragment {
+		uint32_t infoRevision;
+		std::string json;
+	};
+
+	// cached port information; a fragment is rendered again when the info revision of its port changes
+	std::unordered_map<opdi::Port*, PortInfoFragment> portInfoCache;
+	// port list version of the cache; ports may have been removed if the version changes
+	uint32_t portListVersion;
+
+	// buffers that are reused for all responses
+	JSONWriter responseWriter;
+	JSONWriter fragmentWriter;
+	// response to one request of a batch
+	JSONWriter batchWriter;
+
+	// a WebSocket client that receives the state changes of its subscribed ports
+	struct PushClient {
+		std::string portSpec;
+		std::unordered_set<opdi::Port*> ports;
+		// ports whose state has changed since the last message
+		std::unordered_set<opdi::Port*> pending;
+		// true if the states of all subscribed ports are to be sent
+		bool pendingAll;
+		// info revisions of the ports as known by the client
+		std::unordered_map<opdi::Port*, uint32_t> infoRevisions;
+	};
+
+	// WebSocket clients in push mode; other clients receive "Refresh" messages
+	std::unordered_map<mg_connection*, PushClient> pushClients;
+	// change queues of the subscribed ports; the ports record their state changes in these queues
+	std::unordered_map<opdi::Port*, std::unique_ptr<opdi::PortChangeQueue>> pushQueues;
+	// the subscriptions have changed since the change queues have been updated
+	bool pushQueuesChanged;
+	// port list version of the subscriptions
+	uint32_t pushPortListVersion;
+	// maximum number of bytes that may be waiting to be sent to a client before state changes are held back
+	size_t webSocketSendLimit;
+	// state and extended state of the ports (JSON object members) as rendered in the current frame
+	std::unordered_map<opdi::Port*, std::string> pushStates;
+	JSONWriter pushWriter;
 	
 	uint8_t oldPriority;
 	uint64_t accelTime;
@@ -63,6 +323,10 @@ public:
 		this->indexFiles = "index.html";
 		this->jsonRpcUrl = "/api/jsonrpc";
 		this->nc = nullptr;
+		this->portListVersion = 0;
+		this->pushPortListVersion = 0;
+		this->pushQueuesChanged = false;
+		this->webSocketSendLimit = 65536;
 
 		this->setMode(OPDI_DIGITAL_MODE_OUTPUT, opdi::Port::ChangeSource::CHANGESOURCE_INT);
 		this->setLine(1, opdi::Port::ChangeSource::CHANGESOURCE_INT);
@@ -77,44 +341,100 @@ public:
 
 	void onAllPortsRefreshed(const void* pSender);
 	void onPortRefreshed(const void* pSender, opdi::Port*& port);
+
+	// WebSocket push mode
+
+	/** This method handles a message of a WebSocket client ("Subscribe <port spec>" or "Unsubscribe"). */
+	void handleWebSocketMessage(struct mg_connection* nc, const std::string& message);
+
+	/** This method resolves the port spec of the client. */
+	void resolveSubscription(PushClient& client);
+
+	/** This method registers change queues with the subscribed ports and removes the queues of ports
+	* that are no longer subscribed. If portsRemoved is true, ports that are no longer in the port list
+	* have been deleted; their queues are discarded. */
+	void updatePushQueues(bool portsRemoved);
+
+	/** This method sends the state changes to the clients in push mode; at most one message per client.
+	* Clients that have not yet received the previous messages are skipped; their changes are sent
+	* later with the then current states. */
+	void pushStateChanges(void);
+
+	/** This method writes the state of the port as a JSON object for a push message. */
+	void jsonWritePushState(JSONWriter& writer, PushClient& client, opdi::Port* port);
 	
 	// JSON-RPC functions
 
-	void sendJsonRpcError(struct mg_connection* nc, Poco::Dynamic::Var id, int code, const std::string& message);
+	/** This method processes a single JSON-RPC request and writes the response object.
+	* Errors are written as error responses. Returns false if the request is a notification
+	* (a request without id); in this case nothing is written. */
+	bool handleJsonRpcRequest(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, const Poco::Dynamic::Var& request);
 
-	/** This method returns the state of the given port as a JSON object. */
-	Poco::JSON::Object jsonGetPortState(opdi::Port* port);
+	/** This method writes a JSON-RPC error response, replacing anything that has been written before.
+	* If port errors are specified they are written as the data of the error. */
+	void jsonWriteRpcError(JSONWriter& writer, Poco::Dynamic::Var id, int code, const std::string& message, const PortErrors* portErrors = nullptr);
 
-	/** This method returns information about the given port as a JSON object. */
-	Poco::JSON::Object jsonGetPortInfo(opdi::Port* port);
+	/** This method sends the JSON text as the body of an HTTP response. If the text is empty
+	* (the request consisted of notifications only) the response has no content. */
+	void sendJsonResponse(struct mg_connection* nc, const std::string& json);
 
-	/** This method returns the list of (non-hidden) ports as a JSON array. */
-	Poco::JSON::Array jsonGetPortList();
+	/** This method writes the state of the given port as a JSON object. */
+	void jsonWritePortState(JSONWriter& writer, opdi::Port* port);
 
-	/** This method returns the list of groups as a JSON array. */
-	Poco::JSON::Array jsonGetPortGroups();
+	/** This method writes the state and the extended state of the given port as members of a JSON object. */
+	void jsonWritePortStateMembers(JSONWriter& writer, opdi::Port* port);
 
-	/** This method returns information about the device (name, ports, groups, ...) as a JSON object. */
-	Poco::JSON::Object jsonRpcGetDeviceInfo(struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
+	/** This method returns the static information about the given port as JSON object members.
+	* The result is cached until the information changes. */
+	const std::string& jsonGetPortInfoFragment(opdi::Port* port);
+
+	/** This method writes information about the given port as a JSON object. */
+	void jsonWritePortInfo(JSONWriter& writer, opdi::Port* port);
+
+	/** This method writes the list of (non-hidden) ports as a JSON array. */
+	void jsonWritePortList(JSONWriter& writer);
+
+	/** This method writes the list of groups as a JSON array. */
+	void jsonWritePortGroups(JSONWriter& writer);
+
+	/** This method writes information about the device (name, ports, groups, ...) as a JSON object. */
+	void jsonRpcGetDeviceInfo(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
 
 	/** This method expects the port ID in the portID parameter of the params object. */
-	Poco::JSON::Object jsonRpcGetPortInfo(struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
+	void jsonRpcGetPortInfo(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
 
 	/** This method expects the port ID in the portID parameter and the new line state in the line parameter of the params object.
-	* It returns the port info object. */
-	Poco::JSON::Object jsonRpcSetDigitalState(struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
+	* It writes the port info object. */
+	void jsonRpcSetDigitalState(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
 
 	/** This method expects the port ID in the portID parameter and the new value in the value parameter of the params object.
-	* It returns the port info object. */
-	Poco::JSON::Object jsonRpcSetAnalogValue(struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
+	* It writes the port info object. */
+	void jsonRpcSetAnalogValue(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
 
 	/** This method expects the port ID in the portID parameter and the new position in the position parameter of the params object.
-	* It returns the port info object. */
-	Poco::JSON::Object jsonRpcSetDialPosition(struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
+	* It writes the port info object. */
+	void jsonRpcSetDialPosition(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
 
 	/** This method expects the port ID in the portID parameter and the new position in the position parameter of the params object.
-	* It returns the port info object. */
-	Poco::JSON::Object jsonRpcSetSelectPosition(struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
+	* It writes the port info object. */
+	void jsonRpcSetSelectPosition(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
+
+	/** This method expects the port ID in the portID parameter and optionally the sequence number of the last known
+	* history value in the sinceSeq parameter of the params object. It writes the history values that have been
+	* added since then as a base64 encoded sequence of zigzag varint deltas. */
+	void jsonRpcGetPortHistory(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
+
+	/** This method expects a port specification in the portSpec parameter of the params object (default: all ports).
+	* It writes an array of objects containing the ID, state and extended state of the matching (non-hidden) ports. */
+	void jsonRpcGetPortStates(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
+
+	/** This method expects an object in the ports parameter of the params object that maps port IDs to new states.
+	* A state is either an object with the parameter of the respective set method (line, value or position)
+	* or the value itself. All changes are validated first; if one of them is invalid no port is changed
+	* and the errors of all invalid ports are returned as the data of the error response.
+	* It writes an array of objects containing the ID, state and extended state of the ports.
+	* If a port fails to apply its new state the object contains an error member instead. */
+	void jsonRpcSetPortStates(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, Poco::Dynamic::Var& params);
 };
 
 }	// end anonymous namespace
@@ -127,10 +447,10 @@ static void ev_handler(struct mg_connection* nc, int ev, void* ev_data, void* fn
 	instance->handleEvent(nc, ev, ev_data, fn_data);
 }
 
-Poco::JSON::Object WebServerPlugin::jsonGetPortState(opdi::Port* port) {
-	Poco::JSON::Object result;
+void WebServerPlugin::jsonWritePortState(JSONWriter& writer, opdi::Port* port) {
+	writer.beginObject();
 	if (port->hasError())
-		result.set("error", this->to_string(port->getError()));
+		writer.key("error").value(this->to_string(port->getError()));
 	else
 		try {
 			// query port state
@@ -139,8 +459,8 @@ Poco::JSON::Object WebServerPlugin::jsonGetPortState(opdi::Port* port) {
 				uint8_t mode;
 				uint8_t line;
 				dport->getState(&mode, &line);
-				result.set("mode", mode);
-				result.set("line", line);
+				writer.key("mode").value(mode);
+				writer.key("line").value(line);
 			} else
 			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_ANALOG)) {
 				uint8_t mode;
@@ -148,60 +468,87 @@ Poco::JSON::Object WebServerPlugin::jsonGetPortState(opdi::Port* port) {
 				uint8_t reference;
 				int32_t value;
 				((opdi::AnalogPort*)port)->getState(&mode, &resolution, &reference, &value);
-				result.set("mode", mode);
-				result.set("resolution", resolution);
-				result.set("reference", reference);
-				result.set("value", value);
+				writer.key("mode").value(mode);
+				writer.key("resolution").value(resolution);
+				writer.key("reference").value(reference);
+				writer.key("value").value(value);
 			} else
 			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL)) {
 				opdi::DialPort* dport = (opdi::DialPort*)port;
 				int64_t position;
 				dport->getState(&position);
-				result.set("position", position);
+				writer.key("position").value(position);
 			} else
 			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_SELECT)) {
 				opdi::SelectPort* sport = (opdi::SelectPort*)port;
 				uint16_t position;
 				sport->getState(&position);
-				result.set("position", position);
+				writer.key("position").value(position);
 			} else
 				throw Poco::Exception("Port " + port->ID() + ": The port type is unknown");
 		} catch (Poco::Exception&) {
-			result.set("error", this->to_string(port->getError()));
+			writer.key("error").value(this->to_string(port->getError()));
 		}
+	writer.endObject();
+}
 
-	return result;
+void WebServerPlugin::jsonWritePortStateMembers(JSONWriter& writer, opdi::Port* port) {
+	writer.key("state");
+	this->jsonWritePortState(writer, port);
+	writer.key("extendedState").value(port->getExtendedState(true));
 }
 
-Poco::JSON::Object WebServerPlugin::jsonGetPortInfo(opdi::Port* port) {
-	Poco::JSON::Object result;
-	result.set("id", port->ID());
-	result.set("type", port->getType());
-	result.set("label", port->getLabel());
-	result.set("dirCaps", port->getDirCaps());
-	result.set("flags", port->getFlags());
-	result.set("readonly", port->isReadonly());
+const std::string& WebServerPlugin::jsonGetPortInfoFragment(opdi::Port* port) {
+	// ports have been added or removed? cached pointers may be invalid
+	if (this->portListVersion != this->opdi->getPortListVersion()) {
+		this->portInfoCache.clear();
+		this->portListVersion = this->opdi->getPortListVersion();
+	}
+	auto it = this->portInfoCache.find(port);
+	if ((it != this->portInfoCache.end()) && (it->second.infoRevision == port->getInfoRevision()))
+		return it->second.json;
+
+	JSONWriter& writer = this->fragmentWriter;
+	writer.clear();
+	writer.beginObject();
+	writer.key("id").value(port->ID());
+	writer.key("type").value(port->getType());
+	writer.key("label").value(port->getLabel());
+	writer.key("dirCaps").value(port->getDirCaps());
+	writer.key("flags").value(port->getFlags());
+	writer.key("readonly").value(port->isReadonly());
 	if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL)) {
 		opdi::DialPort* dport = (opdi::DialPort*)port;
-		result.set("min", dport->getMin());
-		result.set("max", dport->getMax());
-		result.set("step", dport->getStep());
+		writer.key("min").value(dport->getMin());
+		writer.key("max").value(dport->getMax());
+		writer.key("step").value(dport->getStep());
 	} else
 		if (0 == strcmp(port->getType(), OPDI_PORTTYPE_SELECT)) {
 		opdi::SelectPort* sport = (opdi::SelectPort*)port;
-		Poco::JSON::Array positions;
+		writer.key("positions").beginArray();
 		for (uint16_t i = 0; i <= sport->getMaxPosition(); i++) {
-			positions.add(sport->getPositionLabel(i));
+			writer.value(sport->getPositionLabel(i));
 		}
-		result.set("positions", positions);
+		writer.endArray();
 	}
-	result.set("state", this->jsonGetPortState(port));
-	result.set("extendedInfo", port->getExtendedInfo());
-	result.set("extendedState", port->getExtendedState(true));
-	return result;
+	writer.key("extendedInfo").value(port->getExtendedInfo());
+	writer.endObject();
+
+	// store the members without the braces
+	PortInfoFragment& fragment = this->portInfoCache[port];
+	fragment.infoRevision = port->getInfoRevision();
+	fragment.json.assign(writer.str(), 1, writer.str().size() - 2);
+	return fragment.json;
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcGetPortInfo(struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
+void WebServerPlugin::jsonWritePortInfo(JSONWriter& writer, opdi::Port* port) {
+	writer.beginObject();
+	writer.members(this->jsonGetPortInfoFragment(port));
+	this->jsonWritePortStateMembers(writer, port);
+	writer.endObject();
+}
+
+void WebServerPlugin::jsonRpcGetPortInfo(JSONWriter& writer, struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
 	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
 	Poco::Dynamic::Var portID = object->get("portID");
 	std::string portIDStr = portID.convert<std::string>();
@@ -213,56 +560,54 @@ Poco::JSON::Object WebServerPlugin::jsonRpcGetPortInfo(struct mg_connection* /*n
 	if (port == NULL)
 		throw Poco::InvalidArgumentException(std::string("Method getPortData: port not found: ") + portIDStr);
 
-	return this->jsonGetPortInfo(port);
+	this->jsonWritePortInfo(writer, port);
 }
 
-Poco::JSON::Array WebServerPlugin::jsonGetPortList() {
-	// return an array of port objects
-	Poco::JSON::Array result;
-	opdi::PortList pl = this->opdi->getPorts();
+void WebServerPlugin::jsonWritePortList(JSONWriter& writer) {
+	// write an array of port objects
+	writer.beginArray();
+	const opdi::PortList& pl = this->opdi->getPorts();
 	auto it = pl.begin();
 	auto ite = pl.end();
 	while (it != ite) {
 		if (!(*it)->isHidden())
-			result.add(this->jsonGetPortInfo(*it));
+			this->jsonWritePortInfo(writer, *it);
 		++it;
 	}
-
-	return result;
+	writer.endArray();
 }
 
-Poco::JSON::Array WebServerPlugin::jsonGetPortGroups() {
-	// return an array of group objects
-	Poco::JSON::Array result;
-	opdi::PortGroupList gl = this->opdi->getPortGroups();
+void WebServerPlugin::jsonWritePortGroups(JSONWriter& writer) {
+	// write an array of group objects
+	writer.beginArray();
+	const opdi::PortGroupList& gl = this->opdi->getPortGroups();
 	auto it = gl.begin();
 	auto ite = gl.end();
 	while (it != ite) {
-		Poco::JSON::Object group;
-		group.set("id", std::string((*it)->getID()));
-		group.set("label", std::string((*it)->getLabel()));
-		group.set("parent", std::string((*it)->getParent()));
-		result.add(group);
+		writer.beginObject();
+		writer.key("id").value((*it)->getID());
+		writer.key("label").value((*it)->getLabel());
+		writer.key("parent").value((*it)->getParent());
+		writer.endObject();
 		++it;
 	}
-
-	return result;
+	writer.endArray();
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcGetDeviceInfo(struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& /*params*/) {
-	// return an object that represents the top group
+void WebServerPlugin::jsonRpcGetDeviceInfo(JSONWriter& writer, struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& /*params*/) {
+	// write an object that represents the top group
 	// sub-groups will be contained in its subgroups member
-	Poco::JSON::Object result;
-
-	result.set("name", this->opdi->getSlaveName());
-	result.set("ports", this->jsonGetPortList());
-	result.set("groups", this->jsonGetPortGroups());
-	result.set("info", this->openhat->getDeviceInfo());
-
-	return result;
+	writer.beginObject();
+	writer.key("name").value(this->opdi->getSlaveName());
+	writer.key("ports");
+	this->jsonWritePortList(writer);
+	writer.key("groups");
+	this->jsonWritePortGroups(writer);
+	writer.key("info").value(this->openhat->getDeviceInfo());
+	writer.endObject();
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcSetDigitalState(struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
+void WebServerPlugin::jsonRpcSetDigitalState(JSONWriter& writer, struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
 	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
 	Poco::Dynamic::Var portID = object->get("portID");
 	if (portID.isEmpty())
@@ -289,10 +634,10 @@ Poco::JSON::Object WebServerPlugin::jsonRpcSetDigitalState(struct mg_connection*
 	if (!port->isReadonly())
 		((opdi::DigitalPort*)port)->setLine(newLine, opdi::Port::ChangeSource::CHANGESOURCE_USER);
 
-	return this->jsonGetPortInfo(port);
+	this->jsonWritePortInfo(writer, port);
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcSetAnalogValue(struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
+void WebServerPlugin::jsonRpcSetAnalogValue(JSONWriter& writer, struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
 	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
 	Poco::Dynamic::Var portID = object->get("portID");
 	if (portID.isEmpty())
@@ -317,10 +662,10 @@ Poco::JSON::Object WebServerPlugin::jsonRpcSetAnalogValue(struct mg_connection*
 	if (!port->isReadonly())
 		((opdi::AnalogPort*)port)->setAbsoluteValue(newValue, opdi::Port::ChangeSource::CHANGESOURCE_USER);
 
-	return this->jsonGetPortInfo(port);
+	this->jsonWritePortInfo(writer, port);
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcSetDialPosition(struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
+void WebServerPlugin::jsonRpcSetDialPosition(JSONWriter& writer, struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
 	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
 	Poco::Dynamic::Var portID = object->get("portID");
 	if (portID.isEmpty())
@@ -345,10 +690,10 @@ Poco::JSON::Object WebServerPlugin::jsonRpcSetDialPosition(struct mg_connection*
 	if (!port->isReadonly())
 		((opdi::DialPort*)port)->setPosition(newPosition, opdi::Port::ChangeSource::CHANGESOURCE_USER);
 
-	return this->jsonGetPortInfo(port);
+	this->jsonWritePortInfo(writer, port);
 }
 
-Poco::JSON::Object WebServerPlugin::jsonRpcSetSelectPosition(struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
+void WebServerPlugin::jsonRpcSetSelectPosition(JSONWriter& writer, struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
 	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
 	Poco::Dynamic::Var portID = object->get("portID");
 	if (portID.isEmpty())
@@ -373,7 +718,199 @@ Poco::JSON::Object WebServerPlugin::jsonRpcSetSelectPosition(struct mg_connectio
 	if (!port->isReadonly())
 		((opdi::SelectPort*)port)->setPosition(newPosition, opdi::Port::ChangeSource::CHANGESOURCE_USER);
 
-	return this->jsonGetPortInfo(port);
+	this->jsonWritePortInfo(writer, port);
+}
+
+void WebServerPlugin::jsonRpcGetPortHistory(JSONWriter& writer, struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
+	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
+	Poco::Dynamic::Var portID = object->get("portID");
+	if (portID.isEmpty())
+		throw Poco::InvalidArgumentException("Method getPortHistory: parameter portID is missing");
+
+	std::string portIDStr = portID.convert<std::string>();
+	if (portIDStr == "")
+		throw Poco::InvalidArgumentException("Method getPortHistory: parameter portID is missing");
+
+	opdi::Port* port = this->opdi->findPortByID(portIDStr.c_str());
+	if (port == NULL)
+		throw Poco::InvalidArgumentException(std::string("Method getPortHistory: port not found: ") + portIDStr);
+
+	// sinceSeq is optional; if it is missing all values are returned
+	uint64_t sinceSeq = 0;
+	Poco::Dynamic::Var since = object->get("sinceSeq");
+	if (!since.isEmpty())
+		sinceSeq = since.convert<uint64_t>();
+
+	uint64_t firstSeq;
+	size_t count;
+	bool reset;
+	std::string delta = port->getHistoryDelta(sinceSeq, &firstSeq, &count, &reset);
+
+	std::stringstream sData;
+	Poco::Base64Encoder encoder(sData);
+	encoder.rdbuf()->setLineLength(0);
+	encoder << delta;
+	encoder.close();
+
+	writer.beginObject();
+	writer.key("id").value(port->ID());
+	writer.key("seq").value(port->getHistorySeq());
+	writer.key("interval").value(port->getHistoryInterval());
+	writer.key("maxCount").value(port->getHistoryMaxCount());
+	writer.key("firstSeq").value(firstSeq);
+	writer.key("count").value(count);
+	writer.key("reset").value(reset);
+	writer.key("encoding").value("zigzag-varint-delta");
+	writer.key("data").value(sData.str());
+	writer.endObject();
+}
+
+void WebServerPlugin::jsonRpcGetPortStates(JSONWriter& writer, struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
+	// portSpec is optional; if it is missing all ports are returned
+	std::string portSpec = "*";
+	if (!params.isEmpty()) {
+		Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
+		Poco::Dynamic::Var spec = object->get("portSpec");
+		if (!spec.isEmpty())
+			portSpec = spec.convert<std::string>();
+	}
+
+	std::vector<std::string> portIDs;
+	try {
+		this->opdi->findPortIDs(portSpec, portIDs);
+	} catch (Poco::Exception& e) {
+		throw Poco::InvalidArgumentException("Method getPortStates: " + e.message());
+	}
+
+	writer.beginArray();
+	for (auto it = portIDs.cbegin(); it != portIDs.cend(); ++it) {
+		opdi::Port* port = this->opdi->findPortByID((*it).c_str());
+		if ((port == NULL) || port->isHidden())
+			continue;
+		writer.beginObject();
+		writer.key("id").value(port->ID());
+		this->jsonWritePortStateMembers(writer, port);
+		writer.endObject();
+	}
+	writer.endArray();
+}
+
+void WebServerPlugin::jsonRpcSetPortStates(JSONWriter& writer, struct mg_connection* /*nc*/, struct mg_http_message* /*hm*/, Poco::Dynamic::Var& params) {
+	if (params.type() != typeid(Poco::JSON::Object::Ptr))
+		throw Poco::InvalidArgumentException("Method setPortStates: parameter ports is missing or not an object");
+	Poco::JSON::Object::Ptr object = params.extract<Poco::JSON::Object::Ptr>();
+	Poco::JSON::Object::Ptr states = object->getObject("ports");
+	if (states.isNull())
+		throw Poco::InvalidArgumentException("Method setPortStates: parameter ports is missing or not an object");
+
+	struct PortChange {
+		opdi::Port* port;
+		int64_t value;
+		std::string error;
+	};
+
+	// validate all changes before a port is changed
+	std::vector<PortChange> changes;
+	PortErrors errors;
+	for (auto it = states->begin(); it != states->end(); ++it) {
+		const std::string& portID = it->first;
+		try {
+			opdi::Port* port = this->opdi->findPortByID(portID.c_str());
+			if (port == NULL)
+				throw Poco::InvalidArgumentException("Port not found");
+			if (port->isReadonly())
+				throw Poco::InvalidArgumentException("The port is readonly");
+
+			const char* parameter;
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIGITAL))
+				parameter = "line";
+			else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_ANALOG))
+				parameter = "value";
+			else
+			if ((0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL)) || (0 == strcmp(port->getType(), OPDI_PORTTYPE_SELECT)))
+				parameter = "position";
+			else
+				throw Poco::InvalidArgumentException("The port type is not supported");
+
+			Poco::Dynamic::Var value = it->second;
+			if (value.type() == typeid(Poco::JSON::Object::Ptr))
+				value = value.extract<Poco::JSON::Object::Ptr>()->get(parameter);
+			if (value.isEmpty())
+				throw Poco::InvalidArgumentException(std::string("Parameter ") + parameter + " is missing");
+
+			PortChange change;
+			change.port = port;
+			try {
+				change.value = value.convert<int64_t>();
+			} catch (Poco::Exception& e) {
+				throw Poco::InvalidArgumentException("Illegal value: " + e.message());
+			}
+
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIGITAL)) {
+				if ((change.value != OPDI_DIGITAL_LINE_LOW) && (change.value != OPDI_DIGITAL_LINE_HIGH))
+					throw Poco::InvalidArgumentException("Illegal value for line: " + this->to_string(change.value));
+			} else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_ANALOG)) {
+				int64_t maxValue = (1 << ((opdi::AnalogPort*)port)->getResolution()) - 1;
+				if ((change.value < 0) || (change.value > maxValue))
+					throw Poco::InvalidArgumentException("Value must be in the range of 0.." + this->to_string(maxValue) + ": " + this->to_string(change.value));
+			} else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL)) {
+				opdi::DialPort* dialPort = (opdi::DialPort*)port;
+				if (change.value < dialPort->getMin())
+					throw Poco::InvalidArgumentException("Position must not be less than the minimum: " + this->to_string(dialPort->getMin()));
+				if (change.value > dialPort->getMax())
+					throw Poco::InvalidArgumentException("Position must not be greater than the maximum: " + this->to_string(dialPort->getMax()));
+				if ((dialPort->getStep() > 1) && ((change.value - dialPort->getMin()) % dialPort->getStep() != 0))
+					throw Poco::InvalidArgumentException("Position must be a multiple of the step " + this->to_string(dialPort->getStep())
+						+ " from the minimum: " + this->to_string(dialPort->getMin()));
+			} else {
+				if ((change.value < 0) || (change.value > ((opdi::SelectPort*)port)->getMaxPosition()))
+					throw Poco::InvalidArgumentException("Illegal position: " + this->to_string(change.value));
+			}
+
+			changes.push_back(change);
+		} catch (Poco::InvalidArgumentException& e) {
+			errors.push_back(std::make_pair(portID, e.message()));
+		}
+	}
+	if (!errors.empty())
+		throw PortStatesException("Method setPortStates: " + this->to_string((int)errors.size()) + " port(s) have invalid states; no port has been changed", errors);
+
+	// apply the changes; they take effect in the same frame, so the resulting refreshes
+	// are sent to WebSocket clients in push mode as one message
+	for (auto it = changes.begin(); it != changes.end(); ++it) {
+		opdi::Port* port = it->port;
+		try {
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIGITAL))
+				((opdi::DigitalPort*)port)->setLine((uint8_t)it->value, opdi::Port::ChangeSource::CHANGESOURCE_USER);
+			else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_ANALOG))
+				((opdi::AnalogPort*)port)->setAbsoluteValue((int32_t)it->value, opdi::Port::ChangeSource::CHANGESOURCE_USER);
+			else
+			if (0 == strcmp(port->getType(), OPDI_PORTTYPE_DIAL))
+				((opdi::DialPort*)port)->setPosition(it->value, opdi::Port::ChangeSource::CHANGESOURCE_USER);
+			else
+				((opdi::SelectPort*)port)->setPosition((uint16_t)it->value, opdi::Port::ChangeSource::CHANGESOURCE_USER);
+		} catch (Poco::Exception& e) {
+			// the port has rejected the state; the other changes remain in effect
+			it->error = e.message();
+			this->logVerbose("Method setPortStates: Unable to set the state of port " + port->ID() + ": " + e.message());
+		}
+	}
+
+	writer.beginArray();
+	for (auto it = changes.begin(); it != changes.end(); ++it) {
+		writer.beginObject();
+		writer.key("id").value(it->port->ID());
+		if (it->error.empty())
+			this->jsonWritePortStateMembers(writer, it->port);
+		else
+			writer.key("error").value(it->error);
+		writer.endObject();
+	}
+	writer.endArray();
 }
 
 // get sockaddr, IPv4 or IPv6:
@@ -384,27 +921,153 @@ static void* get_in_addr(struct sockaddr* sa)
     return &(((struct sockaddr_in6*)sa)->sin6_addr);
 }
 
-void WebServerPlugin::sendJsonRpcError(struct mg_connection* nc, Poco::Dynamic::Var id, int code, const std::string& message) {
-	Poco::JSON::Object error;
-	error.set("code", code);
-	error.set("message", message);
-
-	// send error response
-	Poco::JSON::Object response;
-	response.set("jsonrpc", "2.0");
-	response.set("id", id);
-	response.set("error", error);
-	response.set("result", Poco::Dynamic::Var());	// will resolve to null on the client
-					
-	std::stringstream sOut;
-	response.stringify(sOut);
-	std::string strOut = sOut.str();
+void WebServerPlugin::jsonWriteRpcError(JSONWriter& writer, Poco::Dynamic::Var id, int code, const std::string& message, const PortErrors* portErrors) {
+	// replace a partially written response
+	writer.clear();
+	writer.beginObject();
+	writer.key("jsonrpc").value("2.0");
+	writer.key("id").value(id);
+	writer.key("error").beginObject();
+	writer.key("code").value(code);
+	writer.key("message").value(message);
+	if (portErrors != nullptr) {
+		writer.key("data").beginArray();
+		for (auto it = portErrors->cbegin(); it != portErrors->cend(); ++it) {
+			writer.beginObject();
+			writer.key("id").value(it->first);
+			writer.key("message").value(it->second);
+			writer.endObject();
+		}
+		writer.endArray();
+	}
+	writer.endObject();
+	writer.key("result").null();	// will resolve to null on the client
+	writer.endObject();
+}
 
-	this->logDebug("Sending JSON-RPC error: " + strOut);
+bool WebServerPlugin::handleJsonRpcRequest(JSONWriter& writer, struct mg_connection* nc, struct mg_http_message* hm, const Poco::Dynamic::Var& request) {
+	Poco::Dynamic::Var id;
+	// a request without id is a notification; the client does not expect a response
+	bool notification = false;
+	try {
+		if (request.type() != typeid(Poco::JSON::Object::Ptr))
+			throw InvalidRequestException("Request must be an object");
+		Poco::JSON::Object::Ptr object = request.extract<Poco::JSON::Object::Ptr>();
+		notification = !object->has("id");
+		Poco::Dynamic::Var method = object->get("method");
+		std::string methodStr = method.convert<std::string>();
+		Poco::Dynamic::Var params = object->get("params");
+		id = object->get("id");
+		Poco::Dynamic::Var jsonrpc = object->get("jsonrpc");
+		std::string jsonrpcStr = jsonrpc.convert<std::string>();
+
+		// validate request
+		if (jsonrpcStr != "2.0")
+			throw InvalidRequestException("Invalid version number, expected 2.0");
+		if (methodStr == "")
+			throw InvalidRequestException("Method name missing");
+		
+		// create JSON-RPC response object; the result is written directly into the response
+		writer.clear();
+		writer.beginObject();
+		writer.key("jsonrpc").value("2.0");
+		writer.key("id").value(id);
+		writer.key("error").null();	// will resolve to null on the client
+		writer.key("result").beginObject();
+		if (methodStr == "getDeviceInfo") {
+			this->jsonRpcGetDeviceInfo(writer.key("deviceInfo"), nc, hm, params);
+		} else
+		if (methodStr == "getPortInfo") {
+			this->jsonRpcGetPortInfo(writer.key("port"), nc, hm, params);
+		} else
+		if (methodStr == "setDigitalState") {
+			this->jsonRpcSetDigitalState(writer.key("port"), nc, hm, params);
+		} else
+		if (methodStr == "setAnalogValue") {
+			this->jsonRpcSetAnalogValue(writer.key("port"), nc, hm, params);
+		} else
+		if (methodStr == "setDialPosition") {
+			this->jsonRpcSetDialPosition(writer.key("port"), nc, hm, params);
+		} else
+		if (methodStr == "setSelectPosition") {
+			this->jsonRpcSetSelectPosition(writer.key("port"), nc, hm, params);
+		} else
+		if (methodStr == "getPortHistory") {
+			this->jsonRpcGetPortHistory(writer.key("history"), nc, hm, params);
+		} else
+		if (methodStr == "getPortStates") {
+			this->jsonRpcGetPortStates(writer.key("ports"), nc, hm, params);
+		} else
+		if (methodStr == "setPortStates") {
+			this->jsonRpcSetPortStates(writer.key("ports"), nc, hm, params);
+		} else
+			throw MethodNotFoundException(std::string("Unknown JSON-RPC method: ") + methodStr);
+		writer.endObject();
+		writer.endObject();
+	// Error handling:
+	// http://www.jsonrpc.org/specification, section 5.1
+	} catch (InvalidRequestException& e) {
+		// Invalid Request
+		std::string err("Invalid JSON request: ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		this->jsonWriteRpcError(writer, id, -32600, err);	// Invalid Request
+	} catch (MethodNotFoundException& e) {
+		// Method not found
+		std::string err("Method not found: ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		this->jsonWriteRpcError(writer, id, -32601, err);	// Method not found
+	} catch (PortStatesException& e) {
+		// Invalid params of several ports
+		std::string err("Invalid parameters: ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		for (auto it = e.portErrors.cbegin(); it != e.portErrors.cend(); ++it)
+			this->logVerbose("Port " + it->first + ": " + it->second);
+		this->jsonWriteRpcError(writer, id, -32602, err, &e.portErrors);	// Invalid params
+	} catch (Poco::InvalidArgumentException& e) {
+		// Invalid params
+		std::string err("Invalid parameters: ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		this->jsonWriteRpcError(writer, id, -32602, err);	// Invalid params
+	} catch (Poco::Exception& e) {
+		// Internal error
+		std::string err("Error processing request: ");
+		err.append(e.what());
+		err.append(": ");
+		err.append(e.message());
+		this->logVerbose("" + err);
+		this->jsonWriteRpcError(writer, id, -32603, err);	// Internal error
+	} catch (std::exception& e) {
+		// Internal error
+		std::string err("Error processing request: ");
+		err.append(e.what());
+		this->logVerbose("" + err);
+		this->jsonWriteRpcError(writer, id, -32603, err);	// Internal error
+	} catch (...) {
+		// Internal error
+		std::string err("Error processing request (unknown error)");
+		this->logVerbose("" + err);
+		this->jsonWriteRpcError(writer, id, -32603, err);	// Internal error
+	}
+	if (notification) {
+		writer.clear();
+		return false;
+	}
+	return true;
+}
 
-	mg_printf(nc, "HTTP/1.0 200 OK\r\nContent-Length: %zu\r\n"
-		"Content-Type: application/json\r\n\r\n%s",
-		strOut.size(), strOut.c_str());
+void WebServerPlugin::sendJsonResponse(struct mg_connection* nc, const std::string& json) {
+	// notifications have no response
+	if (json.empty()) {
+		mg_printf(nc, "HTTP/1.0 204 No Content\r\nContent-Length: 0\r\n\r\n");
+		return;
+	}
+	mg_printf(nc, "HTTP/1.0 200 OK\r\nContent-Length: %lu\r\n"
+		"Content-Type: application/json\r\n\r\n", (unsigned long)json.size());
+	mg_send(nc, json.data(), json.size());
 }
 
 void WebServerPlugin::handleEvent(struct mg_connection* nc, int ev, void* ev_data, void* fn_data) {
@@ -433,119 +1096,54 @@ void WebServerPlugin::handleEvent(struct mg_connection* nc, int ev, void* ev_dat
 			if (mg_vcmp(&hm->uri, jsonRpcUrl.c_str()) == 0) {
 				std::string json(hm->body.ptr, hm->body.len);
 				this->logDebug("Received JSON-RPC request: " + json);
+				JSONWriter& writer = this->responseWriter;
 				// parse JSON
-				Poco::Dynamic::Var id;
 				try {
 					Poco::JSON::Parser parser;
 					Poco::Dynamic::Var request = parser.parse(json);
-					Poco::JSON::Object::Ptr object = request.extract<Poco::JSON::Object::Ptr>();
-					Poco::Dynamic::Var method = object->get("method");
-					std::string methodStr = method.convert<std::string>();
-					Poco::Dynamic::Var params = object->get("params");
-					id = object->get("id");
-					Poco::Dynamic::Var jsonrpc = object->get("jsonrpc");
-					std::string jsonrpcStr = jsonrpc.convert<std::string>();
-
-					// validate request
-					if (jsonrpcStr != "2.0")
-						throw InvalidRequestException("Invalid version number, expected 2.0");
-					if (methodStr == "")
-						throw InvalidRequestException("Method name missing");
-					
-					Poco::JSON::Object result;
-					if (methodStr == "getDeviceInfo") {
-						result.set("deviceInfo", this->jsonRpcGetDeviceInfo(nc, hm, params));
-					} else
-					if (methodStr == "getPortInfo") {
-						result.set("port", this->jsonRpcGetPortInfo(nc, hm, params));
-					} else
-					if (methodStr == "setDigitalState") {
-						result.set("port", this->jsonRpcSetDigitalState(nc, hm, params));
-					} else
-					if (methodStr == "setAnalogValue") {
-						result.set("port", this->jsonRpcSetAnalogValue(nc, hm, params));
-					} else
-					if (methodStr == "setDialPosition") {
-						result.set("port", this->jsonRpcSetDialPosition(nc, hm, params));
-					} else
-					if (methodStr == "setSelectPosition") {
-						result.set("port", this->jsonRpcSetSelectPosition(nc, hm, params));
+
+					if (request.type() == typeid(Poco::JSON::Array::Ptr)) {
+						// batch request; all requests are processed in the same frame
+						Poco::JSON::Array::Ptr batch = request.extract<Poco::JSON::Array::Ptr>();
+						if (batch->size() == 0)
+							throw InvalidRequestException("Empty batch");
+						writer.clear();
+						writer.beginArray();
+						size_t responses = 0;
+						for (size_t i = 0; i < batch->size(); i++) {
+							if (this->handleJsonRpcRequest(this->batchWriter, nc, hm, batch->get(i))) {
+								writer.raw(this->batchWriter.str());
+								responses++;
+							}
+						}
+						writer.endArray();
+						// a batch of notifications has no response
+						if (responses == 0)
+							writer.clear();
 					} else
-						throw MethodNotFoundException(std::string("Unknown JSON-RPC method: ") + methodStr);
-
-					// create JSON-RPC response object
-					
-					Poco::JSON::Object response;
-					response.set("jsonrpc", "2.0");
-					response.set("id", id);
-					response.set("error", Poco::Dynamic::Var());	// will resolve to null on the client
-					response.set("result", result);
-					
-					std::stringstream sOut;
-					response.stringify(sOut);
-					std::string strOut = sOut.str();
-
-					this->logDebug("Sending JSON-RPC response: " + strOut);
-
-					// send result
-                    mg_printf(nc, "%s", "HTTP/1.0 200 OK\r\n");                  // Response line
-                    mg_printf(nc, "%s", "Content-Type: application/json\r\n");   // One header
-                    mg_printf(nc, "Content-Length: %d\r\n", strOut.size());      // important: content length first
-                    mg_printf(nc, "%s", "\r\n");                                 // End of headers
-                    mg_printf(nc, "%s", strOut.c_str());                         // Body
-/*
-					mg_printf(nc, "HTTP/1.0 200 OK\r\nContent-Length: %zu\r\n"
-						"Content-Type: application/json\r\n\r\n%s",
-						strOut.size(), strOut.c_str());
-*/
+						this->handleJsonRpcRequest(writer, nc, hm, request);
 				// Error handling:
 				// http://www.jsonrpc.org/specification, section 5.1
-				} catch (Poco::JSON::JSONException& e) {
-					// Parse error
-					std::string err("Error processing JSON: ");
-					err.append(e.what());
-					err.append(": ");
-					err.append(e.message());
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32700, err);	// Parse error
 				} catch (InvalidRequestException& e) {
 					// Invalid Request
 					std::string err("Invalid JSON request: ");
 					err.append(e.message());
 					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32600, err);	// Invalid Request
-				} catch (MethodNotFoundException& e) {
-					// Method not found
-					std::string err("Method not found: ");
-					err.append(e.message());
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32601, err);	// Method not found
-				} catch (Poco::InvalidArgumentException& e) {
-					// Invalid params
-					std::string err("Invalid parameters: ");
-					err.append(e.message());
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32602, err);	// Invalid params
+					this->jsonWriteRpcError(writer, Poco::Dynamic::Var(), -32600, err);	// Invalid Request
 				} catch (Poco::Exception& e) {
-					// Internal error
-					std::string err("Error processing request: ");
+					// Parse error
+					std::string err("Error processing JSON: ");
 					err.append(e.what());
 					err.append(": ");
 					err.append(e.message());
 					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32603, err);	// Internal error
-				} catch (std::exception& e) {
-					// Internal error
-					std::string err("Error processing request: ");
-					err.append(e.what());
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32603, err);	// Internal error
-				} catch (...) {
-					// Internal error
-					std::string err("Error processing request (unknown error)");
-					this->logVerbose("" + err);
-					this->sendJsonRpcError(nc, id, -32603, err);	// Internal error
+					this->jsonWriteRpcError(writer, Poco::Dynamic::Var(), -32700, err);	// Parse error
 				}
+
+				this->logDebug("Sending JSON-RPC response: " + writer.str());
+
+				// send result
+				this->sendJsonResponse(nc, writer.str());
 				// send data
 				nc->is_draining = 1;
 				break;
@@ -553,19 +1151,202 @@ void WebServerPlugin::handleEvent(struct mg_connection* nc, int ev, void* ev_dat
 				// serve static content
 				mg_http_serve_dir(nc, hm, &this->s_http_server_opts);
 			break;
+		case MG_EV_WS_MSG: {
+			struct mg_ws_message* wm = (struct mg_ws_message*)ev_data;
+			this->handleWebSocketMessage(nc, std::string(wm->data.ptr, wm->data.len));
+			break;
+		}
+		case MG_EV_CLOSE:
+			if (this->pushClients.erase(nc) > 0)
+				this->pushQueuesChanged = true;
+			break;
 		default:
 			break;
 	  }
 }
 
+void WebServerPlugin::handleWebSocketMessage(struct mg_connection* nc, const std::string& message) {
+	if ((message == "Subscribe") || (message.find("Subscribe ") == 0)) {
+		// an empty port spec subscribes to all ports
+		std::string portSpec = (message.size() > 10 ? message.substr(10) : "");
+		if (portSpec.find_first_not_of(' ') == std::string::npos)
+			portSpec = "*";
+		PushClient client;
+		client.portSpec = portSpec;
+		try {
+			this->resolveSubscription(client);
+		} catch (Poco::Exception& e) {
+			this->logVerbose("Invalid WebSocket subscription: " + e.message());
+			JSONWriter& writer = this->pushWriter;
+			writer.clear();
+			writer.beginObject();
+			writer.key("type").value("error");
+			writer.key("message").value(e.message());
+			writer.endObject();
+			mg_ws_send(nc, writer.str().data(), writer.str().size(), WEBSOCKET_OP_TEXT);
+			return;
+		}
+		this->logDebug("WebSocket client subscribed to " + this->to_string(client.ports.size()) + " ports: " + portSpec);
+		// the first message contains the complete information of all subscribed ports
+		client.pendingAll = true;
+		this->pushClients[nc] = client;
+		this->pushQueuesChanged = true;
+	} else
+	if (message == "Unsubscribe") {
+		// back to "Refresh" messages
+		if (this->pushClients.erase(nc) > 0)
+			this->pushQueuesChanged = true;
+	} else
+		this->logDebug("Ignoring unknown WebSocket message: " + message);
+}
+
+void WebServerPlugin::resolveSubscription(PushClient& client) {
+	std::vector<std::string> portIDs;
+	this->opdi->findPortIDs(client.portSpec, portIDs);
+	client.ports.clear();
+	for (auto it = portIDs.cbegin(); it != portIDs.cend(); ++it) {
+		opdi::Port* port = this->opdi->findPortByID((*it).c_str());
+		if (port != nullptr)
+			client.ports.insert(port);
+	}
+	// port pointers may have become invalid
+	client.pending.clear();
+	client.infoRevisions.clear();
+}
+
+void WebServerPlugin::updatePushQueues(bool portsRemoved) {
+	std::unordered_set<opdi::Port*> subscribed;
+	for (auto it = this->pushClients.cbegin(); it != this->pushClients.cend(); ++it)
+		subscribed.insert(it->second.ports.cbegin(), it->second.ports.cend());
+	std::unordered_set<opdi::Port*> existing;
+	if (portsRemoved) {
+		opdi::PortList ports = this->opdi->getPorts();
+		existing.insert(ports.cbegin(), ports.cend());
+	}
+
+	// after ports have been removed all queues are registered again because a new port
+	// may have the address of a deleted one
+	for (auto it = this->pushQueues.begin(); it != this->pushQueues.end(); ) {
+		if (!portsRemoved && (subscribed.count(it->first) > 0)) {
+			++it;
+			continue;
+		}
+		if (!portsRemoved || (existing.count(it->first) > 0))
+			it->first->removeChangeQueue(it->second.get());
+		it = this->pushQueues.erase(it);
+	}
+	for (auto it = subscribed.cbegin(); it != subscribed.cend(); ++it) {
+		if (this->pushQueues.count(*it) > 0)
+			continue;
+		// the queue only signals that the port has changed; its current state is sent
+		opdi::PortChangeQueue* queue = new opdi::PortChangeQueue(16);
+		this->pushQueues[*it].reset(queue);
+		(*it)->addChangeQueue(queue);
+	}
+	this->pushQueuesChanged = false;
+}
+
+void WebServerPlugin::jsonWritePushState(JSONWriter& writer, PushClient& client, opdi::Port* port) {
+	// render the state once per frame for all clients
+	auto it = this->pushStates.find(port);
+	if (it == this->pushStates.end()) {
+		JSONWriter& stateWriter = this->fragmentWriter;
+		stateWriter.clear();
+		stateWriter.beginObject();
+		this->jsonWritePortStateMembers(stateWriter, port);
+		stateWriter.endObject();
+		it = this->pushStates.emplace(port, stateWriter.str().substr(1, stateWriter.str().size() - 2)).first;
+	}
+
+	writer.beginObject();
+	// send the port information only if the client does not know it yet
+	auto rev = client.infoRevisions.find(port);
+	if ((rev == client.infoRevisions.end()) || (rev->second != port->getInfoRevision())) {
+		writer.members(this->jsonGetPortInfoFragment(port));
+		client.infoRevisions[port] = port->getInfoRevision();
+	} else
+		writer.key("id").value(port->ID());
+	writer.members(it->second);
+	writer.endObject();
+}
+
+void WebServerPlugin::pushStateChanges(void) {
+	if (this->pushClients.empty() && this->pushQueues.empty())
+		return;
+
+	// ports have been added or removed? resolve the subscriptions again
+	bool portsChanged = (this->pushPortListVersion != this->opdi->getPortListVersion());
+	if (portsChanged) {
+		for (auto it = this->pushClients.begin(); it != this->pushClients.end(); ++it) {
+			try {
+				this->resolveSubscription(it->second);
+			} catch (Poco::Exception& e) {
+				this->logWarning("Unable to resolve WebSocket subscription: " + e.message());
+			}
+			it->second.pendingAll = true;
+		}
+		this->pushPortListVersion = this->opdi->getPortListVersion();
+	}
+	if (portsChanged || this->pushQueuesChanged)
+		this->updatePushQueues(portsChanged);
+
+	// mark the ports that have recorded state changes since the last frame; several changes
+	// of a port are coalesced
+	opdi::PortChangeQueue::Change change;
+	for (auto it = this->pushQueues.begin(); it != this->pushQueues.end(); ++it) {
+		bool changed = false;
+		while (it->second->pop(change))
+			changed = true;
+		if (!changed)
+			continue;
+		for (auto cit = this->pushClients.begin(); cit != this->pushClients.end(); ++cit)
+			if (cit->second.ports.count(it->first) > 0)
+				cit->second.pending.insert(it->first);
+	}
+
+	this->pushStates.clear();
+	for (auto it = this->pushClients.begin(); it != this->pushClients.end(); ++it) {
+		PushClient& client = it->second;
+		if (!client.pendingAll && client.pending.empty())
+			continue;
+		// slow client? keep the changes; the states current at the time of sending are transmitted
+		if (it->first->send.len > this->webSocketSendLimit)
+			continue;
+
+		JSONWriter& writer = this->pushWriter;
+		writer.clear();
+		writer.beginObject();
+		writer.key("type").value("state");
+		writer.key("ports").beginArray();
+		std::unordered_set<opdi::Port*>& ports = (client.pendingAll ? client.ports : client.pending);
+		for (auto pit = ports.begin(); pit != ports.end(); ++pit) {
+			if (!(*pit)->isHidden())
+				this->jsonWritePushState(writer, client, *pit);
+		}
+		writer.endArray();
+		writer.endObject();
+
+		mg_ws_send(it->first, writer.str().data(), writer.str().size(), WEBSOCKET_OP_TEXT);
+
+		client.pending.clear();
+		client.pendingAll = false;
+	}
+}
+
 void WebServerPlugin::onAllPortsRefreshed(const void* /*pSender*/) {
 	struct mg_connection *c = this->mgr.conns;
 	const char* message = "RefreshAll";
 	int msgLen = strlen(message);
 
 	while (c != nullptr) {
-		if (c->is_websocket == 1)
-			mg_ws_send(c, message, msgLen, WEBSOCKET_OP_TEXT);
+		if (c->is_websocket == 1) {
+			auto it = this->pushClients.find(c);
+			if (it != this->pushClients.end())
+				// push mode; sent in the next doWork
+				it->second.pendingAll = true;
+			else
+				mg_ws_send(c, message, msgLen, WEBSOCKET_OP_TEXT);
+		}
 		c = c->next;
 	}
 }
@@ -577,8 +1358,16 @@ void WebServerPlugin::onPortRefreshed(const void* /*pSender*/, opdi::Port*& port
 	int bufLen = strlen(buf);
 
 	while (c != nullptr) {
-		if (c->is_websocket == 1)
-			mg_ws_send(c, buf, bufLen, WEBSOCKET_OP_TEXT);
+		if (c->is_websocket == 1) {
+			auto it = this->pushClients.find(c);
+			if (it != this->pushClients.end()) {
+				// push mode; state changes are recorded by the change queues, but a refresh may
+				// also announce changed port information
+				if (it->second.ports.count(port) > 0)
+					it->second.pending.insert(port);
+			} else
+				mg_ws_send(c, buf, bufLen, WEBSOCKET_OP_TEXT);
+		}
 		c = c->next;
 	}
 }
@@ -605,6 +1394,12 @@ void WebServerPlugin::setupPlugin(openhat::AbstractOpenHAT* openhat, const std::
 		
 	// expose JSON-RPC API via special URL (can be disabled by setting the URL to "")
 	this->jsonRpcUrl = nodeConfig->getString("JsonRpcUrl", this->jsonRpcUrl);
+
+	// state changes are held back while more data is waiting to be sent to a WebSocket client
+	int sendLimit = nodeConfig->getInt("WebSocketSendLimit", (int)this->webSocketSendLimit);
+	if (sendLimit <= 0)
+		this->openhat->throwSettingException("WebSocketSendLimit must be greater than 0");
+	this->webSocketSendLimit = sendLimit;
 		
 	this->s_http_server_opts.root_dir = this->documentRoot.c_str();
 
@@ -640,9 +1435,12 @@ void WebServerPlugin::setupPlugin(openhat::AbstractOpenHAT* openhat, const std::
 uint8_t WebServerPlugin::doWork(uint8_t canSend) {
 	opdi::DigitalPort::doWork(canSend);
 
-	if (this->getLine() == 1)
+	if (this->getLine() == 1) {
+		// send the state changes of this frame to clients in push mode
+		this->pushStateChanges();
 		// call Mongoose work function
 		mg_mgr_poll(&this->mgr, 1);
+	}
 	
 	// reset priority if acceleration time is over
 	if (opdi_get_time_ms() - this->accelTime > this->accelDuration) {
@@ -656,6 +1454,10 @@ uint8_t WebServerPlugin::doWork(uint8_t canSend) {
 void WebServerPlugin::shutdown() {
 	//this->logVerbose("WebServerPlugin shutting down");
 	mg_mgr_free(&this->mgr);
+
+	// the ports must not record changes in the queues of this plugin any more
+	this->pushClients.clear();
+	this->updatePushQueues(this->pushPortListVersion != this->opdi->getPortListVersion());
 }
 
 // plugin instance factory function
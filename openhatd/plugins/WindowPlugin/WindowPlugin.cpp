@@ -104,6 +104,9 @@ protected:
 
 	void prepare() override;
 
+	// looks up the ports that are specified by the configuration; throws errors if something required is missing
+	void resolvePorts(void);
+
 	// gets the line status from the digital port
 	uint8_t getPortLine(opdi::DigitalPort* port);
 
@@ -154,10 +157,17 @@ class WindowPlugin : public IOpenHATPlugin, public openhat::IConnectionListener
 
 protected:
 	openhat::AbstractOpenHAT* openhat;
+	WindowPort* port;
 
 public:
+	WindowPlugin() : openhat(nullptr), port(nullptr) {}
+
 	virtual void setupPlugin(openhat::AbstractOpenHAT* openhat, const std::string& node, openhat::ConfigurationView::Ptr nodeConfig, openhat::ConfigurationView::Ptr parentConfig, const std::string& driverPath) override;
 
+	virtual bool supportsReload(void) override { return true; }
+
+	virtual void portsReplaced(openhat::AbstractOpenHAT* openhat, const std::string& node) override;
+
 	virtual void masterConnected(void) override;
 	virtual void masterDisconnected(void) override;
 };
@@ -239,7 +249,29 @@ void WindowPort::prepare() {
 	this->logDebug("Preparing WindowPort");
 	opdi::Port::prepare();
 
-	// find ports; throws errors if something required is missing
+	this->resolvePorts();
+
+	// a window port normally refreshes itself automatically unless specified otherwise
+	if (this->refreshMode == RefreshMode::REFRESH_NOT_SET)
+		this->refreshMode = RefreshMode::REFRESH_AUTO;
+}
+
+void WindowPort::resolvePorts(void) {
+	// the ports may be looked up again after a configuration reload
+	this->sensorClosedPort = nullptr;
+	this->sensorOpenPort = nullptr;
+	this->motorAPort = nullptr;
+	this->motorBPort = nullptr;
+	this->directionPort = nullptr;
+	this->enablePort = nullptr;
+	this->statusPort = nullptr;
+	this->autoOpenPorts.clear();
+	this->autoClosePorts.clear();
+	this->forceOpenPorts.clear();
+	this->forceClosePorts.clear();
+	this->errorPorts.clear();
+	this->resetPorts.clear();
+
 	if (this->sensorClosedPortStr != "")
 		this->sensorClosedPort = this->findDigitalPort(this->ID(), "SensorClosed", this->sensorClosedPortStr, true);
 	if (this->sensorOpenPortStr != "")
@@ -268,10 +300,6 @@ void WindowPort::prepare() {
 	this->findDigitalPorts(this->ID(), "ForceClose", this->forceCloseStr, this->forceClosePorts);
 	this->findDigitalPorts(this->ID(), "ErrorPorts", this->errorPortStr, this->errorPorts);
 	this->findDigitalPorts(this->ID(), "ResetPorts", this->resetPortStr, this->resetPorts);
-	
-	// a window port normally refreshes itself automatically unless specified otherwise
-	if (this->refreshMode == RefreshMode::REFRESH_NOT_SET)
-		this->refreshMode = RefreshMode::REFRESH_AUTO;
 }
 
 uint8_t WindowPort::getPortLine(opdi::DigitalPort* port) {
@@ -1170,12 +1198,18 @@ void WindowPlugin::setupPlugin(openhat::AbstractOpenHAT* openhat, const std::str
 	port->positionAfterOpen = nodeConfig->getInt("PositionAfterOpen", -1);
 
 	this->openhat->addPort(port);
+	this->port = port;
 
 	this->openhat->addConnectionListener(this);
 
 	this->openhat->logVerbose(node + ": WindowPlugin setup completed successfully");
 }
 
+void WindowPlugin::portsReplaced(openhat::AbstractOpenHAT* /*openhat*/, const std::string& /*node*/) {
+	if (this->port != nullptr)
+		this->port->resolvePorts();
+}
+
 void WindowPlugin::masterConnected() {
 }
 
@@ -66,6 +66,9 @@ protected:
 public:
 	virtual void setupPlugin(openhat::AbstractOpenHAT* openhat, const std::string& node, openhat::ConfigurationView::Ptr nodeConfig, openhat::ConfigurationView::Ptr parentConfig, const std::string& driverPath);
 
+	// the Gertboard is locked as a resource before its IO is initialized
+	virtual bool supportsParallelSetup(void) override { return true; }
+
 	virtual void masterConnected(void) override;
 	virtual void masterDisconnected(void) override;
 
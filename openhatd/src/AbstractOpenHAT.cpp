@@ -1,7 +1,12 @@
 #include "AbstractOpenHAT.h"
 
 #include <vector>
+#include <set>
+#include <cctype>
 #include <ctime>
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
 #ifdef __GNUG__
 #include <cxxabi.h>
 #endif
@@ -16,10 +21,12 @@
 #include "Poco/Mutex.h"
 #include "Poco/SimpleFileChannel.h"
 #include "Poco/UTF8String.h"
+#include "Poco/String.h"
 #include "Poco/FileStream.h"
 #include "Poco/Process.h"
 #include "Poco/Util/LayeredConfiguration.h"
 #include "Poco/NumberParser.h"
+#include "Poco/NumberFormatter.h"
 #include "Poco/RegularExpression.h"
 
 #include "OPDI_Ports.h"
@@ -27,6 +34,9 @@
 #include "TimerPort.h"
 #include "ExpressionPort.h"
 #include "ExecPort.h"
+#include "FileWatcher.h"
+#include "ProcessSupervisor.h"
+#include "TimerWheel.h"
 #include "opdi_protocol.h"
 #include "TypeGUIDs.h"
 
@@ -66,6 +76,12 @@ AbstractOpenHAT::AbstractOpenHAT(void) {
 
 	this->logVerbosity = opdi::LogVerbosity::UNKNOWN;
 	this->persistentConfig = nullptr;
+	this->simulatedClock = nullptr;
+	this->configCache = nullptr;
+	this->reloadRequested = false;
+	this->currentRootNode = nullptr;
+	this->profileDepth = 0;
+	this->profiling = false;
 
 	this->logger = nullptr;
 	this->timestampFormat = "%Y-%m-%d %H:%M:%S.%i";
@@ -172,11 +188,14 @@ void AbstractOpenHAT::disconnected() {
 }
 
 void AbstractOpenHAT::addConnectionListener(IConnectionListener* listener) {
+	// plugins may register listeners during a parallel setup
+	Poco::Mutex::ScopedLock lock(this->mutex);
 	this->removeConnectionListener(listener);
 	this->connectionListeners.push_back(listener);
 }
 
 void AbstractOpenHAT::removeConnectionListener(IConnectionListener* listener) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
 	ConnectionListenerList::iterator it = std::find(this->connectionListeners.begin(), this->connectionListeners.end(), listener);
 	if (it != this->connectionListeners.end())
 		this->connectionListeners.erase(it);
@@ -207,14 +226,25 @@ void AbstractOpenHAT::showHelp(void) {
 	this->println("  -l <filename>: write log to the specified file");
 	this->println("  -t: test mode; validate config, prepare ports and exit");
 	this->println("  -p <name=value>: set config parameter $name to value");
+	this->println("  -b <frames>: benchmark mode; run the specified number of frames without connection,");
+	this->println("     print statistics as JSON and exit");
+	this->println("  -s <start>: simulated time mode; start at the specified local time (\"YYYY-MM-DD HH:MM:SS\"");
+	this->println("     or \"now\") and advance the clock directly to the next scheduled event");
+	this->println("  --profile: log the wall time of each node, include file and plugin after startup");
+	this->println("  --config-cache <file>: use the specified file to cache the parsed configuration files;");
+	this->println("     the cache is updated automatically if configuration files change");
 }
 
 uint64_t AbstractOpenHAT::getCurrentFrame(void) {
 	return this->currentFrame;
 }
 
+AstroTable& AbstractOpenHAT::getAstroTable(void) {
+	return AstroTable::get();
+}
+
 std::string AbstractOpenHAT::getTimestampStr(void) {
-	return Poco::DateTimeFormatter::format(Poco::LocalDateTime(), this->timestampFormat);
+	return Poco::DateTimeFormatter::format(Poco::LocalDateTime(Poco::DateTime(opdi::Clock::get().now())), this->timestampFormat);
 }
 
 std::string AbstractOpenHAT::getResultCodeText(uint8_t code) {
@@ -226,15 +256,54 @@ std::string AbstractOpenHAT::getResultCodeText(uint8_t code) {
 
 ConfigurationView::Ptr AbstractOpenHAT::readConfiguration(const std::string& filename, const std::map<std::string, std::string>& parameters) {
 	// will throw an exception if something goes wrong
-	OpenHATConfigurationFile* fileConfig = new OpenHATConfigurationFile(filename, parameters);
+	Poco::Util::AbstractConfiguration* fileConfig = (this->configCache != nullptr ? this->configCache->read(filename, parameters)
+		: new OpenHATConfigurationFile(filename, parameters));
 	// remember config file location
 	Poco::Path filePath(filename);
 	fileConfig->setString(OPENHAT_CONFIG_FILE_SETTING, filePath.absolute().toString());
+	// remember the files that belong to a top-level node to detect changes when reloading
+	if (this->currentRootNode != nullptr)
+		this->currentRootNode->files[filePath.absolute().toString()] = this->getFileStamp(filePath.absolute().toString());
 
 	ConfigurationView::Ptr result = new ConfigurationView(this, fileConfig, filename, "", false);
 	return result;
 }
 
+std::string AbstractOpenHAT::getFileStamp(const std::string& path) {
+	Poco::File file(path);
+	if (!file.exists())
+		return "";
+	return this->to_string(file.getLastModified().epochMicroseconds()) + "/" + this->to_string(file.getSize());
+}
+
+void AbstractOpenHAT::getSectionSettings(ConfigurationView::Ptr config, const std::string& section, std::string& settings, std::vector<std::string>* references) {
+	ConfigurationView::Keys keys;
+	config->keys(section, keys);
+	for (auto it = keys.begin(), ite = keys.end(); it != ite; ++it) {
+		std::string key = section + "." + *it;
+		if (config->hasProperty(key))
+			settings += key + "=" + config->getRawString(key) + "\n";
+		// keys of sub-sections may refer to other sections
+		if ((references != nullptr) && (section.find('.') != std::string::npos))
+			references->push_back(*it);
+		this->getSectionSettings(config, key, settings, references);
+	}
+}
+
+std::string AbstractOpenHAT::getNodeSettings(ConfigurationView::Ptr config, const std::string& node) {
+	std::string settings;
+	std::vector<std::string> references;
+	this->getSectionSettings(config, node, settings, &references);
+
+	std::set<std::string> sections;
+	for (auto it = references.begin(), ite = references.end(); it != ite; ++it) {
+		if ((*it == node) || !sections.insert(*it).second)
+			continue;
+		this->getSectionSettings(config, *it, settings, nullptr);
+	}
+	return settings;
+}
+
 std::string AbstractOpenHAT::getConfigString(Poco::Util::AbstractConfiguration::Ptr config, const std::string &section, const std::string &key, const std::string &defaultValue, const bool isRequired) {
 	if (isRequired) {
 		if (!config->hasProperty(key)) {
@@ -256,7 +325,7 @@ void AbstractOpenHAT::printlne(const std::string& text) {
 
 void AbstractOpenHAT::log(const std::string& text) {
 	// Important: log must be thread-safe.
-	Poco::Mutex::ScopedLock(this->mutex);
+	Poco::Mutex::ScopedLock lock(this->mutex);
 
 	std::string msg = "[" + this->getTimestampStr() + "] " + (this->shutdownRequested ? "<SHUTDOWN> " : "") + text;
 	if (this->logger != nullptr) {
@@ -268,7 +337,7 @@ void AbstractOpenHAT::log(const std::string& text) {
 
 void AbstractOpenHAT::logErr(const std::string& message) {
 	// Important: log must be thread-safe.
-	Poco::Mutex::ScopedLock(this->mutex);
+	Poco::Mutex::ScopedLock lock(this->mutex);
 
 	std::string msg = "[" + this->getTimestampStr() + "] " + "ERROR: " + message;
 	if (this->logger != nullptr) {
@@ -279,7 +348,7 @@ void AbstractOpenHAT::logErr(const std::string& message) {
 
 void AbstractOpenHAT::logWarn(const std::string& message) {
 	// Important: log must be thread-safe.
-	Poco::Mutex::ScopedLock(this->mutex);
+	Poco::Mutex::ScopedLock lock(this->mutex);
 
 	std::string msg = "[" + this->getTimestampStr() + "] " + "WARNING: " + message;
 	if (this->logger != nullptr) {
@@ -293,6 +362,11 @@ int AbstractOpenHAT::startup(const std::vector<std::string>& args, const std::ma
 	Poco::AutoPtr<ConfigurationView> configuration = nullptr;
 
 	bool testMode = false;
+	uint64_t benchmarkFrames = 0;
+
+	// measure the startup time for benchmarks
+	Poco::Stopwatch startupStopwatch;
+	startupStopwatch.start();
 
 	// add default environment parameters
 	this->environment["$OPENHAT_VERSION"] = OPENHAT_VERSION_ID;
@@ -306,8 +380,6 @@ int AbstractOpenHAT::startup(const std::vector<std::string>& args, const std::ma
 		".sh";
 #endif
 
-	std::string configFile;
-
 	// evaluate arguments
 	for (unsigned int i = 1; i < args.size(); i++) {
 		if (args.at(i) == "-h" || args.at(i) == "-?") {
@@ -334,12 +406,53 @@ int AbstractOpenHAT::startup(const std::vector<std::string>& args, const std::ma
 		if (args.at(i) == "-t") {
 			testMode = true;
 		} else
+		if (args.at(i) == "--profile") {
+			this->profiling = true;
+		} else
+		if (args.at(i) == "-b") {
+			i++;
+			if (args.size() == i) {
+				throw Poco::SyntaxException("Expected number of frames after argument -b");
+			} else {
+				benchmarkFrames = Poco::NumberParser::parseUnsigned64(args.at(i));
+				if (benchmarkFrames == 0)
+					throw Poco::SyntaxException("The number of benchmark frames must be greater than 0");
+			}
+		} else
+		if (args.at(i) == "-s") {
+			i++;
+			if (args.size() == i) {
+				throw Poco::SyntaxException("Expected start time after argument -s");
+			} else {
+				Poco::Timestamp start;
+				if (args.at(i) != "now") {
+					int tzd;
+					Poco::DateTime startTime;
+					if (!Poco::DateTimeParser::tryParse("%Y-%m-%d %H:%M:%S", args.at(i), startTime, tzd))
+						throw Poco::SyntaxException("Expected start time in the format YYYY-MM-DD HH:MM:SS or 'now' after argument -s", args.at(i));
+					// the start time is specified in local time; convert to UTC
+					startTime.makeUTC(Poco::Timezone::tzd());
+					start = startTime.timestamp();
+				}
+				// the clock must be set before any ports are created
+				this->simulatedClock = new opdi::SimulatedClock(start, DEFAULT_SIMULATION_MAX_STEP_MS);
+				opdi::Clock::set(this->simulatedClock);
+			}
+		} else
+		if (args.at(i) == "--config-cache") {
+			i++;
+			if (args.size() == i) {
+				throw Poco::SyntaxException("Expected cache file name after argument --config-cache");
+			} else {
+				this->configCache = new ConfigurationCache(args.at(i));
+			}
+		} else
 		if (args.at(i) == "-c") {
 			i++;
 			if (args.size() == i) {
 				throw Poco::SyntaxException("Expected configuration file name after argument -c");
 			} else {
-				configFile = args.at(i);
+				this->configFile = args.at(i);
 			}
 		} else
 		if (args.at(i) == "-l") {
@@ -375,11 +488,23 @@ int AbstractOpenHAT::startup(const std::vector<std::string>& args, const std::ma
 	}
 
 	// no configuration?
-	if (configFile == "")
+	if (this->configFile == "")
 		throw Poco::SyntaxException("Expected argument: -c <config_file>");
 
+	if (this->configCache != nullptr) {
+		try {
+			this->configCache->load();
+		} catch (Poco::Exception& e) {
+			this->logWarning("Ignoring configuration cache: " + this->getExceptionMessage(e));
+		}
+	}
+
 	// load configuration, substituting environment parameters
-	configuration = this->readConfiguration(configFile, this->environment);
+	size_t profileEntry = this->addProfileEntry("Read", this->configFile);
+	Poco::Stopwatch readStopwatch;
+	readStopwatch.start();
+	configuration = this->readConfiguration(this->configFile, this->environment);
+	this->setProfileElapsed(profileEntry, readStopwatch.elapsed());
 
 	opdi::LogVerbosity savedVerbosity = this->logVerbosity;
 
@@ -388,7 +513,7 @@ int AbstractOpenHAT::startup(const std::vector<std::string>& args, const std::ma
 		this->logVerbosity = opdi::LogVerbosity::NORMAL;
 
 	this->sayHello();
-	this->logVerbose("Using configuration file: " + configFile);
+	this->logVerbose("Using configuration file: " + this->configFile);
 
 	if (this->logVerbosity >= opdi::LogVerbosity::DEBUG) {
 		this->logDebug("Environment parameters:");
@@ -404,23 +529,45 @@ int AbstractOpenHAT::startup(const std::vector<std::string>& args, const std::ma
 	this->logVerbosity = savedVerbosity;
 
 	std::string switchToUserName = this->setupGeneralConfiguration(configuration);
+	this->globalSettings = this->getNodeSettings(configuration, "General") + this->getNodeSettings(configuration, "Connection");
 
 	this->setupRoot(configuration);
 
 	this->logVerbose("Node setup complete, preparing ports");
 
+	if (this->configCache != nullptr) {
+		this->logVerbose("Configuration cache: " + this->to_string(this->configCache->getHits()) + " file(s) cached, "
+			+ this->to_string(this->configCache->getMisses()) + " file(s) read");
+		try {
+			this->configCache->save();
+		} catch (Poco::Exception& e) {
+			this->logWarning("Unable to write configuration cache: " + this->getExceptionMessage(e));
+		}
+	}
+
 	this->sortPorts();
+	profileEntry = this->addProfileEntry("Prepare", "ports");
+	Poco::Stopwatch prepareStopwatch;
+	prepareStopwatch.start();
 	this->preparePorts();
+	this->setProfileElapsed(profileEntry, prepareStopwatch.elapsed());
 
 	this->prepared = true;
 
+	if (this->profiling)
+		this->logStartupProfile(startupStopwatch.elapsed());
+
 	// startup has been done using the process owner
 	// if specified, change process privileges to a different user
 	if (!switchToUserName.empty()) {
 		this->switchToUser(switchToUserName);
 	}
 
-	int result = this->setupConnection(configuration, testMode);
+	int result;
+	if (benchmarkFrames > 0)
+		result = this->runBenchmark(benchmarkFrames, startupStopwatch.elapsed());
+	else
+		result = this->setupConnection(configuration, testMode);
 
 	// special case: shutdown requested by test port?
 	if (result == OPENHATD_TEST_EXIT)
@@ -447,6 +594,7 @@ uint8_t AbstractOpenHAT::shutdownInternal(void) {
 }
 
 void AbstractOpenHAT::lockResource(const std::string& resourceID, const std::string& lockerID) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
 	this->logDebug("Trying to lock resource '" + resourceID + "' for " + lockerID);
 	// try to locate the resource ID
 	LockedResources::const_iterator it = this->lockedResources.find(resourceID);
@@ -458,6 +606,22 @@ void AbstractOpenHAT::lockResource(const std::string& resourceID, const std::str
 	this->lockedResources[resourceID] = lockerID;
 }
 
+void AbstractOpenHAT::unlockResources(const std::string& lockerID) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	auto it = this->lockedResources.begin();
+	while (it != this->lockedResources.end()) {
+		if (it->second == lockerID) {
+			this->logDebug("Unlocking resource '" + it->first + "' of " + lockerID);
+			it = this->lockedResources.erase(it);
+		} else
+			++it;
+	}
+}
+
+void AbstractOpenHAT::requestReload(void) {
+	this->reloadRequested = true;
+}
+
 opdi::LogVerbosity AbstractOpenHAT::getConfigLogVerbosity(ConfigurationView::Ptr config, opdi::LogVerbosity defaultVerbosity) {
 	std::string logVerbosityStr = config->getString("LogVerbosity", "");
 
@@ -557,6 +721,14 @@ std::string AbstractOpenHAT::setupGeneralConfiguration(ConfigurationView::Ptr co
 	this->heartbeatFile = this->getConfigString(general, "General", "HeartbeatFile", "", false);
 	this->targetFramesPerSecond = general->getInt("TargetFPS", this->targetFramesPerSecond);
 
+	if (this->simulatedClock != nullptr) {
+		int64_t maxStep = general->getInt64("SimulationMaxStep", DEFAULT_SIMULATION_MAX_STEP_MS);
+		if (maxStep <= 0)
+			throw Poco::InvalidArgumentException("SimulationMaxStep must be greater than 0", to_string(maxStep));
+		this->simulatedClock->setMaxStep(maxStep);
+		this->logVerbose("Running in simulated time starting at " + this->getTimestampStr());
+	}
+
 	std::string slaveName = this->getConfigString(general, "General", "SlaveName", "", true);
 	int messageTimeout = general->getInt("MessageTimeout", OPDI_DEFAULT_MESSAGE_TIMEOUT);
 	if ((messageTimeout < 0) || (messageTimeout > 65535))
@@ -568,6 +740,11 @@ std::string AbstractOpenHAT::setupGeneralConfiguration(ConfigurationView::Ptr co
 	this->deviceInfo = general->getString("DeviceInfo", "");
 
 	this->allowHiddenPorts = general->getBool("AllowHidden", true);
+
+	int maxProcesses = general->getInt("MaxProcesses", 0);
+	if (maxProcesses < 0)
+		throw Poco::InvalidArgumentException("MaxProcesses must not be negative", to_string(maxProcesses));
+	ProcessSupervisor::get().setMaxProcesses(maxProcesses);
         
     uint32_t portPriority = general->getUInt("PortPriority", opdi::DEFAULT_PORT_PRIORITY);
     if (portPriority > 255)
@@ -764,10 +941,22 @@ void AbstractOpenHAT::setupInclude(ConfigurationView::Ptr config, ConfigurationV
 			++it;
 		}
 	}
-	ConfigurationView::Ptr includeConfig = this->readConfiguration(filename, parameters);
-
-	// setup the root node of the included configuration
-	this->setupRoot(includeConfig);
+	// the nodes of the include file are nested in the startup profile
+	this->profileDepth++;
+	try {
+		size_t profileEntry = this->addProfileEntry("Read", filename);
+		Poco::Stopwatch stopwatch;
+		stopwatch.start();
+		ConfigurationView::Ptr includeConfig = this->readConfiguration(filename, parameters);
+		this->setProfileElapsed(profileEntry, stopwatch.elapsed());
+
+		// setup the root node of the included configuration
+		this->setupRoot(includeConfig);
+	} catch (...) {
+		this->profileDepth--;
+		throw;
+	}
+	this->profileDepth--;
 
 	if (this->logVerbosity >= opdi::LogVerbosity::VERBOSE) {
 		this->logVerbose(node + ": Include file " + filename + " processed successfully.");
@@ -871,33 +1060,148 @@ void AbstractOpenHAT::configurePort(ConfigurationView::Ptr portConfig, opdi::Por
 	port->setLogVerbosity(this->getConfigLogVerbosity(portConfig, this->logVerbosity));
 }
 
-void AbstractOpenHAT::configureDigitalPort(ConfigurationView::Ptr portConfig, opdi::DigitalPort* port, bool stateOnly) {
-	if (!stateOnly)
-		this->configurePort(portConfig, port, 0);
+AbstractOpenHAT::PortState::PortState() : hasMode(false), mode(0), hasLine(false), line(0), hasResolution(false), resolution(0), hasValue(false), value(0) {
+}
 
-	Poco::AutoPtr<Poco::Util::AbstractConfiguration> stateConfig = this->getConfigForState(portConfig, port->ID());
+void AbstractOpenHAT::PortState::merge(const PortState& other) {
+	if (other.hasMode) {
+		this->hasMode = true;
+		this->mode = other.mode;
+	}
+	if (other.hasLine) {
+		this->hasLine = true;
+		this->line = other.line;
+	}
+	if (other.hasResolution) {
+		this->hasResolution = true;
+		this->resolution = other.resolution;
+	}
+	if (other.hasValue) {
+		this->hasValue = true;
+		this->value = other.value;
+	}
+}
 
-	std::string portMode = this->getConfigString(stateConfig, port->ID(), "Mode", "", false);
-	if (portMode == "Input") {
-		port->setMode(OPDI_DIGITAL_MODE_INPUT_FLOATING);
+void AbstractOpenHAT::readPortState(Poco::Util::AbstractConfiguration::Ptr stateConfig, opdi::Port* port, PortState& state) {
+	char type = port->getType()[0];
+	if (type == OPDI_PORTTYPE_DIGITAL[0]) {
+		std::string portMode = this->getConfigString(stateConfig, port->ID(), "Mode", "", false);
+		if (portMode == "Input") {
+			state.hasMode = true;
+			state.mode = OPDI_DIGITAL_MODE_INPUT_FLOATING;
 /* these modes are no longer necessary
-	} else if (portMode == "Input with pullup") {
-		port->setMode(OPDI_DIGITAL_MODE_INPUT_PULLUP);
-	} else if (portMode == "Input with pulldown") {
-		port->setMode(OPDI_DIGITAL_MODE_INPUT_PULLDOWN);
+		} else if (portMode == "Input with pullup") {
+			state.mode = OPDI_DIGITAL_MODE_INPUT_PULLUP;
+		} else if (portMode == "Input with pulldown") {
+			state.mode = OPDI_DIGITAL_MODE_INPUT_PULLDOWN;
 */
-	} else if (portMode == "Output") {
-		port->setMode(OPDI_DIGITAL_MODE_OUTPUT);
-	} else if (portMode != "")
-		this->throwSettingException("Unknown Mode specified; expected 'Input'" /*, 'Input with pullup', 'Input with pulldown',*/ " or 'Output'", portMode);
+		} else if (portMode == "Output") {
+			state.hasMode = true;
+			state.mode = OPDI_DIGITAL_MODE_OUTPUT;
+		} else if (portMode != "")
+			this->throwSettingException("Unknown Mode specified; expected 'Input'" /*, 'Input with pullup', 'Input with pulldown',*/ " or 'Output'", portMode);
+
+		std::string portLine = this->getConfigString(stateConfig, port->ID(), "Line", "", false);
+		if (portLine == "High") {
+			state.hasLine = true;
+			state.line = 1;
+		} else if (portLine == "Low") {
+			state.hasLine = true;
+			state.line = 0;
+		} else if (portLine != "")
+			this->throwSettingException("Unknown Line specified; expected 'Low' or 'High'", portLine);
+	} else
+	if (type == OPDI_PORTTYPE_ANALOG[0]) {
+		std::string mode = this->getConfigString(stateConfig, port->ID(), "Mode", "", false);
+		if (mode == "Input") {
+			state.hasMode = true;
+			state.mode = 0;
+		} else if (mode == "Output") {
+			state.hasMode = true;
+			state.mode = 1;
+		} else if (mode != "")
+			throw Poco::ApplicationException("Unknown mode specified; expected 'Input' or 'Output'", mode);
+
+		// TODO reference?
+
+		if (stateConfig->hasProperty("Resolution")) {
+			state.hasResolution = true;
+			state.resolution = stateConfig->getInt("Resolution", OPDI_ANALOG_PORT_RESOLUTION_12);
+		}
+		if (stateConfig->hasProperty("Value")) {
+			state.hasValue = true;
+			state.value = stateConfig->getInt("Value", 0);
+		}
+	} else
+	if (type == OPDI_PORTTYPE_SELECT[0]) {
+		if (stateConfig->getString("Position", "") != "") {
+			state.hasValue = true;
+			state.value = stateConfig->getInt("Position", 0);
+		}
+	} else
+	if (type == OPDI_PORTTYPE_DIAL[0]) {
+		if (stateConfig->hasProperty("Position")) {
+			state.hasValue = true;
+			state.value = stateConfig->getInt64("Position", 0);
+		}
+	} else
+		throw Poco::ApplicationException("Port " + port->ID() + " has an unknown type");
+}
 
-	std::string portLine = this->getConfigString(stateConfig, port->ID(), "Line", "", false);
-	if (portLine == "High") {
-		port->setLine(1);
-	} else if (portLine == "Low") {
-		port->setLine(0);
-	} else if (portLine != "")
-		this->throwSettingException("Unknown Line specified; expected 'Low' or 'High'", portLine);
+void AbstractOpenHAT::applyPortState(opdi::Port* port, const PortState& state) {
+	char type = port->getType()[0];
+	if (type == OPDI_PORTTYPE_DIGITAL[0]) {
+		opdi::DigitalPort* digPort = (opdi::DigitalPort*)port;
+		if (state.hasMode)
+			digPort->setMode(state.mode);
+		if (state.hasLine)
+			digPort->setLine(state.line);
+	} else
+	if (type == OPDI_PORTTYPE_ANALOG[0]) {
+		opdi::AnalogPort* anaPort = (opdi::AnalogPort*)port;
+		if (state.hasMode)
+			anaPort->setMode(state.mode);
+		if (state.hasResolution)
+			anaPort->setResolution(state.resolution);
+		if (state.hasValue)
+			anaPort->setAbsoluteValue((int32_t)state.value);
+	} else
+	if (type == OPDI_PORTTYPE_SELECT[0]) {
+		opdi::SelectPort* selPort = (opdi::SelectPort*)port;
+		if (state.hasValue) {
+			if ((state.value < 0) || (state.value > selPort->getMaxPosition()))
+				this->throwSettingException("Wrong Select port setting: Position is out of range: " + to_string(state.value));
+			selPort->setPosition((uint16_t)state.value);
+		}
+	} else
+	if (type == OPDI_PORTTYPE_DIAL[0]) {
+		opdi::DialPort* dialPort = (opdi::DialPort*)port;
+		if (state.hasValue) {
+			// set port error to invalid if the value is out of range
+			if ((state.value < dialPort->getMin()) || (state.value > dialPort->getMax()))
+				dialPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+				//this->throwSettingException("Wrong dial port setting: Position is out of range: " + to_string(position));
+			else
+				dialPort->setPosition(state.value);
+		}
+	}
+}
+
+void AbstractOpenHAT::mergePersistentState(opdi::Port* port, PortState& state) {
+	if (this->persistentConfig == nullptr)
+		return;
+	PortState persisted;
+	this->readPortState(this->createConfigView(this->persistentConfig, port->ID()), port, persisted);
+	state.merge(persisted);
+}
+
+void AbstractOpenHAT::configureDigitalPort(ConfigurationView::Ptr portConfig, opdi::DigitalPort* port, bool stateOnly) {
+	if (!stateOnly)
+		this->configurePort(portConfig, port, 0);
+
+	PortState state;
+	this->readPortState(this->getConfigForState(portConfig, port->ID()), port, state);
+	this->applyPortState(port, state);
 }
 
 void AbstractOpenHAT::setupDigitalPort(ConfigurationView::Ptr portConfig, const std::string& port) {
@@ -923,26 +1227,9 @@ void AbstractOpenHAT::configureAnalogPort(ConfigurationView::Ptr portConfig, opd
 			OPDI_ANALOG_PORT_REFERENCE_INT |
 			OPDI_ANALOG_PORT_REFERENCE_EXT);
 
-	Poco::AutoPtr<Poco::Util::AbstractConfiguration> stateConfig = this->getConfigForState(portConfig, port->ID());
-
-	std::string mode = this->getConfigString(stateConfig, port->ID(), "Mode", "", false);
-	if (mode == "Input")
-		port->setMode(0);
-	else if (mode == "Output")
-		port->setMode(1);
-	else if (mode != "")
-		throw Poco::ApplicationException("Unknown mode specified; expected 'Input' or 'Output'", mode);
-
-	// TODO reference?
-
-	if (stateConfig->hasProperty("Resolution")) {
-		uint8_t resolution = stateConfig->getInt("Resolution", OPDI_ANALOG_PORT_RESOLUTION_12);
-		port->setResolution(resolution);
-	}
-	if (stateConfig->hasProperty("Value")) {
-		uint32_t value = stateConfig->getInt("Value", 0);
-		port->setAbsoluteValue(value);
-	}
+	PortState state;
+	this->readPortState(this->getConfigForState(portConfig, port->ID()), port, state);
+	this->applyPortState(port, state);
 }
 
 void AbstractOpenHAT::setupAnalogPort(ConfigurationView::Ptr portConfig, const std::string& port) {
@@ -994,14 +1281,9 @@ void AbstractOpenHAT::configureSelectPort(ConfigurationView::Ptr portConfig, Con
 		port->setLabels(orderedLabels);
 	}
 
-	Poco::AutoPtr<Poco::Util::AbstractConfiguration> stateConfig = this->getConfigForState(portConfig, port->ID());
-
-	if (stateConfig->getString("Position", "") != "") {
-		int16_t position = stateConfig->getInt("Position", 0);
-		if ((position < 0) || (position > port->getMaxPosition()))
-			this->throwSettingException("Wrong Select port setting: Position is out of range: " + to_string(position));
-		port->setPosition(position);
-	}
+	PortState state;
+	this->readPortState(this->getConfigForState(portConfig, port->ID()), port, state);
+	this->applyPortState(port, state);
 }
 
 void AbstractOpenHAT::setupSelectPort(ConfigurationView::Ptr portConfig, ConfigurationView::Ptr parentConfig, const std::string& port) {
@@ -1062,15 +1344,14 @@ void AbstractOpenHAT::configureDialPort(ConfigurationView::Ptr portConfig, opdi:
 		}
 	}
 
-	Poco::AutoPtr<Poco::Util::AbstractConfiguration> stateConfig = this->getConfigForState(portConfig, port->ID());
-
-	int64_t position = stateConfig->getInt64("Position", port->getPosition());
-	// set port error to invalid if the value is out of range
-	if ((position < port->getMin()) || (position > port->getMax()))
-		port->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
-		//this->throwSettingException("Wrong dial port setting: Position is out of range: " + to_string(position));
-	else
-		port->setPosition(position);
+	PortState state;
+	this->readPortState(this->getConfigForState(portConfig, port->ID()), port, state);
+	// the current position is checked against the range, too
+	if (!state.hasValue) {
+		state.hasValue = true;
+		state.value = port->getPosition();
+	}
+	this->applyPortState(port, state);
 }
 
 void AbstractOpenHAT::setupDialPort(ConfigurationView::Ptr portConfig, const std::string& port) {
@@ -1181,27 +1462,17 @@ void AbstractOpenHAT::setupNode(ConfigurationView::Ptr config, const std::string
 	Poco::AutoPtr<ConfigurationView> nodeConfig = this->createConfigView(config, node);
 
 	std::string nodeType = this->getConfigString(nodeConfig, node, "Type", "", true);
-	if (nodeType == "Plugin") {
-		// get driver information
-		std::string nodeDriver = this->getConfigString(nodeConfig, node, "Driver", "", true);
-		// plugins are by default relative to the current working directory
-		nodeDriver = this->resolveRelativePath(nodeConfig, node, nodeDriver, "CWD");
 
-		this->logVerbose("Loading plugin driver: " + nodeDriver);
+	// other nodes may depend on the ports of plugins that are set up in parallel
+	if (nodeType != "Plugin")
+		this->completePluginSetups();
 
-		// try to load the plugin; the driver name is the (platform dependent) library file name
-		IOpenHATPlugin* plugin = this->getPlugin(nodeDriver);
-
-		// add plugin to internal list (avoids memory leaks)
-		this->pluginList.push_back(plugin);
-
-		// plugins check their own settings usage, so the nodeConfig does not need to
-		// check for unused keys
-		nodeConfig->setCheckUnused(false);
-
-		// init the plugin
-		plugin->setupPlugin(this, node, nodeConfig, config, nodeDriver);
+	size_t profileEntry = this->addProfileEntry(nodeType, node);
+	Poco::Stopwatch stopwatch;
+	stopwatch.start();
 
+	if (nodeType == "Plugin") {
+		this->setupPlugin(nodeConfig, config, node);
 	} else
 	if (nodeType == "Group") {
 		this->setupGroup(nodeConfig, node);
@@ -1273,6 +1544,9 @@ void AbstractOpenHAT::setupNode(ConfigurationView::Ptr config, const std::string
 	if (nodeType == "Counter") {
 		this->setupPort<CounterPort>(nodeConfig, node);
 	} else
+	if (nodeType == "Astro") {
+		this->setupPort<AstroPort>(nodeConfig, node);
+	} else
 	if (nodeType == "InfluxDB") {
 		this->setupPort<InfluxDBPort>(nodeConfig, node);
 	} else
@@ -1283,15 +1557,16 @@ void AbstractOpenHAT::setupNode(ConfigurationView::Ptr config, const std::string
 		this->setupPortEx<AssignmentPort>(nodeConfig, config, node);
 	} else
 		this->throwSettingException("Invalid configuration: Unknown node type: " + nodeType);
+
+	this->setProfileElapsed(profileEntry, stopwatch.elapsed());
 }
 
-void AbstractOpenHAT::setupRoot(ConfigurationView::Ptr config) {
+void AbstractOpenHAT::getRootNodes(ConfigurationView::Ptr config, std::vector<std::string>& nodes) {
 	// enumerate section "Root"
-	Poco::AutoPtr<ConfigurationView> nodes = this->createConfigView(config, "Root");
-	this->logVerbose("Setting up root nodes");
+	Poco::AutoPtr<ConfigurationView> rootConfig = this->createConfigView(config, "Root");
 
 	ConfigurationView::Keys nodeKeys;
-	nodes->keys("", nodeKeys);
+	rootConfig->keys("", nodeKeys);
 
 	typedef Poco::Tuple<int, std::string> Node;
 	typedef std::vector<Node> NodeList;
@@ -1299,25 +1574,31 @@ void AbstractOpenHAT::setupRoot(ConfigurationView::Ptr config) {
 
 	// create ordered list of nodes (by priority)
 	for (auto it = nodeKeys.begin(), ite = nodeKeys.end(); it != ite; ++it) {
-		int nodeNumber = nodes->getInt(*it, 0);
+		int nodeNumber = rootConfig->getInt(*it, 0);
 		// check whether the node is active
 		if (nodeNumber < 0)
 			continue;
 
-		// insert at the correct position to create a sorted list of nodes
-		auto nli = orderedNodes.begin();
-		auto nlie = orderedNodes.end();
-		while (nli != nlie) {
-			if (nli->get<0>() > nodeNumber)
-				break;
-			++nli;
-		}
-		Node node(nodeNumber, *it);
-		orderedNodes.insert(nli, node);
+		orderedNodes.push_back(Node(nodeNumber, *it));
 	}
+	// nodes with the same priority keep their order
+	std::stable_sort(orderedNodes.begin(), orderedNodes.end(), [](const Node& a, const Node& b) {
+		return a.get<0>() < b.get<0>();
+	});
+
+	nodes.clear();
+	for (auto it = orderedNodes.begin(), ite = orderedNodes.end(); it != ite; ++it)
+		nodes.push_back(it->get<1>());
+}
+
+void AbstractOpenHAT::setupRoot(ConfigurationView::Ptr config) {
+	this->logVerbose("Setting up root nodes");
+
+	std::vector<std::string> nodes;
+	this->getRootNodes(config, nodes);
 
 	// warn if no nodes found
-	if ((orderedNodes.size() == 0) && (this->logVerbosity >= opdi::LogVerbosity::NORMAL)) {
+	if ((nodes.size() == 0) && (this->logVerbosity >= opdi::LogVerbosity::NORMAL)) {
 		// get file name
 		std::string filename = config->getString(OPENHAT_CONFIG_FILE_SETTING, "");
 		if (filename == "")
@@ -1326,16 +1607,530 @@ void AbstractOpenHAT::setupRoot(ConfigurationView::Ptr config) {
 	}
 
 	// go through ordered list, setup nodes by name
-	auto nli = orderedNodes.begin();
-	auto nlie = orderedNodes.end();
+	auto nli = nodes.begin();
+	auto nlie = nodes.end();
 	while (nli != nlie) {
-		this->setupNode(config, nli->get<1>());
+		// remember the top-level nodes of the main configuration file for reloading
+		if (this->currentRootNode == nullptr) {
+			std::shared_ptr<RootNode>& rootNode = this->rootNodes[*nli];
+			rootNode.reset(new RootNode());
+			this->setupRootNode(config, *nli, *rootNode);
+		} else
+			this->setupNode(config, *nli);
 		++nli;
 	}
 
+	this->completePluginSetups();
+
 	// TODO check group hierarchy
 }
 
+void AbstractOpenHAT::setupRootNode(ConfigurationView::Ptr config, const std::string& node, RootNode& rootNode) {
+	rootNode.type = config->getString(node + ".Type", "");
+	rootNode.settings = this->getNodeSettings(config, node);
+	rootNode.files.clear();
+	rootNode.ports.clear();
+	rootNode.references.clear();
+	rootNode.usesPatterns = false;
+	rootNode.plugins.clear();
+
+	// addPort() assigns the new ports to the current root node; port lookups are recorded for the node
+	this->currentRootNode = &rootNode;
+	RootNode* savedReferencingNode = referencingNode;
+	referencingNode = &rootNode;
+	try {
+		this->setupNode(config, node);
+	} catch (...) {
+		this->currentRootNode = nullptr;
+		referencingNode = savedReferencingNode;
+		throw;
+	}
+	this->currentRootNode = nullptr;
+	referencingNode = savedReferencingNode;
+}
+
+thread_local AbstractOpenHAT::RootNode* AbstractOpenHAT::referencingNode = nullptr;
+
+namespace {
+
+// Returns true if the port list specification selects ports by pattern (*, id=, group= or tag=).
+// The result of such a specification may change if any port changes.
+bool specUsesPatterns(const std::string& spec) {
+	std::stringstream ss(spec);
+	std::string item;
+	while (std::getline(ss, item, ' ')) {
+		if (!item.empty() && (item[0] == '!'))
+			item = item.substr(1);
+		if ((item == "*") || (item.find("id=") == 0) || (item.find("group=") == 0) || (item.find("tag=") == 0))
+			return true;
+	}
+	return false;
+}
+
+}	// end anonymous namespace
+
+opdi::Port* AbstractOpenHAT::findPortByID(const char* portID, bool caseInsensitive) {
+	// IDs are recorded in lower case because expressions look up their variables case-insensitively
+	if (referencingNode != nullptr) {
+		Poco::FastMutex::ScopedLock lock(this->referencesMutex);
+		referencingNode->references.insert(Poco::toLower(std::string(portID)));
+	}
+	return OPDI::findPortByID(portID, caseInsensitive);
+}
+
+void AbstractOpenHAT::findPortIDs(const std::string& spec, std::vector<std::string>& results) {
+	// the ports themselves are recorded when they are looked up by ID
+	if ((referencingNode != nullptr) && specUsesPatterns(spec)) {
+		Poco::FastMutex::ScopedLock lock(this->referencesMutex);
+		referencingNode->usesPatterns = true;
+	}
+	OPDI::findPortIDs(spec, results);
+}
+
+void AbstractOpenHAT::preparePort(opdi::Port* port) {
+	auto it = this->portNodes.find(port);
+	RootNode* savedReferencingNode = referencingNode;
+	referencingNode = (it == this->portNodes.end() ? nullptr : it->second);
+	try {
+		OPDI::preparePort(port);
+	} catch (...) {
+		referencingNode = savedReferencingNode;
+		throw;
+	}
+	referencingNode = savedReferencingNode;
+}
+
+namespace {
+
+// receives the ports that are added by a plugin during a parallel setup
+thread_local opdi::PortList* parallelSetupPorts = nullptr;
+
+}	// end anonymous namespace
+
+void AbstractOpenHAT::addPort(opdi::Port* port) {
+	if (parallelSetupPorts != nullptr) {
+		parallelSetupPorts->push_back(port);
+		return;
+	}
+	if (OPDI::findPortByID(port->ID().c_str()) != nullptr) {
+		std::string id = port->ID();
+		delete port;
+		this->throwSettingException("Duplicate port ID: " + id);
+	}
+	if (this->currentRootNode != nullptr) {
+		this->currentRootNode->ports.push_back(port);
+		this->portNodes[port] = this->currentRootNode;
+	}
+	OPDI::addPort(port);
+}
+
+void AbstractOpenHAT::PluginSetup::run(void) {
+	Poco::Stopwatch stopwatch;
+	stopwatch.start();
+	parallelSetupPorts = &this->ports;
+	// the port lookups of the plugin are recorded for its top-level node
+	referencingNode = this->rootNode;
+	try {
+		this->plugin->setupPlugin(this->openhat, this->node, this->nodeConfig, this->parentConfig, this->driver);
+	} catch (Poco::Exception& e) {
+		this->error.reset(e.clone());
+	} catch (std::exception& e) {
+		this->error.reset(new Poco::Exception(this->node + ": " + this->openhat->getExceptionMessage(e)));
+	} catch (...) {
+		this->error.reset(new Poco::Exception(this->node + ": Unknown error during plugin setup"));
+	}
+	parallelSetupPorts = nullptr;
+	referencingNode = nullptr;
+	this->elapsed = stopwatch.elapsed();
+}
+
+void AbstractOpenHAT::setupPlugin(ConfigurationView::Ptr nodeConfig, ConfigurationView::Ptr parentConfig, const std::string& node) {
+	// get driver information
+	std::string nodeDriver = this->getConfigString(nodeConfig, node, "Driver", "", true);
+	// plugins are by default relative to the current working directory
+	nodeDriver = this->resolveRelativePath(nodeConfig, node, nodeDriver, "CWD");
+
+	this->logVerbose("Loading plugin driver: " + nodeDriver);
+
+	// try to load the plugin; the driver name is the (platform dependent) library file name
+	IOpenHATPlugin* plugin = this->getPlugin(nodeDriver);
+
+	// add plugin to internal list (avoids memory leaks)
+	this->pluginList.push_back(plugin);
+	// remember the plugin for reloading the configuration
+	if (this->currentRootNode != nullptr)
+		this->currentRootNode->plugins.push_back(std::make_pair(node, plugin));
+
+	// plugins check their own settings usage, so the nodeConfig does not need to
+	// check for unused keys
+	nodeConfig->setCheckUnused(false);
+
+	// the node can disable parallel setup if the plugin supports it
+	if (plugin->supportsParallelSetup() && nodeConfig->getBool("ParallelSetup", true)) {
+		this->logVerbose(node + ": Starting parallel plugin setup");
+		PluginSetup* setup = new PluginSetup();
+		this->pluginSetups.emplace_back(setup);
+		setup->openhat = this;
+		setup->plugin = plugin;
+		setup->node = node;
+		setup->nodeConfig = nodeConfig;
+		setup->parentConfig = parentConfig;
+		setup->driver = nodeDriver;
+		setup->rootNode = this->currentRootNode;
+		setup->elapsed = 0;
+		setup->thread.setName(node + " setup thread");
+		setup->thread.start(*setup);
+		return;
+	}
+
+	// plugins that are set up sequentially may depend on the ports of previous plugins
+	this->completePluginSetups();
+
+	// init the plugin
+	plugin->setupPlugin(this, node, nodeConfig, parentConfig, nodeDriver);
+}
+
+void AbstractOpenHAT::completePluginSetups(void) {
+	if (this->pluginSetups.empty())
+		return;
+
+	std::vector<std::unique_ptr<PluginSetup> > setups;
+	setups.swap(this->pluginSetups);
+
+	// wait for all setups before reporting errors
+	for (auto it = setups.begin(), ite = setups.end(); it != ite; ++it)
+		(*it)->thread.join();
+
+	// add the ports of all setups (also of failed ones, as with a sequential setup) so that they are freed
+	// with the other ports; the first error in the order of the plugin nodes is thrown afterwards
+	std::unique_ptr<Poco::Exception> error;
+	for (auto it = setups.begin(), ite = setups.end(); it != ite; ++it) {
+		PluginSetup& setup = **it;
+		size_t entry = this->addProfileEntry("Plugin setup", setup.node);
+		this->setProfileElapsed(entry, setup.elapsed, true);
+
+		if (setup.error && !error)
+			error.reset(setup.error->clone());
+
+		// add the ports in the order of the plugin nodes
+		RootNode* savedRootNode = this->currentRootNode;
+		this->currentRootNode = setup.rootNode;
+		for (auto pit = setup.ports.begin(), pite = setup.ports.end(); pit != pite; ++pit) {
+			try {
+				this->addPort(*pit);
+			} catch (Poco::Exception& e) {
+				if (!error)
+					error.reset(e.clone());
+			}
+		}
+		this->currentRootNode = savedRootNode;
+
+		if (!setup.error)
+			this->logVerbose(setup.node + ": Parallel plugin setup completed in " + this->to_string(setup.elapsed / 1000) + " ms");
+	}
+
+	if (error)
+		error->rethrow();
+}
+
+size_t AbstractOpenHAT::addProfileEntry(const std::string& kind, const std::string& name) {
+	if (!this->profiling)
+		return SIZE_MAX;
+	ProfileEntry entry;
+	entry.kind = kind;
+	entry.name = name;
+	entry.depth = this->profileDepth;
+	entry.elapsed = 0;
+	entry.parallel = false;
+	this->startupProfile.push_back(entry);
+	return this->startupProfile.size() - 1;
+}
+
+void AbstractOpenHAT::setProfileElapsed(size_t entry, Poco::Timestamp::TimeDiff elapsed, bool parallel) {
+	if (entry >= this->startupProfile.size())
+		return;
+	this->startupProfile[entry].elapsed = elapsed;
+	this->startupProfile[entry].parallel = parallel;
+}
+
+void AbstractOpenHAT::logStartupProfile(Poco::Timestamp::TimeDiff startupMicroseconds) {
+	this->logNormal("Startup profile (wall time in milliseconds):");
+	for (auto it = this->startupProfile.begin(), ite = this->startupProfile.end(); it != ite; ++it) {
+		this->logNormal(std::string(2 + it->depth * 2, ' ') + it->kind + " " + it->name + ": "
+			+ Poco::NumberFormatter::format(it->elapsed / 1000.0, 1) + (it->parallel ? " (parallel)" : ""));
+	}
+	this->logNormal("  Total: " + Poco::NumberFormatter::format(startupMicroseconds / 1000.0, 1));
+}
+
+void AbstractOpenHAT::removePorts(const opdi::PortList& ports) {
+	// shutdown all ports first; ports may refer to each other
+	for (auto it = ports.begin(), ite = ports.end(); it != ite; ++it) {
+		this->logVerbose("Removing port: " + (*it)->ID());
+		try {
+			(*it)->shutdown();
+		} catch (Poco::Exception& e) {
+			this->logWarning("Error shutting down port " + (*it)->ID() + ": " + this->getExceptionMessage(e));
+		}
+	}
+
+	std::vector<double*> values;
+	for (auto it = ports.begin(), ite = ports.end(); it != ite; ++it) {
+		values.push_back(&(*it)->getValuePtr());
+		this->portNodes.erase(*it);
+		this->removePort(*it);
+	}
+
+#ifdef OPENHAT_USE_EXPRTK
+	// remove the port variables after all expressions that use them have been freed
+	ExpressionPort::releaseValues(values);
+#endif
+}
+
+void AbstractOpenHAT::addDependentNodes(std::set<std::string>& affected, std::set<std::string>& changedIDs, std::set<std::string>& pluginNodes) {
+	bool found = true;
+	while (found) {
+		found = false;
+		for (auto it = this->rootNodes.begin(), ite = this->rootNodes.end(); it != ite; ++it) {
+			if ((affected.find(it->first) != affected.end()) || (pluginNodes.find(it->first) != pluginNodes.end()))
+				continue;
+			const RootNode& rootNode = *it->second;
+			// a specification with a pattern may select different ports now
+			bool dependent = rootNode.usesPatterns;
+			for (auto rit = rootNode.references.begin(), rite = rootNode.references.end(); !dependent && (rit != rite); ++rit)
+				dependent = (changedIDs.find(*rit) != changedIDs.end());
+			if (!dependent)
+				continue;
+			// plugins keep their ports and look up the changed ports again
+			if (!rootNode.plugins.empty()) {
+				this->logDebug("Node " + it->first + " contains plugins that refer to changed ports");
+				pluginNodes.insert(it->first);
+				continue;
+			}
+			this->logDebug("Node " + it->first + " refers to changed ports");
+			affected.insert(it->first);
+			for (auto pit = rootNode.ports.begin(), pite = rootNode.ports.end(); pit != pite; ++pit)
+				changedIDs.insert(Poco::toLower((*pit)->ID()));
+			found = true;
+		}
+	}
+}
+
+void AbstractOpenHAT::reloadConfiguration(void) {
+	this->logNormal("Reloading configuration file: " + this->configFile);
+
+	// the profile describes the most recent (re)configuration
+	this->startupProfile.clear();
+	this->profileDepth = 0;
+
+	// read the configuration; errors leave the running configuration unchanged
+	ConfigurationView::Ptr configuration;
+	std::vector<std::string> nodes;
+	RootNodes newNodes;
+	std::string newGlobalSettings;
+	try {
+		configuration = this->readConfiguration(this->configFile, this->environment);
+		this->getRootNodes(configuration, nodes);
+		for (auto it = nodes.begin(), ite = nodes.end(); it != ite; ++it) {
+			std::shared_ptr<RootNode> rootNode(new RootNode());
+			rootNode->type = configuration->getString(*it + ".Type", "");
+			rootNode->settings = this->getNodeSettings(configuration, *it);
+			newNodes[*it] = rootNode;
+		}
+		newGlobalSettings = this->getNodeSettings(configuration, "General") + this->getNodeSettings(configuration, "Connection");
+	} catch (Poco::Exception& e) {
+		this->logError("Unable to reload the configuration: " + this->getExceptionMessage(e));
+		return;
+	}
+
+	if (newGlobalSettings != this->globalSettings)
+		this->logWarning("Changes of the General or Connection sections require a restart and are ignored");
+
+	// determine the nodes that have been removed or changed
+	std::set<std::string> affected;
+	for (auto it = this->rootNodes.begin(), ite = this->rootNodes.end(); it != ite; ++it) {
+		auto nit = newNodes.find(it->first);
+		bool changed = (nit == newNodes.end()) || (nit->second->type != it->second->type) || (nit->second->settings != it->second->settings);
+		for (auto fit = it->second->files.begin(), fite = it->second->files.end(); !changed && (fit != fite); ++fit)
+			changed = (this->getFileStamp(fit->first) != fit->second);
+		if (changed)
+			affected.insert(it->first);
+	}
+	// added nodes
+	for (auto it = nodes.begin(), ite = nodes.end(); it != ite; ++it)
+		if (this->rootNodes.find(*it) == this->rootNodes.end())
+			affected.insert(*it);
+
+	if (affected.empty()) {
+		this->logNormal("Configuration reloaded, no changes detected");
+		return;
+	}
+
+	// nodes that have looked up ports of affected nodes must be set up again, too
+	std::set<std::string> changedIDs;
+	for (auto it = affected.begin(), ite = affected.end(); it != ite; ++it) {
+		auto rit = this->rootNodes.find(*it);
+		if (rit == this->rootNodes.end())
+			continue;
+		for (auto pit = rit->second->ports.begin(), pite = rit->second->ports.end(); pit != pite; ++pit)
+			changedIDs.insert(Poco::toLower((*pit)->ID()));
+	}
+	std::set<std::string> pluginNodes;
+	this->addDependentNodes(affected, changedIDs, pluginNodes);
+
+	// plugins and groups cannot be replaced at runtime; plugins that refer to replaced ports must support reloading
+	auto checkNodes = [&](void) {
+		for (auto it = affected.begin(), ite = affected.end(); it != ite; ++it) {
+			auto rit = this->rootNodes.find(*it);
+			auto nit = newNodes.find(*it);
+			std::string oldType = (rit == this->rootNodes.end() ? "" : rit->second->type);
+			std::string newType = (nit == newNodes.end() ? "" : nit->second->type);
+			if ((oldType == "Plugin") || (oldType == "Group") || (newType == "Plugin") || (newType == "Group"))
+				throw Poco::ApplicationException("Node " + *it + " of type " + (oldType.empty() ? newType : oldType)
+					+ " cannot be changed at runtime, restart required");
+			if ((rit != this->rootNodes.end()) && !rit->second->plugins.empty())
+				throw Poco::ApplicationException("Node " + *it + " contains plugins and cannot be changed at runtime, restart required");
+		}
+		for (auto it = pluginNodes.begin(), ite = pluginNodes.end(); it != ite; ++it) {
+			const RootNode& rootNode = *this->rootNodes[*it];
+			if (rootNode.type != "Plugin")
+				throw Poco::ApplicationException("Node " + *it + " contains plugins and refers to replaced ports, restart required");
+			for (auto pit = rootNode.plugins.begin(), pite = rootNode.plugins.end(); pit != pite; ++pit)
+				if (!pit->second->supportsReload())
+					throw Poco::ApplicationException("The plugin of node " + pit->first + " refers to replaced ports but does not support reloading, restart required");
+		}
+	};
+	try {
+		checkNodes();
+	} catch (Poco::Exception& e) {
+		this->logWarning("Unable to reload the configuration: " + e.message());
+		return;
+	}
+
+	// The new ports are set up and prepared before the old ports are freed. The old ports are removed from
+	// the port list so that the new ports can use their IDs and resources, and the Expression ports are
+	// compiled using a separate symbol table. On errors the old ports are restored.
+	opdi::PortList savedPorts = this->ports;
+	LockedResources savedLocks = this->lockedResources;
+	opdi::PortList oldPorts;
+	opdi::PortList newPorts;
+	std::set<std::string> replaced;
+#ifdef OPENHAT_USE_EXPRTK
+	ExpressionPort::beginSymbolTransaction();
+#endif
+	try {
+		// nodes that look up the IDs of the new ports are replaced in another round
+		size_t previous = 0;
+		while (affected.size() > previous) {
+			previous = affected.size();
+			std::set<std::string> pending;
+			std::set_difference(affected.begin(), affected.end(), replaced.begin(), replaced.end(), std::inserter(pending, pending.end()));
+			for (auto it = pending.begin(), ite = pending.end(); it != ite; ++it) {
+				auto rit = this->rootNodes.find(*it);
+				if (rit == this->rootNodes.end())
+					continue;
+				for (auto pit = rit->second->ports.begin(), pite = rit->second->ports.end(); pit != pite; ++pit) {
+					oldPorts.push_back(*pit);
+					auto lit = std::find(this->ports.begin(), this->ports.end(), *pit);
+					if (lit != this->ports.end())
+						this->ports.erase(lit);
+					this->unlockResources((*pit)->ID());
+				}
+			}
+			this->portListVersion++;
+
+			// set up the nodes in the order of the configuration
+			size_t firstNewPort = newPorts.size();
+			for (auto it = nodes.begin(), ite = nodes.end(); it != ite; ++it) {
+				if (pending.find(*it) == pending.end())
+					continue;
+				RootNode& rootNode = *newNodes[*it];
+				try {
+					this->setupRootNode(configuration, *it, rootNode);
+				} catch (...) {
+					newPorts.insert(newPorts.end(), rootNode.ports.begin(), rootNode.ports.end());
+					throw;
+				}
+				newPorts.insert(newPorts.end(), rootNode.ports.begin(), rootNode.ports.end());
+				if (!rootNode.plugins.empty())
+					throw Poco::ApplicationException("Node " + *it + " contains plugins which cannot be added at runtime, restart required");
+			}
+			replaced.insert(pending.begin(), pending.end());
+
+			for (auto it = newPorts.begin() + firstNewPort, ite = newPorts.end(); it != ite; ++it)
+				changedIDs.insert(Poco::toLower((*it)->ID()));
+			this->addDependentNodes(affected, changedIDs, pluginNodes);
+			checkNodes();
+		}
+
+		// prepare the new ports in the order of the port list
+		this->sortPorts();
+		for (auto it = this->ports.begin(), ite = this->ports.end(); it != ite; ++it)
+			if (std::find(newPorts.begin(), newPorts.end(), *it) != newPorts.end())
+				this->preparePort(*it);
+		this->updatePortList();
+	} catch (Poco::Exception& e) {
+		this->logError("Unable to reload the configuration, keeping the current configuration: " + this->getExceptionMessage(e));
+		// free the new ports before the symbol table that their expressions use
+		this->removePorts(newPorts);
+#ifdef OPENHAT_USE_EXPRTK
+		ExpressionPort::endSymbolTransaction(false);
+#endif
+		this->ports = savedPorts;
+		this->portListVersion++;
+		this->lockedResources = savedLocks;
+		try {
+			this->updatePortList();
+		} catch (Poco::Exception& e) {
+			this->logError("Unable to restore the port list: " + this->getExceptionMessage(e));
+		}
+		return;
+	}
+#ifdef OPENHAT_USE_EXPRTK
+	ExpressionPort::endSymbolTransaction(true);
+#endif
+
+	if (this->configCache != nullptr) {
+		try {
+			this->configCache->save();
+		} catch (Poco::Exception& e) {
+			this->logWarning("Unable to write configuration cache: " + this->getExceptionMessage(e));
+		}
+	}
+
+	// replace the old ports
+	this->removePorts(oldPorts);
+	for (auto it = replaced.begin(), ite = replaced.end(); it != ite; ++it) {
+		auto nit = newNodes.find(*it);
+		if (nit == newNodes.end())
+			this->rootNodes.erase(*it);
+		else
+			this->rootNodes[*it] = nit->second;
+	}
+	for (auto it = newPorts.begin(), ite = newPorts.end(); it != ite; ++it)
+		this->schedulePort(*it);
+
+	// plugins look up the replaced ports again
+	for (auto it = pluginNodes.begin(), ite = pluginNodes.end(); it != ite; ++it) {
+		RootNode* savedReferencingNode = referencingNode;
+		referencingNode = this->rootNodes[*it].get();
+		const RootNode& rootNode = *referencingNode;
+		for (auto pit = rootNode.plugins.begin(), pite = rootNode.plugins.end(); pit != pite; ++pit) {
+			try {
+				pit->second->portsReplaced(this, pit->first);
+			} catch (Poco::Exception& e) {
+				this->logError("Plugin of node " + pit->first + " is unable to look up the replaced ports: " + this->getExceptionMessage(e));
+			}
+		}
+		referencingNode = savedReferencingNode;
+	}
+
+	this->logNormal("Configuration reloaded: " + this->to_string(replaced.size()) + " node(s) changed, "
+		+ this->to_string(oldPorts.size()) + " port(s) removed, " + this->to_string(newPorts.size()) + " port(s) created");
+
+	// the master needs to read the port list again
+	this->reconfigure();
+}
+
 int AbstractOpenHAT::setupConnection(ConfigurationView::Ptr configuration, bool testMode) {
 	this->logVerbose(std::string("Setting up connection for slave: ") + this->slaveName);
 	Poco::AutoPtr<ConfigurationView> config = this->createConfigView(configuration, "Connection");
@@ -1369,6 +2164,51 @@ int AbstractOpenHAT::setupConnection(ConfigurationView::Ptr configuration, bool
 	return OPDI_STATUS_OK;
 }
 
+int AbstractOpenHAT::runBenchmark(uint64_t frames, uint64_t startupMicroseconds) {
+	this->logVerbose("Running benchmark for " + this->to_string(frames) + " frames");
+
+	std::vector<Poco::Timestamp::TimeDiff> frameTimes;
+	frameTimes.reserve((size_t)frames);
+
+	// ports are freed if a port requests a shutdown
+	size_t portCount = this->getPorts().size();
+
+	int result = OPDI_STATUS_OK;
+	Poco::Stopwatch totalStopwatch;
+	Poco::Stopwatch frameStopwatch;
+	totalStopwatch.start();
+	for (uint64_t i = 0; i < frames; i++) {
+		uint8_t sleepTimeMs;
+		frameStopwatch.restart();
+		result = this->doWork(false, &sleepTimeMs);
+		frameTimes.push_back(frameStopwatch.elapsed());
+		if (result != OPDI_STATUS_OK)
+			break;
+	}
+	totalStopwatch.stop();
+
+	std::sort(frameTimes.begin(), frameTimes.end());
+	Poco::Timestamp::TimeDiff total = totalStopwatch.elapsed();
+	size_t count = frameTimes.size();
+	// nearest rank percentile
+	size_t p99 = (count * 99 + 99) / 100;
+
+	std::stringstream json;
+	json << "{\"ports\":" << portCount
+		<< ",\"frames\":" << count
+		<< ",\"startup_ms\":" << startupMicroseconds / 1000.0
+		<< ",\"fps\":" << (total > 0 ? count * 1000000.0 / total : 0.0)
+		<< ",\"frame_avg_us\":" << (count > 0 ? (double)total / count : 0.0)
+		<< ",\"frame_p50_us\":" << (count > 0 ? frameTimes[(count - 1) / 2] : 0)
+		<< ",\"frame_p99_us\":" << (count > 0 ? frameTimes[p99 - 1] : 0)
+		<< ",\"frame_max_us\":" << (count > 0 ? frameTimes.back() : 0)
+		<< ",\"peak_rss_kb\":" << this->getPeakMemoryUsage() / 1024
+		<< "}";
+	this->println(json.str());
+
+	return result;
+}
+
 void AbstractOpenHAT::warnIfPluginMoreRecent(const std::string& driver) {
 	// parse compile date and time
     std::stringstream compiled;
@@ -1406,7 +2246,27 @@ uint8_t AbstractOpenHAT::doWork(uint8_t canSend, uint8_t* sleepTimeMs) {
 
 	// exception-safe processing
 	try {
+		// notify ports about modified files and expired timers before they do their work
+		FileWatcher::get().dispatchEvents();
+		TimerWheel::get().advance();
+
 		result = OPDI::doWork(canSend, sleepTimeMs);
+
+		// start requested processes and notify ports about output and terminated processes
+		ProcessSupervisor::get().dispatchEvents();
+
+		// a simulated clock must not skip the next timer
+		if (opdi::Clock::get().isSimulated()) {
+			uint64_t nextDueMs = TimerWheel::get().getNextDueMs();
+			if (nextDueMs != UINT64_MAX)
+				opdi::Clock::get().addDeadlineMs(nextDueMs);
+		}
+
+		// configuration reload requested (e. g. by a signal)?
+		if ((result == OPDI_STATUS_OK) && this->reloadRequested && this->prepared && !this->shutdownRequested) {
+			this->reloadRequested = false;
+			this->reloadConfiguration();
+		}
 	} catch (Poco::Exception &pe) {
 		this->logError(std::string("Unhandled exception while housekeeping: ") + this->getExceptionMessage(pe));
 		result = OPDI_STATUS_OK;	// not critical
@@ -1470,6 +2330,9 @@ uint8_t AbstractOpenHAT::doWork(uint8_t canSend, uint8_t* sleepTimeMs) {
 		}
 	}
 
+	// a simulated clock advances to the next deadline that has been registered during this iteration
+	opdi::Clock::get().advance();
+
 	// restart idle stopwatch to measure time until doWork() is called again
 	this->idleStopwatch.restart();
 
@@ -1537,11 +2400,11 @@ void AbstractOpenHAT::savePersistentConfig() {
 		return;
 
     // avoid saving too often (performance)
-    if (this->shutdownRequested || (opdi_get_time_ms() - this->lastPersistentConfigSave > 10000)) {
+    if (this->shutdownRequested || (opdi::Clock::get().getTimeMs() - this->lastPersistentConfigSave > 10000)) {
 	    this->persistentConfig->setString("LastChange", this->getTimestampStr());
 	    this->persistentConfig->save(this->persistentConfigFile);
 
-        this->lastPersistentConfigSave = opdi_get_time_ms();
+        this->lastPersistentConfigSave = opdi::Clock::get().getTimeMs();
     }
 }
 
@@ -1706,6 +2569,7 @@ std::string AbstractOpenHAT::getExceptionMessage(const std::exception& e) {
 }
 
 void AbstractOpenHAT::logConfigKeyAccess(const std::string& message) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
 	if (this->lastConfigKeyAccessMessage == message)
 		return;
 	this->lastConfigKeyAccessMessage = message;
@@ -1,13 +1,20 @@
 #pragma once
 
+#include <atomic>
 #include <sstream>
 #include <list>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
 
 #include "Poco/Mutex.h"
 #include "Poco/Util/AbstractConfiguration.h"
 #include "Poco/Util/PropertyFileConfiguration.h"
 #include "Poco/Logger.h"
 #include "Poco/Stopwatch.h"
+#include "Poco/Thread.h"
+#include "Poco/Runnable.h"
 #include "Poco/BasicEvent.h"
 #include "Poco/Delegate.h"
 #include "Poco/Exception.h"
@@ -18,6 +25,7 @@
 #include "OPDI.h"
 
 #include "Configuration.h"
+#include "AstroTable.h"
 
 // protocol callback function for the OPDI slave implementation
 extern void protocol_callback(uint8_t state);
@@ -37,6 +45,21 @@ struct IOpenHATPlugin {
 	virtual void setupPlugin(openhat::AbstractOpenHAT* openHAT, const std::string& nodeName, openhat::ConfigurationView::Ptr nodeConfig, openhat::ConfigurationView::Ptr parentConfig, const std::string& driverPath) = 0;
 
         virtual void terminate(void) {};
+
+	/// Returns true if setupPlugin() may run concurrently with the setup of other plugins.
+	/// Consecutive plugin nodes that support this are set up in parallel; their ports are added
+	/// after all of them have completed, in the order of the plugin nodes. The setup must not
+	/// depend on ports of other plugins.
+	virtual bool supportsParallelSetup(void) { return false; }
+
+	/// Returns true if the plugin can look up the ports that it refers to again when the configuration
+	/// is reloaded (see portsReplaced()). If a reload replaces ports that the plugin refers to and the
+	/// plugin does not support this, the configuration is not reloaded.
+	virtual bool supportsReload(void) { return false; }
+
+	/// Called after the configuration has been reloaded if ports that the plugin has looked up have been
+	/// replaced. The previous ports have been freed; the plugin must look up the ports again.
+	virtual void portsReplaced(openhat::AbstractOpenHAT* /*openHAT*/, const std::string& /*nodeName*/) {}
         
 	// virtual destructor (called when the plugin is deleted)
 	virtual ~IOpenHATPlugin() {}
@@ -50,6 +73,9 @@ namespace openhat {
 
 #define OPENHAT_CONFIG_FILE_SETTING	"__OPENHATD_CONFIG_FILE_PATH"
 
+// maximum time in milliseconds that a simulated clock advances per doWork iteration
+#define DEFAULT_SIMULATION_MAX_STEP_MS	1000
+
 constexpr char OPENHAT_VERSION_ID[] =
 #include "VERSION"
 ;
@@ -131,6 +157,64 @@ protected:
 
 	std::string heartbeatFile;
 
+	opdi::SimulatedClock* simulatedClock;	// only set in simulated time mode
+
+	ConfigurationCache* configCache;		// only set if a configuration cache file is specified
+
+	std::string configFile;					// main configuration file
+	std::atomic<bool> reloadRequested;	// set by the SIGHUP handler (lock-free)
+
+	// a top-level node of the main configuration file; used to determine the changes when reloading the configuration
+	struct RootNode {
+		std::string type;
+		std::string settings;						// settings of the node and of its referenced sections
+		std::map<std::string, std::string> files;	// stamps of configuration files read while setting up the node, by path
+		opdi::PortList ports;						// ports created by the node
+		std::set<std::string> references;			// lower case IDs of the ports that have been looked up by the node
+		bool usesPatterns;							// ports have been looked up by a pattern (*, id=, group=, tag=)
+		std::vector<std::pair<std::string, IOpenHATPlugin*> > plugins;	// plugins set up by the node, by plugin node
+
+		RootNode() : usesPatterns(false) {}
+	};
+	typedef std::map<std::string, std::shared_ptr<RootNode> > RootNodes;
+	RootNodes rootNodes;
+	RootNode* currentRootNode;				// the top-level node that is being set up
+	std::unordered_map<opdi::Port*, RootNode*> portNodes;	// the top-level node of each port
+	static thread_local RootNode* referencingNode;	// the node whose port lookups are recorded
+	Poco::FastMutex referencesMutex;		// plugins of the same node may look up ports in parallel
+	std::string globalSettings;				// settings of the General and Connection sections
+
+	// startup profile: wall time of nodes, includes and plugins
+	struct ProfileEntry {
+		std::string kind;
+		std::string name;
+		int depth;								// include nesting level
+		Poco::Timestamp::TimeDiff elapsed;		// microseconds
+		bool parallel;
+	};
+	std::vector<ProfileEntry> startupProfile;
+	int profileDepth;
+	bool profiling;							// entries are only recorded if --profile has been specified
+
+	// setup of a plugin that runs in a separate thread
+	class PluginSetup : public Poco::Runnable {
+	public:
+		AbstractOpenHAT* openhat;
+		IOpenHATPlugin* plugin;
+		std::string node;
+		ConfigurationView::Ptr nodeConfig;
+		ConfigurationView::Ptr parentConfig;
+		std::string driver;
+		RootNode* rootNode;						// top-level node that the plugin belongs to
+		opdi::PortList ports;					// ports that have been added by the plugin
+		Poco::Timestamp::TimeDiff elapsed;
+		std::unique_ptr<Poco::Exception> error;
+		Poco::Thread thread;
+
+		virtual void run(void) override;
+	};
+	std::vector<std::unique_ptr<PluginSetup> > pluginSetups;
+
 	bool suppressUnusedParameterMessages;
 	std::string lastConfigKeyAccessMessage;		// used to suppress subsequent identical messages from nested configurations
 
@@ -138,6 +222,49 @@ protected:
 
 	virtual ConfigurationView::Ptr readConfiguration(const std::string& fileName, const std::map<std::string, std::string>& parameters);
 
+	/** Appends the settings of the specified section and its sub-sections as key=value lines.
+	 *  If references is specified it receives the keys of the sub-sections. */
+	virtual void getSectionSettings(ConfigurationView::Ptr config, const std::string& section, std::string& settings, std::vector<std::string>* references);
+
+	/** Returns the settings of the specified node, including sections that are referenced by the node's sub-sections
+	 *  (such as Timer schedules or Aggregator calculations). */
+	virtual std::string getNodeSettings(ConfigurationView::Ptr config, const std::string& node);
+
+	/** Returns the active nodes of the Root section, ordered by priority. */
+	virtual void getRootNodes(ConfigurationView::Ptr config, std::vector<std::string>& nodes);
+
+	/** Sets up a top-level node and records its settings, configuration files and ports in rootNode. */
+	virtual void setupRootNode(ConfigurationView::Ptr config, const std::string& node, RootNode& rootNode);
+
+	/** Loads the plugin of the specified node and sets it up, in a separate thread if the plugin supports it. */
+	virtual void setupPlugin(ConfigurationView::Ptr nodeConfig, ConfigurationView::Ptr parentConfig, const std::string& node);
+
+	/** Waits for the plugin setups that run in parallel and adds their ports in the order of the plugin nodes.
+	 *  The ports of all setups are added, then the exception of the first failed setup is thrown. */
+	virtual void completePluginSetups(void);
+
+	/** Adds an entry to the startup profile and returns its index. Returns SIZE_MAX if profiling is disabled. */
+	size_t addProfileEntry(const std::string& kind, const std::string& name);
+
+	/** Sets the wall time of the specified entry of the startup profile (if it exists). */
+	void setProfileElapsed(size_t entry, Poco::Timestamp::TimeDiff elapsed, bool parallel = false);
+
+	/** Logs the startup profile. */
+	virtual void logStartupProfile(Poco::Timestamp::TimeDiff startupMicroseconds);
+
+	/** Shuts down and frees the specified ports. */
+	virtual void removePorts(const opdi::PortList& ports);
+
+	/** Adds the nodes that have looked up ports with the specified IDs (or ports by a pattern) to affected,
+	 *  and the IDs of their ports to changedIDs. Nodes with plugins are added to pluginNodes instead;
+	 *  their plugins have to look up the ports again. */
+	virtual void addDependentNodes(std::set<std::string>& affected, std::set<std::string>& changedIDs, std::set<std::string>& pluginNodes);
+
+	/** Reads the main configuration file again and sets up the nodes that have changed, have been added or removed,
+	 *  and the nodes that refer to ports of these nodes. The new ports are prepared before they replace the old ones;
+	 *  if this fails the current configuration is kept. Other ports continue to run. */
+	virtual void reloadConfiguration(void);
+
 	/** Outputs a log message with a timestamp. */
 	virtual void log(const std::string& text);
 
@@ -179,6 +306,20 @@ public:
 
 	virtual void showHelp(void);
 
+	/** Adds the port to the port list. Throws an exception if a port with the same ID exists.
+	 *  Ports that are added by plugins during a parallel setup are collected and added when
+	 *  the setup has completed. */
+	virtual void addPort(opdi::Port* port) override;
+
+	/** Prepares the port and records the ports that it looks up for its top-level node. */
+	virtual void preparePort(opdi::Port* port) override;
+
+	/** Returns the port with the specified ID, or nullptr. Records the lookup while a node is set up or prepared. */
+	virtual opdi::Port* findPortByID(const char* portID, bool caseInsensitive = false) override;
+
+	/** Returns the IDs of the ports that match the specification. Records the lookup while a node is set up or prepared. */
+	virtual void findPortIDs(const std::string& spec, std::vector<std::string>& results) override;
+
 	/** Returns the current frame number. */
 	virtual uint64_t getCurrentFrame(void);
 
@@ -188,6 +329,13 @@ public:
 	/** Modify the current process credentials to a less privileged user. */
 	virtual void switchToUser(const std::string& newUser) = 0;
 
+	/** Returns the peak resident set size of the process in bytes, or 0 if it can't be determined. */
+	virtual uint64_t getPeakMemoryUsage(void) = 0;
+
+	/** Returns the table of astronomical events. Plugins link their own copy of the AstroTable class;
+	 *  they must use this method so that all ports share the table of openhatd. */
+	virtual AstroTable& getAstroTable(void);
+
 	virtual std::string getTimestampStr(void);
 
 	virtual std::string getResultCodeText(uint8_t code);
@@ -215,6 +363,13 @@ public:
 	 *  Use this mechanism to avoid resource conflicts. */
 	virtual void lockResource(const std::string& resourceID, const std::string& lockerID);
 
+	/** Releases all resources locked by the specified locker. */
+	virtual void unlockResources(const std::string& lockerID);
+
+	/** Requests reloading the configuration file. The configuration is reloaded in the next doWork iteration.
+	 *  This method may be called from a signal handler. */
+	virtual void requestReload(void);
+
 	virtual opdi::LogVerbosity getConfigLogVerbosity(ConfigurationView::Ptr config, opdi::LogVerbosity defaultVerbosity);
 
 	/** Creates a configuration view with the specified view name. */
@@ -251,6 +406,33 @@ public:
 	/** Reads common properties from the configuration and configures the port. */
 	virtual void configurePort(ConfigurationView::Ptr portConfig, opdi::Port* port, int defaultFlags);
 
+	/** The state settings of a port (Mode, Line, Resolution, Value or Position) as specified by a configuration. */
+	struct PortState {
+		bool hasMode;
+		uint8_t mode;
+		bool hasLine;
+		uint8_t line;
+		bool hasResolution;
+		uint8_t resolution;
+		// analog value, select position or dial position
+		bool hasValue;
+		int64_t value;
+
+		PortState();
+
+		/** Replaces the settings that are specified by other. */
+		void merge(const PortState& other);
+	};
+
+	/** Reads the state settings of the port from the configuration. Throws an exception if a setting is invalid. */
+	virtual void readPortState(Poco::Util::AbstractConfiguration::Ptr stateConfig, opdi::Port* port, PortState& state);
+
+	/** Applies the state settings to the port. Throws an exception if a select position is out of range. */
+	virtual void applyPortState(opdi::Port* port, const PortState& state);
+
+	/** Replaces the state settings by the states that have been persisted for the port, if any. */
+	virtual void mergePersistentState(opdi::Port* port, PortState& state);
+
 	/** Reads special properties from the configuration and configures the digital port. */
 	virtual void configureDigitalPort(ConfigurationView::Ptr portConfig, opdi::DigitalPort* port, bool stateOnly = false);
 
@@ -295,6 +477,10 @@ public:
 	/** Sets up the connection from "Connection" section of the specified configuration. */
 	virtual int setupConnection(ConfigurationView::Ptr configuration, bool testMode);
 
+	/** Runs the doWork loop for the specified number of frames without a connection and without sleeping.
+	*   Prints the measured statistics as a JSON object. */
+	virtual int runBenchmark(uint64_t frames, uint64_t startupMicroseconds);
+
 	/** Sets up a TCP listener and listens for incoming requests. This method does not return unless the program should exit. */
 	virtual int setupTCP(const std::string& interface_, int port) = 0;
 
@@ -327,6 +513,9 @@ public:
 
 	virtual void getEnvironment(std::map<std::string, std::string>& mapToFill);
 
+	/** Returns a string that changes if the file is modified; empty if the file does not exist. */
+	virtual std::string getFileStamp(const std::string& path);
+
 	virtual std::string getExceptionMessage(const std::exception& e);
 
 	virtual std::string getExceptionMessage(const Poco::Exception& e);
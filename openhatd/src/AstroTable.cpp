@@ -0,0 +1,110 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "AstroTable.h"
+
+#include <cmath>
+
+#include "Poco/DateTime.h"
+#include "Poco/LocalDateTime.h"
+
+#include "SunRiseSet.h"
+
+namespace openhat {
+
+#define SECONDS_PER_DAY		86400
+
+AstroTable& AstroTable::get(void) {
+	static AstroTable instance;
+	return instance;
+}
+
+bool AstroTable::parseEvent(const std::string& name, Event* event) {
+	static const char* names[EVENT_COUNT] = { "Sunrise", "Sunset", "CivilDawn", "CivilDusk",
+		"NauticalDawn", "NauticalDusk", "AstronomicalDawn", "AstronomicalDusk" };
+	for (int i = 0; i < EVENT_COUNT; i++) {
+		if (name == names[i]) {
+			*event = (Event)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+int AstroTable::getUtcOffset(const Poco::Timestamp& time) {
+	// the local time determines whether daylight saving time is in effect at this time
+	Poco::DateTime utc(time);
+	Poco::LocalDateTime local(utc);
+	return local.tzd();
+}
+
+int64_t AstroTable::getLocalDay(const Poco::Timestamp& time) {
+	int64_t seconds = time.epochMicroseconds() / Poco::Timestamp::resolution() + getUtcOffset(time);
+	// round towards negative infinity
+	return (seconds >= 0 ? seconds : seconds - SECONDS_PER_DAY + 1) / SECONDS_PER_DAY;
+}
+
+void AstroTable::calculate(double latitude, double longitude, int64_t localDay, Day& day) {
+	static const double zeniths[EVENT_COUNT / 2] = { 90.833, 96, 102, 108 };
+
+	// the calendar date of the local day
+	Poco::DateTime date(Poco::Timestamp(localDay * SECONDS_PER_DAY * Poco::Timestamp::resolution()));
+	CSunRiseSet sunRiseSet;
+	for (int i = 0; i < EVENT_COUNT; i++) {
+		// even events are rises, odd events are sets
+		// the calculation expects longitudes west of Greenwich to be positive
+		double minutes = sunRiseSet.GetEventGMT(latitude, -longitude, date.year(), date.month(), date.day(), zeniths[i / 2], i % 2 == 0);
+		if (std::isnan(minutes))
+			day.times[i] = NO_EVENT;
+		else
+			// use full seconds (like CSunRiseSet::GetSunrise)
+			day.times[i] = (localDay * SECONDS_PER_DAY + (int64_t)(minutes * 60)) * Poco::Timestamp::resolution();
+	}
+}
+
+const AstroTable::Day& AstroTable::getDay(double latitude, double longitude, int64_t localDay) {
+	Location& location = this->locations[std::make_pair(latitude, longitude)];
+	if (location.days.empty() || (localDay < location.firstDay) || (localDay >= location.firstDay + (int64_t)location.days.size())) {
+		// calculate a year ahead; keep the previous day for times shortly after midnight
+		location.firstDay = localDay - 1;
+		location.days.resize(DAYS_AHEAD + 1);
+		for (int i = 0; i <= DAYS_AHEAD; i++)
+			calculate(latitude, longitude, location.firstDay + i, location.days[i]);
+	}
+	return location.days[(size_t)(localDay - location.firstDay)];
+}
+
+bool AstroTable::getEvent(double latitude, double longitude, Event event, const Poco::Timestamp& day, Poco::Timestamp* result) {
+	Poco::FastMutex::ScopedLock lock(this->mutex);
+
+	int64_t time = this->getDay(latitude, longitude, getLocalDay(day)).times[event];
+	if (time == NO_EVENT)
+		return false;
+	*result = Poco::Timestamp(time);
+	return true;
+}
+
+bool AstroTable::getNextEvent(double latitude, double longitude, Event event, const Poco::Timestamp& time, Poco::Timestamp* result) {
+	Poco::FastMutex::ScopedLock lock(this->mutex);
+
+	int64_t localDay = getLocalDay(time);
+	for (int i = 0; i < DAYS_AHEAD; i++) {
+		int64_t eventTime = this->getDay(latitude, longitude, localDay + i).times[event];
+		if ((eventTime != NO_EVENT) && (eventTime > time.epochMicroseconds())) {
+			*result = Poco::Timestamp(eventTime);
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t AstroTable::getLocationCount(void) {
+	Poco::FastMutex::ScopedLock lock(this->mutex);
+	return this->locations.size();
+}
+
+}		// namespace openhat
@@ -0,0 +1,93 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Poco/Mutex.h"
+#include "Poco/Timestamp.h"
+
+namespace openhat {
+
+/// A table of the times of sunrise, sunset and twilight per location and day that is shared by
+/// all users in the process (Timer ports, Astro ports and expressions, also those of plugins). The times of a location
+/// are calculated once for a year ahead when the location is first used or when a day outside
+/// of the calculated range is requested. Days are local calendar days; the times are UTC.
+/// The methods are thread-safe.
+class AstroTable {
+public:
+	enum Event {
+		SUNRISE,
+		SUNSET,
+		CIVIL_DAWN,
+		CIVIL_DUSK,
+		NAUTICAL_DAWN,
+		NAUTICAL_DUSK,
+		ASTRONOMICAL_DAWN,
+		ASTRONOMICAL_DUSK,
+		EVENT_COUNT
+	};
+
+	/// Returns the instance of the module. Plugins link their own copy of this class and must
+	/// use AbstractOpenHAT::getAstroTable() to share the instance of openhatd.
+	static AstroTable& get(void);
+
+	/// Returns the offset of the local time zone from UTC in seconds that is in effect at the
+	/// specified time, including daylight saving time.
+	static int getUtcOffset(const Poco::Timestamp& time);
+
+	/// Returns the event for the specified name (e. g. "Sunrise" or "CivilDusk").
+	/// Returns false if the name is unknown.
+	static bool parseEvent(const std::string& name, Event* event);
+
+	/// Retrieves the time of the event on the local day that contains the specified time.
+	/// Returns false if the event does not occur on this day (polar day or night).
+	bool getEvent(double latitude, double longitude, Event event, const Poco::Timestamp& day, Poco::Timestamp* result);
+
+	/// Retrieves the first occurrence of the event that is later than the specified time.
+	/// Returns false if the event does not occur within a year.
+	bool getNextEvent(double latitude, double longitude, Event event, const Poco::Timestamp& time, Poco::Timestamp* result);
+
+	/// Returns the number of locations in the table.
+	size_t getLocationCount(void);
+
+protected:
+	// number of days that are calculated in advance
+	static const int DAYS_AHEAD = 366;
+
+	// marks events that do not occur on a day
+	static const int64_t NO_EVENT = INT64_MIN;
+
+	struct Day {
+		int64_t times[EVENT_COUNT];		// microseconds since the epoch (UTC)
+	};
+
+	struct Location {
+		int64_t firstDay;				// local day number of the first entry
+		std::vector<Day> days;
+	};
+
+	Poco::FastMutex mutex;
+	std::map<std::pair<double, double>, Location> locations;
+
+	AstroTable() {};
+
+	// returns the number of the local day that contains the specified time
+	static int64_t getLocalDay(const Poco::Timestamp& time);
+
+	// returns the entry of the specified day, calculating the table if necessary
+	const Day& getDay(double latitude, double longitude, int64_t localDay);
+
+	static void calculate(double latitude, double longitude, int64_t localDay, Day& day);
+};
+
+}		// namespace openhat
@@ -0,0 +1,476 @@
+#include "BinaryLog.h"
+
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#include "Poco/File.h"
+
+namespace openhat {
+
+namespace {
+
+void writeVarint(std::string& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back((char)((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+uint64_t readVarint(const char* data, size_t size, size_t& pos) {
+	uint64_t result = 0;
+	int shift = 0;
+	while (pos < size && shift < 64) {
+		uint8_t b = (uint8_t)data[pos++];
+		result |= (uint64_t)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0)
+			return result;
+		shift += 7;
+	}
+	throw Poco::DataFormatException("Invalid or truncated varint in binary log");
+}
+
+void writeFixed(std::string& out, uint64_t value, int bytes) {
+	for (int i = 0; i < bytes; i++)
+		out.push_back((char)((value >> (i * 8)) & 0xFF));
+}
+
+uint64_t readFixed(const char* data, int bytes) {
+	uint64_t result = 0;
+	for (int i = 0; i < bytes; i++)
+		result |= (uint64_t)(uint8_t)data[i] << (i * 8);
+	return result;
+}
+
+uint64_t zigzag(int64_t value) {
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+	return (int64_t)((value >> 1) ^ (~(value & 1) + 1));
+}
+
+uint64_t doubleBits(double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+double bitsDouble(uint64_t bits) {
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// moves the high order bytes (sign, exponent, high mantissa bits) to the low end
+uint64_t swapBytes(uint64_t value) {
+	uint64_t result = 0;
+	for (int i = 0; i < 8; i++) {
+		result = (result << 8) | (value & 0xFF);
+		value >>= 8;
+	}
+	return result;
+}
+
+}	// end anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// BinaryLogWriter
+///////////////////////////////////////////////////////////////////////////////
+
+BinaryLogWriter::BinaryLogWriter(const std::vector<std::string>& columns, size_t blockRows) : columns(columns), values(columns.size()) {
+	this->blockRows = (blockRows > 0 ? blockRows : 1);
+}
+
+std::string BinaryLogWriter::getSegmentHeader(void) const {
+	std::string result(binarylog::SEGMENT_MAGIC, 4);
+	result.push_back((char)binarylog::VERSION);
+	writeVarint(result, this->columns.size());
+	auto ite = this->columns.cend();
+	for (auto it = this->columns.cbegin(); it != ite; ++it) {
+		writeVarint(result, it->size());
+		result.append(*it);
+	}
+	return result;
+}
+
+void BinaryLogWriter::addRow(int64_t timestamp, const std::vector<double>& rowValues) {
+	if (rowValues.size() != this->columns.size())
+		throw Poco::InvalidArgumentException("Number of values does not match the number of binary log columns");
+	this->timestamps.push_back(timestamp);
+	for (size_t i = 0; i < rowValues.size(); i++)
+		this->values[i].push_back(rowValues[i]);
+}
+
+size_t BinaryLogWriter::getRowCount(void) const {
+	return this->timestamps.size();
+}
+
+bool BinaryLogWriter::isBlockFull(void) const {
+	return this->timestamps.size() >= this->blockRows;
+}
+
+std::string BinaryLogWriter::encodeBlock(void) {
+	if (this->timestamps.empty())
+		return "";
+
+	std::string payload;
+	payload.reserve(this->timestamps.size() * (1 + this->columns.size() * 2));
+
+	// timestamp column
+	int64_t previous = 0;
+	auto ite = this->timestamps.cend();
+	for (auto it = this->timestamps.cbegin(); it != ite; ++it) {
+		writeVarint(payload, zigzag((int64_t)((uint64_t)*it - (uint64_t)previous)));
+		previous = *it;
+	}
+
+	// value columns
+	for (size_t c = 0; c < this->values.size(); c++) {
+		uint64_t previousBits = 0;
+		auto vite = this->values[c].cend();
+		for (auto vit = this->values[c].cbegin(); vit != vite; ++vit) {
+			uint64_t bits = doubleBits(*vit);
+			writeVarint(payload, swapBytes(bits ^ previousBits));
+			previousBits = bits;
+		}
+		this->values[c].clear();
+	}
+
+	std::string result(binarylog::BLOCK_MAGIC, 4);
+	writeFixed(result, payload.size(), 4);
+	writeFixed(result, this->timestamps.size(), 4);
+	writeFixed(result, (uint64_t)this->timestamps.front(), 8);
+	writeFixed(result, (uint64_t)this->timestamps.back(), 8);
+	result.append(payload);
+
+	this->timestamps.clear();
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// BinaryLogIndex
+///////////////////////////////////////////////////////////////////////////////
+
+BinaryLogIndex::BinaryLogIndex(void) {
+	this->reset(0);
+}
+
+void BinaryLogIndex::reset(uint64_t startOffset) {
+	this->startOffset = startOffset;
+	this->offset = startOffset;
+	this->segmentOffsets.clear();
+	this->blockEntries.clear();
+	this->blockCount = 0;
+}
+
+void BinaryLogIndex::add(const std::string& record) {
+	if ((record.size() >= 4) && (memcmp(record.data(), binarylog::SEGMENT_MAGIC, 4) == 0))
+		this->segmentOffsets.push_back(this->offset);
+	else
+	if ((record.size() >= binarylog::BLOCK_HEADER_SIZE) && (memcmp(record.data(), binarylog::BLOCK_MAGIC, 4) == 0)) {
+		writeFixed(this->blockEntries, this->offset, 8);
+		// payload size, row count and time range are copied from the block header
+		this->blockEntries.append(record, 4, binarylog::BLOCK_HEADER_SIZE - 4);
+		++this->blockCount;
+	}
+	this->offset += record.size();
+}
+
+bool BinaryLogIndex::isEmpty(void) const {
+	return this->segmentOffsets.empty() && (this->blockCount == 0);
+}
+
+std::string BinaryLogIndex::encode(void) const {
+	std::string body;
+	writeFixed(body, this->startOffset, 8);
+	writeFixed(body, this->segmentOffsets.size(), 4);
+	writeFixed(body, this->blockCount, 4);
+	auto ite = this->segmentOffsets.cend();
+	for (auto it = this->segmentOffsets.cbegin(); it != ite; ++it)
+		writeFixed(body, *it, 8);
+	body.append(this->blockEntries);
+
+	std::string result(binarylog::INDEX_MAGIC, 4);
+	writeFixed(result, body.size(), 4);
+	result.append(body);
+	// the trailer points to the index record which starts at the current end of the file
+	result.append(binarylog::TRAILER_MAGIC, 4);
+	writeFixed(result, this->offset, 8);
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// BinaryLogReader
+///////////////////////////////////////////////////////////////////////////////
+
+BinaryLogReader::BinaryLogReader(const std::string& fileName) {
+	this->data = nullptr;
+	this->size = 0;
+	this->truncated = false;
+
+	Poco::File file(fileName);
+	if (file.getSize() == 0)
+		throw Poco::DataFormatException("Binary log file is empty: " + fileName);
+
+	Poco::SharedMemory mem(file, Poco::SharedMemory::AM_READ);
+	this->memory.swap(mem);
+	this->data = this->memory.begin();
+	this->size = this->memory.end() - this->memory.begin();
+
+	if (this->size < 4 || memcmp(this->data, binarylog::SEGMENT_MAGIC, 4) != 0)
+		throw Poco::DataFormatException("Not a binary log file: " + fileName);
+
+	this->buildIndex();
+}
+
+void BinaryLogReader::buildIndex(void) {
+	// follow the trailers from the end of the file to the part that has not been closed properly
+	std::vector<size_t> indexOffsets;
+	size_t end = this->size;
+	size_t indexOffset;
+	while ((indexOffset = this->findIndex(end)) > 0) {
+		indexOffsets.push_back(indexOffset);
+		end = (size_t)readFixed(this->data + indexOffset + binarylog::INDEX_HEADER_SIZE, 8);
+	}
+
+	this->scan(0, end);
+
+	auto ite = indexOffsets.crend();
+	for (auto it = indexOffsets.crbegin(); it != ite; ++it)
+		this->readIndex(*it);
+}
+
+bool BinaryLogReader::readSegment(size_t& pos) {
+	pos += 4;
+	if (pos >= this->size)
+		return false;
+	uint8_t version = (uint8_t)this->data[pos++];
+	if ((version < 1) || (version > binarylog::VERSION))
+		throw Poco::DataFormatException("Unsupported binary log version: " + std::to_string((int)version));
+	Segment segment;
+	try {
+		uint64_t count = readVarint(this->data, this->size, pos);
+		for (uint64_t i = 0; i < count; i++) {
+			uint64_t length = readVarint(this->data, this->size, pos);
+			if (pos + length > this->size)
+				throw Poco::DataFormatException("Truncated column name");
+			segment.columns.push_back(std::string(this->data + pos, (size_t)length));
+			pos += (size_t)length;
+		}
+	} catch (Poco::DataFormatException&) {
+		// a segment header that has been partially written
+		return false;
+	}
+	this->segments.push_back(segment);
+	return true;
+}
+
+void BinaryLogReader::scan(size_t from, size_t to) {
+	size_t pos = from;
+	while (pos + 4 <= to) {
+		if (memcmp(this->data + pos, binarylog::SEGMENT_MAGIC, 4) == 0) {
+			if (!this->readSegment(pos) || (pos > to)) {
+				this->truncated = true;
+				break;
+			}
+		} else
+		if (memcmp(this->data + pos, binarylog::BLOCK_MAGIC, 4) == 0) {
+			if (this->segments.empty())
+				throw Poco::DataFormatException("Binary log block without segment header at offset " + std::to_string(pos));
+			if (pos + binarylog::BLOCK_HEADER_SIZE > to) {
+				this->truncated = true;
+				break;
+			}
+			Block block;
+			block.segment = this->segments.size() - 1;
+			block.payloadSize = (size_t)readFixed(this->data + pos + 4, 4);
+			block.rowCount = (uint32_t)readFixed(this->data + pos + 8, 4);
+			block.firstTimestamp = (int64_t)readFixed(this->data + pos + 12, 8);
+			block.lastTimestamp = (int64_t)readFixed(this->data + pos + 20, 8);
+			block.offset = pos + binarylog::BLOCK_HEADER_SIZE;
+			if (block.offset + block.payloadSize > to) {
+				this->truncated = true;
+				break;
+			}
+			this->blocks.push_back(block);
+			// skip payload
+			pos = block.offset + block.payloadSize;
+		} else
+		if (memcmp(this->data + pos, binarylog::INDEX_MAGIC, 4) == 0) {
+			// index record of a part that has been appended to later
+			if (pos + binarylog::INDEX_HEADER_SIZE > to) {
+				this->truncated = true;
+				break;
+			}
+			pos += binarylog::INDEX_HEADER_SIZE + (size_t)readFixed(this->data + pos + 4, 4);
+		} else
+		if (memcmp(this->data + pos, binarylog::TRAILER_MAGIC, 4) == 0)
+			pos += binarylog::TRAILER_SIZE;
+		else
+			throw Poco::DataFormatException("Invalid binary log record at offset " + std::to_string(pos));
+	}
+	if ((pos < to) && !this->truncated)
+		this->truncated = true;
+}
+
+size_t BinaryLogReader::findIndex(size_t end) const {
+	if (end < binarylog::INDEX_HEADER_SIZE + 16 + binarylog::TRAILER_SIZE)
+		return 0;
+	const char* trailer = this->data + end - binarylog::TRAILER_SIZE;
+	if (memcmp(trailer, binarylog::TRAILER_MAGIC, 4) != 0)
+		return 0;
+	uint64_t offset = readFixed(trailer + 4, 8);
+	// the index record must end exactly at the trailer
+	if ((offset == 0) || (offset + binarylog::INDEX_HEADER_SIZE + 16 > end - binarylog::TRAILER_SIZE))
+		return 0;
+	if (memcmp(this->data + offset, binarylog::INDEX_MAGIC, 4) != 0)
+		return 0;
+	uint64_t bodySize = readFixed(this->data + offset + 4, 4);
+	if (offset + binarylog::INDEX_HEADER_SIZE + bodySize != end - binarylog::TRAILER_SIZE)
+		return 0;
+	const char* body = this->data + offset + binarylog::INDEX_HEADER_SIZE;
+	uint64_t startOffset = readFixed(body, 8);
+	uint64_t segmentCount = readFixed(body + 8, 4);
+	uint64_t blockCount = readFixed(body + 12, 4);
+	if ((startOffset >= offset) || (16 + segmentCount * 8 + blockCount * binarylog::INDEX_BLOCK_SIZE != bodySize))
+		return 0;
+	return (size_t)offset;
+}
+
+void BinaryLogReader::readIndex(size_t offset) {
+	const char* body = this->data + offset + binarylog::INDEX_HEADER_SIZE;
+	uint32_t segmentCount = (uint32_t)readFixed(body + 8, 4);
+	uint32_t blockCount = (uint32_t)readFixed(body + 12, 4);
+	const char* segmentEntries = body + 16;
+	const char* blockEntries = segmentEntries + segmentCount * 8;
+
+	uint32_t s = 0;
+	for (uint32_t b = 0; b <= blockCount; b++) {
+		size_t headerOffset = (b < blockCount ? (size_t)readFixed(blockEntries + b * binarylog::INDEX_BLOCK_SIZE, 8) : offset);
+		// read the segment headers that precede the block
+		while ((s < segmentCount) && (readFixed(segmentEntries + s * 8, 8) < headerOffset)) {
+			size_t pos = (size_t)readFixed(segmentEntries + s * 8, 8);
+			if ((pos + 4 > offset) || (memcmp(this->data + pos, binarylog::SEGMENT_MAGIC, 4) != 0) || !this->readSegment(pos))
+				throw Poco::DataFormatException("Invalid segment in binary log index at offset " + std::to_string(offset));
+			++s;
+		}
+		if (b == blockCount)
+			break;
+		if (this->segments.empty())
+			throw Poco::DataFormatException("Binary log block without segment header at offset " + std::to_string(headerOffset));
+		const char* entry = blockEntries + b * binarylog::INDEX_BLOCK_SIZE;
+		Block block;
+		block.segment = this->segments.size() - 1;
+		block.payloadSize = (size_t)readFixed(entry + 8, 4);
+		block.rowCount = (uint32_t)readFixed(entry + 12, 4);
+		block.firstTimestamp = (int64_t)readFixed(entry + 16, 8);
+		block.lastTimestamp = (int64_t)readFixed(entry + 24, 8);
+		block.offset = headerOffset + binarylog::BLOCK_HEADER_SIZE;
+		if (block.offset + block.payloadSize > offset)
+			throw Poco::DataFormatException("Invalid block in binary log index at offset " + std::to_string(offset));
+		this->blocks.push_back(block);
+	}
+}
+
+const std::vector<BinaryLogReader::Segment>& BinaryLogReader::getSegments(void) const {
+	return this->segments;
+}
+
+const std::vector<BinaryLogReader::Block>& BinaryLogReader::getBlocks(void) const {
+	return this->blocks;
+}
+
+bool BinaryLogReader::isTruncated(void) const {
+	return this->truncated;
+}
+
+void BinaryLogReader::decodeBlock(const Block& block, std::vector<int64_t>& timestamps, std::vector<std::vector<double> >& values) const {
+	const char* payload = this->data + block.offset;
+	size_t pos = 0;
+	size_t columnCount = this->segments[block.segment].columns.size();
+
+	timestamps.resize(block.rowCount);
+	int64_t previous = 0;
+	for (uint32_t r = 0; r < block.rowCount; r++) {
+		previous = (int64_t)((uint64_t)previous + (uint64_t)unzigzag(readVarint(payload, block.payloadSize, pos)));
+		timestamps[r] = previous;
+	}
+
+	values.resize(columnCount);
+	for (size_t c = 0; c < columnCount; c++) {
+		values[c].resize(block.rowCount);
+		uint64_t previousBits = 0;
+		for (uint32_t r = 0; r < block.rowCount; r++) {
+			previousBits ^= swapBytes(readVarint(payload, block.payloadSize, pos));
+			values[c][r] = bitsDouble(previousBits);
+		}
+	}
+}
+
+size_t BinaryLogReader::read(int64_t from, int64_t to, const std::vector<std::string>& columns, RowHandler handler) const {
+	size_t result = 0;
+
+	// skip blocks that end before the start of the range; blocks are usually in chronological order
+	// so this can be determined using a binary search
+	auto start = this->blocks.cbegin();
+	bool ordered = std::is_sorted(this->blocks.cbegin(), this->blocks.cend(), [](const Block& a, const Block& b) {
+		return a.lastTimestamp < b.lastTimestamp;
+	});
+	if (ordered)
+		start = std::lower_bound(this->blocks.cbegin(), this->blocks.cend(), from, [](const Block& block, int64_t time) {
+			return block.lastTimestamp < time;
+		});
+
+	std::vector<int64_t> timestamps;
+	std::vector<std::vector<double> > values;
+	std::vector<double> rowValues;
+	// column mapping per segment
+	size_t mappedSegment = std::numeric_limits<size_t>::max();
+	std::vector<int> mapping;
+	std::vector<std::string> resultColumns;
+
+	auto ite = this->blocks.cend();
+	for (auto it = start; it != ite; ++it) {
+		if (it->firstTimestamp > to) {
+			if (ordered)
+				break;
+			continue;
+		}
+		if (it->lastTimestamp < from)
+			continue;
+
+		// determine the columns to return
+		if (it->segment != mappedSegment) {
+			mappedSegment = it->segment;
+			const std::vector<std::string>& segmentColumns = this->segments[mappedSegment].columns;
+			mapping.clear();
+			if (columns.empty()) {
+				resultColumns = segmentColumns;
+				for (size_t c = 0; c < segmentColumns.size(); c++)
+					mapping.push_back((int)c);
+			} else {
+				resultColumns = columns;
+				for (auto cit = columns.cbegin(); cit != columns.cend(); ++cit) {
+					auto found = std::find(segmentColumns.cbegin(), segmentColumns.cend(), *cit);
+					mapping.push_back(found == segmentColumns.cend() ? -1 : (int)(found - segmentColumns.cbegin()));
+				}
+			}
+			rowValues.resize(mapping.size());
+		}
+
+		this->decodeBlock(*it, timestamps, values);
+		for (size_t r = 0; r < timestamps.size(); r++) {
+			if ((timestamps[r] < from) || (timestamps[r] > to))
+				continue;
+			for (size_t c = 0; c < mapping.size(); c++)
+				rowValues[c] = (mapping[c] < 0 ? std::numeric_limits<double>::quiet_NaN() : values[mapping[c]][r]);
+			handler(resultColumns, timestamps[r], rowValues);
+			++result;
+		}
+	}
+	return result;
+}
+
+}		// namespace openhat
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "Poco/Exception.h"
+#include "Poco/SharedMemory.h"
+
+namespace openhat {
+
+/// Binary log format used by the LoggerPort (Format = Binary).
+///
+/// A file consists of segments. Each segment starts with a segment header that lists the column names:
+///
+///     "OHBL" | version (1 byte) | column count (varint) | { name length (varint) | name bytes }
+///
+/// The segment header is followed by blocks of rows. Each block starts with a fixed size block header:
+///
+///     "OHBB" | payload size (uint32) | row count (uint32) | first timestamp (int64) | last timestamp (int64)
+///
+/// All fixed size integers are little endian. The payload stores the data column by column. The timestamp
+/// column (milliseconds since the epoch) contains zigzag varints of the difference to the previous timestamp.
+/// A value column contains doubles; each value is XORed with the bits of the previous value and the
+/// byte-swapped result is written as a varint. Equal values thus require one byte; values that differ only
+/// in the leading bits (sign, exponent, high mantissa bits) require few bytes. Unavailable values are NaN.
+/// The first row of each block is encoded relative to zero so that blocks can be decoded independently.
+///
+/// The block headers form an index by timestamp which allows a reader to locate a time range without
+/// decoding the whole file.
+///
+/// When a writer closes the file it appends an index record followed by a trailer (version 2):
+///
+///     "OHBX" | body size (uint32) | start offset (uint64) | segment count (uint32) | block count (uint32) |
+///         { segment header offset (uint64) } | { block header offset (uint64) | payload size (uint32) |
+///         row count (uint32) | first timestamp (int64) | last timestamp (int64) }
+///     "OHBT" | index record offset (uint64)
+///
+/// The index record lists the segments and blocks written since the file has been opened at the start offset.
+/// A reader thus finds all blocks by reading the trailer at the end of the file and following the start
+/// offsets to the trailers of earlier writers. Only the part of a file that has not been closed properly
+/// (e. g. because the writer has been interrupted) needs to be scanned block by block.
+namespace binarylog {
+
+const char SEGMENT_MAGIC[] = "OHBL";
+const char BLOCK_MAGIC[] = "OHBB";
+const char INDEX_MAGIC[] = "OHBX";
+const char TRAILER_MAGIC[] = "OHBT";
+const uint8_t VERSION = 2;
+const size_t BLOCK_HEADER_SIZE = 4 + 4 + 4 + 8 + 8;
+const size_t INDEX_HEADER_SIZE = 4 + 4;
+const size_t INDEX_BLOCK_SIZE = 8 + 4 + 4 + 8 + 8;
+const size_t TRAILER_SIZE = 4 + 8;
+
+}
+
+/// Accumulates rows and encodes them as blocks of the binary log format.
+class BinaryLogWriter {
+protected:
+	std::vector<std::string> columns;
+	size_t blockRows;
+	std::vector<int64_t> timestamps;
+	std::vector<std::vector<double> > values;
+
+public:
+	/// Creates a writer for the given value columns. A block is full when it contains blockRows rows.
+	BinaryLogWriter(const std::vector<std::string>& columns, size_t blockRows);
+
+	/// Returns the encoded segment header.
+	std::string getSegmentHeader(void) const;
+
+	/// Adds a row. The number of values must match the number of columns.
+	void addRow(int64_t timestamp, const std::vector<double>& rowValues);
+
+	/// Returns the number of rows that have not yet been encoded.
+	size_t getRowCount(void) const;
+
+	bool isBlockFull(void) const;
+
+	/// Encodes the pending rows as a block and clears them. Returns an empty string if there are no rows.
+	std::string encodeBlock(void);
+};
+
+/// Records the positions of the segment headers and blocks that are written to a file and encodes them
+/// as the index record and trailer that are appended when the file is closed.
+class BinaryLogIndex {
+protected:
+	uint64_t startOffset;
+	uint64_t offset;
+	std::vector<uint64_t> segmentOffsets;
+	std::string blockEntries;
+	uint32_t blockCount;
+
+public:
+	BinaryLogIndex(void);
+
+	/// Starts a new index for a file whose current size is startOffset.
+	void reset(uint64_t startOffset);
+
+	/// Registers an encoded segment header or block that is appended to the file.
+	void add(const std::string& record);
+
+	/// Returns true if no segment header or block has been added since the last reset.
+	bool isEmpty(void) const;
+
+	/// Returns the index record and the trailer to append to the file.
+	std::string encode(void) const;
+};
+
+/// Reads files in the binary log format. The file is memory-mapped; the index is read from the
+/// index records at the end of the file. Only block headers of parts of the file that are not covered
+/// by an index record are read. Blocks are decoded on demand.
+class BinaryLogReader {
+public:
+	struct Segment {
+		std::vector<std::string> columns;
+	};
+
+	struct Block {
+		size_t segment;
+		size_t offset;			// offset of the payload
+		size_t payloadSize;
+		uint32_t rowCount;
+		int64_t firstTimestamp;
+		int64_t lastTimestamp;
+	};
+
+	/// Callback that receives the segment's column names (filtered if columns have been specified),
+	/// the timestamp and the values of a row.
+	typedef std::function<void(const std::vector<std::string>& columns, int64_t timestamp, const std::vector<double>& values)> RowHandler;
+
+protected:
+	Poco::SharedMemory memory;
+	const char* data;
+	size_t size;
+	std::vector<Segment> segments;
+	std::vector<Block> blocks;
+	bool truncated;
+
+	void buildIndex(void);
+
+	/// Parses the segment header at pos and appends the segment. Returns false if it is incomplete.
+	bool readSegment(size_t& pos);
+
+	/// Reads the block headers between from and to.
+	void scan(size_t from, size_t to);
+
+	/// Returns the offset of the index record whose trailer ends at end, or 0 if there is none.
+	size_t findIndex(size_t end) const;
+
+	/// Reads the segments and blocks of the index record at the given offset.
+	void readIndex(size_t offset);
+
+public:
+	/// Opens and indexes the file. Throws an exception if the file is not in the binary log format.
+	explicit BinaryLogReader(const std::string& fileName);
+
+	const std::vector<Segment>& getSegments(void) const;
+
+	const std::vector<Block>& getBlocks(void) const;
+
+	/// Returns true if the file ends with an incomplete block (e. g. because the writer has been interrupted).
+	bool isTruncated(void) const;
+
+	/// Decodes the given block.
+	void decodeBlock(const Block& block, std::vector<int64_t>& timestamps, std::vector<std::vector<double> >& values) const;
+
+	/// Calls the handler for each row with from <= timestamp <= to. If columns is not empty only the specified
+	/// columns are returned; columns that do not exist in a segment are returned as NaN.
+	/// Blocks outside of the time range are skipped using the block index.
+	/// Returns the number of rows.
+	size_t read(int64_t from, int64_t to, const std::vector<std::string>& columns, RowHandler handler) const;
+};
+
+}		// namespace openhat
@@ -0,0 +1,111 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "Clock.h"
+
+#include "Poco/ScopedLock.h"
+
+#include "opdi_platformfuncs.h"
+
+namespace opdi {
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Clock
+//////////////////////////////////////////////////////////////////////////////////////////
+
+static SystemClock systemClock;
+static Clock* currentClock = &systemClock;
+
+Clock::~Clock() {
+}
+
+void Clock::addDeadlineMs(uint64_t /*timeMs*/) {
+}
+
+void Clock::addDeadline(const Poco::Timestamp& /*deadline*/) {
+}
+
+void Clock::advance(void) {
+}
+
+bool Clock::isSimulated(void) const {
+	return false;
+}
+
+Clock& Clock::get(void) {
+	return *currentClock;
+}
+
+void Clock::set(Clock* clock) {
+	currentClock = (clock == nullptr ? &systemClock : clock);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// System clock
+//////////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t SystemClock::getTimeMs(void) {
+	return opdi_get_time_ms();
+}
+
+Poco::Timestamp SystemClock::now(void) {
+	return Poco::Timestamp();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Simulated clock
+//////////////////////////////////////////////////////////////////////////////////////////
+
+SimulatedClock::SimulatedClock(const Poco::Timestamp& start, Poco::Timestamp::TimeDiff maxStepMs) : current(start) {
+	this->setMaxStep(maxStepMs);
+	this->deadlineSet = false;
+}
+
+void SimulatedClock::setMaxStep(Poco::Timestamp::TimeDiff maxStepMs) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	this->maxStep = (maxStepMs > 0 ? maxStepMs : 1) * 1000;
+}
+
+uint64_t SimulatedClock::getTimeMs(void) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	return this->current.epochMicroseconds() / 1000;
+}
+
+Poco::Timestamp SimulatedClock::now(void) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	return this->current;
+}
+
+void SimulatedClock::addDeadlineMs(uint64_t timeMs) {
+	this->addDeadline(Poco::Timestamp((Poco::Timestamp::TimeVal)timeMs * 1000));
+}
+
+void SimulatedClock::addDeadline(const Poco::Timestamp& deadline) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	if (!this->deadlineSet || (deadline < this->nextDeadline)) {
+		this->nextDeadline = deadline;
+		this->deadlineSet = true;
+	}
+}
+
+void SimulatedClock::advance(void) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	Poco::Timestamp next = this->current + this->maxStep;
+	if (this->deadlineSet && (this->nextDeadline < next))
+		next = this->nextDeadline;
+	// always advance by at least one millisecond
+	if (next - this->current < 1000)
+		next = this->current + 1000;
+	this->current = next;
+	this->deadlineSet = false;
+}
+
+bool SimulatedClock::isSimulated(void) const {
+	return true;
+}
+
+}		// namespace opdi
@@ -0,0 +1,90 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstdint>
+
+#include "Poco/Timestamp.h"
+#include "Poco/Mutex.h"
+
+namespace opdi {
+
+/// The source of the current time for the doWork loop and for the ports.
+/// Time dependent code should use Clock::get() instead of opdi_get_time_ms() or Poco::Timestamp()
+/// so that it can run in simulated time.
+/// Code that waits for something to happen at a certain time should register this point in time
+/// using addDeadline() or addDeadlineMs() in each doWork iteration. A simulated clock advances
+/// directly to the earliest deadline after each iteration.
+class Clock {
+public:
+	virtual ~Clock();
+
+	/// Returns the current time in milliseconds (since the epoch).
+	virtual uint64_t getTimeMs(void) = 0;
+
+	/// Returns the current time.
+	virtual Poco::Timestamp now(void) = 0;
+
+	/// Registers a time (as returned by getTimeMs()) at which something needs to be done.
+	virtual void addDeadlineMs(uint64_t timeMs);
+
+	/// Registers a time at which something needs to be done.
+	virtual void addDeadline(const Poco::Timestamp& deadline);
+
+	/// Called after each doWork iteration.
+	virtual void advance(void);
+
+	/// Returns true if the time does not correspond to the real time.
+	virtual bool isSimulated(void) const;
+
+	/// Returns the clock that is used by the application. The default is a SystemClock.
+	static Clock& get(void);
+
+	/// Sets the clock that is used by the application. The clock is not owned.
+	/// Must be called before ports are created.
+	static void set(Clock* clock);
+};
+
+/// A clock that returns the system time.
+class SystemClock : public Clock {
+public:
+	virtual uint64_t getTimeMs(void) override;
+
+	virtual Poco::Timestamp now(void) override;
+};
+
+/// A clock that starts at a specified time and advances only when advance() is called,
+/// either to the earliest registered deadline or by the maximum step, whichever is earlier.
+/// It advances at least by one millisecond.
+class SimulatedClock : public Clock {
+protected:
+	mutable Poco::Mutex mutex;
+	Poco::Timestamp current;
+	Poco::Timestamp::TimeDiff maxStep;		// microseconds
+	Poco::Timestamp nextDeadline;
+	bool deadlineSet;
+
+public:
+	SimulatedClock(const Poco::Timestamp& start, Poco::Timestamp::TimeDiff maxStepMs);
+
+	void setMaxStep(Poco::Timestamp::TimeDiff maxStepMs);
+
+	virtual uint64_t getTimeMs(void) override;
+
+	virtual Poco::Timestamp now(void) override;
+
+	virtual void addDeadlineMs(uint64_t timeMs) override;
+
+	virtual void addDeadline(const Poco::Timestamp& deadline) override;
+
+	virtual void advance(void) override;
+
+	virtual bool isSimulated(void) const override;
+};
+
+}		// namespace opdi
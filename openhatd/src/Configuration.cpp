@@ -2,11 +2,86 @@
 #include "AbstractOpenHAT.h"
 
 #include <sstream>
+#include <set>
+#include <cstring>
+#include <algorithm>
 
 #include "Poco/FileStream.h"
+#include "Poco/File.h"
+#include "Poco/Path.h"
+#include "Poco/String.h"
+#include "Poco/SharedMemory.h"
 
 namespace openhat {
 
+namespace {
+
+const char CACHE_MAGIC[] = "OHCC";
+const uint8_t CACHE_VERSION = 1;
+const size_t CACHE_HEADER_SIZE = 4 + 1 + 4 + 8 + 8;
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+uint64_t fnv(uint64_t hash, const char* data, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (uint8_t)data[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+// hashes the string including a terminator so that concatenations are unambiguous
+uint64_t fnv(uint64_t hash, const std::string& value) {
+	hash = fnv(hash, value.data(), value.size());
+	return fnv(hash, "", 1);
+}
+
+void writeFixed(std::string& out, uint64_t value, int bytes) {
+	for (int i = 0; i < bytes; i++)
+		out.push_back((char)((value >> (i * 8)) & 0xFF));
+}
+
+void writeString(std::string& out, const std::string& value) {
+	writeFixed(out, value.size(), 4);
+	out.append(value);
+}
+
+// reads from a record; throws if the record is too short
+class RecordReader {
+	const char* data;
+	size_t size;
+	size_t pos;
+
+public:
+	RecordReader(const char* data, size_t size, size_t pos = 0) : data(data), size(size), pos(pos) {}
+
+	uint64_t readFixed(int bytes) {
+		if (this->pos + bytes > this->size)
+			throw Poco::DataFormatException("Truncated configuration cache record");
+		uint64_t result = 0;
+		for (int i = 0; i < bytes; i++)
+			result |= (uint64_t)(uint8_t)this->data[this->pos + i] << (i * 8);
+		this->pos += bytes;
+		return result;
+	}
+
+	std::string readString(void) {
+		size_t length = (size_t)this->readFixed(4);
+		if (this->pos + length > this->size)
+			throw Poco::DataFormatException("Truncated configuration cache record");
+		std::string result(this->data + this->pos, length);
+		this->pos += length;
+		return result;
+	}
+
+	size_t getPosition(void) const {
+		return this->pos;
+	}
+};
+
+}	// end anonymous namespace
+
 // OpenHATConfigurationFile
 
 bool OpenHATConfigurationFile::getRaw(const std::string & key, std::string & value) const {
@@ -20,7 +95,7 @@ bool OpenHATConfigurationFile::getRaw(const std::string & key, std::string & val
 	return result;
 }
 
-OpenHATConfigurationFile::OpenHATConfigurationFile(const std::string& path, std::map<std::string, std::string> parameters) {
+OpenHATConfigurationFile::OpenHATConfigurationFile(const std::string& path, std::map<std::string, std::string> parameters, std::vector<std::string>* usedParameters) {
 
 	// load the file content
 	Poco::FileInputStream istr(path, std::ios::in);
@@ -28,6 +103,14 @@ OpenHATConfigurationFile::OpenHATConfigurationFile(const std::string& path, std:
 	if (!istr.good())
 		throw Poco::OpenFileException(path);
 
+	this->loadContent(istr, parameters, usedParameters);
+}
+
+OpenHATConfigurationFile::OpenHATConfigurationFile(std::istream& istr, const std::map<std::string, std::string>& parameters, std::vector<std::string>* usedParameters) {
+	this->loadContent(istr, parameters, usedParameters);
+}
+
+void OpenHATConfigurationFile::loadContent(std::istream& istr, std::map<std::string, std::string> parameters, std::vector<std::string>* usedParameters) {
 	std::string content;
 	std::string line;
 	while (std::getline(istr, line)) {
@@ -48,9 +131,13 @@ OpenHATConfigurationFile::OpenHATConfigurationFile(const std::string& path, std:
 		std::string value = parameters[*iterator];
 
 		size_t start = 0;
+		bool used = false;
 		while ((start = content.find(key, start)) != std::string::npos) {
 			content.replace(start, key.length(), value);
+			used = true;
 		}
+		if (used && (usedParameters != nullptr))
+			usedParameters->push_back(key);
 	}
 
 	// load the configuration from the new content
@@ -59,6 +146,348 @@ OpenHATConfigurationFile::OpenHATConfigurationFile(const std::string& path, std:
 	this->load(newContent);
 }
 
+void OpenHATConfigurationFile::getEntries(std::vector<std::pair<std::string, std::string> >& entries) const {
+	entries.clear();
+	this->addEntries("", entries);
+}
+
+void OpenHATConfigurationFile::addEntries(const std::string& prefix, std::vector<std::pair<std::string, std::string> >& entries) const {
+	Keys subKeys;
+	this->keys(prefix, subKeys);
+	for (auto it = subKeys.cbegin(), ite = subKeys.cend(); it != ite; ++it) {
+		if (it->empty())
+			continue;
+		std::string key = (prefix.empty() ? *it : prefix + "." + *it);
+		// a key may have a value and sub keys at the same time
+		std::string value;
+		if (Poco::Util::IniFileConfiguration::getRaw(key, value))
+			entries.push_back(std::make_pair(key, value));
+		this->addEntries(key, entries);
+	}
+}
+
+// CachedConfigurationFile
+
+bool CachedConfigurationFile::ICompare::operator () (const std::string& s1, const std::string& s2) const {
+	return Poco::icompare(s1, s2) < 0;
+}
+
+CachedConfigurationFile::CachedConfigurationFile(std::shared_ptr<const void> owner, const char* data, size_t size, size_t entriesOffset)
+	: owner(owner), data(data), size(size) {
+	RecordReader reader(data, size, entriesOffset);
+	this->count = (uint32_t)reader.readFixed(4);
+	this->tableOffset = reader.getPosition();
+	if (this->tableOffset + (size_t)this->count * 4 > size)
+		throw Poco::DataFormatException("Truncated configuration cache record");
+}
+
+void CachedConfigurationFile::getEntry(uint32_t index, std::string* key, std::string* value) const {
+	RecordReader table(this->data, this->size, this->tableOffset + (size_t)index * 4);
+	RecordReader reader(this->data, this->size, (size_t)table.readFixed(4));
+	std::string entryKey = reader.readString();
+	if (key != nullptr)
+		*key = entryKey;
+	if (value != nullptr)
+		*value = reader.readString();
+}
+
+uint32_t CachedConfigurationFile::lowerBound(const std::string& key) const {
+	uint32_t low = 0;
+	uint32_t high = this->count;
+	std::string entryKey;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		this->getEntry(middle, &entryKey, nullptr);
+		if (Poco::icompare(entryKey, key) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+bool CachedConfigurationFile::getRaw(const std::string& key, std::string& value) const {
+	auto it = this->overrides.find(key);
+	if (it != this->overrides.end())
+		value = it->second;
+	else {
+		uint32_t index = this->lowerBound(key);
+		if (index >= this->count)
+			return false;
+		std::string entryKey;
+		this->getEntry(index, &entryKey, &value);
+		if (Poco::icompare(entryKey, key) != 0)
+			return false;
+	}
+	// detect quotes around the value (see OpenHATConfigurationFile)
+	if ((value.size() > 1) && (value[0] == '"') && (value[value.size() - 1] == '"')) {
+		value = value.substr(1, value.size() - 2);
+	}
+	return true;
+}
+
+void CachedConfigurationFile::setRaw(const std::string& key, const std::string& value) {
+	this->overrides[key] = value;
+}
+
+void CachedConfigurationFile::enumerate(const std::string& key, Keys& range) const {
+	std::set<std::string, ICompare> keys;
+	std::string prefix = (key.empty() ? key : key + ".");
+	auto addKey = [&keys, &prefix, &range](const std::string& entryKey) {
+		if ((entryKey.size() <= prefix.size()) || (Poco::icompare(entryKey, 0, prefix.size(), prefix) != 0))
+			return false;
+		std::string subKey = entryKey.substr(prefix.size(), entryKey.find('.', prefix.size()) - prefix.size());
+		if (keys.insert(subKey).second)
+			range.push_back(subKey);
+		return true;
+	};
+	range.clear();
+	// the keys with the prefix are consecutive
+	std::string entryKey;
+	for (uint32_t i = this->lowerBound(prefix); i < this->count; i++) {
+		this->getEntry(i, &entryKey, nullptr);
+		if (!addKey(entryKey))
+			break;
+	}
+	for (auto it = this->overrides.cbegin(), ite = this->overrides.cend(); it != ite; ++it)
+		addKey(it->first);
+}
+
+// ConfigurationCache
+
+ConfigurationCache::ConfigurationCache(const std::string& fileName) : fileName(fileName) {
+	this->hits = 0;
+	this->misses = 0;
+}
+
+void ConfigurationCache::clear(void) {
+	this->records.clear();
+	this->index.clear();
+}
+
+void ConfigurationCache::load(void) {
+	// discard a previously loaded cache
+	this->clear();
+	this->hits = 0;
+	this->misses = 0;
+
+	Poco::File file(this->fileName);
+	if (!file.exists() || (file.getSize() == 0))
+		return;
+
+	// the mapping is released when neither the cache nor a cached configuration uses it
+	std::shared_ptr<Poco::SharedMemory> memory = std::make_shared<Poco::SharedMemory>(file, Poco::SharedMemory::AM_READ);
+	const char* data = memory->begin();
+	size_t size = memory->end() - memory->begin();
+
+	try {
+		if ((size < CACHE_HEADER_SIZE) || (memcmp(data, CACHE_MAGIC, 4) != 0))
+			throw Poco::DataFormatException("Not a configuration cache file: " + this->fileName);
+		RecordReader header(data, CACHE_HEADER_SIZE, 4);
+		uint8_t version = (uint8_t)header.readFixed(1);
+		if (version != CACHE_VERSION)
+			throw Poco::DataFormatException("Unsupported configuration cache version: " + std::to_string((int)version));
+		uint32_t count = (uint32_t)header.readFixed(4);
+		uint64_t payloadSize = header.readFixed(8);
+		uint64_t payloadHash = header.readFixed(8);
+		if (payloadSize != size - CACHE_HEADER_SIZE)
+			throw Poco::DataFormatException("Configuration cache file is truncated: " + this->fileName);
+		if (fnv(FNV_OFFSET, data + CACHE_HEADER_SIZE, (size_t)payloadSize) != payloadHash)
+			throw Poco::DataFormatException("Configuration cache file is corrupt: " + this->fileName);
+
+		size_t pos = CACHE_HEADER_SIZE;
+		for (uint32_t i = 0; i < count; i++) {
+			RecordReader reader(data, size, pos);
+			size_t recordSize = (size_t)reader.readFixed(4);
+			if (pos + 4 + recordSize > size)
+				throw Poco::DataFormatException("Truncated configuration cache record");
+			this->addRecord(memory, data + pos + 4, recordSize, true);
+			pos += 4 + recordSize;
+		}
+	} catch (...) {
+		this->clear();
+		throw;
+	}
+}
+
+void ConfigurationCache::addRecord(std::shared_ptr<const void> owner, const char* data, size_t size, bool saved) {
+	RecordReader reader(data, size);
+	Record record;
+	record.owner = owner;
+	record.data = data;
+	record.size = size;
+	std::string path = reader.readString();
+	record.contentHash = reader.readFixed(8);
+	uint64_t namesHash = reader.readFixed(8);
+	uint64_t valuesHash = reader.readFixed(8);
+	Variant variant;
+	uint32_t parameterCount = (uint32_t)reader.readFixed(4);
+	for (uint32_t i = 0; i < parameterCount; i++)
+		variant.parameters.push_back(reader.readString());
+	record.entriesOffset = reader.getPosition();
+	record.used = false;
+	record.saved = saved;
+
+	// find the records with the same used parameters
+	std::vector<Variant>& variants = this->index[path];
+	auto it = std::find_if(variants.begin(), variants.end(), [&variant](const Variant& v) { return v.parameters == variant.parameters; });
+	if (it == variants.end())
+		it = variants.insert(variants.end(), variant);
+	(*it).records[fnv(namesHash, (const char*)&valuesHash, sizeof(valuesHash))] = this->records.size();
+	this->records.push_back(record);
+}
+
+void ConfigurationCache::readSourceFile(const std::string& path, SourceFile& source) {
+	Poco::File file(path);
+	source.exists = file.exists() && file.isFile();
+	source.hash = FNV_OFFSET;
+	if (source.exists) {
+		Poco::FileInputStream istr(path, std::ios::in | std::ios::binary);
+		std::stringstream content;
+		content << istr.rdbuf();
+		source.content = content.str();
+		source.hash = fnv(FNV_OFFSET, source.content.data(), source.content.size());
+	}
+}
+
+Poco::Util::AbstractConfiguration* ConfigurationCache::read(const std::string& path, const std::map<std::string, std::string>& parameters) {
+	std::string absolutePath = Poco::Path(path).absolute().toString();
+	SourceFile source;
+	this->readSourceFile(absolutePath, source);
+	// let the file configuration report errors
+	if (!source.exists)
+		return new OpenHATConfigurationFile(path, parameters);
+
+	uint64_t namesHash = FNV_OFFSET;
+	for (auto it = parameters.cbegin(), ite = parameters.cend(); it != ite; ++it)
+		namesHash = fnv(namesHash, it->first);
+
+	auto variants = this->index.find(absolutePath);
+	if (variants != this->index.end()) {
+		for (auto vit = variants->second.cbegin(), vite = variants->second.cend(); vit != vite; ++vit) {
+			uint64_t valuesHash = FNV_OFFSET;
+			bool complete = true;
+			for (auto pit = vit->parameters.cbegin(), pite = vit->parameters.cend(); pit != pite; ++pit) {
+				auto param = parameters.find(*pit);
+				if (param == parameters.end()) {
+					complete = false;
+					break;
+				}
+				valuesHash = fnv(valuesHash, param->second);
+			}
+			if (!complete)
+				continue;
+			auto rit = vit->records.find(fnv(namesHash, (const char*)&valuesHash, sizeof(valuesHash)));
+			if (rit == vit->records.end())
+				continue;
+			Record& record = this->records[rit->second];
+			if (record.contentHash != source.hash)
+				continue;
+
+			// cache hit
+			CachedConfigurationFile* result = new CachedConfigurationFile(record.owner, record.data, record.size, record.entriesOffset);
+			record.used = true;
+			this->hits++;
+			return result;
+		}
+	}
+
+	// cache miss; parse the content
+	std::vector<std::string> usedParameters;
+	std::istringstream istr(source.content);
+	OpenHATConfigurationFile* result = new OpenHATConfigurationFile(istr, parameters, &usedParameters);
+	this->misses++;
+
+	std::sort(usedParameters.begin(), usedParameters.end());
+	uint64_t valuesHash = FNV_OFFSET;
+	for (auto it = usedParameters.cbegin(), ite = usedParameters.cend(); it != ite; ++it)
+		valuesHash = fnv(valuesHash, parameters.at(*it));
+	std::vector<std::pair<std::string, std::string> > entries;
+	result->getEntries(entries);
+	// sort the entries the way the cached configuration looks them up
+	std::sort(entries.begin(), entries.end(), [](const std::pair<std::string, std::string>& e1, const std::pair<std::string, std::string>& e2) {
+		return Poco::icompare(e1.first, e2.first) < 0;
+	});
+
+	std::shared_ptr<std::string> encoded = std::make_shared<std::string>();
+	writeString(*encoded, absolutePath);
+	writeFixed(*encoded, source.hash, 8);
+	writeFixed(*encoded, namesHash, 8);
+	writeFixed(*encoded, valuesHash, 8);
+	writeFixed(*encoded, usedParameters.size(), 4);
+	for (auto it = usedParameters.cbegin(), ite = usedParameters.cend(); it != ite; ++it)
+		writeString(*encoded, *it);
+	writeFixed(*encoded, entries.size(), 4);
+	size_t tableOffset = encoded->size();
+	encoded->append(entries.size() * 4, '\0');
+	for (size_t i = 0; i < entries.size(); i++) {
+		uint64_t offset = encoded->size();
+		for (int b = 0; b < 4; b++)
+			(*encoded)[tableOffset + i * 4 + b] = (char)((offset >> (b * 8)) & 0xFF);
+		writeString(*encoded, entries[i].first);
+		writeString(*encoded, entries[i].second);
+	}
+	this->addRecord(encoded, encoded->data(), encoded->size(), false);
+	this->records.back().used = true;
+
+	return result;
+}
+
+void ConfigurationCache::save(void) {
+	// unchanged?
+	bool changed = false;
+	for (auto it = this->records.cbegin(), ite = this->records.cend(); it != ite; ++it)
+		if (it->used != it->saved)
+			changed = true;
+
+	if (changed) {
+		std::string payload;
+		uint32_t count = 0;
+		for (auto it = this->records.cbegin(), ite = this->records.cend(); it != ite; ++it) {
+			if (!it->used)
+				continue;
+			writeFixed(payload, it->size, 4);
+			payload.append(it->data, it->size);
+			count++;
+		}
+		std::string header(CACHE_MAGIC, 4);
+		writeFixed(header, CACHE_VERSION, 1);
+		writeFixed(header, count, 4);
+		writeFixed(header, payload.size(), 8);
+		writeFixed(header, fnv(FNV_OFFSET, payload.data(), payload.size()), 8);
+
+		// write to a temporary file first to avoid leaving a partial file
+		// (the mapping of the replaced file remains valid)
+		std::string tempFileName = this->fileName + ".tmp";
+		Poco::FileOutputStream fos(tempFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+		fos.write(header.data(), header.size());
+		fos.write(payload.data(), payload.size());
+		fos.close();
+		if (!fos.good())
+			throw Poco::WriteFileException(tempFileName);
+		Poco::File(tempFileName).renameTo(this->fileName);
+	}
+
+	// keep the records of the saved file for the next configuration
+	std::vector<Record> saved;
+	for (auto it = this->records.cbegin(), ite = this->records.cend(); it != ite; ++it)
+		if (it->used)
+			saved.push_back(*it);
+	this->clear();
+	for (auto it = saved.cbegin(), ite = saved.cend(); it != ite; ++it)
+		this->addRecord(it->owner, it->data, it->size, true);
+	this->hits = 0;
+	this->misses = 0;
+}
+
+size_t ConfigurationCache::getHits(void) const {
+	return this->hits;
+}
+
+size_t ConfigurationCache::getMisses(void) const {
+	return this->misses;
+}
+
 // ConfigurationView
 
 ConfigurationView::ConfigurationView(AbstractOpenHAT* openhat, Poco::Util::AbstractConfiguration::Ptr config, const std::string& sourceFile, const std::string& section, bool checkUnused)
@@ -81,6 +510,7 @@ ConfigurationView::~ConfigurationView() {
 }
 
 void ConfigurationView::addUsedKey(const std::string & key) {
+	Poco::FastMutex::ScopedLock lock(this->usedKeysMutex);
 	this->usedKeys.insert(key);
 }
 
@@ -90,6 +520,7 @@ bool ConfigurationView::getRaw(const std::string& key, std::string& value) const
 	if (this->innerConfig->has(key)) {
 		if (!section.empty())
 			this->openhat->logConfigKeyAccess((this->sourceFile.empty() ? std::string() : this->sourceFile + ": " ) + "Retrieved setting " + section + "." + key + ", value is: '" + value + "'");
+		Poco::FastMutex::ScopedLock lock(this->usedKeysMutex);
 		this->usedKeys.insert(key);
 		return true;
 	} else
@@ -102,6 +533,7 @@ void ConfigurationView::getUnusedKeys(std::vector<std::string>& unusedKeys) {
 	unusedKeys.clear();
 	std::vector<std::string> keys;
 	this->innerConfig->keys(keys);
+	Poco::FastMutex::ScopedLock lock(this->usedKeysMutex);
 	// add all keys except used ones
 	auto ite = keys.cend();
 	for (auto it = keys.cbegin(); it != ite; ++it)
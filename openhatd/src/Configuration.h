@@ -1,11 +1,15 @@
 #pragma once
 
 #include <map>
+#include <deque>
+#include <vector>
 #include <istream>
 #include <unordered_set>
+#include <memory>
 
 #include "Poco/Util/IniFileConfiguration.h"
 #include "Poco/Util/LayeredConfiguration.h"
+#include "Poco/Mutex.h"
 
 namespace openhat {
 
@@ -19,8 +23,125 @@ protected:
 	*/
 	virtual bool getRaw(const std::string & key, std::string & value) const;
 
+	void addEntries(const std::string& prefix, std::vector<std::pair<std::string, std::string> >& entries) const;
+
+	void loadContent(std::istream& istr, std::map<std::string, std::string> parameters, std::vector<std::string>* usedParameters);
+
+public:
+	/// Reads the file and replaces the parameters. If usedParameters is specified it receives
+	/// the names of the parameters that occurred in the file.
+	OpenHATConfigurationFile(const std::string& path, std::map<std::string, std::string> parameters, std::vector<std::string>* usedParameters = nullptr);
+
+	/// Reads the configuration from the stream and replaces the parameters.
+	OpenHATConfigurationFile(std::istream& istr, const std::map<std::string, std::string>& parameters, std::vector<std::string>* usedParameters = nullptr);
+
+	/// Returns all keys together with their raw values.
+	void getEntries(std::vector<std::pair<std::string, std::string> >& entries) const;
+};
+
+/// A configuration that is served directly from a record of the configuration cache.
+/// The entries of a record are sorted by key, so lookups use a binary search on the record data.
+/// Values that are set later are kept separately.
+class CachedConfigurationFile : public Poco::Util::AbstractConfiguration
+{
+protected:
+	struct ICompare {
+		bool operator () (const std::string& s1, const std::string& s2) const;
+	};
+
+	std::shared_ptr<const void> owner;		// keeps the record data alive
+	const char* data;
+	size_t size;
+	size_t tableOffset;
+	uint32_t count;
+	std::map<std::string, std::string, ICompare> overrides;
+
+	// returns the key and the value of the given entry
+	void getEntry(uint32_t index, std::string* key, std::string* value) const;
+
+	// returns the index of the first entry whose key is not less than the given key
+	uint32_t lowerBound(const std::string& key) const;
+
+	virtual bool getRaw(const std::string& key, std::string& value) const;
+
+	virtual void setRaw(const std::string& key, const std::string& value);
+
+	virtual void enumerate(const std::string& key, Keys& range) const;
+
 public:
-	OpenHATConfigurationFile(const std::string& path, std::map<std::string, std::string> parameters);
+	/// Uses the entries at the given offset of the record data. owner must keep the data alive.
+	CachedConfigurationFile(std::shared_ptr<const void> owner, const char* data, size_t size, size_t entriesOffset);
+};
+
+/// A binary file that contains the entries of configuration files after parameter substitution.
+/// Startup can use the cached entries instead of substituting and parsing the files again.
+/// Each configuration file that is read (including each instance of an included file) is stored
+/// as a record together with a hash of the file's content and a hash of the names of all
+/// parameters and of the values of the parameters that occurred in the file. A record is only used
+/// if all of these match; otherwise the file is parsed again and the cache file is rewritten on save().
+///
+/// File format: "OHCC" | version (uint8) | record count (uint32) | payload size (uint64) | payload hash (uint64)
+/// followed by the records. All integers are little endian; strings are prefixed by their length (uint32).
+/// Record: record size (uint32) | path | content hash (uint64) | names hash (uint64) | values hash (uint64) |
+///         used parameter count (uint32) | used parameter names | entry count (uint32) |
+///         entry offsets (uint32 each, relative to the record) | entries (key, value)
+/// The entries are sorted by key (case-insensitive). The payload hash and the content hash are FNV-1a hashes.
+/// The file is memory-mapped when it is loaded; cached configurations are served from the mapped records.
+class ConfigurationCache {
+protected:
+	struct Record {
+		std::shared_ptr<const void> owner;		// the mapped file or the encoded record
+		const char* data;
+		size_t size;
+		size_t entriesOffset;
+		uint64_t contentHash;
+		bool used;
+		bool saved;				// contained in the cache file
+	};
+
+	// records of one file with the same used parameters, by names and values hash
+	struct Variant {
+		std::vector<std::string> parameters;
+		std::map<uint64_t, size_t> records;
+	};
+
+	struct SourceFile {
+		bool exists;
+		std::string content;
+		uint64_t hash;
+	};
+
+	std::string fileName;
+	std::vector<Record> records;
+	std::map<std::string, std::vector<Variant> > index;
+	size_t hits;
+	size_t misses;
+
+	void readSourceFile(const std::string& path, SourceFile& source);
+
+	void addRecord(std::shared_ptr<const void> owner, const char* data, size_t size, bool saved);
+
+	void clear(void);
+
+public:
+	explicit ConfigurationCache(const std::string& fileName);
+
+	/// Loads the cache file if it exists, discarding a previously loaded cache. Throws an exception
+	/// if the file is invalid; the cache is empty in this case.
+	void load(void);
+
+	/// Returns the configuration of the given file, from the cache if possible.
+	/// The caller takes ownership of the returned object.
+	Poco::Util::AbstractConfiguration* read(const std::string& path, const std::map<std::string, std::string>& parameters);
+
+	/// Writes the cache file if files have been parsed or cached records have not been used since
+	/// the last save. The cache keeps the saved records for the next configuration (on reload);
+	/// the numbers of hits and misses are reset.
+	void save(void);
+
+	size_t getHits(void) const;
+
+	size_t getMisses(void) const;
 };
 
 class AbstractOpenHAT;
@@ -50,6 +171,7 @@ protected:
 	bool checkUnused;
 	mutable Poco::Util::AbstractConfiguration::Ptr innerConfig;
 	mutable std::unordered_set<std::string> usedKeys;
+	mutable Poco::FastMutex usedKeysMutex;		// views can be shared by plugins that are set up in parallel
 
 	bool getRaw(const std::string& key, std::string& value) const;
 };
@@ -1,6 +1,10 @@
 #include "ExecPort.h"
 
+#include <sstream>
+
 #include "Poco/File.h"
+#include "Poco/NumberParser.h"
+#include "Poco/String.h"
 
 namespace openhat {
 
@@ -8,27 +12,34 @@ namespace openhat {
 // Exec Port
 ///////////////////////////////////////////////////////////////////////////////
 
-#ifdef linux
-#include <sys/types.h>
-#include <sys/wait.h>
-#endif
-
-ExecPort::ExecPort(AbstractOpenHAT* openhat, const char* id) : opdi::DigitalPort(id, OPDI_PORTDIRCAP_OUTPUT, 0), waiter(*this, &ExecPort::waitForProcessEnd) {
+ExecPort::ExecPort(AbstractOpenHAT* openhat, const char* id) : opdi::DigitalPort(id, OPDI_PORTDIRCAP_OUTPUT, 0) {
 	this->opdi = this->openhat = openhat;
 
 	opdi::DigitalPort::setMode(OPDI_DIGITAL_MODE_OUTPUT);
 
 	this->exitCodePort = nullptr;
+	this->outputPort = nullptr;
 
 	// default is Low
+	this->processHandle = 0;
 	this->processPID = 0;
+	this->mode = PROCESS_MODE;
+	this->protocol = LINE_PROTOCOL;
+	this->restartDelayMs = 1000;
 	this->killTimeMs = 0;		// kill time disabled
+	this->maxResponseLength = 65536;
 	this->startRequested = false;
-	this->hasTerminated = false;
 	this->lastStartTime = 0;
+	this->requestPending = false;
+	this->requestSent = false;
+	this->requestTime = 0;
+	this->restartTime = 0;
 }
 
 ExecPort::~ExecPort() {
+	// the supervisor must not notify this port any more
+	if (this->processHandle != 0)
+		ProcessSupervisor::get().kill(this->processHandle);
 }
 
 void ExecPort::configure(ConfigurationView::Ptr config) {
@@ -41,11 +52,40 @@ void ExecPort::configure(ConfigurationView::Ptr config) {
 
 	this->parameters = config->getString("Parameters", "");
 
+	std::string modeStr = config->getString("Mode", "Process");
+	if (modeStr == "Process")
+		this->mode = PROCESS_MODE;
+	else
+	if (modeStr == "Worker")
+		this->mode = WORKER_MODE;
+	else
+		this->openhat->throwSettingException(this->ID() + ": Unsupported Mode; expected 'Process' or 'Worker': " + modeStr);
+
+	std::string protocolStr = config->getString("Protocol", "Line");
+	if (protocolStr == "Line")
+		this->protocol = LINE_PROTOCOL;
+	else
+	if (protocolStr == "Length")
+		this->protocol = LENGTH_PROTOCOL;
+	else
+		this->openhat->throwSettingException(this->ID() + ": Unsupported Protocol; expected 'Line' or 'Length': " + protocolStr);
+
+	this->request = config->getString("Request", "");
+
+	this->restartDelayMs = config->getInt64("RestartDelay", this->restartDelayMs);
+	if (this->restartDelayMs < 0)
+		this->openhat->throwSettingException(this->ID() + ": Please specify a positive value for RestartDelay: ", this->to_string(this->restartDelayMs));
+
 	this->exitCodePortStr = config->getString("ExitCodePort", "");
+	this->outputPortStr = config->getString("OutputPort", "");
 
 	this->killTimeMs = config->getInt64("KillTime", this->killTimeMs);
 	if (this->killTimeMs < 0)
 		this->openhat->throwSettingException(this->ID() + ": Please specify a positive value for KillTime: ", this->to_string(this->killTimeMs));
+
+	this->maxResponseLength = config->getInt64("MaxResponseLength", this->maxResponseLength);
+	if (this->maxResponseLength <= 0)
+		this->openhat->throwSettingException(this->ID() + ": Please specify a positive value for MaxResponseLength: ", this->to_string(this->maxResponseLength));
 }
 
 void ExecPort::prepare() {
@@ -53,11 +93,13 @@ void ExecPort::prepare() {
 	opdi::DigitalPort::prepare();
 
 	this->exitCodePort = this->findDialPort(this->ID(), "ExitCodePort", this->exitCodePortStr, false);
+	this->outputPort = this->findDialPort(this->ID(), "OutputPort", this->outputPortStr, false);
 }
 
 bool ExecPort::setLine(uint8_t line, ChangeSource changeSource) {
-	// the line cannot be set to 0 while the process is still running
-	if ((line == 0) && (this->processPID != 0) && Poco::Process::isRunning(*this->processHandle))
+	// the line cannot be set to 0 while the process is queued or still running
+	// or while a request to the worker is pending
+	if ((line == 0) && ((this->mode == WORKER_MODE) ? (this->requestPending || this->requestSent) : (this->processHandle != 0)))
 		return false;
 
 	// switch from Low to High?
@@ -68,90 +110,274 @@ bool ExecPort::setLine(uint8_t line, ChangeSource changeSource) {
 	return opdi::DigitalPort::setLine(line, changeSource);
 }
 
-void ExecPort::waitForProcessEnd() {
-	// Poco::Process does not work correctly on Linux, so we need to have
-	// platform specific code here (isRunning reports true for defunct processes)
-
-	// if this->processPID == 0 it means that the Exec port killed the processed
-	// and the process is being terminated (which may work or not)
-	// anyway, monitoring stops and cleanup takes place in this condition
-#ifdef linux
-	int status = 0;
-	while ((this->processPID > 0) && !waitpid(this->processPID, &status, WNOHANG)) {
-#else
-	while ((this->processPID > 0) && Poco::Process::isRunning(this->processPID)) {
-#endif
-		// read data from the stream
-		std::string data;
-		Poco::StreamCopier::copyToString(*errStr, data);
-		if (!data.empty()) {
-			std::stringstream ss(data);
-			std::string item;
-			while (std::getline(ss, item, '\n')) {
-				if (!item.empty())
-					this->logNormal("stderr: " + item);
-			}
+std::string ExecPort::replacePlaceholders(const std::string& text) {
+	std::string result(text);
+
+	typedef std::map<std::string, std::string> PortValues;
+	PortValues portValues;
+	// fill environment values
+	this->openhat->getEnvironment(portValues);
+	std::string allPorts;
+	// go through all ports
+	opdi::PortList pl = this->openhat->getPorts();
+	auto pli = pl.begin();
+	auto plie = pl.end();
+	while (pli != plie) {
+		std::string val = this->openhat->getPortStateStr(*pli);
+		if (val.empty())
+			val = "<error>";
+		// store value
+		portValues[std::string("$") + (*pli)->ID()] = val;
+		allPorts += (*pli)->ID() + "=" + val + " ";
+		++pli;
+	}
+	portValues["$ALL_PORTS"] = allPorts;
+
+	// replace parameters in content
+	for (auto iterator = portValues.begin(), iteratorEnd = portValues.end(); iterator != iteratorEnd; ++iterator) {
+		std::string key = iterator->first;
+		std::string value = iterator->second;
+
+		size_t start = 0;
+		while ((start = result.find(key, start)) != std::string::npos) {
+			result.replace(start, key.length(), value);
+			start += value.length();
 		}
-		data = {};
-		// read data from the stream
-		Poco::StreamCopier::copyToString(*outStr, data);
-		if (!data.empty()) {
-			std::stringstream ss(data);
-			std::string item;
-			while (std::getline(ss, item, '\n')) { 
-				if (!item.empty())
-					this->logVerbose("stdout: " + item);
-			}
+	}
+	return result;
+}
+
+std::vector<std::string> ExecPort::getArguments(void) {
+	// build parameter string
+	std::string params = this->replacePlaceholders(this->parameters);
+
+	this->logDebug("Preparing start of program '" + this->programName + "'");
+	this->logDebug("Parameters: " + params);
+
+	// split parameters
+	std::vector<std::string> argList;
+	std::stringstream ss(params);
+	std::string item;
+	while (std::getline(ss, item, ' ')) {
+		if (!item.empty())
+			argList.push_back(item);
+	}
+	return argList;
+}
+
+void ExecPort::processEnded(void) {
+	this->processHandle = 0;
+	this->processPID = 0;
+	this->setLine(0);
+}
+
+void ExecPort::workerEnded(void) {
+	this->processHandle = 0;
+	this->processPID = 0;
+	this->response.clear();
+	this->restartTime = opdi_get_time_ms() + this->restartDelayMs;
+	// a pending request fails
+	if (this->requestPending || this->requestSent) {
+		this->requestPending = false;
+		this->requestSent = false;
+		if (this->outputPort != nullptr)
+			this->outputPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+		this->setLine(0);
+	}
+}
+
+void ExecPort::setOutput(const std::string& value) {
+	if (this->outputPort == nullptr)
+		return;
+	int64_t position;
+	if (!Poco::NumberParser::tryParse64(Poco::trim(value), position)) {
+		// a worker must respond with a value
+		if (this->mode == WORKER_MODE) {
+			std::string errorValue = (value.length() > 50 ? value.substr(0, 50) + "..." : value);
+			this->logWarning("Expected integer value but got: " + errorValue);
+			this->outputPort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
 		}
-		Poco::Thread::sleep(1);
+		return;
+	}
+	try {
+		this->outputPort->setPosition(position);
+	} catch (Poco::Exception &e) {
+		this->logWarning("Unable to set the value of the OutputPort: " + this->openhat->getExceptionMessage(e));
+	}
+}
+
+void ExecPort::responseReceived(const std::string& response) {
+	if (!this->requestSent) {
+		this->logVerbose("Ignoring unexpected response of worker: " + response);
+		return;
+	}
+	this->logDebug("Worker responded after " + this->to_string(opdi_get_time_ms() - this->requestTime) + " ms: " + response);
+	this->requestSent = false;
+	this->setOutput(response);
+	this->setLine(0);
+}
+
+void ExecPort::responseFailed(const std::string& message) {
+	this->logWarning(message + "; restarting worker");
+	ProcessSupervisor::get().kill(this->processHandle);
+	this->workerEnded();
+}
+
+void ExecPort::processStarted(int /*handle*/, Poco::Process::PID pid) {
+	this->processPID = pid;
+	this->lastStartTime = opdi_get_time_ms();
+	this->logVerbose(std::string("Started ") + (this->mode == WORKER_MODE ? "worker" : "program") + " '" + this->programName + "' with PID " + this->to_string(this->processPID));
+}
+
+void ExecPort::processOutput(int /*handle*/, bool isError, const std::string& line) {
+	if (!isError && (this->mode == WORKER_MODE)) {
+		// with the Line protocol each line is a response
+		this->responseReceived(line);
+		return;
 	}
-	// if the process has been killed by the Exec port
-	// we don't set the exit code and terminated flag
-	if (this->processPID > 0) {
-#ifdef linux
-		this->exitCode = WEXITSTATUS(status);
-#else
-		this->exitCode = this->processHandle->wait();
-#endif
-		this->hasTerminated = true;
+	if (line.empty())
+		return;
+	if (isError) {
+		this->logNormal("stderr: " + line);
+		return;
+	}
+	this->logVerbose("stdout: " + line);
+	this->setOutput(line);
+}
+
+void ExecPort::processData(int /*handle*/, const std::string& data) {
+	// Length protocol: <length in bytes>\n<response>
+	// the buffer is limited to one response of at most MaxResponseLength bytes and the following data
+	this->response.append(data);
+	while (true) {
+		size_t newline = this->response.find('\n');
+		if (newline == std::string::npos) {
+			if (this->response.size() > MAX_LENGTH_PREFIX)
+				this->responseFailed("Invalid length of worker response");
+			return;
+		}
+		Poco::UInt64 length;
+		if ((newline > MAX_LENGTH_PREFIX) || !Poco::NumberParser::tryParseUnsigned64(Poco::trim(this->response.substr(0, newline)), length)) {
+			this->responseFailed("Invalid length of worker response");
+			return;
+		}
+		if (length > (Poco::UInt64)this->maxResponseLength) {
+			this->responseFailed("Length of worker response exceeds MaxResponseLength: " + this->to_string(length));
+			return;
+		}
+		if (this->response.size() - newline - 1 < length)
+			return;
+		std::string message = this->response.substr(newline + 1, length);
+		this->response.erase(0, newline + 1 + length);
+		this->responseReceived(message);
+	}
+}
+
+void ExecPort::processTerminated(int /*handle*/, int exitCode) {
+	if (this->mode == WORKER_MODE)
+		this->logWarning("Worker with PID " + this->to_string(this->processPID) + " has terminated with exit code " + this->to_string(exitCode));
+	else
+		this->logVerbose("Process with PID " + this->to_string(this->processPID) + " has terminated with exit code " + this->to_string(exitCode));
+	// update exitCodePort if specified
+	if (this->exitCodePort != nullptr) {
+		try {
+			this->exitCodePort->setPosition(exitCode);
+		} catch (Poco::Exception &e) {
+			this->logWarning("Unable to set the value of the ExitCodePort: " + this->openhat->getExceptionMessage(e));
+		}
+	}
+	if (this->mode == WORKER_MODE)
+		this->workerEnded();
+	else
+		this->processEnded();
+}
+
+void ExecPort::processFailed(int /*handle*/, const std::string& message) {
+	this->openhat->logError(this->ID() + ": Unable to start program '" + this->programName + "': " + message);
+	// set exitCodePort to an error specified
+	if (this->exitCodePort != nullptr)
+		this->exitCodePort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+	if (this->mode == WORKER_MODE)
+		this->workerEnded();
+	else
+		this->processEnded();
+}
+
+void ExecPort::startWorker(void) {
+	// check whether the program exists
+	Poco::File file(this->programName);
+	if (!file.exists()) {
+		this->openhat->logError(this->ID() + ": Cannot start worker (file does not exist): " + this->programName);
+		if (this->exitCodePort != nullptr)
+			this->exitCodePort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+		this->workerEnded();
+		return;
+	}
+	int options = ProcessSupervisor::INPUT_PIPE | (this->protocol == LENGTH_PROTOCOL ? ProcessSupervisor::RAW_OUTPUT : 0);
+	this->processHandle = ProcessSupervisor::get().start(this->programName, this->getArguments(), this, options);
+}
+
+void ExecPort::doWorkWorker(void) {
+	uint64_t now = opdi_get_time_ms();
+
+	// keep the worker running
+	if ((this->processHandle == 0) && (now >= this->restartTime))
+		this->startWorker();
+
+	if (this->startRequested) {
+		this->startRequested = false;
+		this->requestPending = true;
+	}
+
+	// send the request as soon as the worker is running
+	if (this->requestPending && (this->processPID != 0)) {
+		std::string message = this->replacePlaceholders(this->request);
+		this->logDebug("Sending request to worker: " + message);
+		if (this->protocol == LENGTH_PROTOCOL)
+			message = this->to_string(message.size()) + "\n" + message;
+		else
+			message += "\n";
+		this->requestPending = false;
+		this->requestSent = true;
+		this->requestTime = now;
+		if (!ProcessSupervisor::get().write(this->processHandle, message)) {
+			this->logWarning("Unable to send the request to the worker; restarting worker");
+			ProcessSupervisor::get().kill(this->processHandle);
+			this->workerEnded();
+			return;
+		}
+	}
+
+	// response time up?
+	if (this->requestSent && (this->killTimeMs > 0) && (now - this->requestTime > (uint64_t)this->killTimeMs)) {
+		this->logWarning("Kill time exceeded: Worker with PID " + this->to_string(this->processPID) + " did not respond; restarting worker");
+		ProcessSupervisor::get().kill(this->processHandle);
+		// the worker is restarted immediately
+		this->workerEnded();
+		this->restartTime = now;
 	}
-	outStr->close();
-	errStr->close();
-	free(this->inPipe);
-	free(this->outPipe);
-	free(this->errPipe);
 }
 
 uint8_t ExecPort::doWork(uint8_t canSend)  {
 	opdi::DigitalPort::doWork(canSend);
 
-	// process terminated?
-	if (this->hasTerminated) {
-		this->hasTerminated = false;
-		this->logVerbose("Process with PID " + this->to_string(this->processPID) + " has terminated with exit code " + this->to_string(this->exitCode));
-		this->processPID = 0;
-		// update exitCodePort if specified
-		if (this->exitCodePort != nullptr)
-			this->exitCodePort->setPosition(this->exitCode);
-		this->setLine(0);
+	if (this->mode == WORKER_MODE) {
+		this->doWorkWorker();
+		return OPDI_STATUS_OK;
 	}
 
 	// process still running?
 	if (this->processPID != 0) {
-		if (Poco::Process::isRunning(this->processPID)) {
-			int64_t timeDiff = opdi_get_time_ms() - this->lastStartTime;
-			// kill time up?
-			if ((this->killTimeMs > 0) && (timeDiff > this->killTimeMs)) {
-				this->logVerbose("Kill time exceeded: Trying to kill previously started process with PID " + this->to_string(this->processPID));
-				// kill process
-				Poco::Process::kill(this->processPID);
-				// reset process ID to stop stream monitoring
-				this->processPID = 0;
-				// set exitCodePort to an error specified
-				if (this->exitCodePort != nullptr)
-					this->exitCodePort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
-				this->setLine(0);
-			}
+		int64_t timeDiff = opdi_get_time_ms() - this->lastStartTime;
+		// kill time up?
+		if ((this->killTimeMs > 0) && (timeDiff > this->killTimeMs)) {
+			this->logVerbose("Kill time exceeded: Trying to kill previously started process with PID " + this->to_string(this->processPID));
+			// kill process and stop stream monitoring
+			ProcessSupervisor::get().kill(this->processHandle);
+			// set exitCodePort to an error specified
+			if (this->exitCodePort != nullptr)
+				this->exitCodePort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
+			this->processEnded();
 		}
 	} else {
 		// process is not running
@@ -168,78 +394,9 @@ uint8_t ExecPort::doWork(uint8_t canSend)  {
 				this->setLine(0);
 			} else
 			{
-				// build parameter string
-				std::string params(this->parameters);
-
-				typedef std::map<std::string, std::string> PortValues;
-				PortValues portValues;
-				// fill environment values
-				this->openhat->getEnvironment(portValues);
-				std::string allPorts;
-				// go through all ports
-				opdi::PortList pl = this->openhat->getPorts();
-				auto pli = pl.begin();
-				auto plie = pl.end();
-				while (pli != plie) {
-					std::string val = this->openhat->getPortStateStr(*pli);
-					if (val.empty())
-						val = "<error>";
-					// store value
-					portValues[std::string("$") + (*pli)->ID()] = val;
-					allPorts += (*pli)->ID() + "=" + val + " ";
-					++pli;
-				}
-				portValues["$ALL_PORTS"] = allPorts;
-
-				// replace parameters in content
-				for (auto iterator = portValues.begin(), iteratorEnd = portValues.end(); iterator != iteratorEnd; ++iterator) {
-					std::string key = iterator->first;
-					std::string value = iterator->second;
-
-					size_t start = 0;
-					while ((start = params.find(key, start)) != std::string::npos) {
-						params.replace(start, key.length(), value);
-					}
-				}
-
-				this->logDebug("Preparing start of program '" + this->programName + "'");
-				this->logDebug("Parameters: " + params);
-
-				// split parameters
-				std::vector<std::string> argList;
-				std::stringstream ss(params);
-				std::string item;
-				while (std::getline(ss, item, ' ')) {
-					if (!item.empty())
-						argList.push_back(item);
-				}
-
-				// execute program
-				try {
-					// start process, register pipes for IO redirection
-					this->inPipe = new Poco::Pipe;
-					this->outPipe = new Poco::Pipe;
-					this->errPipe = new Poco::Pipe;
-					this->processHandle = new Poco::ProcessHandle(Poco::Process::launch(this->programName, argList, this->inPipe, this->outPipe, this->errPipe));
-					this->processPID = this->processHandle->id();
-					this->outStr = make_unique<Poco::PipeInputStream>(*outPipe);
-					this->errStr = make_unique<Poco::PipeInputStream>(*errPipe);
-
-					this->logVerbose("Started program '" + this->programName + "' with PID " + this->to_string(this->processPID));
-
-					// create a thread that waits for the process to terminate
-					// otherwise, on Linux, child processes will remain defunct
-					this->waitThread.start(waiter);
-
-					this->lastStartTime = opdi_get_time_ms();
-				}
-				catch (Poco::Exception &e) {
-					this->openhat->logError(this->ID() + ": Unable to start program '" + this->programName + "': " + this->openhat->getExceptionMessage(e));
-					// set exitCodePort to an error specified
-					if (this->exitCodePort != nullptr)
-						this->exitCodePort->setError(opdi::Port::Error::VALUE_NOT_AVAILABLE);
-					this->setLine(0);
-				}
+				// execute program; the supervisor starts the process as soon as
+				// the maximum number of running processes permits
+				this->processHandle = ProcessSupervisor::get().start(this->programName, this->getArguments(), this);
 			}		// program file exists
 		}		// switched to High
 	}
@@ -247,4 +404,3 @@ uint8_t ExecPort::doWork(uint8_t canSend)  {
 }
 
 }		// namespace openhat
-
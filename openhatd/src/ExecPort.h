@@ -1,38 +1,10 @@
 #pragma once
 
 #include "Poco/Process.h"
-#include "Poco/Thread.h"
-#include "Poco/RunnableAdapter.h"
 #include "Poco/Util/AbstractConfiguration.h"
-#include "Poco/PipeStream.h"
-#include "Poco/StreamCopier.h"
-
-#include <memory>
 
 #include "AbstractOpenHAT.h"
-
-// helper functions because make_unique is not a part of C++11
-#include <type_traits>
-#include <utility>
-
-template <typename T, typename... Args>
-std::unique_ptr<T> make_unique_helper(std::false_type, Args&&... args) {
-  return std::unique_ptr<T>(new T(std::forward<Args>(args)...));
-}
-
-template <typename T, typename... Args>
-std::unique_ptr<T> make_unique_helper(std::true_type, Args&&... args) {
-   static_assert(std::extent<T>::value == 0,
-       "make_unique<T[N]>() is forbidden, please use make_unique<T[]>().");
-
-   typedef typename std::remove_extent<T>::type U;
-   return std::unique_ptr<T>(new U[sizeof...(Args)]{std::forward<Args>(args)...});
-}
-
-template <typename T, typename... Args>
-std::unique_ptr<T> make_unique(Args&&... args) {
-   return make_unique_helper<T>(std::is_array<T>(), std::forward<Args>(args)...);
-}
+#include "ProcessSupervisor.h"
 
 namespace openhat {
 
@@ -55,32 +27,91 @@ namespace openhat {
 *   list of <port_id>=<value> specifiers.
 *   If the parameter ForceKill is true a running process is killed if it is still running when the
 *   same process is to be started again.
+*   Processes are started and monitored by the ProcessSupervisor. If the maximum number of processes
+*   is running, the start is queued. Lines on stdout and stderr are logged; the value of the last
+*   stdout line that is an integer can be assigned to an OutputPort.
+*   In Worker mode the program is started once and kept running. Each time the port is set High
+*   a request (the Request setting with substituted placeholders) is written to the program's stdin
+*   and the port returns to Low when the program has written the response to its stdout. Requests
+*   and responses are either single lines or messages that are prefixed with their length in bytes
+*   and a newline (Protocol = Length). An integer response sets the OutputPort. If the worker does not
+*   respond within the KillTime it is killed. A terminated worker is restarted after the RestartDelay.
 */
-class ExecPort : public opdi::DigitalPort {
+class ExecPort : public opdi::DigitalPort, protected ProcessSupervisor::IListener {
 
 protected:
+	enum Mode {
+		PROCESS_MODE,
+		WORKER_MODE
+	};
+
+	enum Protocol {
+		LINE_PROTOCOL,
+		LENGTH_PROTOCOL
+	};
+
 	openhat::AbstractOpenHAT* openhat;
 	std::string programName;
 	std::string parameters;
+	Mode mode;
+	Protocol protocol;
+	std::string request;
+	int64_t restartDelayMs;
 	int64_t killTimeMs;
+	int64_t maxResponseLength;
 	std::string exitCodePortStr;
 	opdi::DialPort* exitCodePort;
+	std::string outputPortStr;
+	opdi::DialPort* outputPort;
 
 	bool startRequested;
-	bool hasTerminated;
 	uint64_t lastStartTime;
-	Poco::ProcessHandle* processHandle;
-	Poco::Process::PID processPID;
-	Poco::Thread waitThread;
-	Poco::RunnableAdapter<ExecPort> waiter;
-	uint32_t exitCode;
-	Poco::Pipe* inPipe;
-	Poco::Pipe* outPipe;
-	Poco::Pipe* errPipe;
-	std::unique_ptr<Poco::PipeInputStream> outStr;
-	std::unique_ptr<Poco::PipeInputStream> errStr;
-
-	void waitForProcessEnd();
+	int processHandle;					// 0 if no process is queued or running
+	Poco::Process::PID processPID;		// 0 if no process is running
+
+	// worker mode
+	bool requestPending;				// the port has been set High but the request has not been sent
+	bool requestSent;					// the response has not yet been received
+	uint64_t requestTime;
+	uint64_t restartTime;				// the worker is not started before this time
+	std::string response;				// received data of the Length protocol
+
+	// the length prefix of a response of the Length protocol is a decimal number
+	static const size_t MAX_LENGTH_PREFIX = 20;
+
+	// replaces the placeholders in the text with the values of the environment and the ports
+	std::string replacePlaceholders(const std::string& text);
+
+	// returns the argument list from the Parameters setting
+	std::vector<std::string> getArguments(void);
+
+	// resets the port after the process has ended or could not be started
+	void processEnded(void);
+
+	void doWorkWorker(void);
+
+	void startWorker(void);
+
+	// the worker has terminated or has been killed
+	void workerEnded(void);
+
+	void responseReceived(const std::string& response);
+
+	// kills the worker because of an invalid response and restarts it after the RestartDelay
+	void responseFailed(const std::string& message);
+
+	// sets the OutputPort to the value of the response or line
+	void setOutput(const std::string& value);
+
+	virtual void processStarted(int handle, Poco::Process::PID pid) override;
+
+	virtual void processOutput(int handle, bool isError, const std::string& line) override;
+
+	virtual void processData(int handle, const std::string& data) override;
+
+	virtual void processTerminated(int handle, int exitCode) override;
+
+	virtual void processFailed(int handle, const std::string& message) override;
 
 	virtual uint8_t doWork(uint8_t canSend);
 
@@ -93,8 +124,8 @@ public:
 
 	virtual void prepare() override;
 
-	/// This method ensures that the Line of an Exec port cannot be set to Low if a process is running.
-	///
+	/// This method ensures that the Line of an Exec port cannot be set to Low if a process is running
+	/// or a request of a worker has not yet been answered.
 	virtual bool setLine(uint8_t line, ChangeSource changeSource = opdi::Port::ChangeSource::CHANGESOURCE_INT) override;
 };
 
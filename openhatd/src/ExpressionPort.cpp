@@ -2,6 +2,12 @@
 
 #include "Poco/Timestamp.h"
 #include "Poco/String.h"
+#include "Poco/ScopedLock.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
 
 using Poco::endsWith;
 
@@ -9,17 +15,244 @@ using Poco::endsWith;
 
 namespace openhat {
 
+///////////////////////////////////////////////////////////////////////////////
+// Port Value Window
+///////////////////////////////////////////////////////////////////////////////
+
+#define WINDOW_CHANGE_QUEUE_SIZE	1024
+
+PortValueWindow::PortValueWindow(opdi::Port* port, int64_t durationMs) : queue(WINDOW_CHANGE_QUEUE_SIZE) {
+	this->valuePtr = &port->getValuePtr();
+	this->durationMs = durationMs;
+	this->nextSeq = 0;
+	this->area = 0;
+	this->finiteDuration = 0;
+	this->ewmaValue = std::numeric_limits<double>::quiet_NaN();
+
+	port->addChangeQueue(&this->queue);
+	this->append(opdi::Clock::get().now().epochMicroseconds() / 1000, *this->valuePtr);
+}
+
+const PortValueWindow::Sample& PortValueWindow::sample(uint64_t seq) const {
+	// sequence numbers are consecutive
+	return this->samples[(size_t)(seq - this->samples.front().seq)];
+}
+
+void PortValueWindow::append(int64_t time, double value) {
+	if (!this->samples.empty()) {
+		Sample& last = this->samples.back();
+		// changes are expected in chronological order
+		if (time < last.time)
+			time = last.time;
+		// close the segment of the last sample
+		if (!std::isnan(last.value)) {
+			double duration = (double)(time - last.time);
+			last.area = last.value * duration;
+			last.duration = duration;
+			this->area += last.area;
+			this->finiteDuration += duration;
+			// advance the moving average
+			this->ewmaValue = last.value + (this->ewmaValue - last.value) * exp(-duration / (double)this->durationMs);
+		}
+	}
+	if (std::isnan(this->ewmaValue))
+		this->ewmaValue = value;
+
+	Sample sample = { time, value, 0, 0, this->nextSeq++ };
+	this->samples.push_back(sample);
+
+	if (!std::isnan(value)) {
+		while (!this->minSamples.empty() && (this->sample(this->minSamples.back()).value >= value))
+			this->minSamples.pop_back();
+		this->minSamples.push_back(sample.seq);
+		while (!this->maxSamples.empty() && (this->sample(this->maxSamples.back()).value <= value))
+			this->maxSamples.pop_back();
+		this->maxSamples.push_back(sample.seq);
+	}
+}
+
+void PortValueWindow::expire(int64_t start) {
+	// remove samples that are no longer in effect at the start of the window
+	while ((this->samples.size() > 1) && (this->samples[1].time <= start)) {
+		const Sample& front = this->samples.front();
+		this->area -= front.area;
+		this->finiteDuration -= front.duration;
+		if (!this->minSamples.empty() && (this->minSamples.front() == front.seq))
+			this->minSamples.pop_front();
+		if (!this->maxSamples.empty() && (this->maxSamples.front() == front.seq))
+			this->maxSamples.pop_front();
+		this->samples.pop_front();
+	}
+	// avoid accumulating rounding errors
+	if (this->samples.size() == 1) {
+		this->area = 0;
+		this->finiteDuration = 0;
+	}
+}
+
+void PortValueWindow::update(int64_t now) {
+	opdi::PortChangeQueue::Change change;
+	while (this->queue.pop(change))
+		this->append((int64_t)change.timestamp, change.value);
+
+	// catch values that have been set without a change notification, or lost changes
+	double current = *this->valuePtr;
+	if (memcmp(&current, &this->samples.back().value, sizeof(double)) != 0)
+		this->append(now, current);
+
+	this->expire(now - this->durationMs);
+}
+
+double PortValueWindow::average(int64_t now) const {
+	int64_t start = now - this->durationMs;
+	double area = this->area;
+	double duration = this->finiteDuration;
+
+	// subtract the part of the first segment that lies before the window
+	const Sample& front = this->samples.front();
+	if ((this->samples.size() > 1) && (front.time < start) && !std::isnan(front.value)) {
+		double before = (double)(start - front.time);
+		area -= front.value * before;
+		duration -= before;
+	}
+	// add the segment of the current value
+	const Sample& last = this->samples.back();
+	if (!std::isnan(last.value)) {
+		double current = (double)(now - (last.time > start ? last.time : start));
+		area += last.value * current;
+		duration += current;
+	}
+
+	if (duration > 0)
+		return area / duration;
+	return last.value;
+}
+
+double PortValueWindow::minimum(void) const {
+	if (this->minSamples.empty())
+		return std::numeric_limits<double>::quiet_NaN();
+	return this->sample(this->minSamples.front()).value;
+}
+
+double PortValueWindow::maximum(void) const {
+	if (this->maxSamples.empty())
+		return std::numeric_limits<double>::quiet_NaN();
+	return this->sample(this->maxSamples.front()).value;
+}
+
+double PortValueWindow::delta(void) const {
+	return this->samples.back().value - this->samples.front().value;
+}
+
+double PortValueWindow::rate(int64_t now) const {
+	int64_t start = now - this->durationMs;
+	int64_t first = this->samples.front().time;
+	double seconds = (double)(now - (first > start ? first : start)) / 1000.0;
+	if (seconds <= 0)
+		return std::numeric_limits<double>::quiet_NaN();
+	return this->delta() / seconds;
+}
+
+double PortValueWindow::ewma(int64_t now) const {
+	const Sample& last = this->samples.back();
+	if (std::isnan(last.value))
+		return this->ewmaValue;
+	return last.value + (this->ewmaValue - last.value) * exp(-(double)(now - last.time) / (double)this->durationMs);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Window functions
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct WindowRegistry {
+	Poco::Mutex mutex;
+	std::map<double*, opdi::Port*> ports;
+	std::map<std::pair<double*, int64_t>, std::unique_ptr<PortValueWindow> > windows;
+};
+
+WindowRegistry& getWindowRegistry(void) {
+	static WindowRegistry registry;
+	return registry;
+}
+
+}	// end anonymous namespace
+
+void window_func::registerPort(opdi::Port* port) {
+	WindowRegistry& registry = getWindowRegistry();
+	Poco::Mutex::ScopedLock lock(registry.mutex);
+	registry.ports[&port->getValuePtr()] = port;
+}
+
+PortValueWindow* window_func::getWindow(double* valuePtr, int64_t durationMs) {
+	WindowRegistry& registry = getWindowRegistry();
+	Poco::Mutex::ScopedLock lock(registry.mutex);
+	auto key = std::make_pair(valuePtr, durationMs);
+	auto it = registry.windows.find(key);
+	if (it != registry.windows.end())
+		return it->second.get();
+	// the window starts when it is first used
+	auto pit = registry.ports.find(valuePtr);
+	if (pit == registry.ports.end())
+		return nullptr;
+	PortValueWindow* window = new PortValueWindow(pit->second, durationMs);
+	registry.windows[key].reset(window);
+	return window;
+}
+
+void window_func::unregisterValue(double* valuePtr) {
+	WindowRegistry& registry = getWindowRegistry();
+	Poco::Mutex::ScopedLock lock(registry.mutex);
+	registry.ports.erase(valuePtr);
+	auto it = registry.windows.lower_bound(std::make_pair(valuePtr, std::numeric_limits<int64_t>::min()));
+	while ((it != registry.windows.end()) && (it->first.first == valuePtr))
+		it = registry.windows.erase(it);
+}
+
+double window_func::operator()(parameter_list_t parameters) {
+	// the first argument refers to the variable that is bound to the port value
+	scalar_t port(parameters[0]);
+	scalar_t seconds(parameters[1]);
+
+	if (!(seconds() > 0))
+		return std::numeric_limits<double>::quiet_NaN();
+	PortValueWindow* window = getWindow(&port(), (int64_t)(seconds() * 1000));
+	if (window == nullptr)
+		return std::numeric_limits<double>::quiet_NaN();
+
+	int64_t now = opdi::Clock::get().now().epochMicroseconds() / 1000;
+	window->update(now);
+	switch (this->aggregate) {
+	case AVERAGE: return window->average(now);
+	case MINIMUM: return window->minimum();
+	case MAXIMUM: return window->maximum();
+	case DELTA: return window->delta();
+	case RATE: return window->rate(now);
+	case EWMA: return window->ewma(now);
+	}
+	return std::numeric_limits<double>::quiet_NaN();
+}
+
+AstroTable* astro_func::table = nullptr;
+
 ///////////////////////////////////////////////////////////////////////////////
 // Expression Port
 ///////////////////////////////////////////////////////////////////////////////
 
 ExpressionPort::ExpressionPort(AbstractOpenHAT* openhat, const char* id) : opdi::DigitalPort(id, OPDI_PORTDIRCAP_OUTPUT, 0) {
 	this->opdi = this->openhat = openhat;
+	astro_func::table = &openhat->getAstroTable();
 	this->numIterations = 0;
 	this->fallbackSpecified = false;
 	this->fallbackValue = 0;
 	this->deactivationSpecified = false;
 	this->deactivationValue = 0;
+	this->continuous = true;
+	this->usesTime = false;
+	this->evaluationRequired = true;
+	this->lastEvaluationTime = 0;
+	this->cacheCompiled = false;
 
 	opdi::DigitalPort::setMode(OPDI_DIGITAL_MODE_OUTPUT);
 
@@ -55,6 +288,206 @@ void ExpressionPort::configure(ConfigurationView::Ptr config) {
 		this->deactivationValue = config->getDouble("DeactivationValue");
 		this->deactivationSpecified = true;
 	}
+
+	std::string evaluation = config->getString("Evaluation", "Continuous");
+	if (evaluation == "Change")
+		this->continuous = false;
+	else
+	if (evaluation == "Continuous")
+		this->continuous = true;
+	else
+		this->openhat->throwSettingException(this->ID() + ": Invalid value for Evaluation, expected 'Change' or 'Continuous': " + evaluation);
+
+	// configured expressions don't change; expressions of dynamically created ports (plugins) are not cached
+	this->cacheCompiled = true;
+}
+
+ExpressionPort::symbol_table_t& ExpressionPort::getSharedSymbolTable(void) {
+	static timestamp_func timestampFunc;
+	static window_func averageFunc(window_func::AVERAGE);
+	static window_func minimumFunc(window_func::MINIMUM);
+	static window_func maximumFunc(window_func::MAXIMUM);
+	static window_func deltaFunc(window_func::DELTA);
+	static window_func rateFunc(window_func::RATE);
+	static window_func ewmaFunc(window_func::EWMA);
+	static astro_func sunriseFunc(AstroTable::SUNRISE);
+	static astro_func sunsetFunc(AstroTable::SUNSET);
+	static astro_func dawnFunc(AstroTable::CIVIL_DAWN);
+	static astro_func duskFunc(AstroTable::CIVIL_DUSK);
+	static symbol_table_t sharedSymbolTable;
+
+	// a table that has been replaced by beginSymbolTransaction() needs the functions, too
+	if (sharedSymbolTable.function_count() == 0) {
+		sharedSymbolTable.add_function("timestamp", timestampFunc);
+		sharedSymbolTable.add_function("wavg", averageFunc);
+		sharedSymbolTable.add_function("wmin", minimumFunc);
+		sharedSymbolTable.add_function("wmax", maximumFunc);
+		sharedSymbolTable.add_function("delta", deltaFunc);
+		sharedSymbolTable.add_function("rate", rateFunc);
+		sharedSymbolTable.add_function("ewma", ewmaFunc);
+		sharedSymbolTable.add_function("sunrise", sunriseFunc);
+		sharedSymbolTable.add_function("sunset", sunsetFunc);
+		sharedSymbolTable.add_function("dawn", dawnFunc);
+		sharedSymbolTable.add_function("dusk", duskFunc);
+	}
+	return sharedSymbolTable;
+}
+
+ExpressionPort::CompileCache& ExpressionPort::getCompileCache(void) {
+	static CompileCache compileCache;
+	return compileCache;
+}
+
+std::string ExpressionPort::getArgumentName(size_t index) {
+	// symbols must start with a letter; the name must not collide with a port ID
+	return "openhat_arg" + std::to_string(index) + "_";
+}
+
+bool ExpressionPort::normalize(std::string& normalized, std::vector<std::string>& variables, std::string& shape) {
+	const std::string& text = this->expressionStr;
+	// indexes of the positional variables by lower case variable name (symbols are case-insensitive)
+	std::map<std::string, size_t> indexes;
+
+	normalized.clear();
+	variables.clear();
+	shape.clear();
+
+	// use the tokenizer of ExprTk so that symbols are recognized exactly as by the parser
+	// (string literals and comments are not tokenized as symbols)
+	exprtk::lexer::generator generator;
+	if (!generator.process(text))
+		return false;
+
+	size_t copied = 0;
+	for (std::size_t i = 0; i < generator.size(); ++i) {
+		const exprtk::lexer::token& token = generator[i];
+		if (token.type != exprtk::lexer::token::e_symbol)
+			continue;
+		const std::string& name = token.value;
+
+		// function call?
+		if ((i + 1 < generator.size()) && (generator[i + 1].type == exprtk::lexer::token::e_lbracket)) {
+			// window functions identify the port by its variable
+			if ((Poco::icompare(name, "wavg") == 0) || (Poco::icompare(name, "wmin") == 0)
+				|| (Poco::icompare(name, "wmax") == 0) || (Poco::icompare(name, "delta") == 0)
+				|| (Poco::icompare(name, "rate") == 0) || (Poco::icompare(name, "ewma") == 0))
+				return false;
+			continue;
+		}
+
+		// port variable? (see prepareVariables)
+		std::string portname = name;
+		bool needsValidation = endsWith(portname, std::string("._"));
+		if (needsValidation)
+			portname = portname.substr(0, portname.size() - 2);
+		opdi::Port* port = this->openhat->findPortByID(portname.c_str(), true);
+		// keywords, constants and local variables remain unchanged
+		if (port == nullptr)
+			continue;
+
+		std::string key = Poco::toLower(name);
+		auto it = indexes.find(key);
+		size_t index;
+		if (it == indexes.end()) {
+			index = variables.size();
+			indexes[key] = index;
+			variables.push_back(name);
+			shape += port->getType()[0];
+			if (needsValidation)
+				shape += '!';
+		} else
+			index = it->second;
+
+		// replace the symbol in the original text
+		normalized.append(text, copied, token.position - copied);
+		normalized += getArgumentName(index);
+		copied = token.position + name.size();
+	}
+	normalized.append(text, copied, std::string::npos);
+	return true;
+}
+
+bool ExpressionPort::compileNormalized(const std::string& normalized, size_t argumentCount, CompiledExpression& compiled) {
+	compiled.arguments = std::make_shared<std::vector<double>>(argumentCount, 0.0);
+	symbol_table_t argumentSymbols;
+	for (size_t i = 0; i < argumentCount; i++) {
+		if (!argumentSymbols.add_variable(getArgumentName(i), (*compiled.arguments)[i]))
+			return false;
+	}
+	compiled.expression = expression_t();
+	compiled.expression.register_symbol_table(argumentSymbols);
+	compiled.expression.register_symbol_table(getSharedSymbolTable());
+
+	parser_t parser;
+	parser.dec().collect_variables() = true;
+	parser.dec().collect_functions() = true;
+	// errors are reported by compiling the original expression
+	if (!parser.compile(normalized, compiled.expression))
+		return false;
+	compiled.symbols.clear();
+	parser.dec().symbols(compiled.symbols);
+	// every variable collected by the parser must be a positional variable; otherwise the expression
+	// still refers to a port variable of the shared symbol table
+	for (auto it = compiled.symbols.cbegin(), ite = compiled.symbols.cend(); it != ite; ++it) {
+		if ((it->second == parser_t::e_st_variable) && !argumentSymbols.symbol_exists(it->first))
+			return false;
+	}
+	return true;
+}
+
+Poco::Mutex& ExpressionPort::getSharedSymbolMutex(void) {
+	static Poco::Mutex mutex;
+	return mutex;
+}
+
+namespace {
+
+// the shared symbol table that is used by the existing expressions during a symbol transaction
+exprtk::symbol_table<double> savedSymbolTable;
+bool symbolTransaction = false;
+
+}	// end anonymous namespace
+
+void ExpressionPort::beginSymbolTransaction(void) {
+	Poco::Mutex::ScopedLock lock(getSharedSymbolMutex());
+
+	// existing expressions keep their reference to the current table
+	savedSymbolTable = getSharedSymbolTable();
+	getSharedSymbolTable() = symbol_table_t();
+	symbolTransaction = true;
+	getCompileCache().clear();
+}
+
+void ExpressionPort::endSymbolTransaction(bool commit) {
+	Poco::Mutex::ScopedLock lock(getSharedSymbolMutex());
+
+	if (!symbolTransaction)
+		return;
+	if (!commit)
+		getSharedSymbolTable() = savedSymbolTable;
+	savedSymbolTable = symbol_table_t();
+	symbolTransaction = false;
+	// cached expressions may refer to the discarded table
+	getCompileCache().clear();
+}
+
+void ExpressionPort::releaseValues(const std::vector<double*>& valuePtrs) {
+	Poco::Mutex::ScopedLock lock(getSharedSymbolMutex());
+
+	// cached expressions may refer to the variables
+	getCompileCache().clear();
+
+	symbol_table_t& sharedSymbols = getSharedSymbolTable();
+	std::vector<std::string> variables;
+	sharedSymbols.get_variable_list(variables);
+	for (auto it = variables.begin(), ite = variables.end(); it != ite; ++it) {
+		double* value = &sharedSymbols.get_variable(*it)->ref();
+		if (std::find(valuePtrs.begin(), valuePtrs.end(), value) != valuePtrs.end())
+			sharedSymbols.remove_variable(*it);
+	}
+
+	for (auto it = valuePtrs.begin(), ite = valuePtrs.end(); it != ite; ++it)
+		window_func::unregisterValue(*it);
 }
 
 bool ExpressionPort::setLine(uint8_t line, ChangeSource changeSource) {
@@ -67,6 +500,7 @@ bool ExpressionPort::setLine(uint8_t line, ChangeSource changeSource) {
 	if (line == 1) {
 		this->logDebug("Expression activated, number of iterations: " + this->to_string(this->numIterations));
 		this->iterations = this->numIterations;
+		this->evaluationRequired = true;
 	}
 	// set to 0; check whether to set a deactivation value
 	else {
@@ -79,8 +513,8 @@ bool ExpressionPort::setLine(uint8_t line, ChangeSource changeSource) {
 	return true;
 }
 
-bool ExpressionPort::prepareSymbols(symbol_table_t& symTab, bool /*duringSetup*/) {
-	symTab.add_function("timestamp", this->timestampFunc);
+bool ExpressionPort::prepareSymbols(symbol_table_t& /*symTab*/, bool /*duringSetup*/) {
+	// Custom functions are contained in the shared symbol table.
 
 	// Adding constants leads to a memory leak; furthermore, constants are not detected as known symbols.
 	// As there are only three constants (pi, epsilon, infinity) we can well do without this function.
@@ -91,12 +525,26 @@ bool ExpressionPort::prepareSymbols(symbol_table_t& symTab, bool /*duringSetup*/
 
 bool ExpressionPort::prepareVariables(bool duringSetup) {
 	std::string validationMarker("._");	// special marker for ports that need to be validated
+	symbol_table_t& sharedSymbols = getSharedSymbolTable();
+
+	this->usesTime = false;
+	this->inputValues.clear();
+	this->validationPorts.clear();
 
 	// go through dependent entities (variables) of the expression
 	for (std::size_t i = 0; i < this->symbol_list.size(); ++i)
 	{
 		symbol_t& symbol = this->symbol_list[i];
 
+		// the results of these functions change over time
+		if ((symbol.second == parser_t::e_st_function) && ((Poco::icompare(symbol.first, "timestamp") == 0)
+			|| (Poco::icompare(symbol.first, "wavg") == 0) || (Poco::icompare(symbol.first, "wmin") == 0)
+			|| (Poco::icompare(symbol.first, "wmax") == 0) || (Poco::icompare(symbol.first, "delta") == 0)
+			|| (Poco::icompare(symbol.first, "rate") == 0) || (Poco::icompare(symbol.first, "ewma") == 0)
+			|| (Poco::icompare(symbol.first, "sunrise") == 0) || (Poco::icompare(symbol.first, "sunset") == 0)
+			|| (Poco::icompare(symbol.first, "dawn") == 0) || (Poco::icompare(symbol.first, "dusk") == 0)))
+			this->usesTime = true;
+
 		if (symbol.second != parser_t::e_st_variable)
 			continue;
 
@@ -122,52 +570,153 @@ bool ExpressionPort::prepareVariables(bool duringSetup) {
 			throw PortError(this->ID() + ": Cannot use a streaming port in an expression: " + portname);
 		else {
 			// numeric port value
-			// add reference to the port value (by symbol name)
-			if (!this->symbol_table.add_variable(symbol.first, port->getValuePtr()))
+			// add reference to the port value (by symbol name) unless another expression already did
+			if (!sharedSymbols.symbol_exists(symbol.first) && !sharedSymbols.add_variable(symbol.first, port->getValuePtr()))
 				return false;
 			if (needsValidation)
 				this->validationPorts.push_back(port);
+			this->inputValues.push_back(&port->getValuePtr());
+			window_func::registerPort(port);
 		}
 	}
 
 	return true;
 }
 
-void ExpressionPort::prepare() {
-	opdi::DigitalPort::prepare();
+void ExpressionPort::compile(void) {
+	symbol_table_t& sharedSymbols = getSharedSymbolTable();
 
-	// find ports; throws errors if something required is missing
-	this->findPorts(this->getID(), "OutputPorts", this->outputPortStr, this->outputPorts);
-	this->findPorts(this->getID(), "RequiredPorts", this->requiredPortStr, this->requiredPorts);
+	parser_t parser;
+	// collect variables and functions as symbol names
+	parser.dec().collect_variables() = true;
+	parser.dec().collect_functions() = true;
+
+	// try to compile directly; this succeeds if all port variables have already been bound
+	// by other expressions, so the expression needs to be compiled only once
+	if (parser.compile(this->expressionStr, this->expression)) {
+		parser.dec().symbols(this->symbol_list);
+		if (!this->prepareVariables(true))
+			throw Poco::Exception(this->ID() + ": Unable to resolve variables");
+		return;
+	}
 
+	// unknown symbols are added to the first symbol table
 	symbol_table_t localSymtab;
 	expression_t localExpr;
 	localExpr.register_symbol_table(localSymtab);
+	localExpr.register_symbol_table(sharedSymbols);
 	this->prepareSymbols(localSymtab, true);
 
-	parser_t parser;
 	parser.enable_unknown_symbol_resolver();
-	// collect only variables as symbol names
-	parser.dec().collect_variables() = true;
 
 	// compile to detect variables
 	if (!parser.compile(this->expressionStr, localExpr))
 		throw Poco::Exception(this->ID() + ": Error in expression: " + parser.error());
 
-	// store symbol list (input variables)
+	// store symbol list (input variables and used functions)
+	this->symbol_list.clear();
 	parser.dec().symbols(this->symbol_list);
 
-	// prepare actual symbol table
-	this->expression.register_symbol_table(symbol_table);
-	this->prepareSymbols(this->symbol_table, true);
+	// bind the variables to the port values
 	if (!this->prepareVariables(true)) {
 		throw Poco::Exception(this->ID() + ": Unable to resolve variables");
 	}
 
 	parser.disable_unknown_symbol_resolver();
 	parser.dec().collect_variables() = false;
+	parser.dec().collect_functions() = false;
 	if (!parser.compile(this->expressionStr, this->expression))
 		throw Poco::Exception(this->ID() + ": Error in expression: " + parser.error());
+}
+
+void ExpressionPort::prepare() {
+	opdi::DigitalPort::prepare();
+
+	// find ports; throws errors if something required is missing
+	this->findPorts(this->getID(), "OutputPorts", this->outputPortStr, this->outputPorts);
+	this->findPorts(this->getID(), "RequiredPorts", this->requiredPortStr, this->requiredPorts);
+
+	// the shared symbol table may be used by expressions that are prepared in other threads (plugins)
+	Poco::Mutex::ScopedLock lock(getSharedSymbolMutex());
+
+	// prepare actual symbol tables
+	this->symbol_list.clear();
+	this->expression = expression_t();
+	this->expression.register_symbol_table(this->symbol_table);
+	this->expression.register_symbol_table(getSharedSymbolTable());
+	this->prepareSymbols(this->symbol_table, true);
+
+	// Expressions that differ only in the referenced ports share their compiled form: the port variables
+	// are replaced by positional variables that are set from the port values before each evaluation.
+	// This is not possible if a port defines symbols of its own.
+	bool cacheable = this->cacheCompiled && (this->symbol_table.variable_count() == 0) && (this->symbol_table.function_count() == 0);
+	CompileCache& cache = getCompileCache();
+	this->arguments.reset();
+	this->argumentValues.clear();
+	std::string normalized;
+	std::vector<std::string> variables;
+	std::string shape;
+	if (cacheable && this->normalize(normalized, variables, shape)) {
+		std::string key = normalized + '\n' + shape;
+		auto cached = cache.find(key);
+		if (cached != cache.end())
+			this->logDebug("Using cached compiled expression");
+		else {
+			CompiledExpression compiled;
+			if (this->compileNormalized(normalized, variables.size(), compiled))
+				cached = cache.emplace(key, compiled).first;
+		}
+		if (cached != cache.end()) {
+			this->expression = cached->second.expression;
+			this->arguments = cached->second.arguments;
+			// replace the positional variables by the port variables of this expression
+			std::map<std::string, size_t> indexes;
+			for (size_t i = 0; i < variables.size(); i++)
+				indexes[getArgumentName(i)] = i;
+			this->symbol_list.clear();
+			for (auto it = cached->second.symbols.begin(), ite = cached->second.symbols.end(); it != ite; ++it) {
+				symbol_t symbol = *it;
+				auto index = indexes.find(Poco::toLower(symbol.first));
+				if ((symbol.second == parser_t::e_st_variable) && (index != indexes.end()))
+					symbol.first = variables[index->second];
+				this->symbol_list.push_back(symbol);
+			}
+			if (!this->prepareVariables(true))
+				throw Poco::Exception(this->ID() + ": Unable to resolve variables");
+			for (auto it = variables.begin(), ite = variables.end(); it != ite; ++it) {
+				std::string portname = *it;
+				if (endsWith(portname, std::string("._")))
+					portname = portname.substr(0, portname.size() - 2);
+				this->argumentValues.push_back(&this->openhat->findPortByID(portname.c_str(), true)->getValuePtr());
+			}
+		}
+	}
+
+	if (!this->arguments) {
+		// cache by expression text; port variables are bound in the shared symbol table,
+		// so identical texts bind the same values
+		auto cached = (cacheable ? cache.find(this->expressionStr) : cache.end());
+		if (cached != cache.end()) {
+			this->logDebug("Using cached compiled expression");
+			this->symbol_list = cached->second.symbols;
+			this->expression = cached->second.expression;
+			if (!this->prepareVariables(true))
+				throw Poco::Exception(this->ID() + ": Unable to resolve variables");
+		} else {
+			this->compile();
+			if (cacheable) {
+				CompiledExpression& compiled = cache[this->expressionStr];
+				compiled.symbols = this->symbol_list;
+				compiled.expression = this->expression;
+			}
+		}
+	}
+
+	// required ports are inputs, too
+	for (auto it = this->requiredPorts.begin(), ite = this->requiredPorts.end(); it != ite; ++it)
+		this->inputValues.push_back(&(*it)->getValuePtr());
+	this->lastInputValues.assign(this->inputValues.size(), 0);
+	this->evaluationRequired = true;
 
 	// initialize the number of iterations
 	// if the port is Low this has no effect; if it is High it will disable after the evaluation
@@ -247,6 +796,10 @@ double ExpressionPort::apply() {
 	double value = std::numeric_limits<double>::quiet_NaN();
 
 	if (ok) {
+		// set the positional variables of a shared expression
+		for (size_t i = 0; i < this->argumentValues.size(); i++)
+			(*this->arguments)[i] = *this->argumentValues[i];
+
 		value = expression.value();
 
 		this->logExtreme("Expression result: " + to_string(value));
@@ -265,10 +818,37 @@ double ExpressionPort::apply() {
 	return value;
 }
 
+bool ExpressionPort::inputsChanged(void) {
+	bool changed = this->evaluationRequired;
+	this->evaluationRequired = false;
+
+	// compare bitwise to detect changes from and to NaN
+	for (size_t i = 0; i < this->inputValues.size(); i++) {
+		if (memcmp(this->inputValues[i], &this->lastInputValues[i], sizeof(double)) != 0) {
+			this->lastInputValues[i] = *this->inputValues[i];
+			changed = true;
+		}
+	}
+
+	if (this->usesTime) {
+		time_t now = opdi::Clock::get().now().epochTime();
+		if (now != this->lastEvaluationTime) {
+			this->lastEvaluationTime = now;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
 uint8_t ExpressionPort::doWork(uint8_t canSend)  {
 	opdi::DigitalPort::doWork(canSend);
 
 	if (this->getLine() == 1) {
+		// evaluate only if necessary
+		if (!this->continuous && !this->inputsChanged())
+			return OPDI_STATUS_OK;
+
 		this->apply();
 		
 		// maximum number of iterations specified and reached?
@@ -4,11 +4,17 @@
 #define _SCL_SECURE_NO_WARNINGS	1
 
 #include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <limits>
 
 #include "Poco/Util/AbstractConfiguration.h"
 #include "Poco/Timestamp.h"
+#include "Poco/Mutex.h"
 
 #include "AbstractOpenHAT.h"
+#include "AstroTable.h"
 
 // expression evaluation library
 // avoid excessive g++ 7 (and newer) compile warnings
@@ -36,8 +42,12 @@ namespace openhat {
 /** An ExpressionPort is a DigitalPort that sets the value of other ports
 *   depending on the result of a calculation expression.
 *   Expression syntax documentation: http://partow.net/programming/exprtk/index.html
-*   The expression is evaluated in each doWork iteration if the ExpressionPort is enabled,
-*   i. e. its digital state is High (default).
+*   The expression is evaluated in the doWork iteration if the ExpressionPort is enabled,
+*   i. e. its digital state is High (default). By default (Evaluation = Continuous) the expression
+*   is evaluated in each doWork iteration. With Evaluation = Change it is only evaluated if the
+*   value of one of its input ports or required ports has changed, when the port is activated,
+*   and once per second if the expression uses the timestamp() function.
+*   The port values are bound to a symbol table that is shared by all ExpressionPorts.
 *   The expression can refer to port IDs (input variables). Although these port IDs are case-
 *   insensitive (a restriction of the underlying library), it is recommended to use the correct case.
 *   The rules for the different port types are:
@@ -66,6 +76,23 @@ namespace openhat {
 *   deactivated.
 *   The ExpressionPort supports the following custom functions:
 *    - timestamp(): Returns the number of seconds since 1/1/1970 00:00 UTC.
+*    - wavg(port, seconds): Returns the time-weighted average of the port value over the last seconds.
+*    - wmin(port, seconds), wmax(port, seconds): Return the minimum or maximum port value over the last seconds.
+*    - delta(port, seconds): Returns the difference between the current port value and the value
+*      at the start of the window.
+*    - rate(port, seconds): Returns the delta divided by the covered time span in seconds.
+*    - ewma(port, seconds): Returns the exponentially weighted moving average of the port value
+*      using seconds as the time constant.
+*   The first argument of these window functions must be a port ID. The windows are maintained
+*   incrementally from the port state changes and are shared between all expressions that use
+*   the same port and number of seconds. A window starts when it is first used; until it is full
+*   the functions use the available history. Unavailable (error) values are ignored.
+*   (avg, min and max are built-in ExprTk functions and cannot be redefined.)
+*    - sunrise(lat, lon), sunset(lat, lon): Return the time of today's sunrise or sunset at the specified
+*      location in seconds since 1/1/1970 00:00 UTC.
+*    - dawn(lat, lon), dusk(lat, lon): Return the time of the beginning or end of today's civil twilight.
+*   These functions return NaN if the event does not occur today (polar day or night). The times are
+*   taken from the AstroTable that is shared by the whole process.
 */
 #ifdef OPENHAT_USE_EXPRTK
 
@@ -79,10 +106,115 @@ struct timestamp_func : public exprtk::ifunction<double>
 	double operator()()
 	{
 		// return epoch time since midnight, 1 January 1970, in seconds
-		return (double)Poco::Timestamp().epochTime();
+		return (double)opdi::Clock::get().now().epochTime();
 	}
 };
 
+/// ExprTk function that returns the time of an astronomical event of the current day.
+struct astro_func : public exprtk::ifunction<double>
+{
+	AstroTable::Event event;
+
+	// the table of openhatd; set by the Expression ports because plugins link their own AstroTable
+	static AstroTable* table;
+
+	explicit astro_func(AstroTable::Event event)
+	: exprtk::ifunction<double>(2), event(event)
+	{}
+
+	double operator()(const double& latitude, const double& longitude)
+	{
+		Poco::Timestamp result;
+		if ((table == nullptr) || !table->getEvent(latitude, longitude, this->event, opdi::Clock::get().now(), &result))
+			return std::numeric_limits<double>::quiet_NaN();
+		return (double)result.epochTime();
+	}
+};
+
+/// A sliding time window over the values of a port. The port value is treated as a step function;
+/// the window contains the samples that are in effect during the window, i. e. the first sample may
+/// be older than the start of the window. Aggregates are maintained incrementally.
+class PortValueWindow {
+protected:
+	struct Sample {
+		int64_t time;			// milliseconds since the epoch
+		double value;
+		double area;			// value * duration until the next sample (if finite)
+		double duration;		// duration until the next sample if the value is finite
+		uint64_t seq;
+	};
+
+	double* valuePtr;
+	int64_t durationMs;
+	opdi::PortChangeQueue queue;
+	std::deque<Sample> samples;
+	// sequence numbers of the samples with increasing (min) or decreasing (max) values
+	std::deque<uint64_t> minSamples;
+	std::deque<uint64_t> maxSamples;
+	uint64_t nextSeq;
+	double area;
+	double finiteDuration;
+	double ewmaValue;
+
+	void append(int64_t time, double value);
+
+	void expire(int64_t start);
+
+	const Sample& sample(uint64_t seq) const;
+
+public:
+	PortValueWindow(opdi::Port* port, int64_t durationMs);
+
+	/// Incorporates the changes of the port up to the specified time.
+	void update(int64_t now);
+
+	double average(int64_t now) const;
+
+	double minimum(void) const;
+
+	double maximum(void) const;
+
+	double delta(void) const;
+
+	double rate(int64_t now) const;
+
+	double ewma(int64_t now) const;
+};
+
+/// ExprTk window function. The first argument must be a port variable, the second the window length in seconds.
+struct window_func : public exprtk::igeneric_function<double>
+{
+	typedef exprtk::igeneric_function<double>::generic_type generic_t;
+	typedef exprtk::igeneric_function<double>::parameter_list_t parameter_list_t;
+	typedef generic_t::scalar_view scalar_t;
+
+	enum Aggregate {
+		AVERAGE,
+		MINIMUM,
+		MAXIMUM,
+		DELTA,
+		RATE,
+		EWMA
+	};
+
+	Aggregate aggregate;
+
+	explicit window_func(Aggregate aggregate)
+	: exprtk::igeneric_function<double>("TT"), aggregate(aggregate)
+	{}
+
+	double operator()(parameter_list_t parameters);
+
+	/// Makes the value of the port available to window functions.
+	static void registerPort(opdi::Port* port);
+
+	/// Returns the window for the specified port value and length, or nullptr if the value does not belong to a port.
+	static PortValueWindow* getWindow(double* valuePtr, int64_t durationMs);
+
+	/// Discards the windows of the specified port value. Called when the port has been freed.
+	static void unregisterValue(double* valuePtr);
+};
+
 class ExpressionPort : public opdi::DigitalPort {
 protected:
 	openhat::AbstractOpenHAT* openhat;
@@ -93,8 +225,6 @@ protected:
 	double deactivationValue;
 	bool deactivationSpecified;
 
-	timestamp_func timestampFunc;
-
 	typedef exprtk::symbol_table<double> symbol_table_t;
 	typedef exprtk::expression<double> expression_t;
 	typedef exprtk::parser<double> parser_t;
@@ -108,6 +238,59 @@ protected:
 	opdi::PortList requiredPorts;
 	std::vector<opdi::Port*> validationPorts;
 
+	// change detection
+	bool continuous;
+	bool usesTime;
+	bool evaluationRequired;
+	time_t lastEvaluationTime;
+	std::vector<double*> inputValues;
+	std::vector<double> lastInputValues;
+
+	/// Returns the symbol table that contains the port variables and the custom functions.
+	/// It is shared by all expressions. Access must be protected by the shared symbol mutex.
+	static symbol_table_t& getSharedSymbolTable(void);
+
+	static Poco::Mutex& getSharedSymbolMutex(void);
+
+	// compiled expressions by normalized expression text and binding shape
+	// (or by expression text if the expression can't be normalized)
+	struct CompiledExpression {
+		std::deque<symbol_t> symbols;
+		expression_t expression;
+		// values of the positional variables of a normalized expression
+		std::shared_ptr<std::vector<double>> arguments;
+	};
+	typedef std::map<std::string, CompiledExpression> CompileCache;
+	bool cacheCompiled;
+
+	// positional variables of a shared normalized expression and the port values they are set from
+	std::shared_ptr<std::vector<double>> arguments;
+	std::vector<double*> argumentValues;
+
+	static CompileCache& getCompileCache(void);
+
+	/// Returns the name of the positional variable with the specified index.
+	static std::string getArgumentName(size_t index);
+
+	/// Replaces the port variables of the expression by positional variables (numbered in the order of
+	/// their first occurrence), so expressions that differ only in the referenced ports have the same text.
+	/// The symbols are determined by the ExprTk tokenizer.
+	/// Returns the port variables in variables and their port types and validation markers in shape.
+	/// Returns false if the expression can't be normalized because it uses window functions.
+	bool normalize(std::string& normalized, std::vector<std::string>& variables, std::string& shape);
+
+	/// Compiles a normalized expression; its positional variables are bound to compiled.arguments.
+	/// Returns false if the expression can't be compiled or if the parser collects a variable that is
+	/// not a positional variable.
+	bool compileNormalized(const std::string& normalized, size_t argumentCount, CompiledExpression& compiled);
+
+	/// Compiles the expression and binds its variables.
+	void compile(void);
+
+	/// Returns true if the expression needs to be evaluated because an input has changed.
+	/// Remembers the current input values.
+	bool inputsChanged(void);
+
 	virtual bool prepareSymbols(symbol_table_t& symTab, bool duringSetup);
 
 	virtual bool prepareVariables(bool duringSetup);
@@ -132,6 +315,20 @@ public:
 	virtual void prepare() override;
         
     virtual double apply(void);
+
+	/// Removes the variables that are bound to the specified values of freed ports from the shared symbol table
+	/// and discards all cached compiled expressions. Expressions that use these variables must have been freed before.
+	static void releaseValues(const std::vector<double*>& valuePtrs);
+
+	/// Replaces the shared symbol table by an empty table for expressions that are compiled until
+	/// endSymbolTransaction() is called. Existing expressions continue to use the current table.
+	/// Used to prepare the ports of a reloaded configuration while the current ports are still running.
+	static void beginSymbolTransaction(void);
+
+	/// Keeps the table that has been used since beginSymbolTransaction() (commit) or restores the
+	/// previous table (rollback). Expressions that have been compiled during a rolled back transaction
+	/// must have been freed before.
+	static void endSymbolTransaction(bool commit);
 };
 
 #endif // def OPENHAT_USE_EXPRTK
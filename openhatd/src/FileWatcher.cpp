@@ -0,0 +1,329 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "FileWatcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include "Poco/Path.h"
+#include "Poco/File.h"
+#include "Poco/Exception.h"
+#include "Poco/Delegate.h"
+
+#ifdef linux
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+namespace openhat {
+
+FileWatcher& FileWatcher::get(void) {
+	static FileWatcher instance;
+	return instance;
+}
+
+FileWatcher::FileWatcher() : queueHead(0), queueTail(0), queueOverflow(false) {
+	this->nextHandle = 1;
+#ifdef linux
+	this->inotifyFd = -1;
+	this->wakeupPipe[0] = -1;
+	this->wakeupPipe[1] = -1;
+#else
+	this->nextDirectory = 1;
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+	this->stop();
+}
+
+void FileWatcher::pushEvent(int directory, const char* name) {
+	size_t head = this->queueHead.load(std::memory_order_relaxed);
+	if (head - this->queueTail.load(std::memory_order_acquire) >= QUEUE_SIZE) {
+		// the main thread does not keep up; notify all listeners on the next dispatch
+		this->queueOverflow.store(true, std::memory_order_release);
+		return;
+	}
+	Event& event = this->queue[head % QUEUE_SIZE];
+	event.directory = directory;
+	strncpy(event.name, name, sizeof(event.name) - 1);
+	event.name[sizeof(event.name) - 1] = '\0';
+	this->queueHead.store(head + 1, std::memory_order_release);
+}
+
+int FileWatcher::addWatch(const std::string& filePath, IListener* listener) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	Poco::Path path(filePath);
+	std::string directoryPath = path.parent().toString();
+
+	this->start();
+
+	int directory;
+	auto dit = this->directoriesByPath.find(directoryPath);
+	if (dit == this->directoriesByPath.end()) {
+		try {
+			directory = this->addDirectory(directoryPath);
+		} catch (...) {
+			if (this->watches.empty())
+				this->stop();
+			throw;
+		}
+	} else {
+		directory = dit->second;
+		this->directories[directory].refCount++;
+	}
+
+	Watch watch;
+	watch.path = path.toString();
+	watch.directory = directory;
+	watch.listener = listener;
+
+	int handle = this->nextHandle++;
+	this->watches[handle] = watch;
+	this->watchesByPath.insert(std::make_pair(watch.path, handle));
+
+	return handle;
+}
+
+void FileWatcher::removeWatch(int handle) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+
+	auto it = this->watches.find(handle);
+	if (it == this->watches.end())
+		return;
+
+	auto range = this->watchesByPath.equal_range(it->second.path);
+	for (auto pit = range.first; pit != range.second; ++pit) {
+		if (pit->second == handle) {
+			this->watchesByPath.erase(pit);
+			break;
+		}
+	}
+
+	auto dit = this->directories.find(it->second.directory);
+	if ((dit != this->directories.end()) && (--dit->second.refCount == 0))
+		this->removeDirectory(dit->first);
+
+	this->watches.erase(it);
+
+	// stop the thread if nothing is being watched any more
+	if (this->watches.empty())
+		this->stop();
+}
+
+int FileWatcher::dispatchEvents(void) {
+	std::vector<int> handles;
+	int result = 0;
+
+	{
+		Poco::Mutex::ScopedLock lock(this->mutex);
+
+		if (this->queueOverflow.exchange(false, std::memory_order_acquire)) {
+			// events have been lost; notify everyone
+			for (auto it = this->watches.begin(), ite = this->watches.end(); it != ite; ++it)
+				handles.push_back(it->first);
+		}
+
+		size_t tail = this->queueTail.load(std::memory_order_relaxed);
+		size_t head = this->queueHead.load(std::memory_order_acquire);
+		while (tail != head) {
+			const Event& event = this->queue[tail % QUEUE_SIZE];
+			auto dit = this->directories.find(event.directory);
+			if (dit != this->directories.end()) {
+				std::string path = Poco::Path(Poco::Path(dit->second.path), event.name).toString();
+				auto range = this->watchesByPath.equal_range(path);
+				for (auto pit = range.first; pit != range.second; ++pit)
+					handles.push_back(pit->second);
+			}
+			tail++;
+			// release the slot to the producer
+			this->queueTail.store(tail, std::memory_order_release);
+			result++;
+		}
+	}
+
+	// notify each listener only once, even if there were several events for its file
+	std::sort(handles.begin(), handles.end());
+	handles.erase(std::unique(handles.begin(), handles.end()), handles.end());
+
+	// call the listeners without holding the lock; a handle may have been removed in the meantime
+	for (auto it = handles.begin(), ite = handles.end(); it != ite; ++it) {
+		IListener* listener = nullptr;
+		std::string path;
+		{
+			Poco::Mutex::ScopedLock lock(this->mutex);
+			auto wit = this->watches.find(*it);
+			if (wit == this->watches.end())
+				continue;
+			listener = wit->second.listener;
+			path = wit->second.path;
+		}
+		listener->fileChanged(path);
+	}
+
+	return result;
+}
+
+size_t FileWatcher::getWatchCount(void) {
+	Poco::Mutex::ScopedLock lock(this->mutex);
+	return this->watches.size();
+}
+
+#ifdef linux
+
+int FileWatcher::addDirectory(const std::string& path) {
+	// inotify returns the same watch descriptor for the same directory
+	int wd = inotify_add_watch(this->inotifyFd, path.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_MOVED_TO);
+	if (wd < 0)
+		throw Poco::FileException("Unable to watch directory: " + path, strerror(errno));
+
+	Directory directory;
+	directory.path = path;
+	directory.refCount = 1;
+	this->directories[wd] = directory;
+	this->directoriesByPath[path] = wd;
+	return wd;
+}
+
+void FileWatcher::removeDirectory(int directory) {
+	inotify_rm_watch(this->inotifyFd, directory);
+	this->directoriesByPath.erase(this->directories[directory].path);
+	this->directories.erase(directory);
+}
+
+void FileWatcher::start(void) {
+	if (this->inotifyFd >= 0)
+		return;
+
+	this->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (this->inotifyFd < 0)
+		throw Poco::SystemException("Unable to initialize inotify", strerror(errno));
+	if (pipe(this->wakeupPipe) != 0) {
+		close(this->inotifyFd);
+		this->inotifyFd = -1;
+		throw Poco::SystemException("Unable to create pipe", strerror(errno));
+	}
+
+	this->queueHead.store(0);
+	this->queueTail.store(0);
+	this->queueOverflow.store(false);
+
+	this->thread.setName("FileWatcher");
+	this->thread.start(*this);
+}
+
+void FileWatcher::stop(void) {
+	if (this->inotifyFd < 0)
+		return;
+
+	// wake up and wait for the thread
+	char c = 0;
+	if (write(this->wakeupPipe[1], &c, 1) < 0) {}
+	this->thread.join();
+
+	close(this->wakeupPipe[0]);
+	close(this->wakeupPipe[1]);
+	close(this->inotifyFd);
+	this->inotifyFd = -1;
+	this->directories.clear();
+	this->directoriesByPath.clear();
+}
+
+void FileWatcher::run(void) {
+	// buffer for at least one event with the maximum name length
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	struct pollfd fds[2];
+	fds[0].fd = this->inotifyFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = this->wakeupPipe[0];
+	fds[1].events = POLLIN;
+
+	while (true) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		// stop requested?
+		if (fds[1].revents != 0)
+			break;
+		if ((fds[0].revents & POLLIN) == 0)
+			continue;
+
+		ssize_t length;
+		while ((length = read(this->inotifyFd, buffer, sizeof(buffer))) > 0) {
+			for (char* ptr = buffer; ptr < buffer + length; ) {
+				const struct inotify_event* event = (const struct inotify_event*)ptr;
+				if ((event->mask & IN_Q_OVERFLOW) != 0)
+					this->queueOverflow.store(true, std::memory_order_release);
+				else if (event->len > 0)
+					this->pushEvent(event->wd, event->name);
+				ptr += sizeof(struct inotify_event) + event->len;
+			}
+		}
+	}
+}
+
+#else
+
+int FileWatcher::addDirectory(const std::string& path) {
+	Directory directory;
+	directory.path = path;
+	directory.refCount = 1;
+	directory.watcher = new Poco::DirectoryWatcher(path,
+		Poco::DirectoryWatcher::DW_ITEM_MODIFIED | Poco::DirectoryWatcher::DW_ITEM_ADDED | Poco::DirectoryWatcher::DW_ITEM_MOVED_TO,
+		Poco::DirectoryWatcher::DW_DEFAULT_SCAN_INTERVAL);
+	directory.watcher->itemModified += Poco::delegate(this, &FileWatcher::directoryEvent);
+	directory.watcher->itemAdded += Poco::delegate(this, &FileWatcher::directoryEvent);
+	directory.watcher->itemMovedTo += Poco::delegate(this, &FileWatcher::directoryEvent);
+
+	int id = this->nextDirectory++;
+	this->directories[id] = directory;
+	this->directoriesByPath[path] = id;
+	{
+		Poco::FastMutex::ScopedLock lock(this->producerMutex);
+		this->directoriesByWatcher[directory.watcher] = id;
+	}
+	return id;
+}
+
+void FileWatcher::removeDirectory(int directory) {
+	Poco::DirectoryWatcher* watcher = this->directories[directory].watcher;
+	{
+		Poco::FastMutex::ScopedLock lock(this->producerMutex);
+		this->directoriesByWatcher.erase(watcher);
+	}
+	this->directoriesByPath.erase(this->directories[directory].path);
+	this->directories.erase(directory);
+	delete watcher;
+}
+
+void FileWatcher::directoryEvent(const void* sender, const Poco::DirectoryWatcher::DirectoryEvent& evt) {
+	Poco::FastMutex::ScopedLock lock(this->producerMutex);
+	auto it = this->directoriesByWatcher.find(sender);
+	if (it == this->directoriesByWatcher.end())
+		return;
+	this->pushEvent(it->second, Poco::Path(evt.item.path()).getFileName().c_str());
+}
+
+void FileWatcher::start(void) {
+}
+
+void FileWatcher::stop(void) {
+	while (!this->directories.empty())
+		this->removeDirectory(this->directories.begin()->first);
+}
+
+#endif
+
+}		// namespace openhat
@@ -0,0 +1,129 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Poco/Mutex.h"
+#include "Poco/Runnable.h"
+#include "Poco/Thread.h"
+#include "Poco/DirectoryWatcher.h"
+
+namespace openhat {
+
+/// Watches files for modifications on behalf of all ports of the process.
+/// On Linux a single inotify instance and a single thread serve all watched files. On other
+/// platforms one Poco::DirectoryWatcher is shared by all files in the same directory.
+/// Modification events are put into a lock-free queue by the watcher thread. The queue is
+/// drained in the main thread by dispatchEvents() which notifies the listeners. Thus, listeners
+/// are always called in the main thread and do not need to synchronize with the watcher.
+class FileWatcher : protected Poco::Runnable {
+public:
+	/// Receives notifications about modified files.
+	class IListener {
+	public:
+		virtual ~IListener() {};
+
+		/// Called in the main thread if the specified file has been created, modified or moved into its directory.
+		virtual void fileChanged(const std::string& path) = 0;
+	};
+
+	/// Returns the process-wide instance.
+	static FileWatcher& get(void);
+
+	virtual ~FileWatcher();
+
+	/// Starts watching the specified file (absolute path). Returns a handle for removeWatch().
+	/// The directory of the file must exist.
+	virtual int addWatch(const std::string& filePath, IListener* listener);
+
+	/// Stops watching the file. The listener is not called any more after this method returns.
+	virtual void removeWatch(int handle);
+
+	/// Notifies the listeners of the files that have been modified since the last call.
+	/// Must be called regularly from the main thread. Returns the number of processed events.
+	virtual int dispatchEvents(void);
+
+	/// Returns the number of currently watched files.
+	virtual size_t getWatchCount(void);
+
+protected:
+	// an event as received from the operating system: a file name within a watched directory
+	struct Event {
+		int directory;
+		char name[256];
+	};
+
+	// capacity of the event queue; if it overflows, all listeners are notified
+	static const size_t QUEUE_SIZE = 1024;
+
+	struct Watch {
+		std::string path;
+		int directory;
+		IListener* listener;
+	};
+
+	struct Directory {
+		std::string path;
+		int refCount;
+#ifndef linux
+		Poco::DirectoryWatcher* watcher;
+#endif
+	};
+
+	// single producer, single consumer ring buffer
+	Event queue[QUEUE_SIZE];
+	std::atomic<size_t> queueHead;		// next slot to write (watcher thread)
+	std::atomic<size_t> queueTail;		// next slot to read (main thread)
+	std::atomic<bool> queueOverflow;
+
+	// protects the following data structures
+	Poco::Mutex mutex;
+	int nextHandle;
+	std::map<int, Watch> watches;
+	std::multimap<std::string, int> watchesByPath;
+	std::map<std::string, int> directoriesByPath;
+	std::map<int, Directory> directories;
+
+#ifdef linux
+	int inotifyFd;
+	int wakeupPipe[2];
+	Poco::Thread thread;
+
+	virtual void run(void) override;
+#else
+	int nextDirectory;
+	// serializes the producers because each DirectoryWatcher uses its own thread;
+	// also protects the map of watchers (the producers must not use the main mutex
+	// because a DirectoryWatcher waits for its thread when it is deleted)
+	Poco::FastMutex producerMutex;
+	std::map<const void*, int> directoriesByWatcher;
+
+	void directoryEvent(const void* sender, const Poco::DirectoryWatcher::DirectoryEvent& evt);
+
+	virtual void run(void) override {};
+#endif
+
+	FileWatcher();
+
+	// called by the producer only
+	void pushEvent(int directory, const char* name);
+
+	int addDirectory(const std::string& path);
+
+	void removeDirectory(int directory);
+
+	void start(void);
+
+	void stop(void);
+};
+
+}		// namespace openhat
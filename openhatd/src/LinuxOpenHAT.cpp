@@ -18,6 +18,7 @@
 #include <sys/types.h>
 #include <pwd.h>
 #include <sys/prctl.h>
+#include <sys/resource.h>
 
 #include "Poco/Exception.h"
 #include "Poco/NumberParser.h"
@@ -135,6 +136,10 @@ static uint8_t io_receive(void* info, uint8_t* byte, uint16_t timeout, uint8_t c
 		if (workResult != OPDI_STATUS_OK)
 			return workResult;
 
+		// don't wait in simulated time
+		if (opdi::Clock::get().isSimulated())
+			continue;
+
         struct timespec aSleep;
         aSleep.tv_sec = 0;
         aSleep.tv_nsec = (sleepTimeMs > 0 ? sleepTimeMs : 1) * 1000000;  // at least 1 ms
@@ -266,6 +271,14 @@ void LinuxOpenHAT::switchToUser(const std::string& newUser) {
 	this->logNormal("Switched to user: " + this->getCurrentUser());	
 }
 
+uint64_t LinuxOpenHAT::getPeakMemoryUsage(void) {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	// ru_maxrss is specified in kilobytes
+	return (uint64_t)usage.ru_maxrss * 1024;
+}
+
 /** This method handles an incoming TCP connection. It blocks until the connection is closed.
 */
 int LinuxOpenHAT::HandleTCPConnection(int csock) {
@@ -378,14 +391,17 @@ int LinuxOpenHAT::setupTCP(const std::string& /*interface_*/, int port) {
 					if (workResult != OPDI_STATUS_OK)
 						return workResult;
 
-                    struct timespec aSleep;
-                    aSleep.tv_sec = 0;
-                    aSleep.tv_nsec = (sleepTimeMs > 0 ? sleepTimeMs : 1) * 1000000;  // at least 1 ms
-                    struct timespec aRem;
-                    
-                    if (nanosleep(&aSleep, &aRem) != 0) {
-                        Opdi->shutdown(0);
-						return OPDI_SHUTDOWN;
+					// don't wait in simulated time
+					if (!opdi::Clock::get().isSimulated()) {
+						struct timespec aSleep;
+						aSleep.tv_sec = 0;
+						aSleep.tv_nsec = (sleepTimeMs > 0 ? sleepTimeMs : 1) * 1000000;  // at least 1 ms
+						struct timespec aRem;
+
+						if (nanosleep(&aSleep, &aRem) != 0) {
+							Opdi->shutdown(0);
+							return OPDI_SHUTDOWN;
+						}
 					}
                 } else
 					this->logNormal(std::string("Error accepting connection: ") + this->to_string(errno));
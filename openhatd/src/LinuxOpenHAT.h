@@ -22,6 +22,8 @@ public:
 	virtual std::string getCurrentUser(void);
 
 	virtual void switchToUser(const std::string& newUser);
+
+	virtual uint64_t getPeakMemoryUsage(void);
 	
 	int HandleTCPConnection(int csock);
 
@@ -36,19 +36,26 @@ namespace opdi {
 //////////////////////////////////////////////////////////////////////////////////////////
 
 uint8_t OPDI::shutdownInternal(void) {
-	// shutdown and free all ports
+	// shutdown all ports first; ports may release resources of other ports during shutdown
 	auto it = this->ports.begin();
 	auto ite = this->ports.end();
 	while (it != ite) {
 		// ignore any errors during this process
 		try {
 			(*it)->shutdown();
-			delete *it;
 		}
 		catch (...) {}
 		++it;
 	}
+	// free all ports
+	for (it = this->ports.begin(); it != ite; ++it) {
+		try {
+			delete *it;
+		}
+		catch (...) {}
+	}
 	this->ports.clear();
+	this->portSchedules.clear();
 	this->disconnect();
 	return OPDI_SHUTDOWN;
 }
@@ -56,6 +63,7 @@ uint8_t OPDI::shutdownInternal(void) {
 OPDI::OPDI(void) {
 	this->shutdownRequested = false;
 	this->shutdownExitCode = 0;
+	this->portListVersion = 0;
 }
 
 uint8_t OPDI::setup(const char* slaveName, int idleTimeout) {
@@ -145,6 +153,7 @@ void OPDI::addPort(opdi::Port* port) {
 		this->currentOrderID = 0;
 
 	this->ports.push_back(port);
+	this->portListVersion++;
 
 	this->updatePortData(port);
 
@@ -288,7 +297,7 @@ void OPDI::preparePorts(void) {
 	auto it = this->ports.begin();
 	auto ite = this->ports.end();
 	while (it != ite) {
-		(*it)->prepare();
+		this->preparePort(*it);
 
 		// add ports to the OPDI C subsystem; ignore hidden ports
 		if (!(*it)->isHidden()) {
@@ -300,6 +309,59 @@ void OPDI::preparePorts(void) {
 	}
 }
 
+void OPDI::preparePort(opdi::Port* port) {
+	port->prepare();
+}
+
+void OPDI::removePort(opdi::Port* port) {
+	auto it = std::find(this->ports.begin(), this->ports.end(), port);
+	if (it != this->ports.end())
+		this->ports.erase(it);
+	this->portListVersion++;
+
+	auto sit = this->portSchedules.begin();
+	while (sit != this->portSchedules.end()) {
+		if (std::get<1>(*sit) == port)
+			sit = this->portSchedules.erase(sit);
+		else
+			++sit;
+	}
+
+	delete port;
+}
+
+uint32_t OPDI::getPortListVersion(void) {
+	return this->portListVersion;
+}
+
+void OPDI::schedulePort(opdi::Port* port) {
+	// the schedule table is built on the first call of doWork()
+	if (this->portSchedules.size() == 0)
+		return;
+	PortSchedule ps(opdi::Clock::get().getTimeMs(), port);
+	this->portSchedules.push_back(ps);
+	sort(this->portSchedules.begin(), this->portSchedules.end());
+}
+
+void OPDI::updatePortList(void) {
+	opdi_clear_ports();
+
+	auto it = this->ports.begin();
+	auto ite = this->ports.end();
+	while (it != ite) {
+		// add ports to the OPDI C subsystem; ignore hidden ports
+		if (!(*it)->isHidden()) {
+			opdi_Port* oPort = (opdi_Port*)(*it)->data;
+			// the list is linked using the port structures
+			oPort->next = nullptr;
+			int result = opdi_add_port(oPort);
+			if (result != OPDI_STATUS_OK)
+				throw Poco::ApplicationException("Unable to add port: " + (*it)->ID() + "; code = " + (*it)->to_string(result));
+		}
+		++it;
+	}
+}
+
 uint8_t OPDI::start() {
 	opdi_Message message;
 	uint8_t result;
@@ -310,7 +372,7 @@ uint8_t OPDI::start() {
 	}
 
 	// reset idle timer
-	this->last_activity = opdi_get_time_ms();
+	this->last_activity = opdi::Clock::get().getTimeMs();
 
 	// initiate handshake
 	result = opdi_slave_start(&message, nullptr, nullptr);
@@ -338,22 +400,26 @@ uint8_t OPDI::doWork(uint8_t canSend, uint8_t* sleepTimeMs) {
             // determine random priority to distribute load
             std::uniform_int_distribution<> distr(0, (*it)->getPriority()); // define the range
             uint8_t rndPriority = distr(gen);
-            PortSchedule ps(opdi_get_time_ms() + rndPriority, *it);
+            PortSchedule ps(opdi::Clock::get().getTimeMs() + rndPriority, *it);
             this->portSchedules.push_back(ps);
         }
         
         // sort by first element
         sort(this->portSchedules.begin(), this->portSchedules.end());
         
-        last_work_time = opdi_get_time_ms();
+        last_work_time = opdi::Clock::get().getTimeMs();
     }
     
-    last_work_time = opdi_get_time_ms();
+    last_work_time = opdi::Clock::get().getTimeMs();
     
+    // in simulated time all ports are executed in each iteration because the clock
+    // does not advance while the ports are working
+    bool simulated = opdi::Clock::get().isSimulated();
+
     // go through port schedules
     for (auto& sched: this->portSchedules) {
         // needs to be executed?
-        if (std::get<0>(sched) <= opdi_get_time_ms()) {
+        if (simulated || (std::get<0>(sched) <= opdi::Clock::get().getTimeMs())) {
             Port* port = std::get<1>(sched);
             if (port->getLogVerbosity() > LogVerbosity::EXTREME)
                 this->logDebug(std::string("Executing doWork of port ") + port->getID());
@@ -361,7 +427,7 @@ uint8_t OPDI::doWork(uint8_t canSend, uint8_t* sleepTimeMs) {
             if (result != OPDI_STATUS_OK)
                 return result;
             // update priority after processing
-            std::get<0>(sched) = opdi_get_time_ms() + std::get<1>(sched)->getPriority();
+            std::get<0>(sched) = opdi::Clock::get().getTimeMs() + std::get<1>(sched)->getPriority();
         }
     }
     
@@ -370,7 +436,7 @@ uint8_t OPDI::doWork(uint8_t canSend, uint8_t* sleepTimeMs) {
     
 	if (this->portSchedules.size() > 0)
 		// return suggested sleep time: time until the next port is to be executed
-		*sleepTimeMs = (uint8_t)(std::get<0>(this->portSchedules[0]) - opdi_get_time_ms());
+		*sleepTimeMs = (uint8_t)(std::get<0>(this->portSchedules[0]) - opdi::Clock::get().getTimeMs());
 
 	return OPDI_STATUS_OK;
 }
@@ -439,12 +505,12 @@ uint8_t OPDI::messageHandled(channel_t channel, const char** /*parts*/) {
 		// TODO find a better way to specify this (masters must respect this convention)
 		if (channel >= 20) {
 			// reset activity time
-			this->last_activity = opdi_get_time_ms();
+			this->last_activity = opdi::Clock::get().getTimeMs();
 		} else {
 			// non-resetting message
 
 			// check idle timeout
-			if (opdi_get_time_ms() - this->last_activity > this->idle_timeout_ms) {
+			if (opdi::Clock::get().getTimeMs() - this->last_activity > this->idle_timeout_ms) {
 				return this->idleTimeoutReached();
 			}
 		}
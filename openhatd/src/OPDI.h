@@ -50,6 +50,9 @@ protected:
 	PortList ports;
 	PortGroupList groups;
 
+	// incremented whenever a port is added or removed
+	uint32_t portListVersion;
+
 //	opdi::PortGroup *first_portGroup;
 //	opdi::PortGroup *last_portGroup;
 
@@ -147,6 +150,24 @@ public:
 	Also, adds the ports to the OPDI subsystem. */
 	virtual void preparePorts(void);
 
+	/** Prepares the specified port. Called by preparePorts(). */
+	virtual void preparePort(opdi::Port* port);
+
+	/** Removes the specified port from the port list (if it is contained in the list) and the port schedule
+	* and frees it. The port must have been shut down. Call updatePortList() after removing or adding ports
+	* once the ports have been prepared. */
+	virtual void removePort(opdi::Port* port);
+
+	/** Returns a number that changes whenever a port is added or removed.
+	* Can be used to detect whether cached port pointers may have become invalid. */
+	virtual uint32_t getPortListVersion(void);
+
+	/** Adds a port that has been prepared after the first call of doWork() to the port schedule. */
+	virtual void schedulePort(opdi::Port* port);
+
+	/** Rebuilds the port list of the OPDI subsystem from the current list of ports. */
+	virtual void updatePortList(void);
+
 	/** Adds the specified port group. */
 	virtual void addPortGroup(opdi::PortGroup *portGroup);
 
@@ -15,6 +15,7 @@
 #include <math.h>
 
 #include "Poco/Exception.h"
+#include "Poco/Timestamp.h"
 
 #include "opdi_constants.h"
 #include "opdi_port.h"
@@ -34,6 +35,38 @@
 
 namespace opdi {
 
+//////////////////////////////////////////////////////////////////////////////////////////
+// Port change queue
+//////////////////////////////////////////////////////////////////////////////////////////
+
+PortChangeQueue::PortChangeQueue(size_t capacity) : buffer(capacity + 1), head(0), tail(0), overflows(0) {
+}
+
+bool PortChangeQueue::push(const Change& change) {
+	size_t tail = this->tail.load(std::memory_order_relaxed);
+	size_t next = (tail + 1) % this->buffer.size();
+	if (next == this->head.load(std::memory_order_acquire)) {
+		this->overflows.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	this->buffer[tail] = change;
+	this->tail.store(next, std::memory_order_release);
+	return true;
+}
+
+bool PortChangeQueue::pop(Change& change) {
+	size_t head = this->head.load(std::memory_order_relaxed);
+	if (head == this->tail.load(std::memory_order_acquire))
+		return false;
+	change = this->buffer[head];
+	this->head.store((head + 1) % this->buffer.size(), std::memory_order_release);
+	return true;
+}
+
+uint64_t PortChangeQueue::getOverflows(void) const {
+	return this->overflows.load(std::memory_order_relaxed);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 // General port functionality
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -59,6 +92,12 @@ Port::Port(const char* id, const char* type) {
 	this->logVerbosity = LogVerbosity::UNKNOWN;
 	this->priority = DEFAULT_PORT_PRIORITY;
 	this->inaccurate = false;
+	this->historyChanged = false;
+	this->historyInterval = 0;
+	this->historyMaxCount = 0;
+	this->historySeq = 0;
+	this->historyResetSeq = 0;
+	this->infoRevision = 0;
 	this->setID(id);
 	this->setLabel(id);
 	this->type[0] = type[0];
@@ -78,7 +117,7 @@ uint8_t Port::doWork(uint8_t /* canSend */) {
 		this->refreshRequired = false;
 
 	// refresh necessary? don't refresh too often
-	if (this->refreshRequired && (opdi_get_time_ms() - this->lastRefreshTime > 1000)) {
+	if (this->refreshRequired && (opdi::Clock::get().getTimeMs() - this->lastRefreshTime > 1000)) {
 		this->refresh();
 		this->refreshRequired = false;
 	}
@@ -86,9 +125,9 @@ uint8_t Port::doWork(uint8_t /* canSend */) {
 	// determine whether periodic self refresh is necessary
 	if ((this->refreshMode == RefreshMode::REFRESH_PERIODIC) && (this->periodicRefreshTime > 0)) {
 		// self refresh timer reached?
-		if (opdi_get_time_ms() - this->lastRefreshTime > this->periodicRefreshTime) {
+		if (opdi::Clock::get().getTimeMs() - this->lastRefreshTime > this->periodicRefreshTime) {
 			this->refreshRequired = true;
-			this->lastRefreshTime = opdi_get_time_ms();
+			this->lastRefreshTime = opdi::Clock::get().getTimeMs();
 		}
 	}
 
@@ -117,7 +156,30 @@ void Port::setID(const char* newID) {
 	strcpy_s(this->id, strlen(newID) + 1, newID);
 }
 
+void Port::recordChange(void) {
+	if (this->changeQueues.empty())
+		return;
+	PortChangeQueue::Change change;
+	change.timestamp = opdi::Clock::get().now().epochMicroseconds() / 1000;
+	change.value = this->valueAsDouble;
+	auto ite = this->changeQueues.end();
+	for (auto it = this->changeQueues.begin(); it != ite; ++it)
+		(*it)->push(change);
+}
+
+void Port::addChangeQueue(PortChangeQueue* queue) {
+	this->changeQueues.push_back(queue);
+}
+
+void Port::removeChangeQueue(PortChangeQueue* queue) {
+	auto it = std::find(this->changeQueues.begin(), this->changeQueues.end(), queue);
+	if (it != this->changeQueues.end())
+		this->changeQueues.erase(it);
+}
+
 void Port::handleStateChange(ChangeSource changeSource) {
+	this->recordChange();
+
 	// determine port list to iterate
 	DigitalPortList* pl;
 	switch (changeSource) {
@@ -156,6 +218,7 @@ const char* Port::getLabel(void) const {
 
 void Port::setHidden(bool hidden) {
 	this->hidden = hidden;
+	this->infoRevision++;
 }
 
 bool Port::isHidden(void) const {
@@ -164,6 +227,7 @@ bool Port::isHidden(void) const {
 
 void Port::setReadonly(bool readonly) {
 	this->readonly = readonly;
+	this->infoRevision++;
 }
 
 bool Port::isReadonly(void) const {
@@ -182,6 +246,7 @@ void Port::setLabel(const char* label) {
 	if (this->label != nullptr)
 		free(this->label);
 	this->label = nullptr;
+	this->infoRevision++;
 	if (label == nullptr)
 		return;
 	this->label = (char*)malloc(strlen(label) + 1);
@@ -195,6 +260,7 @@ void Port::setLabel(const char* label) {
 void Port::setDirCaps(const char* dirCaps) {
 	this->caps[0] = dirCaps[0];
 	this->caps[1] = '\0';
+	this->infoRevision++;
 
 	// dirCaps changed; update internal data
 	if (this->opdi != nullptr)
@@ -211,6 +277,8 @@ void Port::setFlags(int32_t flags) {
 		this->flags = flags | OPDI_PORT_READONLY;
 	else
 		this->flags = flags;
+	if (oldFlags != this->flags)
+		this->infoRevision++;
 	// need to update already stored port data?
 	if ((this->opdi != nullptr) && (oldFlags != this->flags))
 		this->opdi->updatePortData(this);
@@ -220,6 +288,10 @@ int32_t Port::getFlags() const {
 	return this->flags;
 }
 
+uint32_t Port::getInfoRevision(void) const {
+	return this->infoRevision;
+}
+
 void Port::setTypeGUID(const std::string & guid) {
 	if (this->typeGUID != guid) {
 		this->typeGUID = guid;
@@ -251,6 +323,7 @@ void Port::updateExtendedInfo(void) {
 		exInfo += "icon=" + escapeKeyValueText(this->icon) + ";";
 	}
 	this->extendedInfo = exInfo;
+	this->infoRevision++;
 }
 
 void Port::setUnit(const std::string& unit) {
@@ -306,27 +379,113 @@ const std::string & Port::getGroup(void) const {
 }
 
 void Port::setHistory(uint64_t intervalSeconds, int maxCount, const std::vector<int64_t>& values) {
-	this->history = "interval=" + this->to_string(intervalSeconds);
-	this->history.append(";maxCount=" + this->to_string(maxCount));
-	this->history.append(";values=");
-	auto it = values.begin();
-	auto ite = values.end();
-	while (it != ite) {
-		if (it != values.begin())
-			this->history.append(",");
-		this->history.append(this->to_string(*it));
-		++it;
+	this->historyInterval = intervalSeconds;
+	this->historyMaxCount = maxCount;
+	this->historyValues.assign(values.begin(), values.end());
+	// start a new series
+	this->historyResetSeq = ++this->historySeq;
+	this->historySeq += values.size();
+	this->historyChanged = true;
+	if (this->refreshMode == RefreshMode::REFRESH_AUTO)
+		this->refreshRequired = true;
+}
+
+void Port::appendHistory(uint64_t intervalSeconds, int maxCount, int64_t value) {
+	// changed parameters invalidate the existing series
+	if ((intervalSeconds != this->historyInterval) || (maxCount != this->historyMaxCount)) {
+		this->historyInterval = intervalSeconds;
+		this->historyMaxCount = maxCount;
+		this->historyValues.clear();
+		this->historyResetSeq = ++this->historySeq;
 	}
+	this->historyValues.push_back(value);
+	++this->historySeq;
+	while ((maxCount > 0) && (this->historyValues.size() > (size_t)maxCount))
+		this->historyValues.pop_front();
+	this->historyChanged = true;
 	if (this->refreshMode == RefreshMode::REFRESH_AUTO)
 		this->refreshRequired = true;
 }
 
 const std::string & Port::getHistory(void) const {
+	// build the string representation only when it is actually requested
+	if (this->historyChanged) {
+		this->history.clear();
+		if ((this->historyInterval > 0) || (this->historyMaxCount > 0)) {
+			this->history = "interval=" + this->to_string(this->historyInterval);
+			this->history.append(";maxCount=" + this->to_string(this->historyMaxCount));
+			this->history.append(";values=");
+			auto it = this->historyValues.begin();
+			auto ite = this->historyValues.end();
+			while (it != ite) {
+				if (it != this->historyValues.begin())
+					this->history.append(",");
+				this->history.append(this->to_string(*it));
+				++it;
+			}
+		}
+		this->historyChanged = false;
+	}
 	return this->history;
 }
 
+uint64_t Port::getHistorySeq(void) const {
+	return this->historySeq;
+}
+
+uint64_t Port::getHistoryInterval(void) const {
+	return this->historyInterval;
+}
+
+int Port::getHistoryMaxCount(void) const {
+	return this->historyMaxCount;
+}
+
+std::string Port::getHistoryDelta(uint64_t sinceSeq, uint64_t* firstSeq, size_t* count, bool* reset) const {
+	std::string result;
+	*reset = false;
+	*count = 0;
+	*firstSeq = this->historySeq + 1;
+	// client is up to date?
+	if (sinceSeq == this->historySeq)
+		return result;
+
+	// sequence number of the oldest retained value
+	uint64_t oldestSeq = this->historySeq + 1 - this->historyValues.size();
+	size_t start = 0;
+	if ((sinceSeq > this->historySeq) || (sinceSeq < this->historyResetSeq) || (sinceSeq + 1 < oldestSeq))
+		// the client's series can't be continued; send all retained values
+		*reset = true;
+	else
+		start = (size_t)(sinceSeq + 1 - oldestSeq);
+
+	*firstSeq = oldestSeq + start;
+	*count = this->historyValues.size() - start;
+	result.reserve(*count * 2);
+
+	int64_t previous = 0;
+	for (size_t i = start; i < this->historyValues.size(); i++) {
+		int64_t value = this->historyValues[i];
+		// compute the difference with wraparound and map it to an unsigned value (zigzag encoding)
+		int64_t diff = (int64_t)((uint64_t)value - (uint64_t)previous);
+		uint64_t zigzag = ((uint64_t)diff << 1) ^ (uint64_t)(diff >> 63);
+		previous = value;
+		// emit varint, seven bits at a time
+		while (zigzag >= 0x80) {
+			result.push_back((char)((zigzag & 0x7F) | 0x80));
+			zigzag >>= 7;
+		}
+		result.push_back((char)zigzag);
+	}
+	return result;
+}
+
 void Port::clearHistory(void) {
-	this->history.clear();
+	this->historyInterval = 0;
+	this->historyMaxCount = 0;
+	this->historyValues.clear();
+	this->historyResetSeq = ++this->historySeq;
+	this->historyChanged = true;
 	if (this->refreshMode == RefreshMode::REFRESH_AUTO)
 		this->refreshRequired = true;
 }
@@ -356,8 +515,10 @@ std::string Port::getExtendedState(bool withHistory) const {
 	if (this->error != Error::VALUE_OK)
 		return "";
 	std::string result;
-	if (withHistory && !this->history.empty())
-		result += "history=" + this->escapeKeyValueText(history);
+	if (withHistory && !this->getHistory().empty())
+		result += "history=" + this->escapeKeyValueText(this->history);
+	if (this->historySeq > 0)
+		result += (result.size() > 0 ? std::string(";") : std::string("")) + "historySeq=" + this->to_string(this->historySeq);
 	if (this->inaccurate)
 		result += (result.size() > 0 ? std::string(";") : std::string("")) + "inaccurate=true";
 	return result;
@@ -404,7 +565,7 @@ uint8_t Port::refresh() {
 	ports[0] = this;
 	ports[1] = nullptr;
 
-	this->lastRefreshTime = opdi_get_time_ms();
+	this->lastRefreshTime = opdi::Clock::get().getTimeMs();
 	return this->opdi->refresh(ports);
 }
 
@@ -432,11 +593,15 @@ void Port::checkError() const {
 }
 
 void Port::setError(Error error) {
-	if (this->error != error)
+	bool changed = (this->error != error);
+	if (changed)
 		this->refreshRequired = (this->refreshMode == RefreshMode::REFRESH_AUTO);
 	if (error != Error::VALUE_OK)
 		this->valueAsDouble = std::numeric_limits<double>::quiet_NaN();
 	this->error = error;
+	// a change to an error state is a state change, too
+	if (changed && (error != Error::VALUE_OK))
+		this->recordChange();
 }
 
 Port::Error Port::getError() const {
@@ -1134,6 +1299,7 @@ SelectPort::Label SelectPort::getLabelAt(uint16_t pos) {
 void SelectPort::setLabels(const char** labels) {
 	this->freeItems();
 	this->count = 0;
+	this->infoRevision++;
 	if (labels == nullptr)
 		return;
 	// determine array size
@@ -1272,6 +1438,7 @@ void DialPort::setMin(int64_t min) {
 		// adjust max value accordingly
 		this->maxValue = min + (this->maxValue - this->minValue);
 	this->minValue = min;
+	this->infoRevision++;
 
 	// adjust position if necessary
 	if (this->position < this->minValue)
@@ -1283,6 +1450,7 @@ void DialPort::setMax(int64_t max) {
 		// adjust min value accordingly
 		this->minValue = max - (this->maxValue - this->minValue);
 	this->maxValue = max;
+	this->infoRevision++;
 	// adjust position if necessary
 	if (this->position > this->maxValue)
 		this->setPosition(this->maxValue);
@@ -1290,6 +1458,7 @@ void DialPort::setMax(int64_t max) {
 
 void DialPort::setStep(uint64_t step) {
 	this->step = step;
+	this->infoRevision++;
 	// adjust position if necessary
 	this->setPosition(this->position);
 }
@@ -1425,6 +1594,24 @@ StreamingPort::StreamingPort(const char* id) :
 StreamingPort::~StreamingPort() {
 }
 
+int StreamingPort::readBytes(char* bytes, size_t length) {
+	size_t result = 0;
+	while (result < length) {
+		int code = this->available(0);
+		if (code < 0)
+			return code;
+		if (code == 0)
+			break;
+		code = this->read(bytes + result);
+		if (code < 0)
+			return code;
+		if (code == 0)
+			break;
+		result++;
+	}
+	return (int)result;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // ValueResolver
 ///////////////////////////////////////////////////////////////////////////////
@@ -9,6 +9,8 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <atomic>
 #include <ostream>
 #include <sstream>
 
@@ -20,6 +22,7 @@
 
 #include "opdi_platformtypes.h"
 #include "opdi_configspecs.h"
+#include "Clock.h"
 
 namespace opdi {
     
@@ -47,6 +50,36 @@ typedef std::vector<Port*> PortList;
 typedef std::vector<DigitalPort*> DigitalPortList;
 typedef std::vector<AnalogPort*> AnalogPortList;
 
+/// A fixed size queue of port state changes. A port pushes its changes into the queues
+/// registered with it; a consumer (e. g. an exporter) pops them. The queue is lock-free for
+/// one producer and one consumer thread. If the queue is full new changes are discarded
+/// and counted as overflows.
+class PortChangeQueue {
+public:
+	struct Change {
+		uint64_t timestamp;		// milliseconds since the epoch
+		double value;			// NaN if the port has an error
+	};
+
+protected:
+	std::vector<Change> buffer;
+	std::atomic<size_t> head;		// next element to pop
+	std::atomic<size_t> tail;		// next element to push
+	std::atomic<uint64_t> overflows;
+
+public:
+	explicit PortChangeQueue(size_t capacity);
+
+	/// Adds a change. Returns false if the queue is full.
+	bool push(const Change& change);
+
+	/// Removes the oldest change. Returns false if the queue is empty.
+	bool pop(Change& change);
+
+	/// Returns the number of changes that have been discarded because the queue was full.
+	uint64_t getOverflows(void) const;
+};
+
 /// Base class for OPDI port wrappers.
 ///
 /// This class is not intended to be used or extended directly. Rather, extend one of its
@@ -129,9 +162,28 @@ protected:
 	/// that is a part of the extended info string changes its setting.
 	std::string extendedInfo;
 
+	/// Revision of the port information (label, flags, extended info, range, labels etc.).
+	/// Is incremented whenever this information changes.
+	uint32_t infoRevision;
+
 	/// Historic values of a port. Is sent to the master as part of the
-	/// extended state string.
-	std::string history;
+	/// extended state string. The string is built from historyValues on demand.
+	mutable std::string history;
+	mutable bool historyChanged;
+
+	/// Interval in seconds and total number of history values as specified by the component
+	/// that collects the history.
+	uint64_t historyInterval;
+	int historyMaxCount;
+
+	/// The currently retained history values. The last element has the sequence number historySeq.
+	std::deque<int64_t> historyValues;
+
+	/// Sequence number of the most recent history value. Is incremented for each appended value.
+	/// A reset of the history also increments the sequence number and stores it in historyResetSeq
+	/// so that clients can detect that their copy of the history is invalid.
+	uint64_t historySeq;
+	uint64_t historyResetSeq;
 
         /// Indicates that the value of this port may not be accurate (extended port state).
         bool inaccurate;    
@@ -168,6 +220,12 @@ protected:
 	/// 
 	bool persistent;
 
+	/// Queues that receive the state changes of this port.
+	std::vector<PortChangeQueue*> changeQueues;
+
+	/// Pushes the current value into the registered change queues.
+	void recordChange(void);
+
 	/// Utility function for string conversion. Can be called directly for most data types
 	/// except char which requires a conversion to int first, such as to_string((int)aChar).
 	template <class T> std::string to_string(const T& t) const;
@@ -456,6 +514,11 @@ public:
 	///
 	int32_t getFlags(void) const;
 
+	/// Returns a number that changes whenever the information about the port changes
+	/// (label, direction caps, flags, hidden and readonly flags, extended info, and the range
+	/// or labels of Dial and Select ports). Can be used to invalidate cached port information.
+	uint32_t getInfoRevision(void) const;
+
 	/// Sets the type GUID of the port.
 	///
 	void setTypeGUID(const std::string& guid);
@@ -500,12 +563,40 @@ public:
 	/// The history consists of an ordered set of values that have been collected in the specified interval.
 	/// maxCount specifies the total number of values that are collected for this port; the size of values may be less.
 	/// The history is not collected by the port itself. It needs to be set by an external component.
+	/// Replaces the current history. Clients that request incremental history updates receive the
+	/// complete series with the next request.
 	void setHistory(uint64_t intervalSeconds, int maxCount, const std::vector<int64_t>& values);
 
+	/// Appends a value to the history. If the history contains more than maxCount values the oldest
+	/// values are dropped. A change of interval or maxCount resets the history.
+	void appendHistory(uint64_t intervalSeconds, int maxCount, int64_t value);
+
 	/// Returns a string representation of the port's history.
 	///
 	const std::string& getHistory(void) const;
 
+	/// Returns the sequence number of the most recent history value.
+	///
+	uint64_t getHistorySeq(void) const;
+
+	/// Returns the interval of the history values in seconds.
+	///
+	uint64_t getHistoryInterval(void) const;
+
+	/// Returns the maximum number of history values.
+	///
+	int getHistoryMaxCount(void) const;
+
+	/// Returns the history values appended after the value with the sequence number sinceSeq.
+	/// Values are encoded as zigzag varints (LEB128) of the difference to the preceding value;
+	/// the first returned value is encoded as the difference to zero.
+	/// firstSeq receives the sequence number of the first returned value and count the number of values.
+	/// If the returned values do not continue the series that ended at sinceSeq (because the history has been
+	/// reset or older values have already been dropped) reset is set to true and all retained values are returned.
+	/// The client should then discard its copy of the history. In any case, the client should keep at most
+	/// getHistoryMaxCount() values.
+	std::string getHistoryDelta(uint64_t sinceSeq, uint64_t* firstSeq, size_t* count, bool* reset) const;
+
 	/// Clears the port history.
 	///
 	void clearHistory(void);
@@ -582,6 +673,13 @@ public:
 	/// </summary>
 	/// <returns></returns>
 	double& getValuePtr() { return this->valueAsDouble; }
+
+	/// Registers a queue that receives the state changes of this port. Changes include errors.
+	/// The queue is not owned by the port; it must remain valid as long as the port exists.
+	void addChangeQueue(PortChangeQueue* queue);
+
+	/// Unregisters a queue that has been registered using addChangeQueue().
+	void removeChangeQueue(PortChangeQueue* queue);
 };
 
 inline std::ostream& operator<<(std::ostream& oStream, const Port::Error error) {
@@ -1038,6 +1136,12 @@ public:
 	/// Reads one byte from the data source and places it in result. If the returned
 	/// value is less than 1 it is considered an (implementation specific) error.
 	virtual int read(char* result) = 0;
+
+	/// Reads up to length bytes that are available from the data source into bytes without waiting.
+	/// Returns the number of bytes read, 0 if no bytes are available, or a value less than 0
+	/// in case of an (implementation specific) error.
+	/// The default implementation calls read() for each byte; subclasses should override it.
+	virtual int readBytes(char* bytes, size_t length);
 };
 
 /// This class wraps either a fixed value or a port name. It is used when port configuration parameters
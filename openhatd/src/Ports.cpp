@@ -1,10 +1,15 @@
 #include "Ports.h"
 
 #include <bitset>
+#include <algorithm>
 #include <cmath>
 #include <numeric>
 #include <functional>
+#include <cctype>
 #include <climits>
+#include <cstdio>
+#include <cstring>
+#include <limits>
 
 #include "Poco/String.h"
 #include "Poco/Timezone.h"
@@ -17,6 +22,11 @@
 #include "Poco/Delegate.h"
 #include "Poco/ScopedLock.h"
 #include "Poco/FileStream.h"
+#include "Poco/DirectoryIterator.h"
+#include "Poco/RegularExpression.h"
+#include "Poco/LocalDateTime.h"
+#include "Poco/DeflatingStream.h"
+#include "Poco/StreamCopier.h"
 #include "Poco/Net/HTTPRequest.h"
 #include "Poco/Net/HTTPResponse.h"
 #include "Poco/Net/HTTPClientSession.h"
@@ -334,19 +344,23 @@ uint8_t PulsePort::doWork(uint8_t canSend)  {
 			newState = (this->negate ? 0 : 1);
 		else {
 			// check whether the time for state change has been reached
-			uint64_t timeDiff = opdi_get_time_ms() - this->lastStateChangeTime;
+			uint64_t timeDiff = opdi::Clock::get().getTimeMs() - this->lastStateChangeTime;
 			// current state (logical) Low?
 			if (this->pulseState == (this->negate ? 1 : 0)) {
 				// time up to High reached?
 				if (timeDiff > period * (1.0 - dutyCycle / 100.0))
 					// switch to (logical) High
 					newState = (this->negate ? 0 : 1);
+				else
+					opdi::Clock::get().addDeadlineMs(this->lastStateChangeTime + (uint64_t)(period * (1.0 - dutyCycle / 100.0)) + 1);
 			}
 			else {
 				// time up to Low reached?
 				if (timeDiff > period * dutyCycle / 100.0)
 					// switch to (logical) Low
 					newState = (this->negate ? 1 : 0);
+				else
+					opdi::Clock::get().addDeadlineMs(this->lastStateChangeTime + (uint64_t)(period * dutyCycle / 100.0) + 1);
 			}
 		}
 	} else {
@@ -359,9 +373,9 @@ uint8_t PulsePort::doWork(uint8_t canSend)  {
 
 	// change detected?
 	if (newState != this->pulseState) {
-		this->logDebug(std::string("Changing pulse to ") + (newState == 1 ? "High" : "Low") + " (dTime: " + to_string(opdi_get_time_ms() - this->lastStateChangeTime) + " ms)");
+		this->logDebug(std::string("Changing pulse to ") + (newState == 1 ? "High" : "Low") + " (dTime: " + to_string(opdi::Clock::get().getTimeMs() - this->lastStateChangeTime) + " ms)");
 
-		this->lastStateChangeTime = opdi_get_time_ms();
+		this->lastStateChangeTime = opdi::Clock::get().getTimeMs();
 
 		// set the new state
 		this->pulseState = newState;
@@ -556,6 +570,223 @@ uint8_t ErrorDetectorPort::doWork(uint8_t canSend)  {
 	return OPDI_STATUS_OK;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// OBIS Parser
+///////////////////////////////////////////////////////////////////////////////
+
+#define SML_TYPE_OCTETS		0
+#define SML_TYPE_INTEGER	5
+#define SML_TYPE_UNSIGNED	6
+#define SML_TYPE_LIST		7
+#define SML_MAX_DEPTH		16
+
+// reads the type-length field of an SML element; for lists the length is the number of elements
+static bool readSMLTypeLength(const uint8_t*& pos, const uint8_t* end, int* type, size_t* length) {
+	if (pos >= end)
+		return false;
+	uint8_t byte = *pos++;
+	*type = (byte >> 4) & 0x07;
+	size_t value = byte & 0x0f;
+	size_t tlBytes = 1;
+	// more length bytes follow?
+	while (byte & 0x80) {
+		if ((pos >= end) || (tlBytes >= 4))
+			return false;
+		byte = *pos++;
+		value = (value << 4) | (byte & 0x0f);
+		tlBytes++;
+	}
+	if (*type == SML_TYPE_LIST) {
+		*length = value;
+		return true;
+	}
+	// the length includes the type-length field; 0x00 (end of message) has no data
+	*length = (value > tlBytes ? value - tlBytes : 0);
+	return (size_t)(end - pos) >= *length;
+}
+
+ObisParser::ObisParser(openhat::AbstractOpenHAT* openhat) {
+	this->openhat = openhat;
+	this->owner = nullptr;
+	this->sml = false;
+}
+
+void ObisParser::configure(ConfigurationView::Ptr config, opdi::Port* owner, bool sml) {
+	this->owner = owner;
+	this->sml = sml;
+
+	Poco::AutoPtr<ConfigurationView> valuesConfig = this->openhat->createConfigView(config, "Values");
+	config->addUsedKey("Values");
+	ConfigurationView::Keys keys;
+	valuesConfig->keys("", keys);
+	for (auto it = keys.begin(), ite = keys.end(); it != ite; ++it) {
+		std::string spec = Poco::trim(valuesConfig->getString(*it));
+		Value value;
+		value.portID = *it;
+		value.factor = 1;
+		value.port = nullptr;
+		// factor specified?
+		size_t paren = spec.find('(');
+		if (paren != std::string::npos) {
+			if ((spec[spec.length() - 1] != ')') || !Poco::NumberParser::tryParseFloat(spec.substr(paren + 1, spec.length() - paren - 2), value.factor))
+				this->openhat->throwSettingException(owner->ID() + ": Invalid factor for port " + *it + ": " + spec);
+			spec = Poco::trim(spec.substr(0, paren));
+		}
+		if (spec.empty())
+			this->openhat->throwSettingException(owner->ID() + ": The OBIS code for port " + *it + " must not be empty");
+		value.code = spec;
+		this->values.push_back(value);
+	}
+	if (this->values.empty())
+		this->openhat->throwSettingException(owner->ID() + ": The Values section must specify at least one port");
+}
+
+void ObisParser::prepare(void) {
+	for (auto it = this->values.begin(), ite = this->values.end(); it != ite; ++it)
+		it->port = this->openhat->findDialPort(this->owner->ID(), "Values", it->portID, true);
+}
+
+void ObisParser::frameReceived(const char* frame, size_t length) {
+	if (!this->sml) {
+		this->parseText(frame, length);
+		return;
+	}
+	// a frame contains a sequence of SML messages
+	const uint8_t* pos = (const uint8_t*)frame;
+	const uint8_t* end = pos + length;
+	while (pos < end) {
+		if (!this->parseSML(pos, end, 0)) {
+			this->owner->logDebug("Invalid SML data at offset " + std::to_string(pos - (const uint8_t*)frame));
+			break;
+		}
+	}
+}
+
+bool ObisParser::parseSML(const uint8_t*& pos, const uint8_t* end, int depth) {
+	if (depth > SML_MAX_DEPTH)
+		return false;
+	int type;
+	size_t length;
+	if (!readSMLTypeLength(pos, end, &type, &length))
+		return false;
+	if (type != SML_TYPE_LIST) {
+		pos += length;
+		return true;
+	}
+	// a list of seven elements that starts with an OBIS code (octet string of six bytes) is a list entry
+	if ((length == 7) && (pos < end) && (*pos == 0x07)) {
+		const uint8_t* entry = pos;
+		if (this->parseSMLEntry(pos, end, depth + 1))
+			return true;
+		pos = entry;
+	}
+	for (size_t i = 0; i < length; i++)
+		if (!this->parseSML(pos, end, depth + 1))
+			return false;
+	return true;
+}
+
+bool ObisParser::parseSMLEntry(const uint8_t*& pos, const uint8_t* end, int depth) {
+	int type;
+	size_t length;
+	// objName
+	if (!readSMLTypeLength(pos, end, &type, &length) || (type != SML_TYPE_OCTETS) || (length != 6))
+		return false;
+	const uint8_t* obis = pos;
+	pos += length;
+	// status, valTime
+	if (!this->parseSML(pos, end, depth) || !this->parseSML(pos, end, depth))
+		return false;
+	// unit and scaler are optional integers
+	int64_t unit = 0;
+	int64_t scaler = 0;
+	if (!this->parseSMLValue(pos, end, depth, &type, &unit) || (type == SML_TYPE_LIST))
+		return false;
+	if (!this->parseSMLValue(pos, end, depth, &type, &scaler) || (type == SML_TYPE_LIST))
+		return false;
+	// the value may be an integer or some other element
+	int64_t value = 0;
+	if (!this->parseSMLValue(pos, end, depth, &type, &value))
+		return false;
+	bool isInteger = (type == SML_TYPE_INTEGER) || (type == SML_TYPE_UNSIGNED);
+	// valueSignature
+	if (!this->parseSML(pos, end, depth))
+		return false;
+
+	if (isInteger) {
+		char code[32];
+		int codeLength = snprintf(code, sizeof(code), "%d-%d:%d.%d.%d*%d", obis[0], obis[1], obis[2], obis[3], obis[4], obis[5]);
+		this->setValue(code, (size_t)codeLength, (double)value * std::pow(10.0, (double)scaler));
+	}
+	return true;
+}
+
+bool ObisParser::parseSMLValue(const uint8_t*& pos, const uint8_t* end, int depth, int* type, int64_t* value) {
+	const uint8_t* start = pos;
+	size_t length;
+	if (!readSMLTypeLength(pos, end, type, &length))
+		return false;
+	if (*type == SML_TYPE_LIST) {
+		pos = start;
+		return this->parseSML(pos, end, depth);
+	}
+	// an empty optional value is an octet string
+	if ((length == 0) || (length > 8) || ((*type != SML_TYPE_INTEGER) && (*type != SML_TYPE_UNSIGNED))) {
+		*type = SML_TYPE_OCTETS;
+		pos += length;
+		return true;
+	}
+	uint64_t result = 0;
+	for (size_t i = 0; i < length; i++)
+		result = (result << 8) | pos[i];
+	// extend the sign of negative integers
+	if ((*type == SML_TYPE_INTEGER) && (pos[0] & 0x80) && (length < 8))
+		result |= ~(uint64_t)0 << (8 * length);
+	*value = (int64_t)result;
+	pos += length;
+	return true;
+}
+
+void ObisParser::parseText(const char* frame, size_t length) {
+	// expected format: code(value*unit)
+	const char* end = frame + length;
+	const char* open = std::find(frame, end, '(');
+	const char* close = std::find(open, end, ')');
+	if (close == end)
+		return;
+	while ((frame < open) && isspace((unsigned char)*frame))
+		frame++;
+	const char* valueEnd = std::find(open + 1, close, '*');
+	char number[32];
+	size_t numberLength = valueEnd - open - 1;
+	if ((numberLength == 0) || (numberLength >= sizeof(number)))
+		return;
+	memcpy(number, open + 1, numberLength);
+	number[numberLength] = '\0';
+	char* parsed;
+	double value = strtod(number, &parsed);
+	// ignore values that are not numeric (e.g. meter IDs)
+	if (*parsed != '\0')
+		return;
+	this->setValue(frame, open - frame, value);
+}
+
+void ObisParser::setValue(const char* code, size_t length, double value) {
+	// length of the code without the last group
+	const char* star = (const char*)memchr(code, '*', length);
+	size_t shortLength = (star == nullptr ? length : star - code);
+	for (auto it = this->values.begin(), ite = this->values.end(); it != ite; ++it) {
+		if ((it->port == nullptr) || ((it->code.compare(0, std::string::npos, code, length) != 0)
+			&& (it->code.compare(0, std::string::npos, code, shortLength) != 0)))
+			continue;
+		try {
+			it->port->setPosition((int64_t)llround(value * it->factor));
+		} catch (Poco::Exception &e) {
+			this->owner->logWarning("Unable to set the value of port " + it->portID + ": " + this->openhat->getExceptionMessage(e));
+		}
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Serial Streaming Port
 ///////////////////////////////////////////////////////////////////////////////
@@ -565,6 +796,10 @@ SerialStreamingPort::SerialStreamingPort(AbstractOpenHAT* openhat, const char* i
 	this->mode = PASS_THROUGH;
 	this->device = nullptr;
 	this->serialPort = new ctb::SerialPort();
+	this->frameListener = nullptr;
+	this->buffer.resize(4096);
+	this->bufferStart = 0;
+	this->bufferCount = 0;
 }
 
 SerialStreamingPort::~SerialStreamingPort() {
@@ -578,16 +813,27 @@ uint8_t SerialStreamingPort::doWork(uint8_t canSend)  {
 	if (this->device == nullptr)
 		return OPDI_STATUS_OK;
 
+	if (this->framer) {
+		this->receiveFrames();
+		return OPDI_STATUS_OK;
+	}
+
+	// receive the available data
+	if (this->fillBuffer() < 0)
+		return OPDI_STATUS_OK;
+
 	if (this->mode == LOOPBACK) {
-		// byte available?
-		if (this->available(0) > 0) {
-			char result;
-			if (this->read(&result) > 0) {
-				this->logDebug("Looping back received serial data byte: " + this->openhat->to_string((int)result));
-
-				// echo
-				this->write(&result, 1);
-			}
+		// echo the received data in at most two blocks; data that cannot be written
+		// remains in the buffer until the next iteration
+		while (this->bufferCount > 0) {
+			size_t length = std::min(this->bufferCount, this->buffer.size() - this->bufferStart);
+			int written = this->write(&this->buffer[this->bufferStart], length);
+			if (written <= 0)
+				break;
+			this->logDebug("Looped back " + this->to_string(written) + " bytes of received serial data");
+			this->takeFromBuffer(nullptr, (size_t)written);
+			if ((size_t)written < length)
+				break;
 		}
 	}
 
@@ -601,6 +847,10 @@ void SerialStreamingPort::configure(ConfigurationView::Ptr config) {
 	std::string serialPortName = this->openhat->getConfigString(config, this->ID(), "SerialPort", "", true);
 	int baudRate = config->getInt("BaudRate", 9600);
 	std::string protocol = config->getString("Protocol", "8N1");
+	int bufferSize = config->getInt("BufferSize", (int)this->buffer.size());
+	if (bufferSize < 1)
+		this->openhat->throwSettingException(this->ID() + ": BufferSize must be greater than 0: " + this->to_string(bufferSize));
+	this->buffer.resize(bufferSize);
 	// int timeout = config->getInt("Timeout", 100);
 
 	this->logVerbose("Opening serial port " + serialPortName + " with " + this->openhat->to_string(baudRate) + " baud and protocol " + protocol);
@@ -627,108 +877,667 @@ void SerialStreamingPort::configure(ConfigurationView::Ptr config) {
 	} else
 		if (modeStr != "")
 			this->openhat->throwSettingException(this->ID() + ": Invalid mode specifier; expected 'Passthrough' or 'Loopback': " + modeStr);
+
+	std::string framingStr = config->getString("Framing", "");
+	if (framingStr != "") {
+		StreamFramer::Framing framing = StreamFramer::DELIMITER;
+		if (framingStr == "Delimiter")
+			framing = StreamFramer::DELIMITER;
+		else if (framingStr == "Length")
+			framing = StreamFramer::LENGTH_PREFIX;
+		else if (framingStr == "SML")
+			framing = StreamFramer::SML;
+		else
+			this->openhat->throwSettingException(this->ID() + ": Unsupported Framing; expected 'Delimiter', 'Length' or 'SML': " + framingStr);
+		if (this->mode == LOOPBACK)
+			this->openhat->throwSettingException(this->ID() + ": Framing cannot be used in Loopback mode");
+
+		int maxFrameSize = config->getInt("MaxFrameSize", 4096);
+		if (maxFrameSize < 1)
+			this->openhat->throwSettingException(this->ID() + ": MaxFrameSize must be greater than 0: " + this->to_string(maxFrameSize));
+		this->framer.reset(new StreamFramer(framing, (size_t)maxFrameSize));
+
+		if (framing == StreamFramer::DELIMITER) {
+			std::string delimiter = config->getString("Delimiter", "\\n");
+			try {
+				this->framer->setDelimiter(StreamFramer::unescape(delimiter));
+			} catch (Poco::Exception &e) {
+				this->openhat->throwSettingException(this->ID() + ": Invalid Delimiter: " + delimiter, this->openhat->getExceptionMessage(e));
+			}
+		}
+		if (framing == StreamFramer::LENGTH_PREFIX) {
+			int lengthBytes = config->getInt("LengthBytes", 2);
+			if ((lengthBytes != 1) && (lengthBytes != 2) && (lengthBytes != 4))
+				this->openhat->throwSettingException(this->ID() + ": LengthBytes must be 1, 2 or 4: " + this->to_string(lengthBytes));
+			this->framer->setLengthBytes(lengthBytes);
+		}
+	}
+
+	std::string parserStr = config->getString("Parser", "");
+	if (parserStr == "OBIS") {
+		if (!this->framer)
+			this->openhat->throwSettingException(this->ID() + ": A Parser requires a Framing");
+		this->parser.reset(new ObisParser(this->openhat));
+		this->parser->configure(config, this, framingStr == "SML");
+		this->frameListener = this->parser.get();
+	} else
+		if (parserStr != "")
+			this->openhat->throwSettingException(this->ID() + ": Unsupported Parser; expected 'OBIS': " + parserStr);
+}
+
+void SerialStreamingPort::prepare() {
+	this->logDebug("Preparing port");
+	opdi::StreamingPort::prepare();
+
+	if (this->parser)
+		this->parser->prepare();
+}
+
+void SerialStreamingPort::setFrameListener(StreamFramer::IListener* listener) {
+	this->frameListener = listener;
+}
+
+void SerialStreamingPort::receiveFrames(void) {
+	// nobody is interested in the frames
+	if (this->frameListener == nullptr)
+		return;
+	// receive the available data in blocks of the ring buffer and pass them to the framer
+	int frames = 0;
+	while (true) {
+		// error or no data?
+		if (this->fillBuffer() <= 0)
+			break;
+		// more data may be available if the buffer is full
+		bool full = (this->bufferCount == this->buffer.size());
+		while (this->bufferCount > 0) {
+			size_t length;
+			char* bytes = this->framer->getWriteBuffer(&length);
+			frames += this->framer->commit(this->takeFromBuffer(bytes, length), this->frameListener);
+		}
+		if (!full)
+			break;
+	}
+	if (frames > 0)
+		this->logExtreme("Received " + this->to_string(frames) + " frames");
 }
 
 int SerialStreamingPort::write(char* bytes, size_t length) {
 	return this->device->Write(bytes, length);
 }
 
-int SerialStreamingPort::available(size_t /*count*/) {
-	// count has no meaning in this implementation
+int SerialStreamingPort::fillBuffer(void) {
+	// read into the free space of the ring buffer (at most two contiguous blocks)
+	while (this->bufferCount < this->buffer.size()) {
+		size_t end = (this->bufferStart + this->bufferCount) % this->buffer.size();
+		size_t length = std::min(this->buffer.size() - this->bufferCount, this->buffer.size() - end);
+		int code = this->device->Read(&this->buffer[end], length);
+		// error?
+		if (code < 0)
+			return code;
+		this->bufferCount += code;
+		// no more data available?
+		if ((size_t)code < length)
+			break;
+	}
+	return (int)this->bufferCount;
+}
 
-	char buf;
-	int code = this->device->Read(&buf, 1);
-	// error?
-	if (code < 0)
-		return code;
-	// byte read?
-	if (code > 0) {
-		this->device->PutBack(buf);
-		return 1;
+size_t SerialStreamingPort::takeFromBuffer(char* bytes, size_t length) {
+	size_t result = std::min(length, this->bufferCount);
+	size_t first = std::min(result, this->buffer.size() - this->bufferStart);
+	if (bytes != nullptr) {
+		memcpy(bytes, &this->buffer[this->bufferStart], first);
+		memcpy(bytes + first, &this->buffer[0], result - first);
 	}
-	// nothing available
-	return 0;
+	this->bufferStart = (this->bufferStart + result) % this->buffer.size();
+	this->bufferCount -= result;
+	if (this->bufferCount == 0)
+		this->bufferStart = 0;
+	return result;
+}
+
+int SerialStreamingPort::available(size_t count) {
+	// received data is passed to the frame listener
+	if (this->framer)
+		return 0;
+	// read from the device only if the buffer does not contain the requested number of bytes
+	if ((this->bufferCount == 0) || (this->bufferCount < count)) {
+		int code = this->fillBuffer();
+		// error?
+		if (code < 0)
+			return code;
+	}
+	return (int)this->bufferCount;
 }
 
 int SerialStreamingPort::read(char* result) {
-	char buf;
-	int code = this->device->Read(&buf, 1);
-	// error?
-	if (code < 0)
-		return code;
-	// byte read?
-	if (code > 0) {
-		*result = buf;
-		return 1;
+	return this->readBytes(result, 1);
+}
+
+int SerialStreamingPort::readBytes(char* bytes, size_t length) {
+	if (this->framer)
+		return 0;
+	if (this->bufferCount < length) {
+		int code = this->fillBuffer();
+		// error?
+		if ((code < 0) && (this->bufferCount == 0))
+			return code;
 	}
-	// nothing available
-	return 0;
+	return (int)this->takeFromBuffer(bytes, length);
 }
 
 bool SerialStreamingPort::hasError(void) const {
 	return false;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Port Change Capture
+///////////////////////////////////////////////////////////////////////////////
+
+PortChangeCapture::PortChangeCapture(openhat::AbstractOpenHAT* openhat) {
+	this->openhat = openhat;
+	this->owner = nullptr;
+	this->defaultDeadband = 0;
+	this->heartbeatMs = 0;
+	this->queueSize = 256;
+}
+
+void PortChangeCapture::configure(ConfigurationView::Ptr config, opdi::Port* owner) {
+	this->owner = owner;
+	this->defaultDeadband = config->getDouble("Deadband", this->defaultDeadband);
+	if (this->defaultDeadband < 0)
+		this->openhat->throwSettingException(owner->ID() + ": Deadband may not be negative: " + std::to_string(this->defaultDeadband));
+	int heartbeat = config->getInt("Heartbeat", (int)this->heartbeatMs);
+	if (heartbeat < 0)
+		this->openhat->throwSettingException(owner->ID() + ": Heartbeat may not be negative: " + std::to_string(heartbeat));
+	this->heartbeatMs = heartbeat;
+	int queueSize = config->getInt("ChangeQueueSize", (int)this->queueSize);
+	if (queueSize < 1)
+		this->openhat->throwSettingException(owner->ID() + ": ChangeQueueSize must be greater than 0: " + std::to_string(queueSize));
+	this->queueSize = queueSize;
+
+	// deadbands for individual ports
+	Poco::AutoPtr<ConfigurationView> deadbandConfig = this->openhat->createConfigView(config, "Deadbands");
+	config->addUsedKey("Deadbands");
+	ConfigurationView::Keys keys;
+	deadbandConfig->keys("", keys);
+	for (auto it = keys.begin(), ite = keys.end(); it != ite; ++it) {
+		double deadband = deadbandConfig->getDouble(*it);
+		if (deadband < 0)
+			this->openhat->throwSettingException(owner->ID() + ": Deadband for port " + *it + " may not be negative: " + std::to_string(deadband));
+		this->deadbands[*it] = deadband;
+	}
+}
+
+void PortChangeCapture::prepare(const opdi::PortList& ports) {
+	this->entries.clear();
+	this->entries.reserve(ports.size());
+	for (auto it = ports.cbegin(), ite = ports.cend(); it != ite; ++it) {
+		Entry entry;
+		entry.port = *it;
+		entry.queue.reset(new opdi::PortChangeQueue(this->queueSize));
+		auto dbit = this->deadbands.find((*it)->ID());
+		entry.deadband = (dbit == this->deadbands.end() ? this->defaultDeadband : dbit->second);
+		entry.lastValue = std::numeric_limits<double>::quiet_NaN();
+		entry.lastTime = 0;
+		entry.reported = false;
+		entry.overflows = 0;
+		(*it)->addChangeQueue(entry.queue.get());
+		this->entries.push_back(std::move(entry));
+	}
+	// check for deadbands of unknown ports
+	for (auto it = this->deadbands.cbegin(), ite = this->deadbands.cend(); it != ite; ++it) {
+		bool found = false;
+		for (auto eit = this->entries.cbegin(), eite = this->entries.cend(); eit != eite; ++eit)
+			if (eit->port->ID() == it->first) {
+				found = true;
+				break;
+			}
+		if (!found)
+			this->openhat->throwSettingException(this->owner->ID() + ": A deadband is specified for a port that is not in the port list: " + it->first);
+	}
+}
+
+void PortChangeCapture::release(void) {
+	for (auto it = this->entries.begin(), ite = this->entries.end(); it != ite; ++it)
+		it->port->removeChangeQueue(it->queue.get());
+	this->entries.clear();
+}
+
+bool PortChangeCapture::accept(const Entry& entry, double value) const {
+	bool wasNaN = std::isnan(entry.lastValue);
+	bool isNaN = std::isnan(value);
+	// changes from or to an error are always reported
+	if (wasNaN || isNaN)
+		return wasNaN != isNaN;
+	if (entry.deadband <= 0)
+		return value != entry.lastValue;
+	return std::fabs(value - entry.lastValue) >= entry.deadband;
+}
+
+void PortChangeCapture::collect(std::vector<Change>& changes) {
+	size_t first = changes.size();
+	uint64_t now = opdi::Clock::get().now().epochMicroseconds() / 1000;
+
+	for (size_t i = 0; i < this->entries.size(); i++) {
+		Entry& entry = this->entries[i];
+
+		opdi::PortChangeQueue::Change queued;
+		while (entry.queue->pop(queued)) {
+			if (!entry.reported || this->accept(entry, queued.value)) {
+				Change change = { i, queued.timestamp, queued.value };
+				changes.push_back(change);
+				entry.lastValue = queued.value;
+				entry.lastTime = queued.timestamp;
+				entry.reported = true;
+			}
+		}
+
+		// changes lost? report the current value
+		uint64_t overflows = entry.queue->getOverflows();
+		if (overflows != entry.overflows) {
+			this->openhat->logWarning(this->owner->ID() + ": Change queue overflow for port " + entry.port->ID() + ", total lost changes: " + std::to_string(overflows));
+			entry.overflows = overflows;
+			entry.reported = false;
+		}
+
+		// report the current value initially and if the heartbeat is due
+		if (!entry.reported || ((this->heartbeatMs > 0) && (now - entry.lastTime >= this->heartbeatMs))) {
+			double value;
+			try {
+				value = this->openhat->getPortValue(entry.port);
+			} catch (Poco::Exception&) {
+				// unavailable values are reported as NaN
+				value = std::numeric_limits<double>::quiet_NaN();
+			}
+			Change change = { i, now, value };
+			changes.push_back(change);
+			entry.lastValue = value;
+			entry.lastTime = now;
+			entry.reported = true;
+		}
+	}
+
+	std::stable_sort(changes.begin() + first, changes.end(), [](const Change& a, const Change& b) {
+		return a.timestamp < b.timestamp;
+	});
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Logger Streaming Port
 ///////////////////////////////////////////////////////////////////////////////
 
-LoggerPort::LoggerPort(AbstractOpenHAT* openhat, const char* id) : opdi::StreamingPort(id) {
+LoggerPort::LoggerPort(AbstractOpenHAT* openhat, const char* id) : opdi::StreamingPort(id), changeCapture(openhat), compressor(*this, &LoggerPort::runCompressor) {
 	this->opdi = this->openhat = openhat;
 	this->logPeriod = 10000;		// default: 10 seconds
 	this->writeHeader = true;
-	this->lastEntryTime = opdi_get_time_ms();		// wait until writing first record
+	this->lastEntryTime = opdi::Clock::get().getTimeMs();		// wait until writing first record
 	this->format = CSV;
 	this->separator = ";";
+	this->maxFileSize = 0;
+	this->rotationInterval = 0;
+	this->maxFiles = 0;
+	this->compress = false;
+	this->fileOpenedTime = 0;
+	this->stopCompressor = false;
+	this->async = true;
+	this->maxQueueSize = 1000;
+	this->stopWriter = false;
+	this->droppedEntries = 0;
+	this->blockSize = 60;
+	this->captureChanges = false;
 }
 
 LoggerPort::~LoggerPort() {
-	if (this->outFile.is_open())
-		this->outFile.close();
+	this->stopThreads();
+	this->closeOutputFile();
 }
 
 std::string LoggerPort::getPortStateStr(opdi::Port* port) {
 	return this->openhat->getPortStateStr(port);
 }
 
+void LoggerPort::openOutputFile(void) {
+	this->logVerbose("Opening output log file " + this->outFileStr);
+
+	Poco::File file(this->outFileStr);
+	this->binaryIndex.reset(file.exists() ? file.getSize() : 0);
+
+	// open the stream in append mode
+	this->outFile.open(this->outFileStr, std::ios_base::app | (this->format == BINARY ? std::ios_base::binary : (std::ios_base::openmode)0));
+	this->fileOpenedTime = opdi::Clock::get().getTimeMs();
+}
+
+void LoggerPort::closeOutputFile(void) {
+	if (!this->outFile.is_open())
+		return;
+	if ((this->format == BINARY) && !this->binaryIndex.isEmpty())
+		this->outFile << this->binaryIndex.encode();
+	this->outFile.close();
+}
+
+void LoggerPort::rotateOutputFile(void) {
+	this->closeOutputFile();
+
+	// rotated files are suffixed with a timestamp so that they sort in chronological order
+	std::string rotatedName = this->outFileStr + "." + Poco::DateTimeFormatter::format(Poco::LocalDateTime(Poco::DateTime(opdi::Clock::get().now())), "%Y%m%d%H%M%S");
+	int counter = 0;
+	while (Poco::File(rotatedName).exists() || Poco::File(rotatedName + ".gz").exists())
+		rotatedName = this->outFileStr + "." + Poco::DateTimeFormatter::format(Poco::LocalDateTime(Poco::DateTime(opdi::Clock::get().now())), "%Y%m%d%H%M%S") + "-" + this->to_string(++counter);
+
+	try {
+		this->logVerbose("Rotating output log file to " + rotatedName);
+		Poco::File(this->outFileStr).renameTo(rotatedName);
+		if (this->compress && this->compressorThread.isRunning()) {
+			// the compressor thread also removes old files after compressing
+			{
+				Poco::Mutex::ScopedLock lock(this->compressMutex);
+				this->compressQueue.push_back(rotatedName);
+			}
+			this->compressEvent.set();
+		} else {
+			if (this->compress)
+				this->compressFile(rotatedName);
+			this->removeOldFiles();
+		}
+	} catch (Poco::Exception& e) {
+		this->logWarning("Error rotating output log file " + this->outFileStr + ": " + this->openhat->getExceptionMessage(e));
+	}
+
+	this->openOutputFile();
+}
+
+void LoggerPort::compressFile(const std::string& fileName) {
+	{
+		Poco::FileInputStream fis(fileName);
+		Poco::FileOutputStream fos(fileName + ".gz");
+		Poco::DeflatingOutputStream gzos(fos, Poco::DeflatingStreamBuf::STREAM_GZIP);
+		Poco::StreamCopier::copyStream(fis, gzos);
+		gzos.close();
+		fos.close();
+	}
+	Poco::File(fileName).remove();
+}
+
+void LoggerPort::runCompressor(void) {
+	// runs in separate thread
+	std::deque<std::string> files;
+	while (true) {
+		// wait for rotated files
+		this->compressEvent.tryWait(1000);
+		bool stop = this->stopCompressor;
+		{
+			Poco::Mutex::ScopedLock lock(this->compressMutex);
+			files.swap(this->compressQueue);
+		}
+		if (!files.empty()) {
+			auto ite = files.cend();
+			for (auto it = files.cbegin(); it != ite; ++it) {
+				try {
+					this->logVerbose("Compressing rotated log file " + *it);
+					this->compressFile(*it);
+				} catch (Poco::Exception& e) {
+					this->logWarning("Error compressing rotated log file " + *it + ": " + this->openhat->getExceptionMessage(e));
+				}
+			}
+			files.clear();
+			try {
+				this->removeOldFiles();
+			} catch (Poco::Exception& e) {
+				this->logWarning("Error removing rotated log files: " + this->openhat->getExceptionMessage(e));
+			}
+		}
+		if (stop)
+			break;
+	}
+	this->logDebug("Logger compressor thread terminated");
+}
+
+void LoggerPort::stopThreads(void) {
+	// the writer thread may still rotate files, so it must be stopped first
+	if (this->writerThread.isRunning()) {
+		this->stopWriter = true;
+		this->queueEvent.set();
+		this->writerThread.join();
+	}
+	if (this->compressorThread.isRunning()) {
+		this->stopCompressor = true;
+		this->compressEvent.set();
+		this->compressorThread.join();
+	}
+}
+
+void LoggerPort::removeOldFiles(void) {
+	if (this->maxFiles <= 0)
+		return;
+
+	Poco::Path outPath(this->outFileStr);
+	outPath.makeAbsolute();
+	std::string prefix = outPath.getFileName() + ".";
+	Poco::Path directory(outPath.parent());
+
+	// collect the rotated files ordered by timestamp and counter; a file that is being compressed
+	// may exist with and without the .gz extension, therefore both are grouped together
+	Poco::RegularExpression suffixRegex("^([0-9]{14})(?:-([0-9]+))?(?:\\.gz)?$");
+	Poco::RegularExpression::MatchVec matches;
+	std::map<std::pair<std::string, int>, std::vector<std::string> > rotatedFiles;
+	Poco::DirectoryIterator ite;
+	for (Poco::DirectoryIterator it(directory); it != ite; ++it) {
+		const std::string& name = it.name();
+		if ((name.size() <= prefix.size()) || (name.compare(0, prefix.size(), prefix) != 0))
+			continue;
+		std::string suffix = name.substr(prefix.size());
+		if (suffixRegex.match(suffix, 0, matches) == 0)
+			continue;
+		int counter = 0;
+		if ((matches.size() > 2) && (matches[2].offset != std::string::npos))
+			counter = Poco::NumberParser::parse(suffix.substr(matches[2].offset, matches[2].length));
+		rotatedFiles[std::make_pair(suffix.substr(matches[1].offset, matches[1].length), counter)].push_back(it->path());
+	}
+
+	int toRemove = (int)rotatedFiles.size() - this->maxFiles;
+	auto it = rotatedFiles.cbegin();
+	while ((toRemove > 0) && (it != rotatedFiles.cend())) {
+		auto fite = it->second.cend();
+		for (auto fit = it->second.cbegin(); fit != fite; ++fit) {
+			this->logVerbose("Removing rotated log file " + *fit);
+			Poco::File(*fit).remove();
+		}
+		--toRemove;
+		++it;
+	}
+}
+
+void LoggerPort::writeEntries(const std::vector<std::string>& entries) {
+	if (entries.empty() || !this->outFile.is_open())
+		return;
+
+	// rotation necessary?
+	bool rotate = false;
+	if ((this->rotationInterval > 0) && (opdi::Clock::get().getTimeMs() - this->fileOpenedTime >= (uint64_t)this->rotationInterval * 1000))
+		rotate = true;
+	if ((this->maxFileSize > 0) && ((uint64_t)this->outFile.tellp() >= this->maxFileSize))
+		rotate = true;
+	if (rotate) {
+		this->rotateOutputFile();
+		if (!this->outFile.is_open())
+			return;
+		// a new file always starts with the header
+		if (!this->headerLine.empty() && (entries.front() != this->headerLine)) {
+			this->outFile << this->headerLine;
+			if (this->format == CSV)
+				this->outFile << '\n';
+			else
+				this->binaryIndex.add(this->headerLine);
+		}
+	}
+
+	auto ite = entries.cend();
+	for (auto it = entries.cbegin(); it != ite; ++it) {
+		this->outFile << *it;
+		// binary entries are complete records
+		if (this->format == CSV)
+			this->outFile << '\n';
+		else
+			this->binaryIndex.add(*it);
+	}
+	this->outFile.flush();
+}
+
+void LoggerPort::buildChangeEntries(std::vector<std::string>& entries) {
+	std::vector<PortChangeCapture::Change> changes;
+	this->changeCapture.collect(changes);
+
+	// create one row per distinct timestamp that contains the current values of all ports
+	size_t i = 0;
+	while (i < changes.size()) {
+		uint64_t timestamp = changes[i].timestamp;
+		while ((i < changes.size()) && (changes[i].timestamp == timestamp)) {
+			this->capturedValues[changes[i].index] = changes[i].value;
+			++i;
+		}
+		if (this->format == CSV) {
+			std::string entry = Poco::DateTimeFormatter::format(Poco::LocalDateTime(Poco::Timestamp(timestamp * 1000)), this->openhat->timestampFormat);
+			auto ite = this->capturedValues.cend();
+			for (auto it = this->capturedValues.cbegin(); it != ite; ++it) {
+				entry += this->separator;
+				// unavailable values are left empty
+				if (!std::isnan(*it))
+					entry += this->to_string(*it);
+			}
+			entries.push_back(entry);
+		} else
+		if (this->format == BINARY) {
+			this->binaryWriter->addRow((int64_t)timestamp, this->capturedValues);
+			if (this->binaryWriter->isBlockFull())
+				entries.push_back(this->binaryWriter->encodeBlock());
+		}
+	}
+}
+
+void LoggerPort::run(void) {
+	// runs in separate thread
+	std::vector<std::string> batch;
+	while (true) {
+		// wait for new entries
+		this->queueEvent.tryWait(1000);
+		bool stop = this->stopWriter;
+		{
+			Poco::Mutex::ScopedLock lock(this->queueMutex);
+			batch.assign(this->queue.begin(), this->queue.end());
+			this->queue.clear();
+		}
+		try {
+			this->writeEntries(batch);
+		} catch (std::exception& e) {
+			this->logWarning(std::string("Error writing output log file: ") + e.what());
+		}
+		batch.clear();
+		if (stop)
+			break;
+	}
+	this->logDebug("Logger writer thread terminated");
+}
+
 void LoggerPort::prepare() {
 	this->logDebug("Preparing port");
 	opdi::StreamingPort::prepare();
 
 	// find ports; throws errors if something required is missing
 	this->findPorts(this->getID(), "Ports", this->portsToLogStr, this->portsToLog);
+
+	if (format == CSV) {
+		this->headerLine = "Timestamp" + this->separator;
+		// go through port list, build header
+		auto it = this->portsToLog.begin();
+		auto ite = this->portsToLog.end();
+		while (it != ite) {
+			this->headerLine += (*it)->getID();
+			// separator necessary?
+			if (it != ite - 1) 
+				this->headerLine += this->separator;
+			++it;
+		}
+	} else
+	if (format == BINARY) {
+		std::vector<std::string> columns;
+		auto it = this->portsToLog.begin();
+		auto ite = this->portsToLog.end();
+		while (it != ite) {
+			columns.push_back((*it)->ID());
+			++it;
+		}
+		this->binaryWriter.reset(new BinaryLogWriter(columns, this->blockSize));
+		this->headerLine = this->binaryWriter->getSegmentHeader();
+	}
+
+	if (this->captureChanges) {
+		this->changeCapture.prepare(this->portsToLog);
+		this->capturedValues.assign(this->portsToLog.size(), std::numeric_limits<double>::quiet_NaN());
+	}
+
+	if (this->compress) {
+		this->compressorThread.setName(this->ID() + " compressor thread");
+		this->compressorThread.start(this->compressor);
+	}
+
+	if (this->async) {
+		this->writerThread.setName(this->ID() + " writer thread");
+		this->writerThread.start(*this);
+	}
+}
+
+void LoggerPort::shutdown(void) {
+	// encode pending binary rows
+	if ((this->binaryWriter != nullptr) && (this->binaryWriter->getRowCount() > 0)) {
+		std::vector<std::string> entries;
+		if (this->writeHeader)
+			entries.push_back(this->headerLine);
+		entries.push_back(this->binaryWriter->encodeBlock());
+		if (this->writerThread.isRunning()) {
+			Poco::Mutex::ScopedLock lock(this->queueMutex);
+			this->queue.insert(this->queue.end(), entries.begin(), entries.end());
+		} else
+			this->writeEntries(entries);
+	}
+	// write remaining entries and compress remaining files
+	this->stopThreads();
+	this->closeOutputFile();
+	this->changeCapture.release();
+	opdi::StreamingPort::shutdown();
 }
 
 uint8_t LoggerPort::doWork(uint8_t canSend)  {
 	opdi::StreamingPort::doWork(canSend);
 
 	// check whether the time for a new entry has been reached
-	uint64_t timeDiff = opdi_get_time_ms() - this->lastEntryTime;
-	if (timeDiff < this->logPeriod)
+	uint64_t timeDiff = opdi::Clock::get().getTimeMs() - this->lastEntryTime;
+	if (timeDiff < this->logPeriod) {
+		opdi::Clock::get().addDeadlineMs(this->lastEntryTime + this->logPeriod);
 		return OPDI_STATUS_OK;
+	}
 
-	this->lastEntryTime = opdi_get_time_ms();
+	this->lastEntryTime = opdi::Clock::get().getTimeMs();
 
-	// build log entry
-	std::string entry;
+	// build log entries (the writer skips them if the output file could not be opened)
+	std::vector<std::string> entries;
 
+	if (this->captureChanges) {
+		this->buildChangeEntries(entries);
+		if (entries.empty())
+			return OPDI_STATUS_OK;
+		// the header precedes the first entry
+		if (this->writeHeader) {
+			entries.insert(entries.begin(), this->headerLine);
+			this->writeHeader = false;
+		}
+	} else
 	if (format == CSV) {
 		if (this->writeHeader) {
-			entry = "Timestamp" + this->separator;
-			// go through port list, build header
-			auto it = this->portsToLog.begin();
-			auto ite = this->portsToLog.end();
-			while (it != ite) {
-				entry += (*it)->getID();
-				// separator necessary?
-				if (it != ite - 1) 
-					entry += this->separator;
-				++it;
-			}
-			this->outFile << entry << std::endl;
+			entries.push_back(this->headerLine);
 			this->writeHeader = false;
 		}
-		entry = this->openhat->getTimestampStr() + this->separator;
+		std::string entry = this->openhat->getTimestampStr() + this->separator;
 		// go through port list
 		auto it = this->portsToLog.begin();
 		auto ite = this->portsToLog.end();
@@ -739,13 +1548,52 @@ uint8_t LoggerPort::doWork(uint8_t canSend)  {
 				entry += this->separator;
 			++it;
 		}
+		entries.push_back(entry);
+	} else
+	if (format == BINARY) {
+		std::vector<double> values;
+		auto it = this->portsToLog.begin();
+		auto ite = this->portsToLog.end();
+		while (it != ite) {
+			try {
+				values.push_back(this->openhat->getPortValue(*it));
+			} catch (Poco::Exception&) {
+				// unavailable values are logged as NaN
+				values.push_back(std::numeric_limits<double>::quiet_NaN());
+			}
+			++it;
+		}
+		this->binaryWriter->addRow(opdi::Clock::get().now().epochMicroseconds() / 1000, values);
+		// the header is written together with the first block
+		if (!this->binaryWriter->isBlockFull())
+			return OPDI_STATUS_OK;
+		if (this->writeHeader) {
+			entries.push_back(this->headerLine);
+			this->writeHeader = false;
+		}
+		entries.push_back(this->binaryWriter->encodeBlock());
 	}
 
-	if (!this->outFile.is_open())
+	if (!this->async) {
+		// write to output
+		this->writeEntries(entries);
 		return OPDI_STATUS_OK;
+	}
 
-	// write to output
-	this->outFile << entry << std::endl;
+	// hand the entries over to the writer thread
+	bool dropped = false;
+	{
+		Poco::Mutex::ScopedLock lock(this->queueMutex);
+		if (this->queue.size() + entries.size() > this->maxQueueSize) {
+			this->droppedEntries += entries.size();
+			dropped = true;
+		} else
+			this->queue.insert(this->queue.end(), entries.begin(), entries.end());
+	}
+	if (dropped)
+		this->logWarning("Writer queue is full, total dropped entries: " + this->to_string(this->droppedEntries));
+	else
+		this->queueEvent.set();
 
 	return OPDI_STATUS_OK;
 }
@@ -758,18 +1606,55 @@ void LoggerPort::configure(ConfigurationView::Ptr config) {
 	this->separator = config->getString("Separator", this->separator);
 
 	std::string formatStr = config->getString("Format", "CSV");
-	if (formatStr != "CSV")
-		this->openhat->throwSettingException(this->ID() + ": Formats other than CSV are currently not supported");
+	if (formatStr == "CSV")
+		this->format = CSV;
+	else
+	if (formatStr == "Binary")
+		this->format = BINARY;
+	else
+		this->openhat->throwSettingException(this->ID() + ": Unsupported Format; expected 'CSV' or 'Binary': " + formatStr);
+
+	int blockSize = config->getInt("BlockSize", (int)this->blockSize);
+	if (blockSize < 1)
+		this->openhat->throwSettingException(this->ID() + ": BlockSize must be greater than 0: " + this->to_string(blockSize));
+	this->blockSize = blockSize;
+
+	this->async = config->getBool("Async", this->async);
+	int queueSize = config->getInt("QueueSize", (int)this->maxQueueSize);
+	if (queueSize < 1)
+		this->openhat->throwSettingException(this->ID() + ": QueueSize must be greater than 0: " + this->to_string(queueSize));
+	this->maxQueueSize = queueSize;
+
+	int64_t maxFileSize = config->getInt64("MaxFileSize", (int64_t)this->maxFileSize);
+	if (maxFileSize < 0)
+		this->openhat->throwSettingException(this->ID() + ": MaxFileSize may not be negative: " + this->to_string(maxFileSize));
+	this->maxFileSize = maxFileSize;
+	int rotationInterval = config->getInt("RotationInterval", (int)this->rotationInterval);
+	if (rotationInterval < 0)
+		this->openhat->throwSettingException(this->ID() + ": RotationInterval may not be negative: " + this->to_string(rotationInterval));
+	this->rotationInterval = rotationInterval;
+	this->maxFiles = config->getInt("MaxFiles", this->maxFiles);
+	if (this->maxFiles < 0)
+		this->openhat->throwSettingException(this->ID() + ": MaxFiles may not be negative: " + this->to_string(this->maxFiles));
+	this->compress = config->getBool("Compress", this->compress);
+
+	std::string captureStr = config->getString("Capture", "Interval");
+	if (captureStr == "Interval")
+		this->captureChanges = false;
+	else
+	if (captureStr == "Change")
+		this->captureChanges = true;
+	else
+		this->openhat->throwSettingException(this->ID() + ": Unsupported Capture mode; expected 'Interval' or 'Change': " + captureStr);
+	if (this->captureChanges)
+		this->changeCapture.configure(config, this);
 
-	std::string outFileStr = config->getString("OutputFile", "");
-	if (outFileStr != "") {
+	this->outFileStr = config->getString("OutputFile", "");
+	if (this->outFileStr != "") {
 		// try to lock the output file name as a resource
-		this->openhat->lockResource(outFileStr, this->getID());
+		this->openhat->lockResource(this->outFileStr, this->getID());
 
-		this->logVerbose("Opening output log file " + outFileStr);
-
-		// open the stream in append mode
-		this->outFile.open(outFileStr, std::ios_base::app);
+		this->openOutputFile();
 	} else
 		this->openhat->throwSettingException(this->ID() + ": The OutputFile setting must be specified");
 
@@ -875,7 +1760,7 @@ bool FaderPort::setLine(uint8_t line, ChangeSource changeSource) {
 			this->logDebug("Refusing to fade because duration is impracticably low: " + to_string(this->durationMs));
 		} else {
 			bool changed = opdi::DigitalPort::setLine(line, changeSource);
-			this->startTime = Poco::Timestamp();
+			this->startTime = opdi::Clock::get().now();
 			// cause correct log output
 			this->lastValue = -1;
 			this->logDebug("Start fading at " + to_string(this->left) + "% with a duration of " + to_string(this->durationMs) + " ms");
@@ -923,7 +1808,7 @@ uint8_t FaderPort::doWork(uint8_t canSend)  {
 			}
 
 			// calculate time difference
-			Poco::Timestamp now;
+			Poco::Timestamp now = opdi::Clock::get().now();
 			elapsedMs = (now.epochMicroseconds() - this->startTime.epochMicroseconds()) / 1000;
 
 			// end reached?
@@ -946,6 +1831,9 @@ uint8_t FaderPort::doWork(uint8_t canSend)  {
 
 				return OPDI_STATUS_OK;
 			}
+
+			// fade in small steps (relevant for simulated time)
+			opdi::Clock::get().addDeadline(now + 10 * 1000);
 		}
 
 		// calculate current value (linear first) within the range [0, 1]
@@ -1109,77 +1997,128 @@ void SceneSelectPort::prepare() {
 
 		++fi;
 	}
+
+	// compile scenes
+	this->scenes.clear();
+	for (auto it = this->fileList.begin(), ite = this->fileList.end(); it != ite; ++it) {
+		Scene scene;
+		scene.file = *it;
+		scene.portListVersion = 0;
+		// errors are reported when the scene is selected
+		this->tryCompileScene(scene);
+		this->scenes.push_back(scene);
+	}
 }
 
-uint8_t SceneSelectPort::doWork(uint8_t canSend)  {
-	opdi::SelectPort::doWork(canSend);
+void SceneSelectPort::compileScene(Scene& scene) {
+	scene.entries.clear();
 
-	// position changed?
-	if (this->positionSet) {
-		this->logVerbose(std::string("Scene selected: ") + this->getPositionLabel(this->getPosition()));
+	// remember the file stamp before reading to detect modifications during compilation
+	std::string stamp = this->openhat->getFileStamp(scene.file);
+
+	// prepare scene file parameters (environment, ports, ...)
+	std::map<std::string, std::string> parameters;
+	this->openhat->getEnvironment(parameters);
+
+	if (this->logVerbosity >= opdi::LogVerbosity::DEBUG) {
+		this->logDebug("Scene file parameters:");
+		auto it = parameters.begin();
+		auto ite = parameters.end();
+		while (it != ite) {
+			this->logDebug("  " + (*it).first + " = " + (*it).second);
+			++it;
+		}
+	}
 
-		std::string sceneFile = this->fileList[this->getPosition()];
+	// open the config file
+	ConfigurationView::Ptr config = new ConfigurationView(this->openhat, new OpenHATConfigurationFile(scene.file, parameters), "", "", false);
 
-		// prepare scene file parameters (environment, ports, ...)
-		std::map<std::string, std::string> parameters;
-		this->openhat->getEnvironment(parameters);
+	// go through sections of the scene file
+	ConfigurationView::Keys sectionKeys;
+	config->keys("", sectionKeys);
 
-		if (this->logVerbosity >= opdi::LogVerbosity::DEBUG) {
-			this->logDebug("Scene file parameters:");
-			auto it = parameters.begin();
-			auto ite = parameters.end();
-			while (it != ite) {
-				this->logDebug("  " + (*it).first + " = " + (*it).second);
-				++it;
-			}
+	if (sectionKeys.size() == 0)
+		this->logWarning("Scene file " + scene.file + " does not contain any scene information, is this intended?");
+	else
+		this->logDebug("Compiling scene file: " + scene.file);
+
+	for (auto it = sectionKeys.begin(), ite = sectionKeys.end(); it != ite; ++it) {
+		// find port corresponding to this section
+		opdi::Port* port = this->openhat->findPortByID((*it).c_str());
+		if (port == nullptr) {
+			this->logWarning("In scene file " + scene.file + ": Port with ID " + (*it) + " not present in current configuration");
+			continue;
 		}
 
-		// open the config file
-		ConfigurationView::Ptr config = new ConfigurationView(this->openhat, new OpenHATConfigurationFile(sceneFile, parameters), "", "", false);
+		Poco::AutoPtr<ConfigurationView> portConfig = this->openhat->createConfigView(config, *it);
 
-		// go through sections of the scene file
-		ConfigurationView::Keys sectionKeys;
-		config->keys("", sectionKeys);
+		SceneEntry entry;
+		entry.port = port;
+		// read only the state settings - not the general setup
+		try {
+			this->openhat->readPortState(portConfig, port, entry.state);
+		} catch (Poco::Exception &e) {
+			this->logWarning("In scene file " + scene.file + ": Error configuring port " + (*it) + ": " + this->openhat->getExceptionMessage(e));
+			continue;
+		}
 
-		if (sectionKeys.size() == 0)
-			this->logWarning("Scene file " + sceneFile + " does not contain any scene information, is this intended?");
-		else
-			this->logDebug("Applying settings from scene file: " + sceneFile);
+		scene.entries.push_back(entry);
+	}
 
-		for (auto it = sectionKeys.begin(), ite = sectionKeys.end(); it != ite; ++it) {
-			// find port corresponding to this section
-			opdi::Port* port = this->openhat->findPortByID((*it).c_str());
-			if (port == nullptr)
-				this->logWarning("In scene file " + sceneFile + ": Port with ID " + (*it) + " not present in current configuration");
-			else {
-				this->logDebug("Applying settings to port: " + *it);
+	scene.stamp = stamp;
+	scene.portListVersion = this->openhat->getPortListVersion();
+}
 
-				// configure port according to settings 
-				Poco::AutoPtr<ConfigurationView> portConfig = this->openhat->createConfigView(config, *it);
+bool SceneSelectPort::tryCompileScene(Scene& scene) {
+	try {
+		this->compileScene(scene);
+	} catch (Poco::Exception &e) {
+		this->logWarning("Error compiling scene file " + scene.file + ": " + this->openhat->getExceptionMessage(e));
+		// the entries may refer to ports that no longer exist
+		scene.entries.clear();
+		scene.stamp = "";
+		return false;
+	}
+	return true;
+}
 
-				// configure only state - not the general setup
-				try {
-					if (port->getType()[0] == OPDI_PORTTYPE_DIGITAL[0]) {
-						this->openhat->configureDigitalPort(portConfig, (opdi::DigitalPort*)port, true);
-					} else
-					if (port->getType()[0] == OPDI_PORTTYPE_ANALOG[0]) {
-						this->openhat->configureAnalogPort(portConfig, (opdi::AnalogPort*)port, true);
-					} else
-					if (port->getType()[0] == OPDI_PORTTYPE_SELECT[0]) {
-						this->openhat->configureSelectPort(portConfig, config, (opdi::SelectPort*)port, true);
-					} else
-					if (port->getType()[0] == OPDI_PORTTYPE_DIAL[0]) {
-						this->openhat->configureDialPort(portConfig, (opdi::DialPort*)port, true);
-					} else
-						this->logWarning("In scene file " + sceneFile + ": Port with ID " + (*it) + " has an unknown type");
-				} catch (Poco::Exception &e) {
-					this->logWarning("In scene file " + sceneFile + ": Error configuring port " + (*it) + ": " + this->openhat->getExceptionMessage(e));
-				}
-			}
+void SceneSelectPort::applyScene(Scene& scene) {
+	for (auto it = scene.entries.begin(), ite = scene.entries.end(); it != ite; ++it) {
+		const SceneEntry& entry = *it;
+		try {
+			// persisted states take precedence, as with the port configuration
+			AbstractOpenHAT::PortState state = entry.state;
+			this->openhat->mergePersistentState(entry.port, state);
+			this->openhat->applyPortState(entry.port, state);
+		} catch (Poco::Exception &e) {
+			this->logWarning("In scene file " + scene.file + ": Error applying settings to port " + entry.port->ID() + ": " + this->openhat->getExceptionMessage(e));
 		}
+	}
+}
 
-		// refresh all ports of a connected master
-		this->openhat->refresh(nullptr);
+uint8_t SceneSelectPort::doWork(uint8_t canSend)  {
+	opdi::SelectPort::doWork(canSend);
+
+	// position changed?
+	if (this->positionSet) {
+		this->logVerbose(std::string("Scene selected: ") + this->getPositionLabel(this->getPosition()));
+
+		Scene& scene = this->scenes[this->getPosition()];
+
+		// recompile the scene if the file has been modified or ports have been added or removed
+		bool compiled = true;
+		if ((scene.portListVersion != this->openhat->getPortListVersion()) || (scene.stamp != this->openhat->getFileStamp(scene.file))) {
+			this->logDebug("Scene file has changed, recompiling: " + scene.file);
+			compiled = this->tryCompileScene(scene);
+		}
+
+		if (compiled) {
+			this->logDebug("Applying scene: " + scene.file);
+			this->applyScene(scene);
+
+			// refresh all ports of a connected master
+			this->openhat->refresh(nullptr);
+		}
 
 		this->positionSet = false;
 	}
@@ -1201,10 +2140,8 @@ uint8_t FilePort::doWork(uint8_t canSend) {
 	if (result != OPDI_STATUS_OK)
 		return result;
 
-	Poco::Mutex::ScopedLock(this->mutex);
-
 	// expiry time over?
-	if ((this->expiryMs > 0) && (this->lastReloadTime > 0) && (opdi_get_time_ms() - lastReloadTime > (uint64_t)this->expiryMs)) {
+	if ((this->expiryMs > 0) && (this->lastReloadTime > 0) && (opdi::Clock::get().getTimeMs() - lastReloadTime > (uint64_t)this->expiryMs)) {
 		// only if the port's value is ok
 		if (this->valuePort->getError() == Error::VALUE_OK) {
 			this->logWarning(ID() + ": Value of port '" + this->valuePort->ID() + "' has expired");
@@ -1219,13 +2156,13 @@ uint8_t FilePort::doWork(uint8_t canSend) {
 	}
 
 	// if a delay is specified, ignore reloads until it's up
-	if ((this->reloadDelayMs > 0) && (this->lastReloadTime > 0) && (opdi_get_time_ms() - lastReloadTime < (uint64_t)this->reloadDelayMs))
+	if ((this->reloadDelayMs > 0) && (this->lastReloadTime > 0) && (opdi::Clock::get().getTimeMs() - lastReloadTime < (uint64_t)this->reloadDelayMs))
 		return OPDI_STATUS_OK;
 
 	if (this->needsReload) {
 		this->logDebug("Reloading file: " + this->filePath);
 
-		this->lastReloadTime = opdi_get_time_ms();
+		this->lastReloadTime = opdi::Clock::get().getTimeMs();
 
 		this->needsReload = false;
 
@@ -1243,7 +2180,7 @@ uint8_t FilePort::doWork(uint8_t canSend) {
 				// creates an empty file before filling it with content.
 				// To avoid generating too many log warnings, this case
 				// is being silently ignored.
-				// When the file is being modified, the DirectoryWatcher will
+				// When the file is being modified, the FileWatcher will
 				// hopefully catch this change so data is not lost.
 				// So, instead of:
 				// throw Poco::DataFormatException("File is empty");
@@ -1327,13 +2264,10 @@ uint8_t FilePort::doWork(uint8_t canSend) {
 	return OPDI_STATUS_OK;
 }
 
-void FilePort::fileChangedEvent(const void*, const Poco::DirectoryWatcher::DirectoryEvent& evt) {
-	if (evt.item.path() == this->filePath) {
-		this->logDebug("Detected file modification: " + this->filePath);
-		
-		Poco::Mutex::ScopedLock(this->mutex);
-		this->needsReload = true;
-	}
+void FilePort::fileChanged(const std::string& /*path*/) {
+	// called by the FileWatcher in the main thread
+	this->logDebug("Detected file modification: " + this->filePath);
+	this->needsReload = true;
 }
 
 void FilePort::writeContent() {
@@ -1392,7 +2326,7 @@ FilePort::FilePort(AbstractOpenHAT* openhat, const char* id) :
 	// a File port is presented as an output (being High means that file IO is active)
 	opdi::DigitalPort(id, OPDI_PORTDIRCAP_OUTPUT, 0) {
 	this->opdi = this->openhat = openhat;
-	this->directoryWatcher = nullptr;
+	this->watchHandle = 0;
 	this->reloadDelayMs = 0;
 	this->expiryMs = 0;
 	this->deleteAfterRead = false;
@@ -1410,8 +2344,8 @@ FilePort::FilePort(AbstractOpenHAT* openhat, const char* id) :
 }
 
 FilePort::~FilePort() {
-	if (this->directoryWatcher != nullptr)
-		delete this->directoryWatcher;
+	if (this->watchHandle != 0)
+		FileWatcher::get().removeWatch(this->watchHandle);
 }
 
 void FilePort::configure(ConfigurationView::Ptr config, ConfigurationView::Ptr parentConfig) {
@@ -1495,16 +2429,10 @@ void FilePort::configure(ConfigurationView::Ptr config, ConfigurationView::Ptr p
 	// std::cout << absPath << std::endl;
 	
 	this->filePath = absPath.toString();
-	this->directory = absPath.parent();
 
-	this->logDebug("Preparing DirectoryWatcher for folder '" + this->directory.path() + "'");
+	this->logDebug("Watching file '" + this->filePath + "'");
 
-	this->directoryWatcher = new Poco::DirectoryWatcher(this->directory, 
-			Poco::DirectoryWatcher::DW_ITEM_MODIFIED | Poco::DirectoryWatcher::DW_ITEM_ADDED | Poco::DirectoryWatcher::DW_ITEM_MOVED_TO, 
-			Poco::DirectoryWatcher::DW_DEFAULT_SCAN_INTERVAL);
-	this->directoryWatcher->itemModified += Poco::delegate(this, &FilePort::fileChangedEvent);
-	this->directoryWatcher->itemAdded += Poco::delegate(this, &FilePort::fileChangedEvent);
-	this->directoryWatcher->itemMovedTo += Poco::delegate(this, &FilePort::fileChangedEvent);
+	this->watchHandle = FileWatcher::get().addWatch(this->filePath, this);
 
 	// can the file be loaded initially?
 	Poco::File file(this->filePath);
@@ -1634,7 +2562,7 @@ void AggregatorPort::persist() {
 			}
 			else {
 				// use current time as persistence timestamp
-				this->openhat->persistentConfig->setUInt64(this->ID() + ".Time", opdi_get_time_ms());
+				this->openhat->persistentConfig->setUInt64(this->ID() + ".Time", opdi::Clock::get().getTimeMs());
 				std::stringstream ss;
 				auto vit = this->values.cbegin();
 				auto vitb = this->values.cbegin();
@@ -1710,11 +2638,11 @@ uint8_t AggregatorPort::doWork(uint8_t canSend) {
 
 		// try to read values from persistent storage?
 		if (this->isPersistent() && (this->openhat->persistentConfig != nullptr)) {
-			this->logVerbose("Trying to read persisted aggregator values with current time being " + this->to_string(opdi_get_time_ms()));
+			this->logVerbose("Trying to read persisted aggregator values with current time being " + this->to_string(opdi::Clock::get().getTimeMs()));
 			// read timestamp
 			uint64_t persistTime = this->openhat->persistentConfig->getUInt64(this->ID() + ".Time", 0);
 			// timestamp acceptable? must be in the past and within the query interval
-			int64_t elapsed = opdi_get_time_ms() - persistTime;
+			int64_t elapsed = opdi::Clock::get().getTimeMs() - persistTime;
 			if ((elapsed > 0) && (elapsed < this->queryInterval * 1000)) {
 				// remember persistent time as last query time
 				this->lastQueryTime = persistTime;
@@ -1738,6 +2666,9 @@ uint8_t AggregatorPort::doWork(uint8_t canSend) {
 				}	// read values
 				valuesAvailable = true;
 				this->logVerbose("Total persisted aggregator values read: " + this->to_string(this->values.size()));
+				// the history port receives the complete series once
+				if (this->setHistory && this->historyPort != nullptr)
+					this->historyPort->setHistory(this->queryInterval, this->totalValues, this->values);
 			}	// timestamp valid
 			else
 				this->logVerbose("Persisted aggregator values not found or outdated, timestamp was: " + to_string(persistTime));
@@ -1745,8 +2676,11 @@ uint8_t AggregatorPort::doWork(uint8_t canSend) {
 	}
 
 	// time to read the next value?
-	if (opdi_get_time_ms() - this->lastQueryTime > (uint64_t)this->queryInterval * 1000) {
-		this->lastQueryTime = opdi_get_time_ms();
+	if (opdi::Clock::get().getTimeMs() - this->lastQueryTime <= (uint64_t)this->queryInterval * 1000)
+		opdi::Clock::get().addDeadlineMs(this->lastQueryTime + (uint64_t)this->queryInterval * 1000 + 1);
+	else {
+		this->lastQueryTime = opdi::Clock::get().getTimeMs();
+		opdi::Clock::get().addDeadlineMs(this->lastQueryTime + (uint64_t)this->queryInterval * 1000 + 1);
 
 		double value;
 		try {
@@ -1810,11 +2744,12 @@ uint8_t AggregatorPort::doWork(uint8_t canSend) {
 		// persist values
 		this->persist();
 		valuesAvailable = true;
+		// append the new value only; the history port drops the oldest values itself
+		if (this->setHistory && this->historyPort != nullptr)
+			this->historyPort->appendHistory(this->queryInterval, this->totalValues, longValue);
 	}
 
 	if (valuesAvailable) {
-		if (this->setHistory && this->historyPort != nullptr)
-			this->historyPort->setHistory(this->queryInterval, this->totalValues, this->values);
 		// perform all calculations
 		auto it = this->calculations.begin();
 		auto ite = this->calculations.end();
@@ -2097,10 +3032,10 @@ void CounterPort::doIncrement(int64_t increment) {
 
 	switch (this->timeBase) {
 	case TimeBase::SECONDS:
-			this->lastCountTime = opdi_get_time_ms() / 1000;
+			this->lastCountTime = opdi::Clock::get().getTimeMs() / 1000;
 			break;
 	case TimeBase::MILLISECONDS:
-			this->lastCountTime = opdi_get_time_ms();
+			this->lastCountTime = opdi::Clock::get().getTimeMs();
 			break;
 	case TimeBase::FRAMES:
 			this->lastCountTime = this->openhat->getCurrentFrame();
@@ -2130,19 +3065,23 @@ uint8_t CounterPort::doWork(uint8_t canSend) {
 	// check whether the period is up, return if not
 	switch (this->timeBase) {
 	case TimeBase::SECONDS:
-		if (opdi_get_time_ms() / 1000 - period > this->lastCountTime) {
-			this->lastCountTime = opdi_get_time_ms() / 1000;
+		if (opdi::Clock::get().getTimeMs() / 1000 - period > this->lastCountTime) {
+			this->lastCountTime = opdi::Clock::get().getTimeMs() / 1000;
 			break;
 		}
-		else
+		else {
+			opdi::Clock::get().addDeadlineMs((this->lastCountTime + period + 1) * 1000);
 			return OPDI_STATUS_OK;
+		}
 	case TimeBase::MILLISECONDS:
-		if (opdi_get_time_ms() - period > this->lastCountTime) {
-			this->lastCountTime = opdi_get_time_ms();
+		if (opdi::Clock::get().getTimeMs() - period > this->lastCountTime) {
+			this->lastCountTime = opdi::Clock::get().getTimeMs();
 			break;
 		}
-		else
+		else {
+			opdi::Clock::get().addDeadlineMs(this->lastCountTime + period + 1);
 			return OPDI_STATUS_OK;
+		}
 	case TimeBase::FRAMES:
 		if (this->openhat->getCurrentFrame() - period > this->lastCountTime) {
 			this->lastCountTime = this->openhat->getCurrentFrame();
@@ -2169,6 +3108,70 @@ uint8_t CounterPort::doWork(uint8_t canSend) {
 	return OPDI_STATUS_OK;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// AstroPort
+///////////////////////////////////////////////////////////////////////////////
+
+AstroPort::AstroPort(AbstractOpenHAT* openhat, const char* id) : opdi::DialPort(id), midnightTimer(this) {
+	this->opdi = this->openhat = openhat;
+	this->setTypeGUID(TypeGUID);
+	this->setMin(LLONG_MIN);
+	this->setMax(LLONG_MAX);
+	this->setPosition(0);
+	this->setReadonly(true);
+
+	this->event = AstroTable::SUNRISE;
+	this->latitude = 0;
+	this->longitude = 0;
+
+	TimerWheel::get().timeChanged += Poco::delegate(this, &AstroPort::timeChanged);
+}
+
+AstroPort::~AstroPort() {
+	TimerWheel::get().timeChanged -= Poco::delegate(this, &AstroPort::timeChanged);
+}
+
+void AstroPort::configure(ConfigurationView::Ptr nodeConfig) {
+	this->openhat->configureDialPort(nodeConfig, this);
+
+	std::string eventStr = this->openhat->getConfigString(nodeConfig, this->ID(), "AstroEvent", "", true);
+	if (!AstroTable::parseEvent(eventStr, &this->event))
+		this->openhat->throwSettingException(this->ID() + ": Invalid value for AstroEvent, expected 'Sunrise', 'Sunset', 'CivilDawn', 'CivilDusk', 'NauticalDawn', 'NauticalDusk', 'AstronomicalDawn' or 'AstronomicalDusk': " + eventStr);
+	this->longitude = nodeConfig->getDouble("Longitude", -999);
+	this->latitude = nodeConfig->getDouble("Latitude", -999);
+	if ((this->longitude < -180) || (this->longitude > 180))
+		this->openhat->throwSettingException(this->ID() + ": Parameter Longitude must be specified and within -180..180");
+	if ((this->latitude < -90) || (this->latitude > 90))
+		this->openhat->throwSettingException(this->ID() + ": Parameter Latitude must be specified and within -90..90");
+}
+
+void AstroPort::prepare() {
+	this->logDebug("Preparing port");
+	opdi::DialPort::prepare();
+
+	this->update();
+}
+
+void AstroPort::update(void) {
+	Poco::Timestamp now = opdi::Clock::get().now();
+	Poco::Timestamp result;
+	if (this->openhat->getAstroTable().getEvent(this->latitude, this->longitude, this->event, now, &result))
+		this->setPosition(result.epochTime());
+	else
+		this->setError(Error::VALUE_NOT_AVAILABLE);
+
+	// update again at the next local midnight
+	int offset = AstroTable::getUtcOffset(now);
+	int64_t localSeconds = now.epochTime() + offset;
+	int64_t midnight = (localSeconds / 86400 + 1) * 86400 - offset;
+	TimerWheel::get().schedule(&this->midnightTimer, (uint64_t)midnight * 1000);
+}
+
+void AstroPort::timeChanged(const void*) {
+	// the day may have changed
+	this->update();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // TriggerPort
 ///////////////////////////////////////////////////////////////////////////////
@@ -2372,7 +3375,7 @@ uint8_t TriggerPort::doWork(uint8_t canSend)  {
 // InfluxDBPort
 ///////////////////////////////////////////////////////////////////////////////
 
-InfluxDBPort::InfluxDBPort(AbstractOpenHAT * openhat, const char * id) : opdi::DigitalPort(id, OPDI_PORTDIRCAP_OUTPUT, 0) {
+InfluxDBPort::InfluxDBPort(AbstractOpenHAT * openhat, const char * id) : opdi::DigitalPort(id, OPDI_PORTDIRCAP_OUTPUT, 0), changeCapture(openhat) {
 	this->opdi = this->openhat = openhat;
 
 	opdi::DigitalPort::setMode(OPDI_DIGITAL_MODE_OUTPUT);
@@ -2382,107 +3385,351 @@ InfluxDBPort::InfluxDBPort(AbstractOpenHAT * openhat, const char * id) : opdi::D
 	this->intervalMs = 60000;	// default: once a minute
 	this->timeoutMs = 5000;		// default: five seconds
 	this->lastLogTime = 0;
+	this->maxQueueSize = 1000;
+	this->batchSize = 100;
+	this->compress = false;
+	this->maxBackoffMs = 300000;	// default: five minutes
+	this->spoolOffset = 0;
+	this->stopWriter = false;
+	this->captureChanges = false;
 }
 
-uint8_t InfluxDBPort::doWork(uint8_t canSend) {
+InfluxDBPort::~InfluxDBPort() {
+	if (this->postThread.isRunning()) {
+		this->stopWriter = true;
+		this->queueEvent.set();
+		this->postThread.join();
+	}
+}
 
-	// need to log data?
-	if (!this->postThread.isRunning() && (opdi_get_time_ms() - this->lastLogTime > this->intervalMs)) {
-		this->logDebug("Preparing InfluxDB data write");
+std::string InfluxDBPort::buildRecord(void) {
+	std::string record;
 
-		// build data string
-		this->dbData.clear();
+	record.append(this->measurement);
+	if (!this->tags.empty())
+		record.append("," + this->tags);
+	record.append(" ");
 
-		this->dbData.append(this->measurement);
-		if (!this->tags.empty())
-			this->dbData.append("," + this->tags);
-		this->dbData.append(" ");
+	bool hasFields = false;
+	auto ite = this->ports.cend();
+	for (auto it = this->ports.cbegin(); it != ite; ++it) {
+		try {
+			double value = this->openhat->getPortValue(*it);
+			if (hasFields)
+				record.append(",");
+			record.append((*it)->ID() + "=" + this->to_string(value));
+			hasFields = true;
+		} catch (Poco::Exception& e) {
+			this->logDebug("Error querying value of port " + (*it)->ID() + ": " + this->openhat->getExceptionMessage(e));
+		}
+	}
+	if (!hasFields)
+		// add dummy field (required by influxDB)
+		record.append("@@dummy@@=1");
 
-		bool hasFields = false;
-		auto ite = this->ports.cend();
-		for (auto it = this->ports.cbegin(); it != ite; ++it) {
-			try {
-				double value = this->openhat->getPortValue(*it);
-				this->dbData.append((*it)->ID() + "=" + this->to_string(value));
-				if (it + 1 != ite)
-					this->dbData.append(",");
-				hasFields = true;
-			} catch (Poco::Exception& e) {
-				this->logDebug("Error querying value of port " + (*it)->ID() + ": " + this->openhat->getExceptionMessage(e));
+	// append timestamp (nanoseconds)
+	record.append(" ");
+	record.append(this->to_string(opdi::Clock::get().now().epochMicroseconds() * 1000));
+
+	return record;
+}
+
+void InfluxDBPort::enqueueChanges(void) {
+	std::vector<PortChangeCapture::Change> changes;
+	this->changeCapture.collect(changes);
+
+	// create one record per distinct timestamp that contains the changed values as fields
+	size_t i = 0;
+	while (i < changes.size()) {
+		uint64_t timestamp = changes[i].timestamp;
+		std::string fields;
+		while ((i < changes.size()) && (changes[i].timestamp == timestamp)) {
+			// errors can't be represented in InfluxDB
+			if (!std::isnan(changes[i].value)) {
+				if (!fields.empty())
+					fields.append(",");
+				fields.append(this->ports[changes[i].index]->ID() + "=" + this->to_string(changes[i].value));
 			}
+			++i;
 		}
-		if (!hasFields)
-			// add dummy field (required by influxDB)
-			this->dbData.append("@@dummy@@=1");
+		if (fields.empty())
+			continue;
 
-		// append timestamp (nanoseconds)
-		this->dbData.append(" ");
-		this->dbData.append(this->to_string(Poco::Timestamp().epochMicroseconds() * 1000));
+		std::string record(this->measurement);
+		if (!this->tags.empty())
+			record.append("," + this->tags);
+		record.append(" " + fields + " " + this->to_string(timestamp * 1000000));
+		this->enqueue(record);
+	}
+}
 
-		// data is complete, start thread to post data to the InfluxDB instance
-		this->postThread.start(*this);
+void InfluxDBPort::enqueue(const std::string& record) {
+	{
+		Poco::Mutex::ScopedLock lock(this->queueMutex);
+		if (this->queue.size() < this->maxQueueSize) {
+			this->queue.push_back(record);
+			this->queueEvent.set();
+			return;
+		}
+	}
+	// queue is full
+	if (this->fallbackFile.empty()) {
+		this->logWarning("Queue is full and no FallbackFile is specified, dropping data point");
+		return;
+	}
+	this->logDebug("Queue is full, writing data point to fallback file");
+	this->spool(std::vector<std::string>(1, record));
+}
 
-		this->lastLogTime = opdi_get_time_ms();
+void InfluxDBPort::spool(const std::vector<std::string>& records) {
+	if (records.empty() || this->fallbackFile.empty())
+		return;
+	Poco::Mutex::ScopedLock lock(this->spoolMutex);
+	try {
+		// open the stream in append mode
+		Poco::FileOutputStream fos(this->fallbackFile, std::ios_base::app);
+		auto ite = records.cend();
+		for (auto it = records.cbegin(); it != ite; ++it) {
+			fos.write(it->c_str(), it->length());
+			fos.write("\n", 1);	// InfluxDB line separator, not platform dependent
+		}
+		fos.close();
+	} catch (Poco::Exception& e) {
+		this->openhat->logError(this->ID() + ": Error writing to fallback file " + this->fallbackFile + ": " + this->openhat->getExceptionMessage(e));
 	}
+}
 
-	return OPDI_STATUS_OK;
+void InfluxDBPort::readSpool(std::vector<std::string>& records, uint64_t& nextOffset) {
+	Poco::Mutex::ScopedLock lock(this->spoolMutex);
+	nextOffset = this->spoolOffset;
+	if (this->fallbackFile.empty() || !Poco::File(this->fallbackFile).exists())
+		return;
+	Poco::FileInputStream fis(this->fallbackFile);
+	fis.seekg(this->spoolOffset);
+	std::string line;
+	while ((records.size() < this->batchSize) && std::getline(fis, line)) {
+		// only complete lines are used
+		if (fis.eof())
+			break;
+		nextOffset += line.length() + 1;
+		if (!line.empty())
+			records.push_back(line);
+	}
 }
 
-void InfluxDBPort::run() {
-	// runs in separate thread
+void InfluxDBPort::commitSpool(uint64_t nextOffset) {
+	Poco::Mutex::ScopedLock lock(this->spoolMutex);
+	this->spoolOffset = nextOffset;
+	try {
+		Poco::File file(this->fallbackFile);
+		Poco::File offsetFile(this->fallbackFile + ".offset");
+		if (file.exists() && (this->spoolOffset >= file.getSize())) {
+			this->logVerbose("All records of the fallback file have been sent, removing " + this->fallbackFile);
+			file.remove();
+			if (offsetFile.exists())
+				offsetFile.remove();
+			this->spoolOffset = 0;
+		} else {
+			// remember the sent records in case openhatd is restarted
+			Poco::FileOutputStream fos(offsetFile.path(), std::ios_base::trunc);
+			fos << this->spoolOffset;
+			fos.close();
+		}
+	} catch (Poco::Exception& e) {
+		this->openhat->logError(this->ID() + ": Error updating fallback file " + this->fallbackFile + ": " + this->openhat->getExceptionMessage(e));
+	}
+}
 
+void InfluxDBPort::loadSpoolOffset(void) {
+	Poco::Mutex::ScopedLock lock(this->spoolMutex);
+	this->spoolOffset = 0;
+	if (this->fallbackFile.empty())
+		return;
 	try {
-		Poco::Net::HTTPClientSession session(this->host, this->tcpPort);
-		session.setTimeout(Poco::Timespan(this->timeoutMs * 1000));
+		Poco::File file(this->fallbackFile);
+		Poco::File offsetFile(this->fallbackFile + ".offset");
+		if (!offsetFile.exists())
+			return;
+		Poco::FileInputStream fis(offsetFile.path());
+		std::string content;
+		std::getline(fis, content);
+		fis.close();
+		Poco::UInt64 offset;
+		// the offset is only valid for the file it has been stored for
+		if (file.exists() && Poco::NumberParser::tryParseUnsigned64(content, offset) && (offset <= file.getSize())) {
+			this->spoolOffset = offset;
+			this->logVerbose("Continuing to send the fallback file " + this->fallbackFile + " at offset " + this->to_string(this->spoolOffset));
+		} else
+			offsetFile.remove();
+	} catch (Poco::Exception& e) {
+		this->openhat->logError(this->ID() + ": Error reading the offset of fallback file " + this->fallbackFile + ": " + this->openhat->getExceptionMessage(e));
+	}
+}
 
-		// build the HTTP post
-		std::string postUrl = "/write?db=" + this->database + (this->retentionPoint.empty() ? "" : "&rp=" + this->retentionPoint);
-		Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, postUrl);
-		request.setContentLength(this->dbData.length());
+void InfluxDBPort::post(Poco::Net::HTTPClientSession& session, const std::vector<std::string>& records) {
+	std::string body;
+	auto ite = records.cend();
+	for (auto it = records.cbegin(); it != ite; ++it) {
+		body.append(*it);
+		body.append("\n");	// InfluxDB line separator, not platform dependent
+	}
 
-		if (this->logVerbosity >= opdi::LogVerbosity::DEBUG) {
-			std::string fullUrl = "http://" + this->host + ":" + this->to_string(this->tcpPort) + postUrl;
-			this->logDebug("Sending InfluxDB data via POST to: " + fullUrl);
-			this->logDebug("InfluxDB data: " + this->dbData);
-		}
-		std::ostream& myOStream = session.sendRequest(request);
-		myOStream << this->dbData;
+	// build the HTTP post
+	std::string postUrl = "/write?db=" + this->database + (this->retentionPoint.empty() ? "" : "&rp=" + this->retentionPoint);
+	Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, postUrl, Poco::Net::HTTPMessage::HTTP_1_1);
+	request.setKeepAlive(true);
 
-		Poco::Net::HTTPResponse res;
-		std::istream& iStr = session.receiveResponse(res);
-		std::stringstream ss;
-		ss << iStr.rdbuf();
+	if (this->compress) {
+		std::stringstream compressed;
+		Poco::DeflatingOutputStream gzos(compressed, Poco::DeflatingStreamBuf::STREAM_GZIP);
+		gzos << body;
+		gzos.close();
+		body = compressed.str();
+		request.set("Content-Encoding", "gzip");
+	}
+	request.setContentLength(body.length());
 
-		if (res.getStatus() >= 500)
-			throw Poco::Exception(this->to_string(res.getStatus()) + " Internal server error: " + ss.str());
-		if (res.getStatus() == 404)
-			throw Poco::Exception(this->to_string(res.getStatus()) + " Not found");
-		if (res.getStatus() >= 400)
-			throw Poco::Exception(this->to_string(res.getStatus()) + " The server did not understand the request: " + ss.str());
-		if (res.getStatus() != 204) {
-			throw Poco::Exception(this->to_string(res.getStatus()) + " Unable to process the request: " + ss.str());
-		}
+	if (this->logVerbosity >= opdi::LogVerbosity::DEBUG) {
+		std::string fullUrl = "http://" + this->host + ":" + this->to_string(this->tcpPort) + postUrl;
+		this->logDebug("Sending " + this->to_string(records.size()) + " InfluxDB record(s) via POST to: " + fullUrl);
+	}
+	if (this->logVerbosity >= opdi::LogVerbosity::EXTREME)
+		this->logExtreme("InfluxDB data: " + records.front() + (records.size() > 1 ? " ..." : ""));
 
-		this->logDebug("204 InfluxDB POST successful");
+	std::ostream& myOStream = session.sendRequest(request);
+	myOStream << body;
 
-		return;
-	} catch (Poco::Exception& e) {
-		this->openhat->logError(this->ID() + ": Error sending data to " + this->host + ": " + this->openhat->getExceptionMessage(e));
+	Poco::Net::HTTPResponse res;
+	std::istream& iStr = session.receiveResponse(res);
+	// the response must be read completely to be able to reuse the connection
+	std::stringstream ss;
+	ss << iStr.rdbuf();
+
+	if (res.getStatus() >= 500)
+		throw Poco::Exception(this->to_string(res.getStatus()) + " Internal server error: " + ss.str());
+	// timeouts and rate limiting are temporary
+	if ((res.getStatus() == Poco::Net::HTTPResponse::HTTP_REQUEST_TIMEOUT) || (res.getStatus() == 429))
+		throw Poco::Exception(this->to_string(res.getStatus()) + " The server can't process the request now: " + ss.str());
+	// other client errors won't go away by repeating the request
+	if (res.getStatus() == 404)
+		throw Poco::DataException(this->to_string(res.getStatus()) + " Not found");
+	if (res.getStatus() >= 400)
+		throw Poco::DataException(this->to_string(res.getStatus()) + " The server did not understand the request: " + ss.str());
+	if (res.getStatus() != 204) {
+		throw Poco::Exception(this->to_string(res.getStatus()) + " Unable to process the request: " + ss.str());
 	}
-	
-	// error case
-	// fallback filename specified?
-	if (!this->fallbackFile.empty()) {
+
+	this->logDebug("204 InfluxDB POST successful");
+}
+
+uint8_t InfluxDBPort::doWork(uint8_t canSend) {
+
+	// in change capture mode changes are sent as soon as they occur
+	if (this->captureChanges) {
+		this->enqueueChanges();
+		return OPDI_STATUS_OK;
+	}
+
+	// need to log data?
+	if (opdi::Clock::get().getTimeMs() - this->lastLogTime > this->intervalMs) {
+		this->logDebug("Preparing InfluxDB data write");
+
+		// the record is sent asynchronously by the post thread
+		this->enqueue(this->buildRecord());
+
+		this->lastLogTime = opdi::Clock::get().getTimeMs();
+	}
+	opdi::Clock::get().addDeadlineMs(this->lastLogTime + this->intervalMs + 1);
+
+	return OPDI_STATUS_OK;
+}
+
+void InfluxDBPort::run() {
+	// runs in separate thread
+	Poco::Net::HTTPClientSession session(this->host, this->tcpPort);
+	session.setTimeout(Poco::Timespan(this->timeoutMs * 1000));
+	session.setKeepAlive(true);
+
+	std::vector<std::string> batch;
+	bool fromSpool = false;
+	uint64_t nextSpoolOffset = 0;
+	uint64_t backoffMs = 0;
+
+	while (!this->stopWriter) {
+		if (batch.empty()) {
+			// new records first
+			{
+				Poco::Mutex::ScopedLock lock(this->queueMutex);
+				while (!this->queue.empty() && (batch.size() < this->batchSize)) {
+					batch.push_back(this->queue.front());
+					this->queue.pop_front();
+				}
+			}
+			fromSpool = false;
+			// replay spooled records if the queue is empty
+			if (batch.empty()) {
+				this->readSpool(batch, nextSpoolOffset);
+				fromSpool = !batch.empty();
+			}
+			// nothing to do?
+			if (batch.empty()) {
+				this->queueEvent.tryWait(1000);
+				continue;
+			}
+		}
+
+		// wait after an error
+		if (backoffMs > 0) {
+			uint64_t waitUntil = opdi_get_time_ms() + backoffMs;
+			while (!this->stopWriter && (opdi_get_time_ms() < waitUntil))
+				this->queueEvent.tryWait((long)(waitUntil - opdi_get_time_ms()));
+			if (this->stopWriter)
+				break;
+		}
+
 		try {
-			// open the stream in append mode
-			Poco::FileOutputStream fos(this->fallbackFile, std::ios_base::app);
-			fos.write(this->dbData.c_str(), this->dbData.length());
-			fos.write("\n", 1);	// InfluxDB line separator, not platform dependent
-			fos.close();
+			this->post(session, batch);
+			if (fromSpool)
+				this->commitSpool(nextSpoolOffset);
+			batch.clear();
+			backoffMs = 0;
+		} catch (Poco::DataException& e) {
+			// the server has rejected the records; sending them again would block all following records
+			std::string records;
+			auto ite = batch.cend();
+			for (auto it = batch.cbegin(); it != ite; ++it)
+				records += "\n" + *it;
+			this->openhat->logError(this->ID() + ": " + this->host + " rejected the data, dropping " + this->to_string(batch.size()) + " record(s): " + this->openhat->getExceptionMessage(e) + records);
+			if (fromSpool)
+				this->commitSpool(nextSpoolOffset);
+			batch.clear();
+			backoffMs = 0;
 		} catch (Poco::Exception& e) {
-			this->openhat->logError(this->ID() + ": Error writing to fallback file " + this->fallbackFile + ": " + this->openhat->getExceptionMessage(e));
+			this->openhat->logError(this->ID() + ": Error sending data to " + this->host + ": " + this->openhat->getExceptionMessage(e));
+			// force a new connection
+			session.reset();
+			// spooled records are read again on the next attempt
+			if (fromSpool)
+				batch.clear();
+			backoffMs = (backoffMs == 0 ? 1000 : backoffMs * 2);
+			if (backoffMs > this->maxBackoffMs)
+				backoffMs = this->maxBackoffMs;
+			this->logDebug("Retrying in " + this->to_string(backoffMs) + " ms");
 		}
 	}
+
+	// keep unsent records in the fallback file
+	if (!fromSpool)
+		this->spool(batch);
+	batch.clear();
+	{
+		Poco::Mutex::ScopedLock lock(this->queueMutex);
+		batch.assign(this->queue.begin(), this->queue.end());
+		this->queue.clear();
+	}
+	if (!batch.empty() && this->fallbackFile.empty())
+		this->logWarning("No FallbackFile specified, discarding " + this->to_string(batch.size()) + " unsent record(s)");
+	this->spool(batch);
 }
 
 void InfluxDBPort::configure(ConfigurationView::Ptr portConfig) {
@@ -2502,6 +3749,30 @@ void InfluxDBPort::configure(ConfigurationView::Ptr portConfig) {
 	if (this->timeoutMs > this->intervalMs)
 		throw Poco::InvalidArgumentException(this->ID() + ": Timeout may not exceed log interval of " + this->to_string(this->intervalMs) + " ms: " + this->to_string(this->timeoutMs));
 
+	int queueSize = portConfig->getInt("QueueSize", (int)this->maxQueueSize);
+	if (queueSize < 1)
+		throw Poco::InvalidArgumentException(this->ID() + ": QueueSize must be greater than 0: " + this->to_string(queueSize));
+	this->maxQueueSize = queueSize;
+	int batchSize = portConfig->getInt("BatchSize", (int)this->batchSize);
+	if (batchSize < 1)
+		throw Poco::InvalidArgumentException(this->ID() + ": BatchSize must be greater than 0: " + this->to_string(batchSize));
+	this->batchSize = batchSize;
+	this->compress = portConfig->getBool("Compress", this->compress);
+	this->maxBackoffMs = portConfig->getInt64("MaxRetryDelay", this->maxBackoffMs);
+	if (this->maxBackoffMs < 1000)
+		throw Poco::InvalidArgumentException(this->ID() + ": Please specify a MaxRetryDelay in milliseconds, at least 1000");
+
+	std::string captureStr = portConfig->getString("Capture", "Interval");
+	if (captureStr == "Interval")
+		this->captureChanges = false;
+	else
+	if (captureStr == "Change")
+		this->captureChanges = true;
+	else
+		throw Poco::InvalidArgumentException(this->ID() + ": Unsupported Capture mode; expected 'Interval' or 'Change': " + captureStr);
+	if (this->captureChanges)
+		this->changeCapture.configure(portConfig, this);
+
 	this->portStr = openhat->getConfigString(portConfig, this->ID(), "Ports", "", true);
 }
 
@@ -2509,9 +3780,29 @@ void InfluxDBPort::prepare() {
 	this->logDebug("Preparing port");
 	opdi::DigitalPort::prepare();
 
-	this->lastLogTime = opdi_get_time_ms();
+	this->lastLogTime = opdi::Clock::get().getTimeMs();
 
 	this->openhat->findPorts(this->ID(), "Ports", this->portStr, this->ports);
+	if (this->captureChanges)
+		this->changeCapture.prepare(this->ports);
+
+	// records of the fallback file that have been sent before a restart are skipped
+	this->loadSpoolOffset();
+	this->stopWriter = false;
+
+	this->postThread.setName(this->ID() + " post thread");
+	this->postThread.start(*this);
+}
+
+void InfluxDBPort::shutdown(void) {
+	// stop the post thread; unsent records are written to the fallback file
+	if (this->postThread.isRunning()) {
+		this->stopWriter = true;
+		this->queueEvent.set();
+		this->postThread.join();
+	}
+	this->changeCapture.release();
+	opdi::DigitalPort::shutdown();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -2532,19 +3823,23 @@ uint8_t TestPort::doWork(uint8_t canSend) {
 	// check whether the interval time is up, return if not
 	switch (this->timeBase) {
 	case TimeBase::SECONDS:
-		if (opdi_get_time_ms() / 1000 - this->interval > this->lastExecution) {
-			this->lastExecution = opdi_get_time_ms() / 1000;
+		if (opdi::Clock::get().getTimeMs() / 1000 - this->interval > this->lastExecution) {
+			this->lastExecution = opdi::Clock::get().getTimeMs() / 1000;
 			break;
 		}
-		else
+		else {
+			opdi::Clock::get().addDeadlineMs((this->lastExecution + this->interval + 1) * 1000);
 			return OPDI_STATUS_OK;
+		}
 	case TimeBase::MILLISECONDS:
-		if (opdi_get_time_ms() - this->interval > this->lastExecution) {
-			this->lastExecution = opdi_get_time_ms();
+		if (opdi::Clock::get().getTimeMs() - this->interval > this->lastExecution) {
+			this->lastExecution = opdi::Clock::get().getTimeMs();
 			break;
 		}
-		else
+		else {
+			opdi::Clock::get().addDeadlineMs(this->lastExecution + this->interval + 1);
 			return OPDI_STATUS_OK;
+		}
 	case TimeBase::FRAMES:
 		if (this->openhat->getCurrentFrame() - this->interval > this->lastExecution) {
 			this->lastExecution = this->openhat->getCurrentFrame();
@@ -3,11 +3,19 @@
 // need to guard against security check warnings
 #define _SCL_SECURE_NO_WARNINGS	1
 
+#include <atomic>
 #include <sstream>
 #include <fstream>
 #include <list>
-
-#include "Poco/DirectoryWatcher.h"
+#include <deque>
+#include <map>
+#include <memory>
+
+#include "Poco/Thread.h"
+#include "Poco/Runnable.h"
+#include "Poco/RunnableAdapter.h"
+#include "Poco/Event.h"
+#include "Poco/Net/HTTPClientSession.h"
 #include "Poco/TimedNotificationQueue.h"
 #include "Poco/Tuple.h"
 #include "Poco/Util/AbstractConfiguration.h"
@@ -18,6 +26,11 @@
 #include "opdi_port.h"
 
 #include "AbstractOpenHAT.h"
+#include "BinaryLog.h"
+#include "FileWatcher.h"
+#include "TimerWheel.h"
+#include "AstroTable.h"
+#include "StreamFramer.h"
 
 namespace openhat {
 
@@ -185,12 +198,73 @@ public:
 	virtual void prepare() override;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// OBIS Parser
+///////////////////////////////////////////////////////////////////////////////
+
+/** Parses the frames of smart meters and sets the values of Dial ports.
+*   Supported are SML messages (binary, e.g. from eHZ meters) and the text lines of
+*   IEC 62056-21 (D0) data telegrams, e.g. "1-0:1.8.0*255(001234.5678*kWh)".
+*   The <port>.Values section maps Dial port IDs to OBIS codes, optionally followed by a
+*   factor in parentheses, e.g. "Energy = 1-0:1.8.0(1000)". A code without the last group
+*   ("*255") matches all values with the same first five groups.
+*   Values are multiplied with the factor and rounded. Frames are parsed in place without
+*   allocating memory.
+*/
+class ObisParser : public StreamFramer::IListener {
+protected:
+	struct Value {
+		std::string portID;
+		std::string code;
+		double factor;
+		opdi::DialPort* port;
+	};
+
+	openhat::AbstractOpenHAT* openhat;
+	opdi::Port* owner;
+	bool sml;
+	std::vector<Value> values;
+
+	// parses an SML element and its children; returns false if the data is invalid
+	bool parseSML(const uint8_t*& pos, const uint8_t* end, int depth);
+
+	// parses an SML list entry (objName, status, valTime, unit, scaler, value, valueSignature);
+	// returns false if the list is not a list entry
+	bool parseSMLEntry(const uint8_t*& pos, const uint8_t* end, int depth);
+
+	// parses an SML element; sets the value if the element is an integer
+	bool parseSMLValue(const uint8_t*& pos, const uint8_t* end, int depth, int* type, int64_t* value);
+
+	// parses a line of a D0 telegram
+	void parseText(const char* frame, size_t length);
+
+	// sets the ports whose code matches
+	void setValue(const char* code, size_t length, double value);
+
+public:
+	explicit ObisParser(openhat::AbstractOpenHAT* openhat);
+
+	/// Reads the Values section. If sml is true, frames are expected to contain SML messages.
+	void configure(ConfigurationView::Ptr config, opdi::Port* owner, bool sml);
+
+	/// Resolves the Dial ports.
+	void prepare(void);
+
+	virtual void frameReceived(const char* frame, size_t length) override;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // Serial Streaming Port
 ///////////////////////////////////////////////////////////////////////////////
 
 /// Defines a serial streaming port that supports streaming from and to a serial port device.
-///
+/// Received data is read from the device in blocks into a ring buffer (BufferSize, default 4096 bytes)
+/// once per doWork iteration and whenever a reader requests more data than is buffered.
+/// The serial device is used without blocking.
+/// If a Framing is specified the received data is split into frames instead (see StreamFramer).
+/// The data is read directly into the buffer of the framer and the frames are passed to a parser
+/// (Parser = OBIS) or to a listener that has been set using setFrameListener(), e.g. by a plugin.
+/// In this mode the data is not available to read() and the port cannot be used in Loopback mode.
 class SerialStreamingPort : public opdi::StreamingPort {
 friend class OPDI;
 
@@ -207,6 +281,25 @@ protected:
 	ctb::IOBase* device;
 	ctb::SerialPort* serialPort;
 
+	// framing of the received data (optional)
+	std::unique_ptr<StreamFramer> framer;
+	std::unique_ptr<ObisParser> parser;
+	StreamFramer::IListener* frameListener;
+
+	// reads the available data from the device into the ring buffer and passes the complete frames to the listener
+	void receiveFrames(void);
+
+	// ring buffer for received data
+	std::vector<char> buffer;
+	size_t bufferStart;			// index of the first byte
+	size_t bufferCount;			// number of bytes in the buffer
+
+	// reads the available data from the device into the buffer; returns a value less than 0 in case of an error
+	int fillBuffer(void);
+
+	// removes up to length bytes from the buffer and copies them to bytes (if not null)
+	size_t takeFromBuffer(char* bytes, size_t length);
+
 	virtual uint8_t doWork(uint8_t canSend) override;
 
 public:
@@ -222,27 +315,94 @@ public:
 	///
 	virtual void configure(ConfigurationView::Ptr config);
 
+	/// Prepares the port for operation.
+	///
+	virtual void prepare() override;
+
+	/// Sets the listener that receives the frames if a Framing is configured.
+	/// Replaces the configured parser.
+	void setFrameListener(StreamFramer::IListener* listener);
+
 	virtual int write(char* bytes, size_t length) override;
 
 	virtual int available(size_t count) override;
 
 	virtual int read(char* result) override;
 
+	virtual int readBytes(char* bytes, size_t length) override;
+
 	virtual bool hasError(void) const override;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// Port Change Capture
+///////////////////////////////////////////////////////////////////////////////
+
+/** Captures the state changes of a list of ports for exporting ports (Logger, InfluxDB).
+*   Each port gets its own change queue. Changes that differ less than the deadband from the
+*   last reported value of a port are ignored. If a port has not been reported for the 
+*   heartbeat interval its current value is reported again.
+*   Settings: Deadband (default for all ports), Heartbeat (milliseconds), ChangeQueueSize,
+*   and a <port>.Deadbands section that specifies deadbands for individual ports.
+*/
+class PortChangeCapture {
+public:
+	struct Change {
+		size_t index;			// index of the port in the port list
+		uint64_t timestamp;		// milliseconds since the epoch
+		double value;
+	};
+
+protected:
+	struct Entry {
+		opdi::Port* port;
+		std::unique_ptr<opdi::PortChangeQueue> queue;
+		double deadband;
+		double lastValue;
+		uint64_t lastTime;
+		bool reported;
+		uint64_t overflows;
+	};
+
+	openhat::AbstractOpenHAT* openhat;
+	opdi::Port* owner;
+	double defaultDeadband;
+	uint64_t heartbeatMs;
+	size_t queueSize;
+	std::map<std::string, double> deadbands;
+	std::vector<Entry> entries;
+
+	bool accept(const Entry& entry, double value) const;
+
+public:
+	explicit PortChangeCapture(openhat::AbstractOpenHAT* openhat);
+
+	void configure(ConfigurationView::Ptr config, opdi::Port* owner);
+
+	/// Registers change queues with the ports.
+	void prepare(const opdi::PortList& ports);
+
+	/// Unregisters the change queues from the ports.
+	void release(void);
+
+	/// Appends the changes that have been captured since the last call in chronological order.
+	/// The first call reports the current values of all ports.
+	void collect(std::vector<Change>& changes);
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // Logger Streaming Port
 ///////////////////////////////////////////////////////////////////////////////
 
 /** Defines a streaming port that can log port states and optionally write them to a log file.
  */
-class LoggerPort : public opdi::StreamingPort {
+class LoggerPort : public opdi::StreamingPort, Poco::Runnable {
 friend class OPDI;
 
 protected:
 	enum Format {
-		CSV
+		CSV,
+		BINARY
 	};
 
 	openhat::AbstractOpenHAT* openhat;
@@ -254,7 +414,73 @@ protected:
 	bool writeHeader;
 	uint64_t lastEntryTime;
 	
+	std::string outFileStr;
+	// the output file is only accessed by the writer thread while it is running
 	std::ofstream outFile;
+	std::string headerLine;
+
+	// binary format
+	size_t blockSize;
+	std::unique_ptr<BinaryLogWriter> binaryWriter;
+	BinaryLogIndex binaryIndex;		// records written to the current output file
+
+	// change capture mode: one row per change instead of one row per period
+	bool captureChanges;
+	PortChangeCapture changeCapture;
+	std::vector<double> capturedValues;
+
+	/// Appends the rows for the captured changes to entries.
+	void buildChangeEntries(std::vector<std::string>& entries);
+
+	// rotation settings
+	uint64_t maxFileSize;			// bytes; 0 = no size based rotation
+	uint32_t rotationInterval;		// seconds; 0 = no time based rotation
+	int maxFiles;					// number of rotated files to keep; 0 = keep all
+	bool compress;					// gzip rotated files
+	uint64_t fileOpenedTime;
+
+	// rotated files are compressed by a separate thread so that writing is not delayed
+	std::deque<std::string> compressQueue;
+	Poco::Mutex compressMutex;
+	Poco::Event compressEvent;
+	std::atomic<bool> stopCompressor;
+	Poco::RunnableAdapter<LoggerPort> compressor;
+	Poco::Thread compressorThread;
+
+	// asynchronous writer
+	bool async;
+	size_t maxQueueSize;
+	std::deque<std::string> queue;
+	Poco::Mutex queueMutex;
+	Poco::Event queueEvent;
+	std::atomic<bool> stopWriter;		// set by the main thread, read by the writer thread
+	uint64_t droppedEntries;
+	Poco::Thread writerThread;
+
+	void openOutputFile(void);
+
+	/// Closes the output file. The index record is appended to binary files.
+	void closeOutputFile(void);
+
+	void rotateOutputFile(void);
+
+	void compressFile(const std::string& fileName);
+
+	/// Compressor thread function.
+	void runCompressor(void);
+
+	/// Stops the writer and compressor threads after they have processed the pending work.
+	void stopThreads(void);
+
+	/// Removes the oldest rotated files that exceed MaxFiles. Only files whose names consist of the
+	/// output file name and a rotation suffix (.<timestamp>[-<counter>][.gz]) are considered.
+	void removeOldFiles(void);
+
+	/// Writes the entries to the output file, rotating it if necessary. Flushes once after writing.
+	void writeEntries(const std::vector<std::string>& entries);
+
+	/// Writer thread function.
+	virtual void run(void) override;
 
 	std::string getPortStateStr(opdi::Port* port);
 
@@ -269,6 +495,8 @@ public:
 
 	virtual void prepare() override;
 
+	virtual void shutdown(void) override;
+
 	virtual int write(char* bytes, size_t length) override;
 
 	virtual int available(size_t count) override;
@@ -346,8 +574,11 @@ public:
 ///////////////////////////////////////////////////////////////////////////////
 
 /** A SceneSelectPort is a select port with n scene settings. Each scene setting corresponds
-* with a settings file. If a scene is selected the port opens the settings file and sets all
-* ports defined in the settings file to the specified values.
+* with a settings file. If a scene is selected the port sets all ports defined in the settings
+* file to the specified values.
+* The scene files are compiled into lists of port states when the port is prepared. A scene
+* file is compiled again only if it has been modified or if ports have been added or removed.
+* As with the port configuration, persisted port states take precedence over the scene files.
 * The SceneSelectPort automatically sends a "Refresh all" message to a connected master when
 * a scene has been selected.
 */
@@ -355,14 +586,40 @@ class SceneSelectPort : public opdi::SelectPort {
 protected:
 	typedef std::vector<std::string> FileList;
 
+	/** The state that a scene specifies for a port. */
+	struct SceneEntry {
+		opdi::Port* port;
+		AbstractOpenHAT::PortState state;
+	};
+	typedef std::vector<SceneEntry> SceneEntries;
+
+	struct Scene {
+		std::string file;
+		// file stamp and port list version at the time of compilation
+		std::string stamp;
+		uint32_t portListVersion;
+		SceneEntries entries;
+	};
+	typedef std::vector<Scene> SceneList;
+
 	openhat::AbstractOpenHAT* openhat;
 	FileList fileList;
+	SceneList scenes;
 	std::string configFilePath;
 
 	bool positionSet;
 
 	virtual uint8_t doWork(uint8_t canSend) override;
 
+	/** Reads the scene file and resolves the ports and states it specifies. */
+	virtual void compileScene(Scene& scene);
+
+	/** Compiles the scene; logs a warning and returns false if this fails. The scene is compiled
+	 *  again when it is selected. */
+	virtual bool tryCompileScene(Scene& scene);
+
+	virtual void applyScene(Scene& scene);
+
 public:
 	SceneSelectPort(AbstractOpenHAT* openhat, const char* id);
 
@@ -379,7 +636,7 @@ public:
 
 /// This port reads and writes data from and to a specified file.
 /// <a href="../../ports/file_port">See the File port documentation.</a>
-class FilePort : public opdi::DigitalPort {
+class FilePort : public opdi::DigitalPort, protected FileWatcher::IListener {
 protected:
 
 	enum PortType {
@@ -409,7 +666,6 @@ protected:
 
 	openhat::AbstractOpenHAT* openhat;
 	std::string filePath;
-	Poco::File directory;
 	opdi::Port* valuePort;
 	PortType portType;
 	int reloadDelayMs;
@@ -418,14 +674,13 @@ protected:
 	int numerator;
 	int denominator;
 
-	Poco::DirectoryWatcher* directoryWatcher;
+	int watchHandle;
 	uint64_t lastReloadTime;
-	Poco::Mutex mutex;
 	bool needsReload;
 
 	virtual uint8_t doWork(uint8_t canSend) override;
 
-	void fileChangedEvent(const void*, const Poco::DirectoryWatcher::DirectoryEvent&);
+	virtual void fileChanged(const std::string& path) override;
 
 	void writeContent();
 
@@ -571,6 +826,57 @@ public:
 	virtual uint8_t doWork(uint8_t canSend) override;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// Astro Port
+///////////////////////////////////////////////////////////////////////////////
+
+/// This port provides the time of an astronomical event (sunrise, sunset or twilight) of the current
+/// day at a location in seconds since 1/1/1970 00:00 UTC. The time is taken from the AstroTable that is
+/// shared by the whole process and updated at local midnight. If the event does not occur on the
+/// current day (polar day or night) the port has the error "value not available".
+/// <a href="../../ports/astro_port">See the Astro port documentation.</a>
+class AstroPort : public opdi::DialPort {
+protected:
+	// updates the port at local midnight
+	class MidnightTimer : public TimerWheel::Timer {
+		AstroPort* port;
+	protected:
+		virtual void expired(void) override { this->port->update(); };
+	public:
+		explicit MidnightTimer(AstroPort* port) : port(port) {};
+	};
+
+	openhat::AbstractOpenHAT* openhat;
+
+	AstroTable::Event event;
+	double latitude;
+	double longitude;
+	MidnightTimer midnightTimer;
+
+	/// Sets the position to the time of the event on the current day and schedules the next update.
+	void update(void);
+
+	void timeChanged(const void*);
+public:
+	/// The unique type GUID of an Astro port.
+	///
+	static constexpr const char* TypeGUID = "0061f4e2-239b-42e3-85d5-e8154b337120";
+
+	/// Creates an Astro port with the specified ID.
+	///
+	AstroPort(AbstractOpenHAT* openhat, const char* id);
+
+	virtual ~AstroPort();
+
+	/// Configures the port from the specified configuration view.
+	///
+	virtual void configure(ConfigurationView::Ptr nodeConfig);
+
+	/// Prepares the port for operation.
+	///
+	virtual void prepare() override;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // Trigger Port
 ///////////////////////////////////////////////////////////////////////////////
@@ -642,8 +948,12 @@ public:
 *   The timestamp sent is the current OPDI time in nanoseconds (with milliseconds precision).
 *   You can specify an interval and a timeout. The interval must be greater than the
 *   timeout.
-*   An optional name for a fallback file can be specified that is written to in case of errors.
-*   The content of this file can later be sent to InfluxDB to complete the missing data points.
+*   Data points are queued and sent in batches by a background thread that keeps the HTTP
+*   connection open. The request body can optionally be compressed using gzip.
+*   If sending fails the thread retries with exponential backoff.
+*   An optional name for a fallback file can be specified that is written to if the queue
+*   is full or on shutdown. The content of this file is replayed automatically once the
+*   InfluxDB instance can be reached again.
 */
 class InfluxDBPort : public opdi::DigitalPort, Poco::Runnable {
 protected:
@@ -659,21 +969,69 @@ protected:
 	std::string tags;		// InfluxDB tags, not port tags
 	std::string portStr;	// specification for the findPortIDs function
 	std::string fallbackFile;
+	size_t maxQueueSize;	// records
+	size_t batchSize;		// records per request
+	bool compress;
+	uint64_t maxBackoffMs;	// milliseconds
 
 	uint64_t lastLogTime;
 	opdi::PortList ports;
-	std::string dbData;		// the data to send asynchronously
+
+	// change capture mode: one record per change instead of one record per interval
+	bool captureChanges;
+	PortChangeCapture changeCapture;
+
+	/// Enqueues records for the captured changes.
+	void enqueueChanges(void);
+
+	// line protocol records that are waiting to be sent
+	std::deque<std::string> queue;
+	Poco::Mutex queueMutex;
+	Poco::Event queueEvent;
+	// protects the fallback file and spoolOffset
+	Poco::Mutex spoolMutex;
+	// position of the first record in the fallback file that has not yet been sent;
+	// stored in <fallback file>.offset to survive restarts
+	uint64_t spoolOffset;
+	std::atomic<bool> stopWriter;		// set by the main thread, read by the post thread
 	Poco::Thread postThread;
 
+	/// Builds a line protocol record of the current port values.
+	std::string buildRecord(void);
+
+	/// Adds the record to the queue. Spools it to the fallback file if the queue is full.
+	void enqueue(const std::string& record);
+
+	/// Appends the records to the fallback file.
+	void spool(const std::vector<std::string>& records);
+
+	/// Reads at most batchSize records from the fallback file, starting at spoolOffset.
+	/// Returns the offset of the next record in nextOffset.
+	void readSpool(std::vector<std::string>& records, uint64_t& nextOffset);
+
+	/// Marks the records up to nextOffset as sent. Removes the fallback file if all records have been sent.
+	void commitSpool(uint64_t nextOffset);
+
+	/// Reads the offset of the fallback file that has been stored by a previous run.
+	void loadSpoolOffset(void);
+
+	/// Sends the records in one request. Throws an exception in case of errors; a Poco::DataException
+	/// indicates that the server has rejected the request permanently (HTTP 4xx except 408 and 429).
+	void post(Poco::Net::HTTPClientSession& session, const std::vector<std::string>& records);
+
 	virtual uint8_t doWork(uint8_t canSend) override;
 
 	virtual void run();
 public:
 	InfluxDBPort(AbstractOpenHAT* openhat, const char* id);
 
+	virtual ~InfluxDBPort();
+
 	virtual void configure(ConfigurationView::Ptr portConfig);
 
 	virtual void prepare() override;
+
+	virtual void shutdown(void) override;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,620 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ProcessSupervisor.h"
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+
+#include "Poco/Exception.h"
+
+#ifdef linux
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#else
+#include "Poco/Runnable.h"
+#endif
+
+namespace openhat {
+
+// an incomplete line is passed on when it exceeds this length
+#define MAX_LINE_LENGTH		65536
+
+void ProcessSupervisor::LineBuffer::append(const char* data, size_t length, bool isError, std::vector<std::pair<bool, std::string> >& lines) {
+	const char* end = data + length;
+	while (data < end) {
+		const char* newline = (const char*)memchr(data, '\n', end - data);
+		if (newline == nullptr) {
+			this->partial.append(data, end - data);
+			if (this->partial.size() >= MAX_LINE_LENGTH)
+				this->flush(isError, lines);
+			return;
+		}
+		this->partial.append(data, newline - data);
+		// remove the carriage return of CRLF line endings
+		if (!this->partial.empty() && (this->partial[this->partial.size() - 1] == '\r'))
+			this->partial.resize(this->partial.size() - 1);
+		lines.push_back(std::make_pair(isError, std::string()));
+		lines.back().second.swap(this->partial);
+		data = newline + 1;
+	}
+}
+
+void ProcessSupervisor::LineBuffer::flush(bool isError, std::vector<std::pair<bool, std::string> >& lines) {
+	if (this->partial.empty())
+		return;
+	lines.push_back(std::make_pair(isError, std::string()));
+	lines.back().second.swap(this->partial);
+}
+
+ProcessSupervisor& ProcessSupervisor::get(void) {
+	static ProcessSupervisor instance;
+	return instance;
+}
+
+#ifdef linux
+
+// maximum number of reads per stream and dispatch; avoids blocking the main loop
+// if a process writes faster than its output can be processed
+#define MAX_READS				16
+// maximum number of reads to drain a stream after the process has terminated
+#define MAX_DRAIN_READS			1024
+
+static void closeFd(int& fd) {
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+}
+
+// reads the available data of a non-blocking stream; closes it at the end of the stream
+static int readStream(int& fd, int maxReads, std::vector<char>& buffer, const std::function<void(const char*, size_t)>& consume) {
+	int result = 0;
+	while ((fd >= 0) && (result < maxReads)) {
+		ssize_t count = read(fd, &buffer[0], buffer.size());
+		if (count > 0) {
+			consume(&buffer[0], (size_t)count);
+			result++;
+		} else
+		if ((count < 0) && (errno == EINTR))
+			continue;
+		else
+		if ((count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+			break;
+		else
+			// end of stream or error
+			closeFd(fd);
+	}
+	return result;
+}
+
+ProcessSupervisor::ProcessSupervisor() {
+	this->nextHandle = 1;
+	this->maxProcesses = 0;
+}
+
+ProcessSupervisor::~ProcessSupervisor() {
+	// running processes are not killed but they lose their output streams
+	for (auto it = this->processes.begin(), ite = this->processes.end(); it != ite; ++it) {
+		closeFd(it->second.pidFd);
+		closeFd(it->second.inFd);
+		closeFd(it->second.outFd);
+		closeFd(it->second.errFd);
+	}
+}
+
+bool ProcessSupervisor::launch(const Request& request, Process& process, std::string& message) {
+	int pipes[3][2] = { { -1, -1 }, { -1, -1 }, { -1, -1 } };
+	// the pipes are not inherited by other processes; the child's ends are duplicated to
+	// stdin, stdout and stderr which clears the close-on-exec flag
+	for (int i = 0; i < 3; i++) {
+		if ((i == STDIN_FILENO) && ((request.options & INPUT_PIPE) == 0))
+			continue;
+		if (pipe2(pipes[i], O_CLOEXEC) != 0) {
+			message = std::string("Unable to create pipe: ") + strerror(errno);
+			for (int j = 0; j < i; j++) {
+				closeFd(pipes[j][0]);
+				closeFd(pipes[j][1]);
+			}
+			return false;
+		}
+	}
+	// the parent's ends of the pipes
+	int& inFd = pipes[STDIN_FILENO][1];
+	int& outFd = pipes[STDOUT_FILENO][0];
+	int& errFd = pipes[STDERR_FILENO][0];
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if (inFd >= 0)
+		posix_spawn_file_actions_adddup2(&actions, pipes[STDIN_FILENO][0], STDIN_FILENO);
+	else
+		posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, pipes[STDOUT_FILENO][1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, pipes[STDERR_FILENO][1], STDERR_FILENO);
+
+	// the child should not inherit the signal mask of the main thread;
+	// SIGPIPE is ignored by openhatd but not by the child
+	posix_spawnattr_t attributes;
+	posix_spawnattr_init(&attributes);
+	sigset_t signals;
+	sigemptyset(&signals);
+	posix_spawnattr_setsigmask(&attributes, &signals);
+	sigaddset(&signals, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attributes, &signals);
+	posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	std::vector<char*> argv;
+	argv.reserve(request.args.size() + 2);
+	argv.push_back(const_cast<char*>(request.program.c_str()));
+	for (auto it = request.args.begin(), ite = request.args.end(); it != ite; ++it)
+		argv.push_back(const_cast<char*>(it->c_str()));
+	argv.push_back(nullptr);
+
+	pid_t pid;
+	int error = posix_spawn(&pid, request.program.c_str(), &actions, &attributes, &argv[0], environ);
+
+	posix_spawnattr_destroy(&attributes);
+	posix_spawn_file_actions_destroy(&actions);
+	// close the child's ends
+	closeFd(pipes[STDIN_FILENO][0]);
+	closeFd(pipes[STDOUT_FILENO][1]);
+	closeFd(pipes[STDERR_FILENO][1]);
+
+	if (error != 0) {
+		message = strerror(error);
+		closeFd(inFd);
+		closeFd(outFd);
+		closeFd(errFd);
+		return false;
+	}
+
+	if (inFd >= 0)
+		fcntl(inFd, F_SETFL, fcntl(inFd, F_GETFL) | O_NONBLOCK);
+	fcntl(outFd, F_SETFL, fcntl(outFd, F_GETFL) | O_NONBLOCK);
+	fcntl(errFd, F_SETFL, fcntl(errFd, F_GETFL) | O_NONBLOCK);
+
+	process.pid = pid;
+	process.inFd = inFd;
+	process.outFd = outFd;
+	process.errFd = errFd;
+	process.rawOutput = ((request.options & RAW_OUTPUT) != 0);
+	process.pidFd = -1;
+#ifdef SYS_pidfd_open
+	// a pidfd becomes readable when the process terminates (Linux 5.3 and later)
+	process.pidFd = (int)syscall(SYS_pidfd_open, pid, 0);
+	if (process.pidFd >= 0)
+		fcntl(process.pidFd, F_SETFD, FD_CLOEXEC);
+	else
+		process.pidFd = -1;
+#endif
+	return true;
+}
+
+void ProcessSupervisor::kill(int handle) {
+	for (auto it = this->queue.begin(), ite = this->queue.end(); it != ite; ++it) {
+		if (it->handle == handle) {
+			this->queue.erase(it);
+			return;
+		}
+	}
+
+	auto it = this->processes.find(handle);
+	if (it == this->processes.end())
+		return;
+	Process& process = it->second;
+	::kill(process.pid, SIGKILL);
+	closeFd(process.pidFd);
+	closeFd(process.inFd);
+	closeFd(process.outFd);
+	closeFd(process.errFd);
+	// the process is reaped by dispatchEvents() to avoid defunct processes
+	if (waitpid(process.pid, nullptr, WNOHANG) == 0)
+		this->zombies.push_back(process.pid);
+	this->processes.erase(it);
+}
+
+void ProcessSupervisor::flushInput(Process& process) {
+	while ((process.inFd >= 0) && !process.inBuffer.empty()) {
+		ssize_t count = ::write(process.inFd, process.inBuffer.data(), process.inBuffer.size());
+		if (count >= 0)
+			process.inBuffer.erase(0, (size_t)count);
+		else
+		if (errno == EINTR)
+			continue;
+		else
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			break;
+		else {
+			// the process has closed its standard input (EPIPE)
+			closeFd(process.inFd);
+			process.inBuffer.clear();
+		}
+	}
+}
+
+bool ProcessSupervisor::write(int handle, const std::string& data) {
+	auto it = this->processes.find(handle);
+	if ((it == this->processes.end()) || (it->second.inFd < 0))
+		return false;
+	it->second.inBuffer.append(data);
+	flushInput(it->second);
+	return true;
+}
+
+int ProcessSupervisor::dispatchEvents(void) {
+	int result = 0;
+
+	// reap killed processes
+	for (auto it = this->zombies.begin(); it != this->zombies.end(); ) {
+		if (waitpid(*it, nullptr, WNOHANG) != 0)
+			it = this->zombies.erase(it);
+		else
+			++it;
+	}
+
+	result += this->startQueued();
+
+	if (this->processes.empty())
+		return result;
+
+	// check all streams and pidfds with one system call
+	struct Entry {
+		int handle;
+		size_t inIndex;
+		size_t outIndex;
+		size_t errIndex;
+		size_t pidIndex;
+	};
+	static const size_t NONE = (size_t)-1;
+	std::vector<Entry> entries;
+	std::vector<struct pollfd> fds;
+	entries.reserve(this->processes.size());
+	fds.reserve(this->processes.size() * 4);
+	bool needsWait = false;
+	for (auto it = this->processes.begin(), ite = this->processes.end(); it != ite; ++it) {
+		Entry entry = { it->first, NONE, NONE, NONE, NONE };
+		// stdin needs to be checked only if there is data to write
+		int fd[4] = { (it->second.inBuffer.empty() ? -1 : it->second.inFd), it->second.outFd, it->second.errFd, it->second.pidFd };
+		size_t* index[4] = { &entry.inIndex, &entry.outIndex, &entry.errIndex, &entry.pidIndex };
+		for (int i = 0; i < 4; i++) {
+			if (fd[i] < 0)
+				continue;
+			*index[i] = fds.size();
+			struct pollfd pfd = { fd[i], (short)(i == 0 ? POLLOUT : POLLIN), 0 };
+			fds.push_back(pfd);
+		}
+		needsWait |= (it->second.pidFd < 0);
+		entries.push_back(entry);
+	}
+	if (!fds.empty()) {
+		int count;
+		do {
+			count = poll(&fds[0], fds.size(), 0);
+		} while ((count < 0) && (errno == EINTR));
+		if ((count <= 0) && !needsWait)
+			return result;
+	}
+
+	std::vector<char> buffer(4096);
+	std::vector<std::pair<bool, std::string> > lines;
+	std::string data;
+	for (auto eit = entries.begin(), eite = entries.end(); eit != eite; ++eit) {
+		// the process may have been killed by a listener in the meantime
+		auto it = this->processes.find(eit->handle);
+		if (it == this->processes.end())
+			continue;
+		Process& process = it->second;
+
+		// terminated?
+		bool terminated = false;
+		int status = 0;
+		if ((process.pidFd < 0) || (fds[eit->pidIndex].revents != 0)) {
+			pid_t pid;
+			do {
+				pid = waitpid(process.pid, &status, WNOHANG);
+			} while ((pid < 0) && (errno == EINTR));
+			terminated = (pid != 0);
+		}
+
+		if ((eit->inIndex != NONE) && !terminated && (fds[eit->inIndex].revents != 0))
+			flushInput(process);
+
+		// read the output; after termination, read the remaining data
+		lines.clear();
+		data.clear();
+		int maxReads = (terminated ? MAX_DRAIN_READS : MAX_READS);
+		if ((eit->outIndex != NONE) && (terminated || (fds[eit->outIndex].revents != 0))) {
+			if (process.rawOutput)
+				readStream(process.outFd, maxReads, buffer, [&](const char* chunk, size_t length) { data.append(chunk, length); });
+			else
+				readStream(process.outFd, maxReads, buffer, [&](const char* chunk, size_t length) { process.outBuffer.append(chunk, length, false, lines); });
+		}
+		if ((eit->errIndex != NONE) && (terminated || (fds[eit->errIndex].revents != 0)))
+			readStream(process.errFd, maxReads, buffer, [&](const char* chunk, size_t length) { process.errBuffer.append(chunk, length, true, lines); });
+		if (terminated || (process.outFd < 0))
+			process.outBuffer.flush(false, lines);
+		if (terminated || (process.errFd < 0))
+			process.errBuffer.flush(true, lines);
+
+		IListener* listener = process.listener;
+		if (terminated) {
+			closeFd(process.pidFd);
+			closeFd(process.inFd);
+			closeFd(process.outFd);
+			closeFd(process.errFd);
+			this->processes.erase(it);
+		}
+
+		for (auto lit = lines.begin(), lite = lines.end(); lit != lite; ++lit) {
+			// stop if the listener has killed the process
+			if (!terminated && (this->processes.find(eit->handle) == this->processes.end()))
+				break;
+			listener->processOutput(eit->handle, lit->first, lit->second);
+			result++;
+		}
+		if (!data.empty() && (terminated || (this->processes.find(eit->handle) != this->processes.end()))) {
+			listener->processData(eit->handle, data);
+			result++;
+		}
+
+		if (terminated) {
+			result++;
+			if (WIFEXITED(status))
+				listener->processTerminated(eit->handle, WEXITSTATUS(status));
+			else
+			if (WIFSIGNALED(status))
+				listener->processTerminated(eit->handle, 128 + WTERMSIG(status));
+			else
+				// the process is not a child of this process any more (ECHILD)
+				listener->processFailed(eit->handle, "Unable to determine the exit code");
+		}
+	}
+
+	// start queued processes instead of the terminated ones
+	result += this->startQueued();
+
+	return result;
+}
+
+#else
+
+// reads a stream of a process until it is closed; deletes itself when done
+class StreamReader : public Poco::Runnable {
+	typedef std::function<void(const char*, size_t, bool)> Consumer;
+
+	Poco::Pipe pipe;
+	bool isError;
+	Consumer consume;
+
+public:
+	StreamReader(const Poco::Pipe& pipe, bool isError, const Consumer& consume) : pipe(pipe), isError(isError), consume(consume) {}
+
+	virtual void run(void) override {
+		char buffer[4096];
+		try {
+			int count;
+			while ((count = this->pipe.readBytes(buffer, sizeof(buffer))) > 0)
+				this->consume(buffer, (size_t)count, false);
+		} catch (...) {
+			// treat errors as the end of the stream
+		}
+		this->consume(nullptr, 0, true);
+		delete this;
+	}
+};
+
+ProcessSupervisor::ProcessSupervisor() : threadPool("ProcessSupervisor", 2, 256) {
+	this->nextHandle = 1;
+	this->maxProcesses = 0;
+}
+
+ProcessSupervisor::~ProcessSupervisor() {
+	// kill the running processes; otherwise, the thread pool would wait for the readers
+	while (!this->processes.empty())
+		this->kill(this->processes.begin()->first);
+	this->threadPool.joinAll();
+}
+
+bool ProcessSupervisor::launch(const Request& request, Process& process, std::string& message) {
+	Poco::Pipe outPipe;
+	Poco::Pipe errPipe;
+	if ((request.options & INPUT_PIPE) != 0)
+		process.inPipe.reset(new Poco::Pipe());
+	try {
+		process.processHandle.reset(new Poco::ProcessHandle(Poco::Process::launch(request.program, request.args, process.inPipe.get(), &outPipe, &errPipe)));
+	} catch (Poco::Exception& e) {
+		message = e.displayText();
+		return false;
+	}
+
+	std::shared_ptr<Output> output = std::make_shared<Output>();
+	output->openStreams = 2;
+	process.output = output;
+
+	Poco::Pipe pipes[2] = { outPipe, errPipe };
+	for (int i = 0; i < 2; i++) {
+		// each reader has its own line buffer
+		std::shared_ptr<LineBuffer> lineBuffer = std::make_shared<LineBuffer>();
+		bool isError = (i == 1);
+		bool raw = !isError && ((request.options & RAW_OUTPUT) != 0);
+		StreamReader* reader = new StreamReader(pipes[i], isError, [output, lineBuffer, isError, raw](const char* data, size_t length, bool end) {
+			Poco::FastMutex::ScopedLock lock(output->mutex);
+			if (end) {
+				lineBuffer->flush(isError, output->lines);
+				output->openStreams--;
+			} else
+			if (raw)
+				output->data.append(data, length);
+			else
+				lineBuffer->append(data, length, isError, output->lines);
+		});
+		try {
+			this->threadPool.start(*reader);
+		} catch (Poco::Exception& e) {
+			delete reader;
+			message = e.displayText();
+			Poco::Process::kill(*process.processHandle);
+			return false;
+		}
+	}
+	return true;
+}
+
+void ProcessSupervisor::kill(int handle) {
+	for (auto it = this->queue.begin(), ite = this->queue.end(); it != ite; ++it) {
+		if (it->handle == handle) {
+			this->queue.erase(it);
+			return;
+		}
+	}
+
+	auto it = this->processes.find(handle);
+	if (it == this->processes.end())
+		return;
+	try {
+		Poco::Process::kill(*it->second.processHandle);
+	} catch (Poco::Exception&) {
+		// the process has already terminated
+	}
+	this->processes.erase(it);
+}
+
+bool ProcessSupervisor::write(int handle, const std::string& data) {
+	auto it = this->processes.find(handle);
+	if ((it == this->processes.end()) || !it->second.inPipe)
+		return false;
+	try {
+		// pipes cannot be used without blocking; data is expected to be small
+		const char* buffer = data.data();
+		size_t remaining = data.size();
+		while (remaining > 0) {
+			int count = it->second.inPipe->writeBytes(buffer, (int)remaining);
+			buffer += count;
+			remaining -= count;
+		}
+	} catch (Poco::Exception&) {
+		// the process has closed its standard input
+		it->second.inPipe.reset();
+		return false;
+	}
+	return true;
+}
+
+int ProcessSupervisor::dispatchEvents(void) {
+	int result = this->startQueued();
+
+	std::vector<int> handles;
+	handles.reserve(this->processes.size());
+	for (auto it = this->processes.begin(), ite = this->processes.end(); it != ite; ++it)
+		handles.push_back(it->first);
+
+	std::vector<std::pair<bool, std::string> > lines;
+	std::string data;
+	for (auto hit = handles.begin(), hite = handles.end(); hit != hite; ++hit) {
+		// the process may have been killed by a listener in the meantime
+		auto it = this->processes.find(*hit);
+		if (it == this->processes.end())
+			continue;
+		Process& process = it->second;
+
+		bool streamsClosed;
+		lines.clear();
+		data.clear();
+		{
+			Poco::FastMutex::ScopedLock lock(process.output->mutex);
+			lines.swap(process.output->lines);
+			data.swap(process.output->data);
+			streamsClosed = (process.output->openStreams == 0);
+		}
+		// the process has terminated if both streams have been closed and it is not running
+		bool terminated = streamsClosed && !Poco::Process::isRunning(*process.processHandle);
+		int exitCode = (terminated ? process.processHandle->wait() : 0);
+
+		IListener* listener = process.listener;
+		if (terminated)
+			this->processes.erase(it);
+
+		for (auto lit = lines.begin(), lite = lines.end(); lit != lite; ++lit) {
+			// stop if the listener has killed the process
+			if (!terminated && (this->processes.find(*hit) == this->processes.end()))
+				break;
+			listener->processOutput(*hit, lit->first, lit->second);
+			result++;
+		}
+		if (!data.empty() && (terminated || (this->processes.find(*hit) != this->processes.end()))) {
+			listener->processData(*hit, data);
+			result++;
+		}
+
+		if (terminated) {
+			result++;
+			listener->processTerminated(*hit, exitCode);
+		}
+	}
+
+	// start queued processes instead of the terminated ones
+	result += this->startQueued();
+
+	return result;
+}
+
+#endif
+
+void ProcessSupervisor::setMaxProcesses(size_t maxProcesses) {
+	this->maxProcesses = maxProcesses;
+}
+
+int ProcessSupervisor::start(const std::string& program, const std::vector<std::string>& args, IListener* listener, int options) {
+	Request request;
+	request.handle = this->nextHandle++;
+	request.program = program;
+	request.args = args;
+	request.listener = listener;
+	request.options = options;
+	this->queue.push_back(request);
+	return request.handle;
+}
+
+int ProcessSupervisor::startQueued(void) {
+	int result = 0;
+	while (!this->queue.empty() && ((this->maxProcesses == 0) || (this->processes.size() < this->maxProcesses))) {
+		Request request = this->queue.front();
+		this->queue.pop_front();
+
+		std::string message;
+		Process& process = this->processes[request.handle];
+		process.listener = request.listener;
+		if (this->launch(request, process, message)) {
+#ifdef linux
+			Poco::Process::PID pid = process.pid;
+#else
+			Poco::Process::PID pid = process.processHandle->id();
+#endif
+			request.listener->processStarted(request.handle, pid);
+		} else {
+			this->processes.erase(request.handle);
+			request.listener->processFailed(request.handle, message);
+		}
+		result++;
+	}
+	return result;
+}
+
+size_t ProcessSupervisor::getProcessCount(void) const {
+	return this->processes.size();
+}
+
+}		// namespace openhat
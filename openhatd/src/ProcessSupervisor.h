@@ -0,0 +1,178 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Poco/Process.h"
+
+#ifndef linux
+#include <memory>
+
+#include "Poco/Mutex.h"
+#include "Poco/Pipe.h"
+#include "Poco/ThreadPool.h"
+#endif
+
+namespace openhat {
+
+/// Starts and monitors operating system processes on behalf of all ports of the process.
+/// On Linux processes are started using posix_spawn. Their standard output and error streams are
+/// connected to non-blocking pipes; the pipes and the processes (using pidfds if the kernel
+/// supports them, waitpid otherwise) are checked with a single poll() call in the main loop, so
+/// no threads are required. On other platforms Poco::Process is used and the streams are read
+/// by threads of a shared thread pool.
+/// Optionally, the standard input of a process is a pipe as well so that requests can be sent
+/// to long-running processes (workers).
+/// The number of processes that may run at the same time can be limited. Processes that are
+/// started while the limit is reached are queued and started as soon as another process ends.
+/// The supervisor is not thread-safe; it must be used in the main thread only. Listeners are
+/// always called from dispatchEvents(), i. e. in the main thread as well.
+class ProcessSupervisor {
+public:
+	/// Receives notifications about a process.
+	class IListener {
+	public:
+		virtual ~IListener() {};
+
+		/// Called when the process has actually been started (it may have been queued before).
+		virtual void processStarted(int handle, Poco::Process::PID pid) = 0;
+
+		/// Called for each line the process writes to its standard output or error stream.
+		/// If the process has been started with RAW_OUTPUT, processData() is called instead for stdout.
+		virtual void processOutput(int handle, bool isError, const std::string& line) = 0;
+
+		/// Called with the data the process writes to its standard output if it has been started
+		/// with RAW_OUTPUT.
+		virtual void processData(int /*handle*/, const std::string& /*data*/) {};
+
+		/// Called when the process has terminated. If the process has been terminated by a signal
+		/// the exit code is 128 plus the signal number.
+		virtual void processTerminated(int handle, int exitCode) = 0;
+
+		/// Called if the process could not be started or monitored.
+		virtual void processFailed(int handle, const std::string& message) = 0;
+	};
+
+	/// Options for start().
+	enum Options {
+		/// The standard input is a pipe that is written to using write(); otherwise, it is empty.
+		INPUT_PIPE = 1,
+		/// The standard output is passed on as it is received instead of line by line.
+		RAW_OUTPUT = 2
+	};
+
+	/// Returns the process-wide instance.
+	static ProcessSupervisor& get(void);
+
+	virtual ~ProcessSupervisor();
+
+	/// Sets the maximum number of processes that may run at the same time (0 means no limit).
+	void setMaxProcesses(size_t maxProcesses);
+
+	/// Starts the program (path of the executable) with the specified arguments, or queues the start
+	/// if the maximum number of processes is running. Returns a handle for kill().
+	/// Errors are reported to the listener. The options are a combination of the Options flags.
+	int start(const std::string& program, const std::vector<std::string>& args, IListener* listener, int options = 0);
+
+	/// Writes the data to the standard input of a running process that has been started with INPUT_PIPE.
+	/// Data that cannot be written immediately is buffered. Returns false if the process is not running
+	/// or its standard input is closed.
+	bool write(int handle, const std::string& data);
+
+	/// Kills the process or removes it from the queue. The listener is not called any more after
+	/// this method returns. A killed process is still reaped by the supervisor.
+	void kill(int handle);
+
+	/// Reads the output of the processes, detects their termination and notifies the listeners.
+	/// Must be called regularly from the main thread. Returns the number of processed events.
+	int dispatchEvents(void);
+
+	/// Returns the number of running processes.
+	size_t getProcessCount(void) const;
+
+	/// Returns the number of processes that are waiting to be started.
+	inline size_t getQueueLength(void) const { return this->queue.size(); };
+
+protected:
+	struct Request {
+		int handle;
+		std::string program;
+		std::vector<std::string> args;
+		IListener* listener;
+		int options;
+	};
+
+	// collects the complete lines of a stream
+	struct LineBuffer {
+		std::string partial;
+
+		// appends the data and moves complete lines to the list
+		void append(const char* data, size_t length, bool isError, std::vector<std::pair<bool, std::string> >& lines);
+
+		// moves an incomplete last line to the list
+		void flush(bool isError, std::vector<std::pair<bool, std::string> >& lines);
+	};
+
+#ifdef linux
+	struct Process {
+		Poco::Process::PID pid;
+		int pidFd;				// -1 if pidfds are not supported
+		int inFd;				// -1 if closed or not used
+		int outFd;				// -1 if closed
+		int errFd;				// -1 if closed
+		std::string inBuffer;	// data that has not yet been written to stdin
+		LineBuffer outBuffer;
+		LineBuffer errBuffer;
+		IListener* listener;
+		bool rawOutput;
+	};
+
+	// killed processes that have not yet been reaped
+	std::vector<Poco::Process::PID> zombies;
+
+	// writes buffered data to the standard input of the process
+	static void flushInput(Process& process);
+#else
+	// output of a process; shared between the main thread and the reader threads
+	struct Output {
+		Poco::FastMutex mutex;
+		std::vector<std::pair<bool, std::string> > lines;
+		std::string data;		// stdout data if RAW_OUTPUT is used
+		int openStreams;
+	};
+
+	struct Process {
+		std::unique_ptr<Poco::ProcessHandle> processHandle;
+		std::unique_ptr<Poco::Pipe> inPipe;
+		std::shared_ptr<Output> output;
+		IListener* listener;
+	};
+
+	Poco::ThreadPool threadPool;
+#endif
+
+	int nextHandle;
+	size_t maxProcesses;
+	std::map<int, Process> processes;
+	std::deque<Request> queue;
+
+	ProcessSupervisor();
+
+	// starts the process; returns false and sets the message in case of an error
+	bool launch(const Request& request, Process& process, std::string& message);
+
+	// starts queued processes as long as the maximum number is not reached
+	int startQueued(void);
+};
+
+}		// namespace openhat
@@ -0,0 +1,287 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "StreamFramer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Poco/Exception.h"
+#include "Poco/NumberParser.h"
+
+namespace openhat {
+
+// SML transport sequences
+static const char SML_ESCAPE[4] = { 0x1b, 0x1b, 0x1b, 0x1b };
+static const char SML_START[8] = { 0x1b, 0x1b, 0x1b, 0x1b, 0x01, 0x01, 0x01, 0x01 };
+#define SML_END		0x1a
+
+StreamFramer::StreamFramer(Framing framing, size_t maxFrameSize) {
+	this->framing = framing;
+	this->maxFrameSize = maxFrameSize;
+	this->delimiter = "\n";
+	this->lengthBytes = 2;
+	// an escaped SML message may be up to twice as long as the frame
+	this->buffer.resize(2 * maxFrameSize + 64);
+	this->discardedBytes = 0;
+	this->frameCount = 0;
+	this->reset();
+}
+
+void StreamFramer::setDelimiter(const std::string& delimiter) {
+	if (delimiter.empty())
+		throw Poco::InvalidArgumentException("The delimiter must not be empty");
+	this->delimiter = delimiter;
+	this->reset();
+}
+
+void StreamFramer::setLengthBytes(int lengthBytes) {
+	if ((lengthBytes != 1) && (lengthBytes != 2) && (lengthBytes != 4))
+		throw Poco::InvalidArgumentException("The number of length bytes must be 1, 2 or 4");
+	this->lengthBytes = lengthBytes;
+	this->reset();
+}
+
+void StreamFramer::reset(void) {
+	this->dataStart = 0;
+	this->dataEnd = 0;
+	this->scanPos = 0;
+	this->overflow = false;
+	this->inFrame = false;
+	this->frameEnd = 0;
+	this->crc = 0xffff;
+}
+
+void StreamFramer::discard(size_t length) {
+	this->discardedBytes += length;
+	this->dataStart += length;
+	if (this->scanPos < this->dataStart)
+		this->scanPos = this->dataStart;
+}
+
+char* StreamFramer::getWriteBuffer(size_t* length) {
+	if ((this->dataEnd == this->buffer.size()) && (this->dataStart > 0)) {
+		// move the unprocessed data to the beginning of the buffer
+		size_t offset = this->dataStart;
+		memmove(&this->buffer[0], &this->buffer[offset], this->dataEnd - offset);
+		this->dataStart = 0;
+		this->dataEnd -= offset;
+		this->scanPos -= offset;
+		if (this->inFrame)
+			this->frameEnd -= offset;
+	}
+	if (this->dataEnd == this->buffer.size()) {
+		// should not happen as frames are limited in size; resynchronize
+		this->discardedBytes += this->dataEnd - this->dataStart;
+		this->reset();
+	}
+	*length = this->buffer.size() - this->dataEnd;
+	return &this->buffer[this->dataEnd];
+}
+
+int StreamFramer::commit(size_t length, IListener* listener) {
+	if (length > this->buffer.size() - this->dataEnd)
+		throw Poco::InvalidArgumentException("Committed length exceeds the write buffer");
+	this->dataEnd += length;
+
+	switch (this->framing) {
+	case DELIMITER: return this->processDelimiter(listener);
+	case LENGTH_PREFIX: return this->processLengthPrefix(listener);
+	case SML: return this->processSML(listener);
+	}
+	return 0;
+}
+
+int StreamFramer::processDelimiter(IListener* listener) {
+	int result = 0;
+	size_t delimiterLength = this->delimiter.size();
+	while (true) {
+		char* begin = &this->buffer[0];
+		char* end = std::search(begin + this->scanPos, begin + this->dataEnd, this->delimiter.begin(), this->delimiter.end());
+		if (end == begin + this->dataEnd) {
+			// the delimiter may be incomplete
+			if (this->dataEnd - this->dataStart >= delimiterLength)
+				this->scanPos = this->dataEnd - delimiterLength + 1;
+			// frame too long?
+			if (this->dataEnd - this->dataStart > this->maxFrameSize + delimiterLength) {
+				this->overflow = true;
+				this->discard(this->scanPos - this->dataStart);
+			}
+			break;
+		}
+		size_t frameLength = end - (begin + this->dataStart);
+		if (this->overflow) {
+			// end of a frame that is too long
+			this->discardedBytes += frameLength;
+			this->overflow = false;
+		} else if (frameLength > this->maxFrameSize) {
+			this->discardedBytes += frameLength;
+		} else if (frameLength > 0) {
+			listener->frameReceived(begin + this->dataStart, frameLength);
+			this->frameCount++;
+			result++;
+		}
+		this->dataStart += frameLength + delimiterLength;
+		this->scanPos = this->dataStart;
+	}
+	return result;
+}
+
+int StreamFramer::processLengthPrefix(IListener* listener) {
+	int result = 0;
+	while (this->dataEnd - this->dataStart >= (size_t)this->lengthBytes) {
+		const uint8_t* data = (const uint8_t*)&this->buffer[this->dataStart];
+		size_t frameLength = 0;
+		for (int i = 0; i < this->lengthBytes; i++)
+			frameLength = (frameLength << 8) | data[i];
+		if (frameLength > this->maxFrameSize) {
+			// the stream can't be synchronized again; discard everything
+			this->discard(this->dataEnd - this->dataStart);
+			break;
+		}
+		if (this->dataEnd - this->dataStart < this->lengthBytes + frameLength)
+			break;
+		listener->frameReceived((const char*)data + this->lengthBytes, frameLength);
+		this->frameCount++;
+		result++;
+		this->dataStart += this->lengthBytes + frameLength;
+	}
+	this->scanPos = this->dataStart;
+	return result;
+}
+
+int StreamFramer::processSML(IListener* listener) {
+	int result = 0;
+	while (true) {
+		char* begin = &this->buffer[0];
+		if (!this->inFrame) {
+			// search the start sequence
+			char* start = std::search(begin + this->dataStart, begin + this->dataEnd, SML_START, SML_START + sizeof(SML_START));
+			if (start == begin + this->dataEnd) {
+				// keep a possibly incomplete start sequence
+				if (this->dataEnd - this->dataStart >= sizeof(SML_START))
+					this->discard(this->dataEnd - this->dataStart - sizeof(SML_START) + 1);
+				break;
+			}
+			this->discard(start - (begin + this->dataStart));
+			this->crc = crc16Update(0xffff, (const uint8_t*)SML_START, sizeof(SML_START));
+			this->dataStart += sizeof(SML_START);
+			this->scanPos = this->dataStart;
+			this->frameEnd = this->dataStart;
+			this->inFrame = true;
+		}
+
+		// the message consists of groups of four bytes; the payload is unescaped in place
+		// (frameEnd <= scanPos always holds)
+		bool abort = false;
+		while (this->dataEnd - this->scanPos >= 4) {
+			char* group = begin + this->scanPos;
+			if (memcmp(group, SML_ESCAPE, 4) != 0) {
+				this->crc = crc16Update(this->crc, (const uint8_t*)group, 4);
+				if (this->frameEnd != this->scanPos)
+					memmove(begin + this->frameEnd, group, 4);
+				this->frameEnd += 4;
+				this->scanPos += 4;
+				if (this->frameEnd - this->dataStart > this->maxFrameSize) {
+					abort = true;
+					break;
+				}
+				continue;
+			}
+			// escape sequence; wait for the following group
+			if (this->dataEnd - this->scanPos < 8)
+				break;
+			const uint8_t* next = (const uint8_t*)group + 4;
+			if (memcmp(next, SML_ESCAPE, 4) == 0) {
+				// escaped escape sequence
+				this->crc = crc16Update(this->crc, (const uint8_t*)group, 8);
+				memmove(begin + this->frameEnd, SML_ESCAPE, 4);
+				this->frameEnd += 4;
+				this->scanPos += 8;
+				if (this->frameEnd - this->dataStart > this->maxFrameSize) {
+					abort = true;
+					break;
+				}
+			} else if (next[0] == SML_END) {
+				this->crc = crc16Update(this->crc, (const uint8_t*)group, 6) ^ 0xffff;
+				size_t padding = next[1];
+				size_t frameLength = this->frameEnd - this->dataStart;
+				// the byte order of the checksum differs between implementations
+				uint16_t received1 = (uint16_t)((next[2] << 8) | next[3]);
+				uint16_t received2 = (uint16_t)((next[3] << 8) | next[2]);
+				if ((padding <= 3) && (padding <= frameLength) && ((this->crc == received1) || (this->crc == received2))) {
+					listener->frameReceived(begin + this->dataStart, frameLength - padding);
+					this->frameCount++;
+					result++;
+				} else
+					this->discardedBytes += this->scanPos + 8 - this->dataStart + sizeof(SML_START);
+				this->scanPos += 8;
+				this->dataStart = this->scanPos;
+				this->inFrame = false;
+				break;
+			} else {
+				// invalid sequence, or the start of a new message; search the start again
+				abort = true;
+				break;
+			}
+		}
+		if (abort) {
+			this->discardedBytes += this->scanPos - this->dataStart + sizeof(SML_START);
+			this->dataStart = this->scanPos;
+			this->inFrame = false;
+			continue;
+		}
+		if (this->inFrame)
+			break;
+	}
+	return result;
+}
+
+std::string StreamFramer::unescape(const std::string& text) {
+	std::string result;
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] != '\\') {
+			result += text[i];
+			continue;
+		}
+		if (++i >= text.size())
+			throw Poco::DataFormatException("Incomplete escape sequence: " + text);
+		switch (text[i]) {
+		case 'r': result += '\r'; break;
+		case 'n': result += '\n'; break;
+		case 't': result += '\t'; break;
+		case '\\': result += '\\'; break;
+		case 'x': {
+			unsigned int value;
+			if ((i + 2 >= text.size()) || !Poco::NumberParser::tryParseHex(text.substr(i + 1, 2), value))
+				throw Poco::DataFormatException("Invalid hex escape sequence: " + text);
+			result += (char)value;
+			i += 2;
+			break;
+		}
+		default:
+			throw Poco::DataFormatException("Unsupported escape sequence: " + text);
+		}
+	}
+	return result;
+}
+
+uint16_t StreamFramer::crc16Update(uint16_t crc, const uint8_t* data, size_t length) {
+	// reflected polynomial 0x1021
+	for (size_t i = 0; i < length; i++) {
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+	}
+	return crc;
+}
+
+uint16_t StreamFramer::crc16(const uint8_t* data, size_t length) {
+	return crc16Update(0xffff, data, length) ^ 0xffff;
+}
+
+}		// namespace openhat
@@ -0,0 +1,105 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace openhat {
+
+/// Splits a stream of bytes into frames and passes complete frames to a listener.
+/// Supported framings are:
+/// - DELIMITER: frames are separated by a delimiter sequence (e. g. lines); empty frames are skipped
+/// - LENGTH_PREFIX: each frame is preceded by its length (1, 2 or 4 bytes, big-endian)
+/// - SML: Smart Message Language transport (escape sequence 1b1b1b1b, start 01010101,
+///   end 1a with padding and CRC); the unescaped message without start and end sequences
+///   is passed to the listener if the checksum is correct
+/// The stream is received directly into the framer's buffer (getWriteBuffer() and commit()).
+/// Frames are passed to the listener as pointers into this buffer, so no data is copied or
+/// allocated per frame. Bytes that do not belong to a valid frame are discarded.
+class StreamFramer {
+public:
+	enum Framing {
+		DELIMITER,
+		LENGTH_PREFIX,
+		SML
+	};
+
+	/// Receives complete frames.
+	class IListener {
+	public:
+		virtual ~IListener() {};
+
+		/// Called for each complete frame. The data is valid only during the call.
+		virtual void frameReceived(const char* frame, size_t length) = 0;
+	};
+
+	/// Creates a framer. Frames that are longer than maxFrameSize are discarded.
+	StreamFramer(Framing framing, size_t maxFrameSize);
+
+	/// Sets the delimiter for DELIMITER framing (default: "\n"). Must not be empty.
+	void setDelimiter(const std::string& delimiter);
+
+	/// Sets the number of length bytes for LENGTH_PREFIX framing (1, 2 or 4; default: 2).
+	void setLengthBytes(int lengthBytes);
+
+	/// Returns the free space at the end of the buffer that received data can be written to.
+	char* getWriteBuffer(size_t* length);
+
+	/// Processes the specified number of bytes that have been written to the write buffer.
+	/// Calls the listener for each complete frame. Returns the number of frames.
+	int commit(size_t length, IListener* listener);
+
+	/// Discards the buffered data.
+	void reset(void);
+
+	/// Returns the number of bytes that have been discarded because they did not belong to a valid frame.
+	inline uint64_t getDiscardedBytes(void) const { return this->discardedBytes; };
+
+	/// Returns the number of frames that have been passed to the listener.
+	inline uint64_t getFrameCount(void) const { return this->frameCount; };
+
+	/// Parses a string that contains the escape sequences \r, \n, \t, \\ and \xhh.
+	/// Throws a Poco::DataFormatException if the string is invalid.
+	static std::string unescape(const std::string& text);
+
+	/// Calculates the CRC-16/X.25 checksum that is used by SML.
+	static uint16_t crc16(const uint8_t* data, size_t length);
+
+protected:
+	static uint16_t crc16Update(uint16_t crc, const uint8_t* data, size_t length);
+
+	Framing framing;
+	size_t maxFrameSize;
+	std::string delimiter;
+	int lengthBytes;
+
+	std::vector<char> buffer;
+	size_t dataStart;			// index of the first unprocessed byte
+	size_t dataEnd;				// index after the last received byte
+	size_t scanPos;				// index from which the search for the end of the frame continues
+	bool overflow;				// the current frame is too long and is being skipped
+	bool inFrame;				// SML: the start sequence has been found
+	size_t frameEnd;			// SML: end of the unescaped payload
+	uint16_t crc;				// SML: checksum of the received message
+
+	uint64_t discardedBytes;
+	uint64_t frameCount;
+
+	void discard(size_t length);
+
+	int processDelimiter(IListener* listener);
+
+	int processLengthPrefix(IListener* listener);
+
+	int processSML(IListener* listener);
+};
+
+}		// namespace openhat
@@ -2,6 +2,7 @@
 // Adjusted to use POCO, L. Meyer, 2015-06-12
 
 #include "math.h" 
+#include <cmath>
 
 #include "Poco/DateTime.h"
 #include "Poco/Timezone.h"
@@ -65,7 +66,7 @@ double CSunRiseSet::CalcJulianDay(int iMonth,int iDay, bool bLeapYr)
 //	The hour angle returned below is only for sunrise/sunset, i.e. when the solar zenith angle is 90.8 degrees. 
 // the reason why it's not 90 degrees is because we need to account for atmoshperic refraction. 
  
-double CSunRiseSet::CalcHourAngle(double dLat, double dSolarDec, bool bTime) 
+double CSunRiseSet::CalcHourAngle(double dLat, double dSolarDec, bool bTime, double dZenith) 
 { 
 		 
 /* 
@@ -90,7 +91,7 @@ double CSunRiseSet::CalcHourAngle(double dLat, double dSolarDec, bool bTime)
 		dTemp = acos(dTemp); 
 		return dTemp; 
 */		 
-		return  (acos(cos(dDegToRad(90.833))/(cos(dLatRad)*cos(dSolarDec))-tan(dLatRad) * tan(dSolarDec))); 
+		return  (acos(cos(dDegToRad(dZenith))/(cos(dLatRad)*cos(dSolarDec))-tan(dLatRad) * tan(dSolarDec))); 
 	} 
 	else 
 	{ 
@@ -100,22 +101,26 @@ double CSunRiseSet::CalcHourAngle(double dLat, double dSolarDec, bool bTime)
 		dTemp = acos(dTemp); 
 		return -dTemp; 
 */ 
-		return -(acos(cos(dDegToRad(90.833))/(cos(dLatRad)*cos(dSolarDec))-tan(dLatRad) * tan(dSolarDec)));		 
+		return -(acos(cos(dDegToRad(dZenith))/(cos(dLatRad)*cos(dSolarDec))-tan(dLatRad) * tan(dSolarDec)));		 
 	}	 
  
 } 
  
-double CSunRiseSet::calcSunsetGMT(int iJulDay, double dLatitude, double dLongitude) 
+double CSunRiseSet::calcSunsetGMT(int iJulDay, double dLatitude, double dLongitude, double dZenith) 
 { 
 		// First calculates sunrise and approx length of day 
  
 		double dGamma = CalcGamma(iJulDay + 1); 
 		double eqTime = CalcEqofTime(dGamma); 
 		double solarDec = CalcSolarDec(dGamma); 
-		double hourAngle = CalcHourAngle(dLatitude, solarDec, 0); 
+		double hourAngle = CalcHourAngle(dLatitude, solarDec, 0, dZenith); 
 		double delta = dLongitude - dRadToDeg(hourAngle); 
 		double timeDiff = 4 * delta; 
 		double setTimeGMT = 720 + timeDiff - eqTime; 
+
+		// the sun does not cross the zenith angle on this day
+		if (std::isnan(setTimeGMT))
+			return setTimeGMT;
  
 		// first pass used to include fractional day in gamma calc 
  
@@ -125,7 +130,7 @@ double CSunRiseSet::calcSunsetGMT(int iJulDay, double dLatitude, double dLongitu
  
 		solarDec = CalcSolarDec(gamma_sunset); 
 		 
-		hourAngle = CalcHourAngle(dLatitude, solarDec, false); 
+		hourAngle = CalcHourAngle(dLatitude, solarDec, false, dZenith); 
 		delta = dLongitude - dRadToDeg(hourAngle); 
 		timeDiff = 4 * delta; 
 		setTimeGMT = 720 + timeDiff - eqTime; // in minutes 
@@ -134,24 +139,28 @@ double CSunRiseSet::calcSunsetGMT(int iJulDay, double dLatitude, double dLongitu
 	} 
  
  
-double CSunRiseSet::calcSunriseGMT(int iJulDay, double dLatitude, double dLongitude) 
+double CSunRiseSet::calcSunriseGMT(int iJulDay, double dLatitude, double dLongitude, double dZenith) 
 { 
 	// *** First pass to approximate sunrise 
  
 	double gamma = CalcGamma(iJulDay); 
 	double eqTime = CalcEqofTime(gamma); 
 	double solarDec = CalcSolarDec(gamma); 
-	double hourAngle = CalcHourAngle(dLatitude, solarDec, true); 
+	double hourAngle = CalcHourAngle(dLatitude, solarDec, true, dZenith); 
 	double delta = dLongitude - dRadToDeg(hourAngle); 
 	double timeDiff = 4 * delta; 
 	double timeGMT = 720 + timeDiff - eqTime; 
+
+	// the sun does not cross the zenith angle on this day
+	if (std::isnan(timeGMT))
+		return timeGMT;
  
 	// *** Second pass includes fractional jday in gamma calc 
  
 	double gamma_sunrise = CalcGamma2(iJulDay, timeGMT/60); 
 	eqTime = CalcEqofTime(gamma_sunrise); 
 	solarDec = CalcSolarDec(gamma_sunrise); 
-	hourAngle = CalcHourAngle(dLatitude, solarDec, 1); 
+	hourAngle = CalcHourAngle(dLatitude, solarDec, 1, dZenith); 
 	delta = dLongitude - dRadToDeg(hourAngle); 
 	timeDiff = 4 * delta; 
 	timeGMT = 720 + timeDiff - eqTime; // in minutes 
@@ -247,6 +256,16 @@ Poco::DateTime CSunRiseSet::GetSunset(double dLat,double dLon,Poco::DateTime tim
 	return NewTime; 
 } 
  
+double CSunRiseSet::GetEventGMT(double dLat, double dLon, int iYear, int iMonth, int iDay, double dZenith, bool bRise)
+{
+	int iJulianDay = CalcJulianDay(iMonth, iDay, IsLeapYear(iYear));
+
+	if (bRise)
+		return calcSunriseGMT(iJulianDay, dLat, dLon, dZenith);
+	else
+		return calcSunsetGMT(iJulianDay, dLat, dLon, dZenith);
+}
+
 Poco::DateTime CSunRiseSet::GetSolarNoon(double dLon, Poco::DateTime time) 
 { 
 	bool bLeap = IsLeapYear(time.year()); 
@@ -60,6 +60,13 @@ public:
 	Poco::DateTime GetSunset(double dLat,double dLon,Poco::DateTime time); 
 	Poco::DateTime GetSunrise(double dLat,double dLon,Poco::DateTime time); 
 	Poco::DateTime GetSolarNoon(double dLon, Poco::DateTime time); 
+
+	// Returns the time of the event in minutes after midnight GMT of the specified date.
+	// Like the other methods, this expects the longitude to be positive west of Greenwich.
+	// dZenith is 90.833 for sunrise/sunset and 96, 102 or 108 for civil, nautical or astronomical twilight.
+	// Returns NaN if the sun does not cross the zenith angle on this day (polar day or night).
+	// Does not apply the corrections of GetSunrise/GetSunset for polar latitudes.
+	double GetEventGMT(double dLat, double dLon, int iYear, int iMonth, int iDay, double dZenith, bool bRise);
 private: 
 	//	Convert radian angle to degrees 
 	double dRadToDeg(double dAngleRad) 
@@ -106,10 +113,10 @@ private:
 	std::string JulianDayToDate(int jday, bool bLeapYear); 
 	double CalcJulianDay(int iMonth,int iDay, bool bLeapYr); 
  
-	double CalcHourAngle(double dLat, double dSolarDec, bool bTime); 
+	double CalcHourAngle(double dLat, double dSolarDec, bool bTime, double dZenith = 90.833); 
 	 
-	double calcSunsetGMT(int iJulDay, double dLatitude, double dLongitude); 
-	double calcSunriseGMT(int iJulDay, double dLatitude, double dLongitude); 
+	double calcSunsetGMT(int iJulDay, double dLatitude, double dLongitude, double dZenith = 90.833); 
+	double calcSunriseGMT(int iJulDay, double dLatitude, double dLongitude, double dZenith = 90.833); 
 	double calcSolNoonGMT(int iJulDay, double dLongitude); 
  
 	double findRecentSunrise(int iJulDay, double dLatitude, double dLongitude); 
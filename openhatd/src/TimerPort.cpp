@@ -5,6 +5,11 @@
 #include "Poco/DateTimeFormatter.h"
 #include "Poco/NumberParser.h"
 #include "Poco/Format.h"
+#include "Poco/Delegate.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "SunRiseSet.h"
 
@@ -43,15 +48,16 @@ int TimerPort::ScheduleComponent::ParseValue(Type type, std::string value, Abstr
 TimerPort::ScheduleComponent TimerPort::ScheduleComponent::Parse(Type type, std::string def, AbstractOpenHAT* openhat) {
 	ScheduleComponent result;
 	result.type = type;
+	result.values = 0;
 
 	std::string compName;
 	switch (type) {
-	case MONTH: result.values.resize(13); compName = "Month"; break;
-	case DAY: result.values.resize(32); compName = "Day"; break;
-	case HOUR: result.values.resize(24); compName = "Hour"; break;
-	case MINUTE: result.values.resize(60); compName = "Minute"; break;
-	case SECOND: result.values.resize(60); compName = "Second"; break;
-	case WEEKDAY: result.values.resize(7); compName = "Weekday"; break;
+	case MONTH: compName = "Month"; break;
+	case DAY: compName = "Day"; break;
+	case HOUR: compName = "Hour"; break;
+	case MINUTE: compName = "Minute"; break;
+	case SECOND: compName = "Second"; break;
+	case WEEKDAY: compName = "Weekday"; break;
 	}
 
 	// split definition at blanks
@@ -67,8 +73,8 @@ TimerPort::ScheduleComponent TimerPort::ScheduleComponent::Parse(Type type, std:
 		}
 		if (item == "*") {
 			// set all values
-			for (size_t i = 0; i < result.values.size(); i++)
-				result.values[i] = val;
+			for (int i = result.getMinimum(); i <= result.getMaximum(); i++)
+				result.setValue(i, val);
 		} else
 		// range specified?
 		if ((dashPos = item.find('-')) != std::string::npos) {
@@ -88,67 +94,56 @@ TimerPort::ScheduleComponent TimerPort::ScheduleComponent::Parse(Type type, std:
 				openhat->throwSettingException("The range specification '" + item + "' is not valid for the date/time component " + compName);
 			// set values of the range
 			for (int i = range1; i <= range2; i++)
-				result.values[i] = val;
+				result.setValue(i, val);
 		} else {
 			// parse as integer
-			result.values[ParseValue(type, item, openhat)] = val;
+			result.setValue(ParseValue(type, item, openhat), val);
 		}
 	}
 
 	// check that at least one value is set
-	for (size_t i = 0; i < result.values.size(); i++)
-		if (result.values[i])
-			return result;
+	if (result.values != 0)
+		return result;
 
 	openhat->throwSettingException("Timer port schedule component " + compName + " requires at least one allowed value");
 	return result;
 }
 
-bool TimerPort::ScheduleComponent::getNextPossibleValue(int* currentValue, bool* rollover, bool* changed, int month, int year) {
-	*rollover = false;
-	*changed = false;
-	// find a match
-	for (int i = *currentValue; i < (int)this->values.size(); i++) {
-		if (this->values[i]) {
-			// for days, make a special check whether the month has as many days
-			if ((this->type != DAY) || (i < Poco::DateTime::daysOfMonth(year, month))) {
-				*changed = *currentValue != i;
-				*currentValue = i;
-				return true;
-			}
-			// day is out of range; need to rollover
-			break;
-		}
-	}
-	// not found? rollover; return first possible value
-	*rollover = true;
-	return this->getFirstPossibleValue(currentValue, month, year);
+void TimerPort::ScheduleComponent::setValue(int value, bool allowed) {
+	if (allowed)
+		this->values |= (uint64_t)1 << value;
+	else
+		this->values &= ~((uint64_t)1 << value);
 }
 
-bool TimerPort::ScheduleComponent::getFirstPossibleValue(int* currentValue, int /*month*/, int /*year*/) {
-	// find a match
-	int i = 0;
-	switch (type) {
-	case MONTH: i = 1; break;
-	case DAY: i = 1; break;
-	case HOUR: break;
-	case MINUTE: break;
-	case SECOND: break;
-	case WEEKDAY:
-		throw Poco::ApplicationException("Weekday is not supported");
-	}
-	for (; i < (int)this->values.size(); i++) {
-		if (this->values[i]) {
-			*currentValue = i;
-			return true;
-		}
-	}
-	// nothing found
-	return false;
+int TimerPort::ScheduleComponent::lowestBit(uint64_t value) {
+#ifdef _MSC_VER
+	// _BitScanForward64 is not available on 32 bit targets
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)value))
+		return (int)index;
+	_BitScanForward(&index, (unsigned long)(value >> 32));
+	return (int)index + 32;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+int TimerPort::ScheduleComponent::getNextValue(int value) const {
+	if (value > 63)
+		return -1;
+	uint64_t remaining = this->values & (~(uint64_t)0 << value);
+	if (remaining == 0)
+		return -1;
+	return lowestBit(remaining);
 }
 
-bool TimerPort::ScheduleComponent::hasValue(int value) {
-	return this->values[value];
+int TimerPort::ScheduleComponent::getFirstValue(void) const {
+	return lowestBit(this->values);
+}
+
+bool TimerPort::ScheduleComponent::hasValue(int value) const {
+	return (this->values & ((uint64_t)1 << value)) != 0;
 }
 
 int TimerPort::ScheduleComponent::getMinimum(void) {
@@ -186,14 +181,13 @@ bool TimerPort::ManualSchedulePort::setPosition(int64_t position, ChangeSource c
 }
 
 
-TimerPort::TimerPort(AbstractOpenHAT* openhat, const char* id) : DigitalPort(id, OPDI_PORTDIRCAP_OUTPUT, 0) {
+TimerPort::TimerPort(AbstractOpenHAT* openhat, const char* id) : DigitalPort(id, OPDI_PORTDIRCAP_OUTPUT, 0), wakeupTimer(this) {
 	this->opdi = this->openhat = openhat;
 
 	DigitalPort::setMode(OPDI_DIGITAL_MODE_OUTPUT);
 
 	// default: enabled
 	this->setLine(1);
-	this->masterLoggedIn = false;
 
 	// set default icon
 	this->icon = "alarmclock";
@@ -204,10 +198,15 @@ TimerPort::TimerPort(AbstractOpenHAT* openhat, const char* id) : DigitalPort(id,
 	this->nextEventText = "Next event: ";
 	this->timestampFormat = openhat->timestampFormat;
 
-	this->lastWorkTimestamp = 0;
+	this->connectionListener = false;
+
+	TimerWheel::get().timeChanged += Poco::delegate(this, &TimerPort::timeChanged);
 }
 
 TimerPort::~TimerPort() {
+	TimerWheel::get().timeChanged -= Poco::delegate(this, &TimerPort::timeChanged);
+	if (this->connectionListener)
+		this->openhat->removeConnectionListener(this);
 }
 
 void TimerPort::configure(ConfigurationView::Ptr config, ConfigurationView::Ptr parentConfig) {
@@ -276,7 +275,7 @@ void TimerPort::configure(ConfigurationView::Ptr config, ConfigurationView::Ptr
 		schedule.maxOccurrences = scheduleConfig->getInt("MaxOccurrences", -1);
 		schedule.duration = scheduleConfig->getInt("Duration", 1000);	// default duration: 1 second
 		schedule.action = SET_HIGH;										// default action
-		schedule.astroEvent = NONE;
+		schedule.astroEvent = AstroTable::SUNRISE;
 
 		std::string action = this->openhat->getConfigString(scheduleConfig, nodeName, "Action", "", false);
 		if (action == "SetHigh") {
@@ -348,13 +347,8 @@ void TimerPort::configure(ConfigurationView::Ptr config, ConfigurationView::Ptr
 		if (scheduleType == "Astronomical") {
 			schedule.type = ASTRONOMICAL;
 			std::string astroEventStr = this->openhat->getConfigString(scheduleConfig, nodeName, "AstroEvent", "", true);
-			if (astroEventStr == "Sunrise") {
-				schedule.astroEvent = SUNRISE;
-			} else
-			if (astroEventStr == "Sunset") {
-				schedule.astroEvent = SUNSET;
-			} else
-				this->openhat->throwSettingException(nodeName + ": Parameter AstroEvent must be specified; use either 'Sunrise' or 'Sunset'");
+			if (!AstroTable::parseEvent(astroEventStr, &schedule.astroEvent))
+				this->openhat->throwSettingException(nodeName + ": Parameter AstroEvent must be specified; use 'Sunrise', 'Sunset', 'CivilDawn', 'CivilDusk', 'NauticalDawn', 'NauticalDusk', 'AstronomicalDawn' or 'AstronomicalDusk'");
 			schedule.astroOffset = scheduleConfig->getInt("AstroOffset", 0);
 			schedule.astroLon = scheduleConfig->getDouble("Longitude", -999);
 			schedule.astroLat = scheduleConfig->getDouble("Latitude", -999);
@@ -362,8 +356,6 @@ void TimerPort::configure(ConfigurationView::Ptr config, ConfigurationView::Ptr
 				this->openhat->throwSettingException(nodeName + ": Parameter Longitude must be specified and within -180..180");
 			if ((schedule.astroLat < -90) || (schedule.astroLat > 90))
 				this->openhat->throwSettingException(nodeName + ": Parameter Latitude must be specified and within -90..90");
-			if ((schedule.astroLat < -65) || (schedule.astroLat > 65))
-				this->openhat->throwSettingException(nodeName + ": Sorry. Latitudes outside -65..65 are currently not supported (library crash). You can either relocate or try and fix the bug.");
 		} else
 		if (scheduleType == "OnLogin") {
 			schedule.type = ONLOGIN;
@@ -416,6 +408,15 @@ void TimerPort::prepare() {
 		this->recalculateSchedules();
 	}
 
+	// schedules that depend on the connection state need to be notified
+	for (auto it = this->schedules.begin(), ite = this->schedules.end(); it != ite; ++it) {
+		if (((*it).type == ONLOGIN) || ((*it).type == ONLOGOUT)) {
+			this->openhat->addConnectionListener(this);
+			this->connectionListener = true;
+			break;
+		}
+	}
+
 	/*
 			// test cases
 			if (schedule.type == ASTRONOMICAL) {
@@ -430,17 +431,80 @@ void TimerPort::prepare() {
 				}
 			}
 	*/
+}
 
-	// remember calculation timestamp
-	this->lastWorkTimestamp = Poco::Timestamp();
+bool TimerPort::findNextTimeOfDay(Schedule* schedule, int* hour, int* minute, int* second) {
+	int h = schedule->hourComponent.getNextValue(*hour);
+	if (h < 0)
+		return false;
+	if (h == *hour) {
+		int m = schedule->minuteComponent.getNextValue(*minute);
+		if (m == *minute) {
+			int s = schedule->secondComponent.getNextValue(*second);
+			if (s >= 0) {
+				*second = s;
+				return true;
+			}
+			m = schedule->minuteComponent.getNextValue(*minute + 1);
+		}
+		if (m >= 0) {
+			*minute = m;
+			*second = schedule->secondComponent.getFirstValue();
+			return true;
+		}
+		h = schedule->hourComponent.getNextValue(*hour + 1);
+		if (h < 0)
+			return false;
+	}
+	*hour = h;
+	*minute = schedule->minuteComponent.getFirstValue();
+	*second = schedule->secondComponent.getFirstValue();
+	return true;
 }
 
-bool TimerPort::matchWeekday(int day, int month, int year, ScheduleComponent* weekdayScheduleComponent) {
-	// determine day of week
-	Poco::DateTime dt(year, month, day);
-	int dayOfWeek = dt.dayOfWeek();	// 0 = Sunday
-	//  weekdayScheduleComponent must match
-	return weekdayScheduleComponent->hasValue(dayOfWeek);
+bool TimerPort::findNextPeriodicMatch(Schedule* schedule, int* year, int* month, int* day, int* hour, int* minute, int* second) {
+	// The Gregorian calendar repeats every 400 years (including the weekdays) so if there is no match
+	// within this period there is none at all. Each iteration checks all days of a month at once
+	// by combining the bit masks of the allowed days, the length of the month and the weekdays.
+	int startYear = *year;
+	uint64_t weekdays = schedule->weekdayComponent.getValues();
+	for (int y = startYear; y <= startYear + 400; y++) {
+		uint64_t months = schedule->monthComponent.getValues();
+		if (y == startYear)
+			months &= ~(uint64_t)0 << *month;
+		while (months != 0) {
+			int m = ScheduleComponent::lowestBit(months);
+			months &= months - 1;
+
+			// bits 1 to the number of days of the month
+			uint64_t days = schedule->dayComponent.getValues() & (((uint64_t)2 << Poco::DateTime::daysOfMonth(y, m)) - 2);
+			// rotate the weekdays so that bit 0 corresponds to the weekday of the first day of the month
+			// and repeat the pattern for five weeks, starting at bit 1 (0 = Sunday)
+			int first = Poco::DateTime(y, m, 1).dayOfWeek();
+			uint64_t week = ((weekdays >> first) | (weekdays << (7 - first))) & 0x7F;
+			days &= (week | (week << 7) | (week << 14) | (week << 21) | (week << 28)) << 1;
+
+			if ((y == startYear) && (m == *month)) {
+				days &= ~(uint64_t)0 << *day;
+				// the start day needs a time of day that is not yet over
+				if ((days & ((uint64_t)1 << *day)) != 0) {
+					if (findNextTimeOfDay(schedule, hour, minute, second))
+						return true;
+					days &= days - 1;
+				}
+			}
+			if (days != 0) {
+				*year = y;
+				*month = m;
+				*day = ScheduleComponent::lowestBit(days);
+				*hour = schedule->hourComponent.getFirstValue();
+				*minute = schedule->minuteComponent.getFirstValue();
+				*second = schedule->secondComponent.getFirstValue();
+				return true;
+			}
+		}
+	}
+	return false;
 }
 
 Poco::Timestamp TimerPort::calculateNextOccurrence(Schedule* schedule) {
@@ -464,7 +528,7 @@ Poco::Timestamp TimerPort::calculateNextOccurrence(Schedule* schedule) {
 		return result.timestamp();
 	} else
 	if (schedule->type == INTERVAL) {
-		Poco::Timestamp result;	// now
+		Poco::Timestamp result = opdi::Clock::get().now();
 		// add interval values (ignore year and month because those are not well defined in seconds)
 		if (schedule->data.time.second > 0)
 			result += schedule->data.time.second * result.resolution();
@@ -478,101 +542,18 @@ Poco::Timestamp TimerPort::calculateNextOccurrence(Schedule* schedule) {
 	} else
 	if (schedule->type == PERIODIC) {
 
-#define correctValues	if (second > 59) { second = 0; minute++; }                                \
-						if (minute > 59) { minute = 0; hour++; }                                  \
-						if (hour > 23) { hour = 0; day++; }                                       \
-						if (day > Poco::DateTime::daysOfMonth(year, month)) { day = 1; month++; } \
-						if (month > 12) { month = 1; year++; }
-
-		Poco::LocalDateTime now;
+		Poco::LocalDateTime now(Poco::DateTime(opdi::Clock::get().now()));
 		// start from the next second
-		int second = now.second() + 1;
-		int minute = now.minute();
-		int hour = now.hour();
-		int day = now.day();
-		int month = now.month();
-		int year = now.year();
-		correctValues;
-
-		bool rollover = false;
-		bool changed = false;
-		// calculate next possible seconds
-		if (!schedule->secondComponent.getNextPossibleValue(&second, &rollover, &changed, month, year))
-			return Poco::Timestamp();
-		// rolled over into next minute?
-		if (rollover) {
-			minute++;
-			correctValues;
-		}
-		// get next possible minute
-		if (!schedule->minuteComponent.getNextPossibleValue(&minute, &rollover, &changed, month, year))
-			return Poco::Timestamp();
-		// rolled over into next hour?
-		if (rollover) {
-			hour++;
-			correctValues;
-		}
-		// if the minute was changed the second value is now invalid; set it to the first
-		// possible value (because the sub-component range starts again with every new value)
-		if (rollover || changed) {
-			schedule->secondComponent.getFirstPossibleValue(&second, month, year);
-		}
-		// get next possible hour
-		if (!schedule->hourComponent.getNextPossibleValue(&hour, &rollover, &changed, month, year))
-			return Poco::Timestamp();
-		// rolled over into next day?
-		if (rollover) {
-			day++;
-			correctValues;
-		}
-		if (rollover || changed) {
-			schedule->secondComponent.getFirstPossibleValue(&second, month, year);
-			schedule->minuteComponent.getFirstPossibleValue(&minute, month, year);
-		}
-		// determine possible dates until the weekday matches
-		// avoid an infinite loop by terminating after too many iterations
-		int maxIter = 100;
-		do {
-			// terminate after too many iterations
-			if (--maxIter < 0)
-				return Poco::Timestamp();
-			// get next possible day
-			if (!schedule->dayComponent.getNextPossibleValue(&day, &rollover, &changed, month, year))
-				return Poco::Timestamp();
-			// rolled over into next month?
-			if (rollover) {
-				month++;
-				correctValues;
-			}
-			if (rollover || changed) {
-				schedule->secondComponent.getFirstPossibleValue(&second, month, year);
-				schedule->minuteComponent.getFirstPossibleValue(&minute, month, year);
-				schedule->hourComponent.getFirstPossibleValue(&hour, month, year);
-			}
-			// get next possible month
-			if (!schedule->monthComponent.getNextPossibleValue(&month, &rollover, &changed, month, year))
-				return Poco::Timestamp();
-			// rolled over into next year?
-			if (rollover) {
-				year++;
-				correctValues;
-			}
-			if (rollover || changed) {
-				schedule->secondComponent.getFirstPossibleValue(&second, month, year);
-				schedule->minuteComponent.getFirstPossibleValue(&minute, month, year);
-				schedule->hourComponent.getFirstPossibleValue(&hour, month, year);
-				schedule->dayComponent.getFirstPossibleValue(&day, month, year);
-			}
-			// does the weekday match?
-			if (this->matchWeekday(day, month, year, &schedule->weekdayComponent))
-				break;
-			// no - try next day
-			day++;
-			correctValues;
-			schedule->secondComponent.getFirstPossibleValue(&second, month, year);
-			schedule->minuteComponent.getFirstPossibleValue(&minute, month, year);
-			schedule->hourComponent.getFirstPossibleValue(&hour, month, year);
-		} while (true);
+		Poco::LocalDateTime start = now + Poco::Timespan(1, 0);
+		int year = start.year();
+		int month = start.month();
+		int day = start.day();
+		int hour = start.hour();
+		int minute = start.minute();
+		int second = start.second();
+
+		if (!findNextPeriodicMatch(schedule, &year, &month, &day, &hour, &minute, &second))
+			return opdi::Clock::get().now();
 
 		Poco::DateTime result = Poco::DateTime(year, month, day, hour, minute, second);
 		// values are specified in local time; convert to UTC
@@ -580,36 +561,11 @@ Poco::Timestamp TimerPort::calculateNextOccurrence(Schedule* schedule) {
 		return result.timestamp();
 	} else
 	if (schedule->type == ASTRONOMICAL) {
-		CSunRiseSet sunRiseSet;
-		Poco::DateTime now;
-		now.makeLocal(Poco::Timezone::tzd());
-		Poco::DateTime today(now.julianDay());
-		switch (schedule->astroEvent) {
-		case NONE: break;
-		case SUNRISE: {
-			// find today's sunrise
-			Poco::DateTime result = sunRiseSet.GetSunrise(schedule->astroLat, schedule->astroLon, today);
-			// sun already risen?
-			if (result < now)
-				// find tomorrow's sunrise
-				result = sunRiseSet.GetSunrise(schedule->astroLat, schedule->astroLon, Poco::DateTime(now.julianDay() + 1));
-			// values are specified in local time; convert to UTC
-			result.makeUTC(Poco::Timezone::tzd());
-			return result.timestamp() + schedule->astroOffset * Poco::Timestamp::resolution();		// add offset in microseconds
-		}
-		case SUNSET: {
-			// find today's sunset
-			Poco::DateTime result = sunRiseSet.GetSunset(schedule->astroLat, schedule->astroLon, today);
-			// sun already set?
-			if (result < now)
-				// find tomorrow's sunset
-				result = sunRiseSet.GetSunset(schedule->astroLat, schedule->astroLon, Poco::DateTime(now.julianDay() + 1));
-			// values are specified in local time; convert to UTC
-			result.makeUTC(Poco::Timezone::tzd());
-			return result.timestamp() + schedule->astroOffset * Poco::Timestamp::resolution();		// add offset in microseconds
-		}
-		}
-		return Poco::Timestamp();
+		// find the next event; the times are calculated once per year and location
+		Poco::Timestamp result;
+		if (!this->openhat->getAstroTable().getNextEvent(schedule->astroLat, schedule->astroLon, schedule->astroEvent, opdi::Clock::get().now(), &result))
+			return opdi::Clock::get().now();
+		return result + schedule->astroOffset * Poco::Timestamp::resolution();		// add offset in microseconds
 	} else
 	if (schedule->type == MANUAL) {
 		// try to get the value from the dependent dial port
@@ -621,15 +577,15 @@ Poco::Timestamp TimerPort::calculateNextOccurrence(Schedule* schedule) {
 			return timestamp;
 		} catch (...) {
 			// ignore errors, can't schedule from this port
-			return Poco::Timestamp();
+			return opdi::Clock::get().now();
 		}
 	} else
 		// return default value (now; must not be enqueued)
-		return Poco::Timestamp();
+		return opdi::Clock::get().now();
 }
 
 void TimerPort::addNotification(ScheduleNotification::Ptr notification, Poco::Timestamp timestamp) {
-	Poco::Timestamp now;
+	Poco::Timestamp now = opdi::Clock::get().now();
 
 	// for debug output: convert UTC timestamp to local time
 	Poco::LocalDateTime ldt(timestamp);
@@ -639,7 +595,7 @@ void TimerPort::addNotification(ScheduleNotification::Ptr notification, Poco::Ti
 			this->logVerbose("Next scheduled time for node " + 
 					notification->schedule->nodeName + " is: " + timeText);
 		// add with the specified activation time
-		this->queue.enqueueNotification(notification, timestamp);
+		this->queue.insert(NotificationQueue::value_type(timestamp, notification));
 		if (!notification->deactivate)
 			notification->schedule->nextEvent = timestamp;
 	} else {
@@ -676,115 +632,91 @@ void TimerPort::setOutputs(int8_t outputLine) {
 	}
 }
 
-uint8_t TimerPort::doWork(uint8_t canSend)  {
-	DigitalPort::doWork(canSend);
-
-	// detect connection status change
-	bool connected = this->openhat->isConnected() != 0;
-	bool connectionStateChanged = connected != this->masterLoggedIn;
-	this->masterLoggedIn = connected;
-
-	// timer not active?
-	if (this->getLine() != 1)
-		return OPDI_STATUS_OK;
-
-	Poco::Notification::Ptr notification = nullptr;
+void TimerPort::WakeupTimer::expired(void) {
+	this->timerPort->processDueNotifications();
+}
 
-	if (connectionStateChanged) {
-		// check whether a schedule is specified for this event
-		auto it = this->schedules.begin();
-		auto ite = this->schedules.end();
-		while (it != ite) {
-			if ((*it).type == (connected ? ONLOGIN : ONLOGOUT)) {
-				this->logDebug("Connection status change detected; executing schedule " + (*it).nodeName + ((*it).type == ONLOGIN ? " (OnLogin)" : " (OnLogout)"));
-				// schedule found; create event notification
-				notification = new ScheduleNotification(&*it, false);
-				break;
-			}
-			++it;
-		}
-	}
+void TimerPort::updateWakeup(void) {
+	if (this->queue.empty())
+		TimerWheel::get().cancel(&this->wakeupTimer);
+	else
+		// round up to the next millisecond to make sure that the notification is due
+		TimerWheel::get().schedule(&this->wakeupTimer, (this->queue.begin()->first.epochMicroseconds() + 999) / 1000);
+}
 
-	// time correction since last calculation or doWork iteration?
-	// this may happen due to daylight saving time or timezone changes
-	// or due to system time corrections (user action, NTP etc)
-	if (abs(Poco::Timestamp() - this->lastWorkTimestamp) > Poco::Timestamp::resolution() * 5) {
-		this->logVerbose("Relevant system time change detected; recalculating schedules");
-		this->recalculateSchedules();
-	}
+void TimerPort::processDueNotifications(void) {
+	ScheduleNotification::Ptr notification;
+	while ((notification = this->dequeueNotification()))
+		this->processNotification(notification);
 
-	this->lastWorkTimestamp = Poco::Timestamp();
-	
-	// notification created due to status change?
-	if (notification.isNull())
-		// no, get next object from the priority queue
-		notification = this->queue.dequeueNotification();
+	this->updateWakeup();
+	this->updateNextOccurrence();
+}
 
-	// notification will only be a valid object if a schedule is due
-	if (notification) {
-		try {
-			ScheduleNotification::Ptr workNf = notification.cast<ScheduleNotification>();
-			Schedule* schedule = workNf->schedule;
+void TimerPort::processNotification(ScheduleNotification::Ptr notification) {
+	try {
+		Schedule* schedule = notification->schedule;
 
-			this->logVerbose(std::string("Timer reached scheduled ") + (workNf->deactivate ? "deactivation " : "")
-				+ "time for node: " + schedule->nodeName);
+		this->logVerbose(std::string("Timer reached scheduled ") + (notification->deactivate ? "deactivation " : "")
+			+ "time for node: " + schedule->nodeName);
 
-			schedule->occurrences++;
+		schedule->occurrences++;
 
-			// cause master's UI state refresh if no deactivate
-			this->refreshRequired = !workNf->deactivate;
+		// cause master's UI state refresh if no deactivate
+		this->refreshRequired = !notification->deactivate;
 
-			// calculate next occurrence depending on type; maximum ocurrences must not have been reached
-			if ((!workNf->deactivate) && (schedule->type != ONCE) 
-				&& ((schedule->maxOccurrences < 0) || (schedule->occurrences < schedule->maxOccurrences))) {
+		// calculate next occurrence depending on type; maximum ocurrences must not have been reached
+		if ((!notification->deactivate) && (schedule->type != ONCE) 
+			&& ((schedule->maxOccurrences < 0) || (schedule->occurrences < schedule->maxOccurrences))) {
 
-				Poco::Timestamp nextOccurrence = this->calculateNextOccurrence(schedule);
-				if (nextOccurrence > Poco::Timestamp()) {
-					// add with the specified occurrence time
-					this->addNotification(workNf, nextOccurrence);
-				} else {
-					// warn if unable to calculate next occurrence; except if login or logout event
-					if ((schedule->type != ONLOGIN) && (schedule->type != ONLOGOUT))
-						this->logNormal("Warning: Next scheduled time for " + schedule->nodeName + " could not be determined");
-				}
+			Poco::Timestamp nextOccurrence = this->calculateNextOccurrence(schedule);
+			if (nextOccurrence > opdi::Clock::get().now()) {
+				// add with the specified occurrence time
+				this->addNotification(notification, nextOccurrence);
+			} else {
+				// warn if unable to calculate next occurrence; except if login or logout event
+				if ((schedule->type != ONLOGIN) && (schedule->type != ONLOGOUT))
+					this->logNormal("Warning: Next scheduled time for " + schedule->nodeName + " could not be determined");
 			}
+		}
 
-			// need to deactivate?
-			if ((!workNf->deactivate) && (schedule->duration > 0)) {
-				// enqueue the notification for the deactivation
-				ScheduleNotification* notification = new ScheduleNotification(schedule, true);
-				Poco::Timestamp deacTime;
-				Poco::Timestamp::TimeDiff timediff = schedule->duration * Poco::Timestamp::resolution() / 1000;
-				deacTime += timediff;
-				Poco::DateTime deacLocal(deacTime);
-				deacLocal.makeLocal(Poco::Timezone::tzd());
-				this->logVerbose("Scheduled deactivation time for node " + schedule->nodeName + " is at: " + 
-						Poco::DateTimeFormatter::format(deacLocal, this->openhat->timestampFormat)
-						+ "; in " + this->to_string(timediff / 1000000) + " second(s)");
-				// add with the specified deactivation time
-				this->addNotification(notification, deacTime);
-			}
+		// need to deactivate?
+		if ((!notification->deactivate) && (schedule->duration > 0)) {
+			// enqueue the notification for the deactivation
+			ScheduleNotification* deactivation = new ScheduleNotification(schedule, true);
+			Poco::Timestamp deacTime = opdi::Clock::get().now();
+			Poco::Timestamp::TimeDiff timediff = schedule->duration * Poco::Timestamp::resolution() / 1000;
+			deacTime += timediff;
+			Poco::DateTime deacLocal(deacTime);
+			deacLocal.makeLocal(Poco::Timezone::tzd());
+			this->logVerbose("Scheduled deactivation time for node " + schedule->nodeName + " is at: " + 
+					Poco::DateTimeFormatter::format(deacLocal, this->openhat->timestampFormat)
+					+ "; in " + this->to_string(timediff / 1000000) + " second(s)");
+			// add with the specified deactivation time
+			this->addNotification(deactivation, deacTime);
+		}
 
-			// set the output ports' state
-			int8_t outputLine = -1;	// assume: toggle
-			if (schedule->action == SET_HIGH)
-				outputLine = (workNf->deactivate ? 0 : 1);
-			if (schedule->action == SET_LOW)
-				outputLine = (workNf->deactivate ? 1 : 0);
+		// set the output ports' state
+		int8_t outputLine = -1;	// assume: toggle
+		if (schedule->action == SET_HIGH)
+			outputLine = (notification->deactivate ? 0 : 1);
+		if (schedule->action == SET_LOW)
+			outputLine = (notification->deactivate ? 1 : 0);
 
-			this->setOutputs(outputLine);
-		} catch (Poco::Exception &e) {
-			this->logNormal("Error processing timer schedule: " + this->openhat->getExceptionMessage(e));
-		}
+		this->setOutputs(outputLine);
+	} catch (Poco::Exception &e) {
+		this->logNormal("Error processing timer schedule: " + this->openhat->getExceptionMessage(e));
 	}
+}
 
+void TimerPort::updateNextOccurrence(void) {
 	// determine next scheduled time text
 	this->nextOccurrenceStr = "";
 
 	if (this->getLine() == 1) {
+		Poco::Timestamp now = opdi::Clock::get().now();
 		// go through schedules
 		Poco::Timestamp ts = Poco::Timestamp::TIMEVAL_MAX;
-		Poco::Timestamp now;
 		auto it = this->schedules.begin();
 		auto ite = this->schedules.end();
 		// select schedule with the earliest nextEvent timestamp
@@ -801,8 +733,53 @@ uint8_t TimerPort::doWork(uint8_t canSend)  {
 			this->nextOccurrenceStr = this->nextEventText + Poco::DateTimeFormatter::format(ldt, this->timestampFormat);
 		}
 	}
+}
 
-	return OPDI_STATUS_OK;
+void TimerPort::timeChanged(const void*) {
+	// this may happen due to daylight saving time or timezone changes
+	// or due to system time corrections (user action, NTP etc)
+	if (this->getLine() != 1)
+		return;
+	this->logVerbose("Relevant system time change detected; recalculating schedules");
+	this->recalculateSchedules();
+}
+
+void TimerPort::connectionStateChanged(bool connected) {
+	// timer not active?
+	if (this->getLine() != 1)
+		return;
+
+	// check whether a schedule is specified for this event
+	auto it = this->schedules.begin();
+	auto ite = this->schedules.end();
+	while (it != ite) {
+		if ((*it).type == (connected ? ONLOGIN : ONLOGOUT)) {
+			this->logDebug("Connection status change detected; executing schedule " + (*it).nodeName + ((*it).type == ONLOGIN ? " (OnLogin)" : " (OnLogout)"));
+			// schedule found; create event notification that is processed in the next iteration of the main loop
+			this->queue.insert(NotificationQueue::value_type(opdi::Clock::get().now(), new ScheduleNotification(&*it, false)));
+			this->updateWakeup();
+			break;
+		}
+		++it;
+	}
+}
+
+void TimerPort::masterConnected(void) {
+	this->connectionStateChanged(true);
+}
+
+void TimerPort::masterDisconnected(void) {
+	this->connectionStateChanged(false);
+}
+
+TimerPort::ScheduleNotification::Ptr TimerPort::dequeueNotification(void) {
+	// return the first notification if it is due
+	auto it = this->queue.begin();
+	if ((it == this->queue.end()) || (it->first > opdi::Clock::get().now()))
+		return nullptr;
+	ScheduleNotification::Ptr result = it->second;
+	this->queue.erase(it);
+	return result;
 }
 
 void TimerPort::recalculateSchedules(Schedule* /*activatingSchedule*/) {
@@ -812,15 +789,17 @@ void TimerPort::recalculateSchedules(Schedule* /*activatingSchedule*/) {
 		Schedule* schedule = &*it;
 		// calculate
 		Poco::Timestamp nextOccurrence = this->calculateNextOccurrence(schedule);
-		if (nextOccurrence > Poco::Timestamp()) {
+		if (nextOccurrence > opdi::Clock::get().now()) {
 			// add with the specified occurrence time
 			this->addNotification(new ScheduleNotification(schedule, false), nextOccurrence);
 		} else {
 			if ((schedule->type != ONLOGIN) && (schedule->type != ONLOGOUT))
 				this->logVerbose("Next scheduled time for " + schedule->nodeName + " could not be determined");
-			schedule->nextEvent = Poco::Timestamp();
+			schedule->nextEvent = opdi::Clock::get().now();
 		}
 	}
+	this->updateWakeup();
+	this->updateNextOccurrence();
 	this->refreshRequired = true;
 }
 
@@ -834,6 +813,7 @@ bool TimerPort::setLine(uint8_t line, ChangeSource changeSource) {
 		if (!wasLow) {
 			// clear all schedules
 			this->queue.clear();
+			this->updateWakeup();
 			if (this->propagateSwitchOff)
 				this->setOutputs(0);
 		}
@@ -3,10 +3,14 @@
 // need to guard against security check warnings
 #define _SCL_SECURE_NO_WARNINGS	1
 
+#include <map>
+
 #include "Poco/Util/AbstractConfiguration.h"
-#include "Poco/TimedNotificationQueue.h"
+#include "Poco/Notification.h"
 
 #include "AbstractOpenHAT.h"
+#include "TimerWheel.h"
+#include "AstroTable.h"
 
 namespace openhat {
 
@@ -16,9 +20,10 @@ namespace openhat {
 
 	/** A TimerPort is a DigitalPort that switches other DigitalPorts on or off
 	*   according to one or more scheduled events. A TimerPort is output only.
-	*   In its doWork method the TimerPort checks whether a timestamp defined
-	*   by a schedule has been reached. If a schedule is due the line
-	*   of the output port(s) is set according to the schedule specification.
+	*   The TimerPort registers the earliest time at which a schedule is due with the
+	*   process-wide TimerWheel and does no work until this time has been reached.
+	*   If a schedule is due the line of the output port(s) is set according to the
+	*   schedule specification.
 	*   The TimerPort supports the following scheduling types:
 	*    - Once: Executes only at the specified time.
 	*    - Interval: Executes with the specifed interval.
@@ -57,14 +62,16 @@ namespace openhat {
 	*   for the event manually. There can be more than one manual schedule. The port must not be added
 	*   through the Root configuration section but is instead created by this port.
 	*/
-	class TimerPort : public opdi::DigitalPort {
+	class TimerPort : public opdi::DigitalPort, protected IConnectionListener {
 
 	protected:
 
 		// helper class
+		// The allowed values of a component are stored as a bit mask (bit i is set if the value i is allowed).
+		// This allows to find the next allowed value with a single bit scan.
 		class ScheduleComponent {
 		private:
-			std::vector<bool> values;
+			uint64_t values;
 
 		public:
 			enum Type {
@@ -81,11 +88,20 @@ namespace openhat {
 
 			static ScheduleComponent Parse(Type type, std::string def, AbstractOpenHAT* openhat);
 
-			bool getNextPossibleValue(int* currentValue, bool* rollover, bool* changed, int month, int year);
+			void setValue(int value, bool allowed);
+
+			// returns the index of the lowest set bit; the value must not be zero
+			static int lowestBit(uint64_t value);
+
+			// returns the smallest allowed value that is greater or equal to the specified value, or -1
+			int getNextValue(int value) const;
 
-			bool getFirstPossibleValue(int* value, int month, int year);
+			// returns the smallest allowed value
+			int getFirstValue(void) const;
 
-			bool hasValue(int value);
+			inline uint64_t getValues(void) const { return this->values; };
+
+			bool hasValue(int value) const;
 
 			int getMinimum(void);
 
@@ -102,12 +118,6 @@ namespace openhat {
 			MANUAL
 		};
 
-		enum AstroEvent {
-			NONE,
-			SUNRISE,
-			SUNSET
-		};
-
 		enum Action {
 			SET_HIGH,
 			SET_LOW,
@@ -142,7 +152,7 @@ namespace openhat {
 			ScheduleComponent weekdayComponent;
 
 			// parameters for ASTRONOMICAL
-			AstroEvent astroEvent;
+			AstroTable::Event astroEvent;
 			int64_t astroOffset;
 			double astroLon;
 			double astroLat;
@@ -178,6 +188,17 @@ namespace openhat {
 			};
 		};
 
+		// wakes up the timer port when the first notification of its queue is due
+		class WakeupTimer : public TimerWheel::Timer {
+			TimerPort* timerPort;
+		protected:
+			virtual void expired(void) override;
+		public:
+			WakeupTimer(TimerPort* timerPort) {
+				this->timerPort = timerPort;
+			}
+		};
+
 		AbstractOpenHAT* openhat;
 
 		typedef std::vector<Schedule> ScheduleList;
@@ -187,7 +208,12 @@ namespace openhat {
 		opdi::DigitalPortList outputPorts;
 		bool propagateSwitchOff;	// deactivates the output ports if itself being deactivated
 
-		Poco::TimedNotificationQueue queue;
+		// notifications ordered by their due time; the time is provided by the application clock
+		typedef std::multimap<Poco::Timestamp, ScheduleNotification::Ptr> NotificationQueue;
+		NotificationQueue queue;
+		WakeupTimer wakeupTimer;
+
+		ScheduleNotification::Ptr dequeueNotification(void);
 
 		Poco::Timestamp calculateNextOccurrence(Schedule* schedule);
 		std::string deactivatedText;
@@ -196,20 +222,39 @@ namespace openhat {
 		std::string timestampFormat;
 		std::string nextOccurrenceStr;
 
-		bool masterLoggedIn;
-
-		Poco::Timestamp lastWorkTimestamp;
+		bool connectionListener;
 
 		void addNotification(ScheduleNotification::Ptr notification, Poco::Timestamp timestamp);
 
-		bool matchWeekday(int day, int month, int year, ScheduleComponent* weekdayScheduleComponent);
+		// schedules the wakeup timer for the first notification of the queue
+		void updateWakeup(void);
+
+		// processes all notifications that are due; called by the wakeup timer
+		void processDueNotifications(void);
+
+		void processNotification(ScheduleNotification::Ptr notification);
+
+		void updateNextOccurrence(void);
+
+		void timeChanged(const void*);
+
+		void connectionStateChanged(bool connected);
+
+		virtual void masterConnected(void) override;
+
+		virtual void masterDisconnected(void) override;
+
+		// finds the first allowed time of day at or after the specified time; returns false if there is none
+		static bool findNextTimeOfDay(Schedule* schedule, int* hour, int* minute, int* second);
+
+		// finds the first local date and time at or after the specified one that matches the periodic schedule;
+		// returns false if the schedule can never match (for example, 30th of February)
+		static bool findNextPeriodicMatch(Schedule* schedule, int* year, int* month, int* day, int* hour, int* minute, int* second);
 
 		void recalculateSchedules(Schedule* activatingSchedule = nullptr);
 
 		void setOutputs(int8_t outputLine);
 
-		virtual uint8_t doWork(uint8_t canSend) override;
-
 	public:
 		TimerPort(AbstractOpenHAT* openhat, const char* id);
 
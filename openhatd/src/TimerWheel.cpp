@@ -0,0 +1,239 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TimerWheel.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "Clock.h"
+
+namespace openhat {
+
+static uint64_t getNowMs(void) {
+	return opdi::Clock::get().now().epochMicroseconds() / 1000;
+}
+
+TimerWheel::Timer::Timer() {
+	this->dueMs = 0;
+	this->prev = nullptr;
+	this->next = nullptr;
+	this->list = nullptr;
+}
+
+TimerWheel::Timer::~Timer() {
+	if (this->list != nullptr)
+		TimerWheel::get().cancel(this);
+}
+
+TimerWheel& TimerWheel::get(void) {
+	static TimerWheel instance;
+	return instance;
+}
+
+TimerWheel::TimerWheel() {
+	for (int level = 0; level < LEVELS; level++)
+		for (int slot = 0; slot < SLOTS; slot++)
+			this->slots[level][slot] = nullptr;
+	this->overflow = nullptr;
+	this->due = nullptr;
+	this->currentMs = 0;
+	this->lastAdvanceMs = 0;
+	this->timerCount = 0;
+	this->initialized = false;
+}
+
+void TimerWheel::link(Timer** list, Timer* timer) {
+	timer->list = list;
+	timer->prev = nullptr;
+	timer->next = *list;
+	if (*list != nullptr)
+		(*list)->prev = timer;
+	*list = timer;
+}
+
+void TimerWheel::unlink(Timer* timer) {
+	if (timer->prev != nullptr)
+		timer->prev->next = timer->next;
+	else
+		*timer->list = timer->next;
+	if (timer->next != nullptr)
+		timer->next->prev = timer->prev;
+	timer->prev = nullptr;
+	timer->next = nullptr;
+	timer->list = nullptr;
+}
+
+void TimerWheel::insert(Timer* timer) {
+	if (timer->dueMs < this->currentMs) {
+		link(&this->due, timer);
+		return;
+	}
+	uint64_t delta = timer->dueMs - this->currentMs;
+	for (int level = 0; level < LEVELS; level++) {
+		if (delta < ((uint64_t)1 << (SLOT_BITS * (level + 1)))) {
+			link(&this->slots[level][(timer->dueMs >> (SLOT_BITS * level)) & SLOT_MASK], timer);
+			return;
+		}
+	}
+	link(&this->overflow, timer);
+}
+
+void TimerWheel::cascade(Timer** list) {
+	// detach the list first because timers may be inserted into the same list again (overflow)
+	Timer* timer = *list;
+	*list = nullptr;
+	while (timer != nullptr) {
+		Timer* next = timer->next;
+		timer->prev = nullptr;
+		timer->next = nullptr;
+		timer->list = nullptr;
+		this->insert(timer);
+		timer = next;
+	}
+}
+
+void TimerWheel::rebuild(uint64_t nowMs) {
+	std::vector<Timer*> timers;
+	timers.reserve(this->timerCount);
+	for (int level = 0; level < LEVELS; level++)
+		for (int slot = 0; slot < SLOTS; slot++)
+			while (this->slots[level][slot] != nullptr) {
+				timers.push_back(this->slots[level][slot]);
+				unlink(this->slots[level][slot]);
+			}
+	while (this->overflow != nullptr) {
+		timers.push_back(this->overflow);
+		unlink(this->overflow);
+	}
+	while (this->due != nullptr) {
+		timers.push_back(this->due);
+		unlink(this->due);
+	}
+
+	this->currentMs = nowMs + 1;
+
+	// insert the latest timers first so that the earliest due timer is at the head of the due list
+	std::sort(timers.begin(), timers.end(), [](const Timer* a, const Timer* b) { return a->dueMs > b->dueMs; });
+	for (auto it = timers.begin(), ite = timers.end(); it != ite; ++it)
+		this->insert(*it);
+}
+
+int TimerWheel::expireDue(void) {
+	int result = 0;
+	while (this->due != nullptr) {
+		Timer* timer = this->due;
+		unlink(timer);
+		this->timerCount--;
+		timer->expired();
+		result++;
+	}
+	return result;
+}
+
+void TimerWheel::schedule(Timer* timer, uint64_t dueMs) {
+	if (!this->initialized) {
+		this->currentMs = this->lastAdvanceMs = getNowMs();
+		this->initialized = true;
+	}
+	if (timer->list != nullptr)
+		unlink(timer);
+	else
+		this->timerCount++;
+	timer->dueMs = dueMs;
+	this->insert(timer);
+}
+
+void TimerWheel::cancel(Timer* timer) {
+	if (timer->list == nullptr)
+		return;
+	unlink(timer);
+	this->timerCount--;
+}
+
+int TimerWheel::advance(void) {
+	uint64_t nowMs = getNowMs();
+	if (!this->initialized) {
+		this->currentMs = this->lastAdvanceMs = nowMs;
+		this->initialized = true;
+	}
+
+	// time correction since the last iteration?
+	// this may happen due to system time corrections (user action, NTP etc)
+	// (a simulated clock may advance by more than the threshold)
+	bool timeJump = !opdi::Clock::get().isSimulated()
+		&& ((nowMs < this->lastAdvanceMs) || (nowMs - this->lastAdvanceMs > TIME_JUMP_MS));
+	this->lastAdvanceMs = nowMs;
+
+	int result = 0;
+	if (this->timerCount == 0) {
+		this->currentMs = nowMs + 1;
+	} else
+	if ((nowMs + 1 < this->currentMs) || ((nowMs >= this->currentMs) && (nowMs - this->currentMs >= (uint64_t)SLOTS * SLOTS))) {
+		// the time has gone backwards or there is a large gap; stepping through the slots
+		// would take too long, therefore insert all timers again
+		this->rebuild(nowMs);
+	} else {
+		while (this->currentMs <= nowMs) {
+			// move timers of the higher levels down when the lower level wraps around
+			if ((this->currentMs & SLOT_MASK) == 0) {
+				int level = 1;
+				for (; level < LEVELS; level++) {
+					uint64_t index = (this->currentMs >> (SLOT_BITS * level)) & SLOT_MASK;
+					this->cascade(&this->slots[level][index]);
+					if (index != 0)
+						break;
+				}
+				if (level == LEVELS)
+					this->cascade(&this->overflow);
+			}
+
+			Timer** slot = &this->slots[0][this->currentMs & SLOT_MASK];
+			this->currentMs++;
+			while (*slot != nullptr) {
+				Timer* timer = *slot;
+				unlink(timer);
+				link(&this->due, timer);
+			}
+			result += this->expireDue();
+		}
+	}
+	result += this->expireDue();
+
+	if (timeJump)
+		this->timeChanged.notify(this);
+
+	return result;
+}
+
+uint64_t TimerWheel::getNextDueMs(void) const {
+	uint64_t result = UINT64_MAX;
+	for (const Timer* timer = this->due; timer != nullptr; timer = timer->next)
+		result = std::min(result, timer->dueMs);
+	// the first occupied slot of each level contains the earliest timers of this level
+	for (int level = 0; level < LEVELS; level++) {
+		uint64_t start = this->currentMs >> (SLOT_BITS * level);
+		// the current slot is cascaded when the lower levels wrap around; until then it contains
+		// the earliest timers of this level, afterwards only timers of the next turn of this level
+		// (level 0 is never cascaded)
+		bool cascaded = (this->currentMs & (((uint64_t)1 << (SLOT_BITS * level)) - 1)) != 0;
+		for (int i = 0; i < SLOTS; i++) {
+			uint64_t offset = (cascaded ? (i + 1) % SLOTS : i);
+			const Timer* timer = this->slots[level][(start + offset) & SLOT_MASK];
+			if (timer == nullptr)
+				continue;
+			for (; timer != nullptr; timer = timer->next)
+				result = std::min(result, timer->dueMs);
+			break;
+		}
+	}
+	for (const Timer* timer = this->overflow; timer != nullptr; timer = timer->next)
+		result = std::min(result, timer->dueMs);
+	return result;
+}
+
+}		// namespace openhat
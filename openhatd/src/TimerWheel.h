@@ -0,0 +1,116 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Poco/BasicEvent.h"
+
+namespace openhat {
+
+/// A hierarchical timer wheel that serves all ports of the process that need to do something
+/// at a certain point in time. Ports schedule a Timer and are called back when it expires, so they
+/// do not need to check the time in every doWork iteration.
+/// The wheel has a resolution of one millisecond. It consists of four levels of 256 slots each;
+/// timers that are due in more than about 49 days are kept in an overflow list.
+/// The wheel is advanced by the main loop using the application clock (opdi::Clock). It is not
+/// thread-safe; timers must be scheduled and cancelled in the main thread only.
+class TimerWheel {
+public:
+	/// Base class for timers. A timer is cancelled automatically when it is destroyed.
+	class Timer {
+		friend class TimerWheel;
+
+		uint64_t dueMs;
+		Timer* prev;
+		Timer* next;
+		Timer** list;		// head of the list that currently contains the timer
+
+	protected:
+		/// Called by the main loop when the due time has been reached.
+		/// The timer may be rescheduled from within this method.
+		virtual void expired(void) = 0;
+
+	public:
+		Timer();
+
+		virtual ~Timer();
+
+		/// Returns true if the timer is scheduled and has not yet expired.
+		inline bool isScheduled(void) const { return this->list != nullptr; };
+
+		/// Returns the time (in milliseconds since the epoch) at which the timer is due.
+		inline uint64_t getDueMs(void) const { return this->dueMs; };
+	};
+
+	/// Is fired if a jump of the system time has been detected (for example, due to a manual change
+	/// or an NTP correction). Timers are not changed by this; listeners should recalculate their
+	/// points in time and reschedule their timers.
+	Poco::BasicEvent<void> timeChanged;
+
+	/// Returns the process-wide instance.
+	static TimerWheel& get(void);
+
+	/// Schedules the timer at the specified time (milliseconds since the epoch).
+	/// If the timer is already scheduled it is moved. A time in the past expires on the next advance().
+	void schedule(Timer* timer, uint64_t dueMs);
+
+	/// Cancels the timer if it is scheduled.
+	void cancel(Timer* timer);
+
+	/// Advances the wheel to the current time of the application clock and calls expired()
+	/// on all timers that are due. Returns the number of expired timers.
+	int advance(void);
+
+	/// Returns the time of the earliest scheduled timer, or UINT64_MAX if no timer is scheduled.
+	uint64_t getNextDueMs(void) const;
+
+	/// Returns the number of scheduled timers.
+	inline size_t getTimerCount(void) const { return this->timerCount; };
+
+protected:
+	enum {
+		SLOT_BITS = 8,
+		SLOTS = 1 << SLOT_BITS,
+		SLOT_MASK = SLOTS - 1,
+		LEVELS = 4
+	};
+
+	// threshold for a jump of the system time
+	static const uint64_t TIME_JUMP_MS = 5000;
+
+	Timer* slots[LEVELS][SLOTS];
+	Timer* overflow;
+	Timer* due;				// timers that are due in the current advance()
+	uint64_t currentMs;		// the next millisecond to process
+	uint64_t lastAdvanceMs;
+	size_t timerCount;
+	bool initialized;
+
+	TimerWheel();
+
+	static void link(Timer** list, Timer* timer);
+
+	static void unlink(Timer* timer);
+
+	// puts the timer into the list that corresponds to its due time
+	void insert(Timer* timer);
+
+	// moves the timers of the specified list to their new positions
+	void cascade(Timer** list);
+
+	// removes all timers and inserts them again relative to the specified time;
+	// timers that are due are sorted by their due time
+	void rebuild(uint64_t nowMs);
+
+	// calls expired() on all timers of the due list
+	int expireDue(void);
+};
+
+}		// namespace openhat
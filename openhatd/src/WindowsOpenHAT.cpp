@@ -3,6 +3,7 @@
 #include <iostream>
 #include <Windows.h>
 #include <winsock2.h>
+#include <psapi.h>
 
 #include "Poco/Stopwatch.h"
 #include "Poco/Format.h"
@@ -162,7 +163,9 @@ static uint8_t io_receive(void* info, uint8_t* byte, uint16_t timeout, uint8_t c
 			uint8_t waitResult = Opdi->doWork(canSend, &sleepTimeMs);
 			if (waitResult != OPDI_STATUS_OK)
 				return waitResult;
-			Sleep(sleepTimeMs);
+			// don't wait in simulated time
+			if (!opdi::Clock::get().isSimulated())
+				Sleep(sleepTimeMs);
 		}
 	}
 
@@ -323,7 +326,9 @@ int WindowsOpenHAT::setupTCP(const std::string& interface_, int port) {
 					if (waitResult != OPDI_STATUS_OK)
 						return waitResult;
 
-					Sleep(sleepTimeMs);
+					// don't wait in simulated time
+					if (!opdi::Clock::get().isSimulated())
+						Sleep(sleepTimeMs);
 				} else 
 					this->logError(std::string("Error accepting connection: ") + this->to_string(lastError));
 			} else {
@@ -381,6 +386,15 @@ IOpenHATPlugin* WindowsOpenHAT::getPlugin(const std::string& driver) {
 }
 
 
+uint64_t WindowsOpenHAT::getPeakMemoryUsage(void) {
+#pragma comment(lib, "psapi")
+
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+}
+
 std::string WindowsOpenHAT::getCurrentUser(void) {
 #define COUNTOF(x)  (sizeof(x)/sizeof(x[0]))
 
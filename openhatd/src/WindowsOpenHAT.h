@@ -38,6 +38,8 @@ public:
 	virtual std::string getCurrentUser(void) override;
 
 	virtual void switchToUser(const std::string& newUser) override;
+
+	virtual uint64_t getPeakMemoryUsage(void) override;
 };
 
 // The plugin DLL entry function that returns the plugin instance
@@ -44,7 +44,7 @@ PPATHBASE = $(OPDI_CORE_PATH)/code/c/platforms
 PPATH = $(PPATHBASE)/$(PLATFORM)
 
 # List C source files of the configuration here.
-SRC = LinuxOpenHAT.cpp Configuration.cpp SunRiseSet.cpp TimerPort.cpp ExpressionPort.cpp ExecPort.cpp
+SRC = LinuxOpenHAT.cpp Configuration.cpp SunRiseSet.cpp AstroTable.cpp TimerPort.cpp ExpressionPort.cpp ExecPort.cpp BinaryLog.cpp Clock.cpp FileWatcher.cpp TimerWheel.cpp ProcessSupervisor.cpp StreamFramer.cpp
 
 # platform specific files
 SRC += $(PPATH)/opdi_platformfuncs.c
@@ -148,6 +148,30 @@ $(TARGET): $(OBJECTS)
 plugins:
 	$(MAKE) -C ../plugins -f $(MAKEFILE)
 
+# test programs of the automatic test suite use all sources except the main program
+TEST_OBJECTS = $(filter-out ./openhat_linux.cpp,$(OBJECTS))
+
+history-test: $(TEST_OBJECTS) ../testconfigs/automatic/history_test.cpp
+	$(CC) $(CFLAGS) $(TEST_OBJECTS) ../testconfigs/automatic/history_test.cpp -o openhat-history-test $(POCOLIBS) $(LIBS) $(LDFLAGS)
+
+binarylog-test: $(TEST_OBJECTS) ../testconfigs/automatic/binarylog_test.cpp
+	$(CC) $(CFLAGS) $(TEST_OBJECTS) ../testconfigs/automatic/binarylog_test.cpp -o openhat-binarylog-test $(POCOLIBS) $(LIBS) $(LDFLAGS)
+
+streamframer-test: $(TEST_OBJECTS) ../testconfigs/automatic/streamframer_test.cpp
+	$(CC) $(CFLAGS) $(TEST_OBJECTS) ../testconfigs/automatic/streamframer_test.cpp -o openhat-streamframer-test $(POCOLIBS) $(LIBS) $(LDFLAGS)
+
+# reader tool for binary Logger port files
+logreader: BinaryLog.cpp openhat_logreader.cpp
+	$(CC) $(CFLAGS) BinaryLog.cpp openhat_logreader.cpp -o openhat-logreader -lPocoFoundation $(LDFLAGS)
+
+# test for the timer wheel (run by the tests target)
+timerwheel-test: TimerWheel.cpp Clock.cpp ../testconfigs/timerwheel_test.cpp
+	$(CC) $(CFLAGS) TimerWheel.cpp Clock.cpp $(PPATH)/opdi_platformfuncs.c ../testconfigs/timerwheel_test.cpp -o openhat-timerwheel-test -lPocoFoundation $(LDFLAGS)
+
+# fuzz test for the periodic Timer port schedules (uses all sources except the main program)
+periodic-fuzz: $(TEST_OBJECTS) ../testconfigs/benchmark/periodic_fuzz.cpp
+	$(CC) $(CFLAGS) $(TEST_OBJECTS) ../testconfigs/benchmark/periodic_fuzz.cpp -o openhat-periodic-fuzz $(POCOLIBS) $(LIBS) $(LDFLAGS)
+
 docs:
 ifneq (,$(wildcard ./openhatd-docs-$(VERSION).tar.gz))
 	@echo Documentation already exists, skipping build.
@@ -200,13 +224,24 @@ endif
 	md5sum $(TARFOLDER).tar.gz > $(TARFOLDER).tar.gz.md5
 	@echo Done.
 
-tests:
+tests: history-test binarylog-test streamframer-test timerwheel-test
+	./openhat-history-test
+	./openhat-binarylog-test
+	./openhat-streamframer-test
+	./openhat-timerwheel-test
 	./$(TARGET) -c hello-world.ini -t -q
 	./$(TARGET) -c ../testconfigs/dev.ini -t -q
 	./$(TARGET) -c ../testconfigs/linux_test.ini -t -q
 	./$(TARGET) -c ../testconfigs/weather_test.ini -t -q
 	./$(TARGET) -c ../testconfigs/window_test.ini -t -q
 	./$(TARGET) -c ../testconfigs/testconfig.ini -t -q
+	sh ../testconfigs/automatic/run_tests.sh ./$(TARGET)
+
+benchmarks: periodic-fuzz
+	./openhat-periodic-fuzz 1000000
+	sh ../testconfigs/benchmark/expression_startup.sh ./$(TARGET) 1000
+	sh ../testconfigs/benchmark/port_engine.sh ./$(TARGET)
+	sh ../testconfigs/benchmark/file_watch.sh ./$(TARGET)
 
 clean:
 	find ../plugins/ -name '*.so' -exec rm {} \;
@@ -34,6 +34,13 @@ void signal_handler_term(int) {
     }
 }
 
+void signal_handler_hup(int) {
+	// tell the OPDI system to reload the configuration
+	if (Opdi != NULL) {
+		Opdi->requestReload();
+	}
+}
+
 void signal_handler_abrt(int signum) {
 	const int BACKTRACE_LEVELS = 10;
 	void* array[BACKTRACE_LEVELS];
@@ -68,11 +75,19 @@ int main(int argc, char* argv[], char* envp[])
 	sigIntHandler.sa_flags = 0;
 	sigaction(SIGTERM, &sigIntHandler, NULL);
 
+	sigIntHandler.sa_handler = signal_handler_hup;
+	sigemptyset(&sigIntHandler.sa_mask);
+	sigIntHandler.sa_flags = 0;
+	sigaction(SIGHUP, &sigIntHandler, NULL);
+
 	sigIntHandler.sa_handler = signal_handler_abrt;
 	sigemptyset(&sigIntHandler.sa_mask);
 	sigIntHandler.sa_flags = 0;
 	sigaction(SIGABRT, &sigIntHandler, NULL);
 
+	// writing to a worker process that has terminated must not terminate openhatd
+	signal(SIGPIPE, SIG_IGN);
+
 	// convert arguments to vector list
 	std::vector<std::string> args;
 	args.reserve(argc);
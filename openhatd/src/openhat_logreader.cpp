@@ -0,0 +1,145 @@
+// Command line tool that extracts data from binary log files written by the Logger port.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cmath>
+
+#include "Poco/Exception.h"
+#include "Poco/NumberParser.h"
+#include "Poco/StringTokenizer.h"
+#include "Poco/Timestamp.h"
+#include "Poco/LocalDateTime.h"
+#include "Poco/DateTimeParser.h"
+#include "Poco/DateTimeFormat.h"
+#include "Poco/DateTimeFormatter.h"
+
+#include "BinaryLog.h"
+
+static void usage(void) {
+	std::cout << "Usage: openhat-logreader <file> [options]" << std::endl;
+	std::cout << "Extracts rows from a binary Logger port file as CSV." << std::endl;
+	std::cout << std::endl;
+	std::cout << "  -f <time>      start of the time range (inclusive)" << std::endl;
+	std::cout << "  -t <time>      end of the time range (inclusive)" << std::endl;
+	std::cout << "  -c <columns>   comma separated list of columns (port IDs) to extract" << std::endl;
+	std::cout << "  -s <sep>       separator (default: ;)" << std::endl;
+	std::cout << "  -r             output raw timestamps (milliseconds since the epoch)" << std::endl;
+	std::cout << "  -i             print the block index instead of the data" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Times can be specified as milliseconds since the epoch or as local time" << std::endl;
+	std::cout << "in the format 'YYYY-MM-DD HH:MM:SS'." << std::endl;
+}
+
+static int64_t parseTime(const std::string& str) {
+	int64_t result;
+	if (Poco::NumberParser::tryParse64(str, result))
+		return result;
+	Poco::DateTime dt;
+	int tzd;
+	if (!Poco::DateTimeParser::tryParse(Poco::DateTimeFormat::SORTABLE_FORMAT, str, dt, tzd))
+		throw Poco::InvalidArgumentException("Invalid time: " + str);
+	// interpret as local time
+	Poco::LocalDateTime ldt(dt.year(), dt.month(), dt.day(), dt.hour(), dt.minute(), dt.second());
+	return ldt.timestamp().epochMicroseconds() / 1000;
+}
+
+static std::string formatTime(int64_t time, bool raw) {
+	if (raw)
+		return std::to_string(time);
+	return Poco::DateTimeFormatter::format(Poco::LocalDateTime(Poco::Timestamp(time * 1000)), "%Y-%m-%d %H:%M:%S.%i");
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+
+	std::string fileName;
+	int64_t from = std::numeric_limits<int64_t>::min();
+	int64_t to = std::numeric_limits<int64_t>::max();
+	std::vector<std::string> columns;
+	std::string separator = ";";
+	bool raw = false;
+	bool index = false;
+
+	try {
+		for (int i = 1; i < argc; i++) {
+			std::string arg(argv[i]);
+			if ((arg == "-f") && (i + 1 < argc))
+				from = parseTime(argv[++i]);
+			else
+			if ((arg == "-t") && (i + 1 < argc))
+				to = parseTime(argv[++i]);
+			else
+			if ((arg == "-c") && (i + 1 < argc)) {
+				Poco::StringTokenizer tok(argv[++i], ",", Poco::StringTokenizer::TOK_TRIM | Poco::StringTokenizer::TOK_IGNORE_EMPTY);
+				columns.assign(tok.begin(), tok.end());
+			} else
+			if ((arg == "-s") && (i + 1 < argc))
+				separator = argv[++i];
+			else
+			if (arg == "-r")
+				raw = true;
+			else
+			if (arg == "-i")
+				index = true;
+			else
+			if ((arg == "-h") || (arg == "-?")) {
+				usage();
+				return 0;
+			} else
+			if (fileName.empty() && (arg[0] != '-'))
+				fileName = arg;
+			else
+				throw Poco::InvalidArgumentException("Invalid argument: " + arg);
+		}
+		if (fileName.empty())
+			throw Poco::InvalidArgumentException("No file specified");
+
+		openhat::BinaryLogReader reader(fileName);
+		if (reader.isTruncated())
+			std::cerr << "Warning: The file ends with an incomplete record" << std::endl;
+
+		if (index) {
+			std::cout << "Block" << separator << "Segment" << separator << "Offset" << separator << "Size" << separator << "Rows" << separator << "From" << separator << "To" << std::endl;
+			const std::vector<openhat::BinaryLogReader::Block>& blocks = reader.getBlocks();
+			for (size_t b = 0; b < blocks.size(); b++) {
+				std::cout << b << separator << blocks[b].segment << separator << blocks[b].offset << separator << blocks[b].payloadSize << separator
+					<< blocks[b].rowCount << separator << formatTime(blocks[b].firstTimestamp, raw) << separator << formatTime(blocks[b].lastTimestamp, raw) << std::endl;
+			}
+			return 0;
+		}
+
+		std::vector<std::string> lastColumns;
+		bool headerWritten = false;
+		reader.read(from, to, columns, [&](const std::vector<std::string>& rowColumns, int64_t timestamp, const std::vector<double>& values) {
+			// print a header whenever the columns change
+			if (!headerWritten || (lastColumns != rowColumns)) {
+				std::cout << "Timestamp";
+				for (auto it = rowColumns.cbegin(); it != rowColumns.cend(); ++it)
+					std::cout << separator << *it;
+				std::cout << std::endl;
+				lastColumns = rowColumns;
+				headerWritten = true;
+			}
+			std::cout << formatTime(timestamp, raw);
+			for (auto it = values.cbegin(); it != values.cend(); ++it) {
+				std::cout << separator;
+				if (!std::isnan(*it))
+					std::cout << *it;
+			}
+			std::cout << '\n';
+		});
+	} catch (Poco::Exception& e) {
+		std::cerr << e.displayText() << std::endl;
+		return 1;
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
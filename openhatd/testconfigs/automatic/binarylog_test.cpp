@@ -0,0 +1,216 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Roundtrip test for the binary log format. Writes files the way the Logger port does (several
+// writers appending to the same file, some of which are interrupted before they can append the
+// index record) and checks that the reader returns exactly the rows that have been written,
+// that it uses the index records, and that it detects incomplete blocks.
+// Build with "make binarylog-test"; exits with code 1 if a check fails.
+
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "Poco/TemporaryFile.h"
+
+#include "AbstractOpenHAT.h"
+#include "BinaryLog.h"
+
+// defined by the main program of openhatd
+openhat::AbstractOpenHAT* Opdi = nullptr;
+
+using namespace openhat;
+
+namespace {
+
+int failed = 0;
+
+struct Row {
+	std::vector<std::string> columns;
+	int64_t timestamp;
+	std::vector<double> values;
+
+	bool operator==(const Row& other) const {
+		if ((this->columns != other.columns) || (this->timestamp != other.timestamp) || (this->values.size() != other.values.size()))
+			return false;
+		for (size_t i = 0; i < this->values.size(); i++) {
+			// compare the bits so that NaN is equal to NaN
+			if (memcmp(&this->values[i], &other.values[i], sizeof(double)) != 0)
+				return false;
+		}
+		return true;
+	}
+};
+
+// appends the records of one writer to data; the writer is interrupted before closing the file if
+// closeFile is false
+void writeSession(std::string& data, const std::vector<std::string>& columns, size_t blockRows, int64_t start, int rows,
+		bool closeFile, std::vector<Row>& expected) {
+	BinaryLogWriter writer(columns, blockRows);
+	BinaryLogIndex index;
+	index.reset(data.size());
+
+	std::vector<std::string> records;
+	records.push_back(writer.getSegmentHeader());
+	for (int r = 0; r < rows; r++) {
+		std::vector<double> values;
+		for (size_t c = 0; c < columns.size(); c++) {
+			// include unavailable values, unchanged values and values with different exponents
+			if ((r + c) % 7 == 3)
+				values.push_back(std::numeric_limits<double>::quiet_NaN());
+			else
+				values.push_back((r / 2) * std::pow(10.0, (double)c) - 0.5 * c);
+		}
+		int64_t timestamp = start + r * 1000 + (r % 3);
+		writer.addRow(timestamp, values);
+		expected.push_back({columns, timestamp, values});
+		if (writer.isBlockFull())
+			records.push_back(writer.encodeBlock());
+	}
+	if (writer.getRowCount() > 0)
+		records.push_back(writer.encodeBlock());
+
+	for (auto it = records.cbegin(); it != records.cend(); ++it) {
+		data.append(*it);
+		index.add(*it);
+	}
+	if (closeFile)
+		data.append(index.encode());
+}
+
+std::vector<Row> readRows(const std::string& fileName, int64_t from, int64_t to, const std::vector<std::string>& columns, BinaryLogReader** readerResult = nullptr) {
+	std::vector<Row> result;
+	BinaryLogReader* reader = new BinaryLogReader(fileName);
+	reader->read(from, to, columns, [&result](const std::vector<std::string>& columns, int64_t timestamp, const std::vector<double>& values) {
+		result.push_back({columns, timestamp, values});
+	});
+	if (readerResult != nullptr)
+		*readerResult = reader;
+	else
+		delete reader;
+	return result;
+}
+
+void writeFile(const std::string& fileName, const std::string& data) {
+	std::ofstream file(fileName, std::ios_base::binary | std::ios_base::trunc);
+	file << data;
+}
+
+void check(const char* name, bool condition) {
+	if (!condition) {
+		printf("FAILED: %s\n", name);
+		failed++;
+	}
+}
+
+void checkRows(const char* name, const std::vector<Row>& rows, const std::vector<Row>& expected) {
+	if (rows.size() != expected.size()) {
+		printf("FAILED: %s: %llu rows, expected %llu\n", name, (unsigned long long)rows.size(), (unsigned long long)expected.size());
+		failed++;
+		return;
+	}
+	for (size_t i = 0; i < rows.size(); i++) {
+		if (!(rows[i] == expected[i])) {
+			printf("FAILED: %s: row %llu (timestamp %lld) differs\n", name, (unsigned long long)i, (long long)expected[i].timestamp);
+			failed++;
+			return;
+		}
+	}
+}
+
+}		// namespace
+
+int main(int /*argc*/, char** /*argv*/) {
+	Poco::TemporaryFile tempFile;
+	std::string fileName = tempFile.path();
+	const int64_t start = 1500000000000;
+
+	try {
+		// two writers that have closed the file
+		std::string data;
+		std::vector<Row> expected;
+		writeSession(data, {"A", "B"}, 3, start, 10, true, expected);
+		size_t secondSession = data.size();
+		writeSession(data, {"A"}, 4, start + 100000, 9, true, expected);
+		writeFile(fileName, data);
+
+		BinaryLogReader* reader;
+		checkRows("closed", readRows(fileName, INT64_MIN, INT64_MAX, {}, &reader), expected);
+		check("closed: segments", reader->getSegments().size() == 2);
+		check("closed: blocks", reader->getBlocks().size() == 4 + 3);
+		check("closed: not truncated", !reader->isTruncated());
+		delete reader;
+
+		// time range and column selection
+		std::vector<Row> range;
+		for (auto it = expected.cbegin(); it != expected.cend(); ++it)
+			if ((it->timestamp >= start + 2500) && (it->timestamp <= start + 100000 + 3000))
+				range.push_back({{"B", "X"}, it->timestamp, {it->columns.size() > 1 ? it->values[1] : std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN()}});
+		checkRows("range", readRows(fileName, start + 2500, start + 100000 + 3000, {"B", "X"}), range);
+
+		// the blocks are found using the index records, so the block headers are not read
+		std::string corrupted(data);
+		for (size_t pos = corrupted.find(binarylog::BLOCK_MAGIC); pos != std::string::npos; pos = corrupted.find(binarylog::BLOCK_MAGIC, pos + 4))
+			memcpy(&corrupted[pos], "XXXX", 4);
+		writeFile(fileName, corrupted);
+		checkRows("index used", readRows(fileName, INT64_MIN, INT64_MAX, {}), expected);
+
+		// an interrupted writer is followed by a writer that has closed the file; the beginning
+		// of the file is scanned, the rest is read from the index
+		data.clear();
+		expected.clear();
+		writeSession(data, {"A", "B"}, 3, start, 10, true, expected);
+		writeSession(data, {"B", "C"}, 5, start + 50000, 12, false, expected);
+		writeSession(data, {"A"}, 4, start + 100000, 9, true, expected);
+		writeFile(fileName, data);
+		checkRows("interrupted", readRows(fileName, INT64_MIN, INT64_MAX, {}, &reader), expected);
+		check("interrupted: segments", reader->getSegments().size() == 3);
+		check("interrupted: blocks", reader->getBlocks().size() == 4 + 3 + 3);
+		check("interrupted: not truncated", !reader->isTruncated());
+		delete reader;
+
+		// the last writer has been interrupted while writing a block
+		data.clear();
+		expected.clear();
+		writeSession(data, {"A", "B"}, 3, start, 10, true, expected);
+		std::vector<Row> interrupted;
+		writeSession(data, {"A"}, 4, start + 100000, 9, false, interrupted);
+		data.resize(data.size() - 3);
+		// the complete blocks of the interrupted writer can be read
+		expected.insert(expected.end(), interrupted.begin(), interrupted.begin() + 8);
+		writeFile(fileName, data);
+		checkRows("truncated", readRows(fileName, INT64_MIN, INT64_MAX, {}, &reader), expected);
+		check("truncated: blocks", reader->getBlocks().size() == 4 + 2);
+		check("truncated: detected", reader->isTruncated());
+		delete reader;
+
+		// the index record of the first writer is skipped when scanning
+		data.resize(secondSession);
+		data.append(data.substr(0, secondSession - binarylog::TRAILER_SIZE));
+		expected.clear();
+		std::vector<Row> first;
+		{
+			std::string unused;
+			writeSession(unused, {"A", "B"}, 3, start, 10, true, first);
+		}
+		expected = first;
+		expected.insert(expected.end(), first.begin(), first.end());
+		writeFile(fileName, data);
+		checkRows("skipped index record", readRows(fileName, INT64_MIN, INT64_MAX, {}), expected);
+	} catch (Poco::Exception& e) {
+		printf("FAILED: %s\n", e.displayText().c_str());
+		failed++;
+	}
+
+	printf("Binary log test: %d check(s) failed\n", failed);
+	return failed > 0 ? 1 : 0;
+}
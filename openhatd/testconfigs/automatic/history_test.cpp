@@ -0,0 +1,131 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Test for the incremental port history. Appends values to the history of a port and checks
+// that getHistoryDelta returns exactly the values after the requested sequence number, and that
+// the client is told to discard its copy when the series can't be continued.
+// Build with "make history-test"; exits with code 1 if a check fails.
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "AbstractOpenHAT.h"
+
+// defined by the main program of openhatd
+openhat::AbstractOpenHAT* Opdi = nullptr;
+
+namespace {
+
+int failed = 0;
+
+// decodes the zigzag varint deltas
+std::vector<int64_t> decode(const std::string& data) {
+	std::vector<int64_t> result;
+	uint64_t previous = 0;
+	size_t pos = 0;
+	while (pos < data.size()) {
+		uint64_t zigzag = 0;
+		int shift = 0;
+		uint8_t byte;
+		do {
+			byte = (uint8_t)data[pos++];
+			zigzag |= (uint64_t)(byte & 0x7F) << shift;
+			shift += 7;
+		} while ((byte & 0x80) && (pos < data.size()));
+		uint64_t diff = (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+		previous += diff;
+		result.push_back((int64_t)previous);
+	}
+	return result;
+}
+
+std::string toString(const std::vector<int64_t>& values) {
+	std::string result;
+	for (size_t i = 0; i < values.size(); i++)
+		result += (i > 0 ? "," : "") + std::to_string(values[i]);
+	return result;
+}
+
+// requests the values after sinceSeq and compares them with the expected result
+void check(const char* name, const opdi::Port& port, uint64_t sinceSeq, bool expectedReset, uint64_t expectedFirstSeq, const std::vector<int64_t>& expectedValues) {
+	uint64_t firstSeq;
+	size_t count;
+	bool reset;
+	std::vector<int64_t> values = decode(port.getHistoryDelta(sinceSeq, &firstSeq, &count, &reset));
+	if ((reset != expectedReset) || (firstSeq != expectedFirstSeq) || (count != values.size()) || (values != expectedValues)) {
+		printf("FAILED: %s: since %llu: reset %d, firstSeq %llu, count %llu, values %s; expected reset %d, firstSeq %llu, values %s\n",
+			name, (unsigned long long)sinceSeq, reset, (unsigned long long)firstSeq, (unsigned long long)count, toString(values).c_str(),
+			expectedReset, (unsigned long long)expectedFirstSeq, toString(expectedValues).c_str());
+		failed++;
+	}
+}
+
+void checkEqual(const char* name, const std::string& value, const std::string& expected) {
+	if (value != expected) {
+		printf("FAILED: %s: '%s', expected '%s'\n", name, value.c_str(), expected.c_str());
+		failed++;
+	}
+}
+
+}		// namespace
+
+int main(int /*argc*/, char** /*argv*/) {
+	opdi::DialPort port("History");
+
+	// no history yet
+	check("empty", port, 0, false, 1, {});
+
+	// the first value starts a new series (sequence number 1 marks the reset)
+	port.appendHistory(1, 5, 10);
+	port.appendHistory(1, 5, 12);
+	port.appendHistory(1, 5, 9);
+	checkEqual("seq", std::to_string(port.getHistorySeq()), "4");
+	checkEqual("history", port.getHistory(), "interval=1;maxCount=5;values=10,12,9");
+	check("new client", port, 0, true, 2, {10, 12, 9});
+	check("continued", port, 2, false, 3, {12, 9});
+	check("up to date", port, 4, false, 5, {});
+	check("ahead", port, 10, true, 2, {10, 12, 9});
+
+	// the oldest values are dropped when maxCount is exceeded
+	port.appendHistory(1, 5, 20);
+	port.appendHistory(1, 5, 21);
+	port.appendHistory(1, 5, 22);
+	port.appendHistory(1, 5, 23);
+	checkEqual("history after drop", port.getHistory(), "interval=1;maxCount=5;values=9,20,21,22,23");
+	check("dropped", port, 2, true, 4, {9, 20, 21, 22, 23});
+	check("oldest retained", port, 3, false, 4, {9, 20, 21, 22, 23});
+	check("after drop", port, 5, false, 6, {21, 22, 23});
+
+	// differences that exceed the value range wrap around
+	port.appendHistory(1, 5, INT64_MIN);
+	port.appendHistory(1, 5, INT64_MAX);
+	port.appendHistory(1, 5, -1);
+	check("extreme values", port, 8, false, 9, {INT64_MIN, INT64_MAX, -1});
+
+	// changed parameters start a new series
+	uint64_t seq = port.getHistorySeq();
+	port.appendHistory(2, 5, 7);
+	check("new interval", port, seq, true, seq + 2, {7});
+	checkEqual("history with new interval", port.getHistory(), "interval=2;maxCount=5;values=7");
+
+	// replacing the history starts a new series
+	seq = port.getHistorySeq();
+	port.setHistory(60, 3, {1, 2, 3});
+	check("replaced", port, seq, true, seq + 2, {1, 2, 3});
+	check("replaced continued", port, seq + 2, false, seq + 3, {2, 3});
+
+	// clearing the history invalidates all copies
+	seq = port.getHistorySeq();
+	port.clearHistory();
+	checkEqual("cleared history", port.getHistory(), "");
+	check("cleared", port, seq, true, seq + 2, {});
+
+	printf("History test: %d check(s) failed\n", failed);
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Runs the automatic test suite.
+# Usage: run_tests.sh <openhatd binary>
+#
+# Each test_*.ini file in this folder is run in simulated time with a temporary working directory.
+# It must terminate by itself, either by a failing test or by a Test port with ExitAfterTest = True.
+# Each test_*.sh script is run with the absolute path of the binary as its only argument; it sets up
+# its scenario, runs openhatd and checks the results. It exits with a non-zero code on failure.
+# The script prints one line per test and exits with code 1 if any test has failed.
+
+BINARY=$1
+
+if [ -z "$BINARY" ]; then
+	echo "Usage: $0 <openhatd binary>" >&2
+	exit 1
+fi
+
+# the tests are run in different working directories
+BINARY=$(cd "$(dirname "$BINARY")" && pwd)/$(basename "$BINARY")
+TESTDIR=$(cd "$(dirname "$0")" && pwd)
+
+# a test that does not terminate is aborted after this time
+TIMEOUT=""
+if command -v timeout > /dev/null 2>&1; then
+	TIMEOUT="timeout 300"
+fi
+
+failed=0
+count=0
+
+for test in "$TESTDIR"/test_*.ini "$TESTDIR"/test_*.sh; do
+	[ -f "$test" ] || continue
+	name=$(basename "$test")
+	count=$((count + 1))
+	DIR=$(mktemp -d /tmp/openhat_test_XXXXXX)
+	case "$test" in
+		*.ini)
+			(cd "$DIR" && $TIMEOUT "$BINARY" -c "$test" -s "2017-01-01 00:00:00" -q > "$DIR/output.txt" 2>&1)
+			result=$?
+			# a Test port with ExitAfterTest = True exits with code 129 (OPENHATD_TEST_EXIT)
+			# if openhatd waits for a connection, otherwise with code 0
+			if [ $result -eq 129 ]; then
+				result=0
+			fi
+			;;
+		*.sh)
+			(cd "$DIR" && $TIMEOUT sh "$test" "$BINARY" > "$DIR/output.txt" 2>&1)
+			result=$?
+			;;
+	esac
+	if [ $result -eq 0 ]; then
+		echo "PASSED: $name"
+	else
+		echo "FAILED: $name (exit code $result)"
+		cat "$DIR/output.txt"
+		failed=$((failed + 1))
+	fi
+	rm -rf "$DIR"
+done
+
+echo "Automatic tests: $count test(s), $failed failed"
+if [ $failed -gt 0 ]; then
+	exit 1
+fi
+exit 0
@@ -0,0 +1,235 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Test for the framing and parsing of serial streams. Checks the CRC-16/X.25 checksum, the
+// escape sequences of the Delimiter setting, the SML transport (escaped data, checksums and
+// data that is received in pieces) and the OBIS parser with SML messages and D0 text lines.
+// Build with "make streamframer-test"; exits with code 1 if a check fails.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "AbstractOpenHAT.h"
+#include "Ports.h"
+#include "StreamFramer.h"
+
+// defined by the main program of openhatd
+openhat::AbstractOpenHAT* Opdi = nullptr;
+
+using namespace openhat;
+
+namespace {
+
+int failed = 0;
+
+// collects the received frames
+class FrameCollector : public StreamFramer::IListener {
+public:
+	std::vector<std::string> frames;
+
+	virtual void frameReceived(const char* frame, size_t length) override {
+		this->frames.push_back(std::string(frame, length));
+	}
+};
+
+// an OBIS parser whose values are set directly instead of being configured
+class TestParser : public ObisParser {
+public:
+	TestParser(opdi::Port* owner, bool sml) : ObisParser(nullptr) {
+		this->owner = owner;
+		this->sml = sml;
+	}
+
+	void addValue(const std::string& code, double factor, opdi::DialPort* port) {
+		Value value;
+		value.portID = port->ID();
+		value.code = code;
+		value.factor = factor;
+		value.port = port;
+		this->values.push_back(value);
+	}
+};
+
+void check(const char* name, bool condition) {
+	if (!condition) {
+		printf("FAILED: %s\n", name);
+		failed++;
+	}
+}
+
+void checkPosition(const char* name, const opdi::DialPort& port, int64_t expected) {
+	if (port.getPosition() != expected) {
+		printf("FAILED: %s: %lld, expected %lld\n", name, (long long)port.getPosition(), (long long)expected);
+		failed++;
+	}
+}
+
+void checkFrames(const char* name, const std::vector<std::string>& frames, const std::vector<std::string>& expected) {
+	if (frames != expected) {
+		printf("FAILED: %s: %llu frame(s), expected %llu\n", name, (unsigned long long)frames.size(), (unsigned long long)expected.size());
+		failed++;
+	}
+}
+
+bool unescapeFails(const std::string& text) {
+	try {
+		StreamFramer::unescape(text);
+	} catch (Poco::DataFormatException&) {
+		return true;
+	}
+	return false;
+}
+
+// builds an SML transport message with the specified payload; the checksum is appended in
+// big-endian byte order unless littleEndian is true
+std::string smlMessage(const std::string& payload, bool littleEndian = false) {
+	const std::string escape("\x1b\x1b\x1b\x1b", 4);
+	std::string result(escape + "\x01\x01\x01\x01");
+	size_t padding = (4 - payload.size() % 4) % 4;
+	std::string data(payload + std::string(padding, '\0'));
+	for (size_t i = 0; i < data.size(); i += 4) {
+		std::string group(data.substr(i, 4));
+		result += group;
+		if (group == escape)
+			result += escape;
+	}
+	result += escape + "\x1a" + (char)padding;
+	uint16_t crc = StreamFramer::crc16((const uint8_t*)result.data(), result.size());
+	if (littleEndian)
+		result += std::string() + (char)(crc & 0xff) + (char)(crc >> 8);
+	else
+		result += std::string() + (char)(crc >> 8) + (char)(crc & 0xff);
+	return result;
+}
+
+// passes the data to the framer in pieces of the specified size
+void receive(StreamFramer& framer, const std::string& data, size_t pieceSize, StreamFramer::IListener* listener) {
+	size_t pos = 0;
+	while (pos < data.size()) {
+		size_t length;
+		char* buffer = framer.getWriteBuffer(&length);
+		size_t count = std::min(std::min(pieceSize, data.size() - pos), length);
+		memcpy(buffer, data.data() + pos, count);
+		framer.commit(count, listener);
+		pos += count;
+	}
+}
+
+}		// namespace
+
+int main(int /*argc*/, char** /*argv*/) {
+	try {
+		// CRC-16/X.25 check value
+		check("crc16", StreamFramer::crc16((const uint8_t*)"123456789", 9) == 0x906e);
+		check("crc16 empty", StreamFramer::crc16((const uint8_t*)"", 0) == 0x0000);
+
+		// escape sequences
+		check("unescape", StreamFramer::unescape("a\\r\\n") == "a\r\n");
+		check("unescape hex", StreamFramer::unescape("\\x1b\\t\\\\\\x00") == std::string("\x1b\t\\\0", 4));
+		check("unescape unsupported", unescapeFails("\\q"));
+		check("unescape incomplete", unescapeFails("abc\\"));
+		check("unescape short hex", unescapeFails("\\x1"));
+		check("unescape invalid hex", unescapeFails("\\xgg"));
+
+		// a message whose checksum has been calculated independently (list with one entry, three
+		// bytes of padding)
+		const std::string entry("\x71\x77\x07\x01\x00\x01\x08\x00\xff\x01\x01\x62\x1e\x52\xff\x65\x00\x01\xe2\x40\x01", 21);
+		const std::string message("\x1b\x1b\x1b\x1b\x01\x01\x01\x01" + entry + std::string("\x00\x00\x00\x1b\x1b\x1b\x1b\x1a\x03\x98\xc4", 11));
+		check("sml reference", smlMessage(entry) == message);
+		{
+			StreamFramer framer(StreamFramer::SML, 1024);
+			FrameCollector collector;
+			receive(framer, message, message.size(), &collector);
+			checkFrames("sml", collector.frames, {entry});
+		}
+
+		// escaped escape sequences in the payload; garbage before the message and data that is
+		// received byte by byte
+		const std::string escaped("\x01\x02\x03\x04\x1b\x1b\x1b\x1b\x05\x06\x07\x08\x1b\x1b\x1b\x1b\x09", 17);
+		{
+			StreamFramer framer(StreamFramer::SML, 1024);
+			FrameCollector collector;
+			receive(framer, "garbage\x1b\x1b" + smlMessage(escaped) + smlMessage(entry, true), 1, &collector);
+			checkFrames("sml escaped", collector.frames, {escaped, entry});
+			check("sml escaped: discarded", framer.getDiscardedBytes() == 9);
+		}
+
+		// a wrong checksum discards the message; the next message is received
+		{
+			std::string corrupted(smlMessage(escaped));
+			corrupted[corrupted.size() - 1] ^= 0x01;
+			StreamFramer framer(StreamFramer::SML, 1024);
+			FrameCollector collector;
+			receive(framer, corrupted + smlMessage(entry), 7, &collector);
+			checkFrames("sml checksum", collector.frames, {entry});
+			check("sml checksum: discarded", framer.getDiscardedBytes() == corrupted.size());
+		}
+
+		// a message that exceeds the maximum frame size is discarded
+		{
+			StreamFramer framer(StreamFramer::SML, 8);
+			FrameCollector collector;
+			receive(framer, smlMessage(escaped) + smlMessage(std::string("\x01\x01", 2)), 5, &collector);
+			checkFrames("sml frame size", collector.frames, {std::string("\x01\x01", 2)});
+		}
+
+		// OBIS values of SML list entries
+		opdi::DialPort owner("Meter");
+		opdi::DialPort energy("Energy", 0, 1000000000, 1);
+		opdi::DialPort energyShort("EnergyShort", 0, 1000000000, 1);
+		opdi::DialPort power("Power", -100000, 100000, 1);
+		opdi::DialPort unused("Unused", 0, 100, 1);
+		{
+			TestParser parser(&owner, true);
+			parser.addValue("1-0:1.8.0*255", 10, &energy);
+			parser.addValue("1-0:1.8.0", 1, &energyShort);
+			parser.addValue("1-0:16.7.0*255", 1, &power);
+			parser.addValue("1-0:2.8.0*255", 1, &unused);
+			// 123456 * 10^-1 Wh
+			parser.frameReceived(entry.data(), entry.size());
+			checkPosition("sml energy", energy, 123456);
+			checkPosition("sml energy without last group", energyShort, 12346);
+			// a signed value of -200 W in a nested list
+			const std::string powerEntry("\x72\x01\x71\x77\x07\x01\x00\x10\x07\x00\xff\x01\x01\x62\x1b\x52\x00\x53\xff\x38\x01", 21);
+			parser.frameReceived(powerEntry.data(), powerEntry.size());
+			checkPosition("sml negative value", power, -200);
+			checkPosition("sml unused", unused, 0);
+			// invalid data does not set values
+			power.setPosition(0);
+			const std::string truncated(powerEntry.substr(0, 19));
+			parser.frameReceived(truncated.data(), truncated.size());
+			checkPosition("sml truncated", power, 0);
+		}
+
+		// OBIS values of D0 text lines
+		{
+			energy.setPosition(0);
+			energyShort.setPosition(0);
+			TestParser parser(&owner, false);
+			parser.addValue("1-0:1.8.0*255", 1000, &energy);
+			parser.addValue("1-0:2.8.0", 1, &energyShort);
+			parser.addValue("0-0:96.1.0*255", 1, &unused);
+			const char* lines[] = { "/ESY5Q3DA1004 V3.04", " 1-0:1.8.0*255(001234.5678*kWh)", "1-0:2.8.0*255(000042.1*kWh)",
+				"0-0:96.1.0*255(1ESY1160000000)", "!" };
+			for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+				parser.frameReceived(lines[i], strlen(lines[i]));
+			checkPosition("d0 energy", energy, 1234568);
+			checkPosition("d0 energy without last group", energyShort, 42);
+			checkPosition("d0 meter ID ignored", unused, 0);
+		}
+	} catch (Poco::Exception& e) {
+		printf("FAILED: %s\n", e.displayText().c_str());
+		failed++;
+	}
+
+	printf("Stream framer test: %d check(s) failed\n", failed);
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+#!/bin/sh
+# Automatic test for the change capture mode of the Logger port.
+# Usage: test_change_capture.sh <openhatd binary>
+#
+# Runs two counters for 120 simulated seconds and logs their changes. The fast counter has a
+# deadband of 3 that is specified in the Deadbands section; the slow counter uses the default
+# deadband of 0. Checks that all changes of the slow counter are logged, that consecutive logged
+# values of the fast counter differ by at least the deadband, and that the rows are in
+# chronological order.
+
+BINARY=$1
+
+if [ -z "$BINARY" ]; then
+	echo "Usage: $0 <openhatd binary>" >&2
+	exit 1
+fi
+
+DIR=$(mktemp -d /tmp/openhat_capture_XXXXXX)
+CONFIG="$DIR/config.ini"
+LOG="$DIR/changes.csv"
+trap 'rm -rf "$DIR"' EXIT
+
+fail() {
+	echo "FAILED: $1" >&2
+	cat "$LOG" >&2
+	exit 1
+}
+
+{
+	printf "[General]\nSlaveName = Change capture test\n\n"
+	printf "[Connection]\nTransport = TCP\nPort = 13121\n\n"
+	printf "[Root]\nFast = 1\nSlow = 2\nLogger = 3\nTest = 4\n\n"
+	printf "[Fast]\nType = Counter\nPeriod = 1\n\n"
+	printf "[Slow]\nType = Counter\nPeriod = 5\n\n"
+	printf "[Logger]\nType = Logger\nPorts = Fast Slow\nPeriod = 10000\nOutputFile = $LOG\nAsync = False\n"
+	printf "Capture = Change\n\n"
+	printf "[Logger.Deadbands]\nFast = 3\n\n"
+	printf "[Test]\nType = Test\nInterval = 120\nExitAfterTest = True\n\n"
+	printf "[Test.Cases]\nFast:Readonly = true\n"
+} > "$CONFIG"
+
+"$BINARY" -c "$CONFIG" -s "2017-01-01 00:00:00" -q
+result=$?
+if [ $result -ne 0 ] && [ $result -ne 129 ]; then
+	fail "openhatd exited with code $result"
+fi
+
+[ -f "$LOG" ] || fail "output file missing"
+[ "$(head -n 1 "$LOG")" = "Timestamp;Fast;Slow" ] || fail "output file does not start with the header"
+
+# prints an error message for the first violation and the number of logged changes per port
+summary=$(awk -F ';' '
+	NR == 2 { time = $1; fast = $2; slow = $3; next }
+	NR > 2 {
+		if ($1 <= time) { print "rows not in chronological order: " time ", " $1; exit }
+		if ($2 != fast) {
+			if ((($2 - fast) < 3) && (($2 - fast) > -3)) { print "fast counter changed by less than the deadband: " fast " to " $2; exit }
+			fastChanges++
+		}
+		if ($3 != slow) {
+			if ($3 - slow != 1) { print "change of the slow counter missing: " slow " to " $3; exit }
+			slowChanges++
+		}
+		time = $1; fast = $2; slow = $3
+	}
+	END { printf "fast=%d slow=%d\n", fastChanges, slowChanges }
+' "$LOG")
+
+case "$summary" in
+	fast=*) ;;
+	*) fail "$summary";;
+esac
+
+fastChanges=$(echo "$summary" | sed 's/fast=\([0-9]*\).*/\1/')
+slowChanges=$(echo "$summary" | sed 's/.*slow=\([0-9]*\)/\1/')
+[ "$fastChanges" -ge 10 ] || fail "too few changes of the fast counter logged: $summary"
+[ "$slowChanges" -ge 10 ] || fail "too few changes of the slow counter logged: $summary"
+
+exit 0
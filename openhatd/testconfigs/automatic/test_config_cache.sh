@@ -0,0 +1,67 @@
+#!/bin/sh
+# Automatic test for the configuration cache.
+# Usage: test_config_cache.sh <openhatd binary>
+#
+# Starts openhatd three times with the same cache file. The first start reads the configuration
+# files, the second one takes them from the cache. Before the third start the contents of the
+# files are changed without changing their sizes or modification times; the changes must be
+# detected. The Test port checks that the settings of the included file are in effect.
+
+BINARY=$1
+
+if [ -z "$BINARY" ]; then
+	echo "Usage: $0 <openhatd binary>" >&2
+	exit 1
+fi
+
+DIR=$(mktemp -d /tmp/openhat_cache_XXXXXX)
+CONFIG="$DIR/config.ini"
+INCLUDE="$DIR/include.ini"
+CACHE="$DIR/config.cache"
+OUTPUT="$DIR/output.txt"
+trap 'rm -rf "$DIR"' EXIT
+
+fail() {
+	echo "FAILED: $1" >&2
+	cat "$OUTPUT" >&2
+	exit 1
+}
+
+# runs openhatd and checks the numbers of cached and read files
+run() {
+	"$BINARY" -c "$CONFIG" --config-cache "$CACHE" -s "2017-01-01 00:00:00" -v > "$OUTPUT" 2>&1
+	result=$?
+	if [ $result -ne 0 ] && [ $result -ne 129 ]; then
+		fail "openhatd exited with code $result"
+	fi
+	grep -q "Configuration cache: $1 file(s) cached, $2 file(s) read" "$OUTPUT" || fail "expected $1 cached and $2 read file(s)"
+}
+
+# writes the configuration files; the argument is the maximum of the dial port
+write_config() {
+	{
+		printf "[General]\nSlaveName = Configuration cache test\n\n"
+		printf "[Connection]\nTransport = TCP\nPort = 13124\n\n"
+		printf "[Root]\nInclude = 1\nTest = 2\n\n"
+		printf "[Include]\nType = Include\nFilename = include.ini\n\n"
+		printf "[Include.Parameters]\nPosition = 5\n\n"
+		printf "[Test]\nType = Test\nInterval = 1\nExitAfterTest = True\n\n"
+		printf "[Test.Cases]\nValue:Position = 5\nValue:Maximum = $1\n"
+	} > "$CONFIG"
+	{
+		printf "[Root]\nValue = 1\n\n"
+		printf "[Value]\nType = DialPort\nMaximum = $1\nPosition = \$Position\n"
+	} > "$INCLUDE"
+}
+
+write_config 100
+run 0 2
+run 2 0
+
+# change the files keeping their sizes and modification times
+touch -r "$INCLUDE" "$DIR/stamp"
+write_config 200
+touch -r "$DIR/stamp" "$CONFIG" "$INCLUDE"
+run 0 2
+
+exit 0
@@ -0,0 +1,70 @@
+#!/bin/sh
+# Automatic test for reloading the configuration.
+# Usage: test_config_reload.sh <openhatd binary>
+#
+# Starts openhatd in real time and sends SIGHUP twice. The first configuration change refers to
+# an unknown port; preparing the new ports fails, so the running configuration must be kept.
+# The second change sets a new position of a dial port. The Expression port that uses the dial
+# port must be set up again although its own settings have not changed. The Test port checks
+# the output of the expression when the reloads are done.
+
+BINARY=$1
+
+if [ -z "$BINARY" ]; then
+	echo "Usage: $0 <openhatd binary>" >&2
+	exit 1
+fi
+
+DIR=$(mktemp -d /tmp/openhat_reload_XXXXXX)
+CONFIG="$DIR/config.ini"
+OUTPUT="$DIR/output.txt"
+PID=""
+trap '[ -n "$PID" ] && kill $PID 2> /dev/null; rm -rf "$DIR"' EXIT
+
+fail() {
+	echo "FAILED: $1" >&2
+	cat "$OUTPUT" >&2
+	exit 1
+}
+
+# writes the configuration; the arguments are the position of the input and an optional extra node
+write_config() {
+	{
+		printf "[General]\nSlaveName = Configuration reload test\n\n"
+		printf "[Connection]\nTransport = TCP\nPort = 13125\n\n"
+		printf "[Root]\nIn = 1\nOut = 2\nExpr = 3\nTest = 4\n"
+		[ -n "$2" ] && printf "$2 = 5\n"
+		printf "\n"
+		printf "[In]\nType = DialPort\nMaximum = 100\nPosition = $1\n\n"
+		printf "[Out]\nType = DialPort\nMaximum = 1000\n\n"
+		printf "[Expr]\nType = Expression\nExpression = In * 2\nOutputPorts = Out\n\n"
+		printf "[Test]\nType = Test\nInterval = 8\nExitAfterTest = True\n\n"
+		printf "[Test.Cases]\nOut:Position = 14\n\n"
+		[ -n "$2" ] && printf "[$2]\nType = Expression\nExpression = In * 3\nOutputPorts = Missing\n"
+	} > "$CONFIG"
+}
+
+write_config 5
+"$BINARY" -c "$CONFIG" > "$OUTPUT" 2>&1 &
+PID=$!
+
+# a reload that fails must keep the running configuration
+sleep 2
+write_config 9 Broken
+kill -HUP $PID || fail "openhatd is not running"
+
+sleep 2
+write_config 7
+kill -HUP $PID || fail "openhatd is not running"
+
+wait $PID
+result=$?
+PID=""
+if [ $result -ne 0 ] && [ $result -ne 129 ]; then
+	fail "openhatd exited with code $result"
+fi
+
+grep -q "Unable to reload the configuration, keeping the current configuration" "$OUTPUT" || fail "the failing reload has not been rolled back"
+grep -q "Configuration reloaded: 2 node(s) changed, 2 port(s) removed, 2 port(s) created" "$OUTPUT" || fail "the dependent Expression port has not been set up again"
+
+exit 0
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Automatic test for the Length protocol of Exec port workers.
+# Usage: test_exec_worker_length.sh <openhatd binary>
+#
+# Starts openhatd in real time with a worker that announces a response that exceeds the
+# MaxResponseLength when it is first started. The worker must be restarted instead of buffering
+# the response. The restarted worker responds correctly, so the Test port checks its result.
+
+BINARY=$1
+
+if [ -z "$BINARY" ]; then
+	echo "Usage: $0 <openhatd binary>" >&2
+	exit 1
+fi
+
+DIR=$(mktemp -d /tmp/openhat_worker_XXXXXX)
+CONFIG="$DIR/config.ini"
+WORKER="$DIR/worker.sh"
+OUTPUT="$DIR/output.txt"
+trap 'rm -rf "$DIR"' EXIT
+
+fail() {
+	echo "FAILED: $1" >&2
+	cat "$OUTPUT" >&2
+	exit 1
+}
+
+# responds with the doubled value; the first instance announces a response that is too long
+cat > "$WORKER" << EOF
+#!/bin/sh
+while read length; do
+	value=\$(dd bs=1 count=\$length 2> /dev/null)
+	if [ ! -f "$DIR/started" ]; then
+		touch "$DIR/started"
+		printf '1000000\n'
+		continue
+	fi
+	result=\$((value * 2))
+	printf '%s\n%s' \${#result} \$result
+done
+EOF
+chmod +x "$WORKER"
+
+{
+	printf "[General]\nSlaveName = Exec worker length test\n\n"
+	printf "[Connection]\nTransport = TCP\nPort = 13126\n\n"
+	printf "[Root]\nIn = 1\nOut = 2\nWorker = 3\nTrigger = 4\nTest = 5\n\n"
+	printf "[In]\nType = DialPort\nPosition = 7\n\n"
+	printf "[Out]\nType = DialPort\n\n"
+	printf "[Worker]\nType = Exec\nMode = Worker\nProtocol = Length\nProgram = $WORKER\nRequest = \$In\n"
+	printf "OutputPort = Out\nMaxResponseLength = 100\nRestartDelay = 100\n\n"
+	printf "[Trigger]\nType = Pulse\nLine = High\nPeriod = 1000\nDutyCycle = 50\nOutputPorts = Worker\n\n"
+	printf "[Test]\nType = Test\nInterval = 5\nExitAfterTest = True\n\n"
+	printf "[Test.Cases]\nOut:Position = 14\n"
+} > "$CONFIG"
+
+"$BINARY" -c "$CONFIG" > "$OUTPUT" 2>&1
+result=$?
+if [ $result -ne 0 ] && [ $result -ne 129 ]; then
+	fail "openhatd exited with code $result"
+fi
+
+grep -q "Length of worker response exceeds MaxResponseLength: 1000000; restarting worker" "$OUTPUT" || fail "the worker has not been restarted"
+
+exit 0
@@ -0,0 +1,60 @@
+#!/bin/sh
+# Automatic test for the sharing of compiled expressions.
+# Usage: test_expression_sharing.sh <openhatd binary>
+#
+# Configures three expressions that differ only in the ports they use (and in the case of a port
+# ID) and one expression that mentions a port ID only inside a string literal. Checks that the
+# expressions evaluate to the values of their own ports, and that the second and the third
+# expression use the compiled form of the first one.
+
+BINARY=$1
+
+if [ -z "$BINARY" ]; then
+	echo "Usage: $0 <openhatd binary>" >&2
+	exit 1
+fi
+
+DIR=$(mktemp -d /tmp/openhat_sharing_XXXXXX)
+CONFIG="$DIR/config.ini"
+OUTPUT="$DIR/output.txt"
+trap 'rm -rf "$DIR"' EXIT
+
+fail() {
+	echo "FAILED: $1" >&2
+	cat "$OUTPUT" >&2
+	exit 1
+}
+
+{
+	printf "[General]\nSlaveName = Expression sharing test\n\n"
+	printf "[Connection]\nTransport = TCP\nPort = 13123\n\n"
+	printf "[Root]\nA = 1\nB = 2\nC = 3\nOutA = 4\nOutB = 5\nOutC = 6\nOutS = 7\n"
+	printf "ExprA = 8\nExprB = 9\nExprC = 10\nExprS = 11\nTest = 12\n\n"
+	printf "[A]\nType = DialPort\nPosition = 3\n\n"
+	printf "[B]\nType = DialPort\nPosition = 7\n\n"
+	printf "[C]\nType = DialPort\nPosition = 5\n\n"
+	for port in OutA OutB OutC OutS; do
+		printf "[$port]\nType = DialPort\nMaximum = 1000\n\n"
+	done
+	printf "[ExprA]\nType = Expression\nExpression = A * 2 + 1\nOutputPorts = OutA\nLogVerbosity = Debug\n\n"
+	printf "[ExprB]\nType = Expression\nExpression = B * 2 + 1\nOutputPorts = OutB\nLogVerbosity = Debug\n\n"
+	printf "[ExprC]\nType = Expression\nExpression = c * 2 + 1\nOutputPorts = OutC\nLogVerbosity = Debug\n\n"
+	printf "[ExprS]\nType = Expression\nExpression = A + ('B' == 'B')\nOutputPorts = OutS\nLogVerbosity = Debug\n\n"
+	printf "[Test]\nType = Test\nInterval = 3\nExitAfterTest = True\n\n"
+	printf "[Test.Cases]\nOutA:Position = 7\nOutB:Position = 15\nOutC:Position = 11\nOutS:Position = 4\n"
+} > "$CONFIG"
+
+"$BINARY" -c "$CONFIG" -s "2017-01-01 00:00:00" -q > "$OUTPUT" 2>&1
+result=$?
+if [ $result -ne 0 ] && [ $result -ne 129 ]; then
+	fail "openhatd exited with code $result"
+fi
+
+for port in ExprB ExprC; do
+	grep -q "$port: Using cached compiled expression" "$OUTPUT" || fail "$port does not use the compiled expression of ExprA"
+done
+for port in ExprA ExprS; do
+	grep -q "$port: Using cached compiled expression" "$OUTPUT" && fail "$port uses a compiled expression of another port"
+done
+
+exit 0
@@ -0,0 +1,71 @@
+#!/bin/sh
+# Automatic test for the rotation of Logger port output files.
+# Usage: test_logger_rotation.sh <openhatd binary>
+#
+# Runs a Logger port for 30 simulated seconds that rotates its output file every five seconds,
+# compresses the rotated files and keeps two of them. Checks that the expected files exist, that
+# each file starts with the header line, and that files which only share the prefix of the
+# output file name are not removed by the cleanup.
+
+BINARY=$1
+
+if [ -z "$BINARY" ]; then
+	echo "Usage: $0 <openhatd binary>" >&2
+	exit 1
+fi
+
+DIR=$(mktemp -d /tmp/openhat_logger_XXXXXX)
+CONFIG="$DIR/config.ini"
+trap 'rm -rf "$DIR"' EXIT
+
+fail() {
+	echo "FAILED: $1" >&2
+	ls -l "$DIR" >&2
+	exit 1
+}
+
+# files that must survive the cleanup
+echo "keep" > "$DIR/log.csv.keep"
+echo "keep" > "$DIR/log.csv.20170101.txt"
+echo "keep" > "$DIR/log.csv.2017010100000.gz"
+
+{
+	printf "[General]\nSlaveName = Logger rotation test\n\n"
+	printf "[Connection]\nTransport = TCP\nPort = 13120\n\n"
+	printf "[Root]\nValue = 1\nLogger = 2\nTest = 3\n\n"
+	printf "[Value]\nType = DialPort\nMaximum = 1000\n\n"
+	printf "[Logger]\nType = Logger\nPorts = Value\nPeriod = 1000\nOutputFile = $DIR/log.csv\n"
+	printf "RotationInterval = 5\nMaxFiles = 2\nCompress = True\n\n"
+	printf "[Test]\nType = Test\nInterval = 30\nExitAfterTest = True\n\n"
+	printf "[Test.Cases]\nValue:Position = 0\n"
+} > "$CONFIG"
+
+"$BINARY" -c "$CONFIG" -s "2017-01-01 00:00:00" -q
+result=$?
+if [ $result -ne 0 ] && [ $result -ne 129 ]; then
+	fail "openhatd exited with code $result"
+fi
+
+HEADER="Timestamp;Value"
+
+[ -f "$DIR/log.csv" ] || fail "output file missing"
+[ "$(head -n 1 "$DIR/log.csv")" = "$HEADER" ] || fail "output file does not start with the header"
+
+for file in log.csv.keep log.csv.20170101.txt log.csv.2017010100000.gz; do
+	[ -f "$DIR/$file" ] || fail "unrelated file $file has been removed"
+done
+
+rotated=$(cd "$DIR" && ls | grep -E '^log\.csv\.[0-9]{14}(-[0-9]+)?(\.gz)?$')
+[ "$(echo "$rotated" | grep -c .)" -eq 2 ] || fail "expected 2 rotated files, found: $rotated"
+
+for file in $rotated; do
+	case "$file" in
+		*.gz) ;;
+		*) fail "rotated file $file has not been compressed";;
+	esac
+	content=$(gzip -dc "$DIR/$file") || fail "rotated file $file can't be decompressed"
+	[ "$(echo "$content" | head -n 1)" = "$HEADER" ] || fail "rotated file $file does not start with the header"
+	[ "$(echo "$content" | grep -c '^2017-01-01')" -ge 4 ] || fail "rotated file $file contains too few entries"
+done
+
+exit 0
@@ -0,0 +1,85 @@
+#!/bin/sh
+# Measures the startup time of openhatd with a large number of Expression ports.
+# Usage: expression_startup.sh <openhatd binary> [number of expressions] [runs]
+#
+# The generated configuration contains one input dial port per group of ten expressions
+# ("rooms") and a small set of formulas that repeat across the rooms, as is typical for
+# large installations. openhatd is started in test mode (-t) which prepares all ports and exits.
+# Output is one line per run in the format: expressions=<n> run=<i> startup_ms=<ms>
+
+BINARY=$1
+COUNT=${2:-1000}
+RUNS=${3:-3}
+
+if [ -z "$BINARY" ]; then
+	echo "Usage: $0 <openhatd binary> [number of expressions] [runs]" >&2
+	exit 1
+fi
+
+CONFIG=$(mktemp /tmp/openhat_expr_XXXXXX)
+
+{
+	echo "[General]"
+	echo "SlaveName = Expression startup benchmark"
+	echo ""
+	echo "[Connection]"
+	echo "Transport = TCP"
+	echo "Port = 13110"
+	echo ""
+	echo "[Root]"
+	i=0
+	while [ $i -lt $COUNT ]; do
+		if [ $((i % 10)) -eq 0 ]; then
+			echo "Room$((i / 10)) = 1"
+		fi
+		echo "Expr$i = 1"
+		echo "Out$i = 1"
+		i=$((i + 1))
+	done
+	echo ""
+	i=0
+	while [ $i -lt $COUNT ]; do
+		room=$((i / 10))
+		if [ $((i % 10)) -eq 0 ]; then
+			echo "[Room$room]"
+			echo "Type = DialPort"
+			echo "Minimum = -1000"
+			echo "Maximum = 1000"
+			echo ""
+		fi
+		echo "[Out$i]"
+		echo "Type = DialPort"
+		echo "Minimum = -100000"
+		echo "Maximum = 100000"
+		echo ""
+		echo "[Expr$i]"
+		echo "Type = Expression"
+		case $((i % 5)) in
+			0) echo "Expression = Room$room * 10 + 5";;
+			1) echo "Expression = if ((Room$room < 0), -Room$room, Room$room)";;
+			2) echo "Expression = clamp(-500, Room$room * 2, 500)";;
+			3) echo "Expression = (Room$room + 273.15) * 9 / 5 - 459.67";;
+			4) echo "Expression = if ((Room$room > 20), 1, 0)";;
+		esac
+		echo "OutputPorts = Out$i"
+		echo ""
+		i=$((i + 1))
+	done
+} > "$CONFIG"
+
+run=1
+while [ $run -le $RUNS ]; do
+	start=$(date +%s%N)
+	"$BINARY" -c "$CONFIG" -t -q
+	result=$?
+	end=$(date +%s%N)
+	if [ $result -ne 0 ]; then
+		echo "openhatd exited with code $result" >&2
+		rm -f "$CONFIG"
+		exit $result
+	fi
+	echo "expressions=$COUNT run=$run startup_ms=$(((end - start) / 1000000))"
+	run=$((run + 1))
+done
+
+rm -f "$CONFIG"
@@ -0,0 +1,77 @@
+#!/bin/sh
+# Benchmark for File ports that watch a large number of files.
+# Usage: file_watch.sh <openhatd binary> [frames] [number of files]
+#
+# The generated configuration contains <number of files> File ports, each of which watches its own
+# file in a temporary directory. While openhatd runs the doWork loop for the specified number of
+# frames without a connection (-b), the files are modified continuously.
+# The result is written as one JSON object, e.g.:
+# {"files":500,"modifications":...,"threads":...,"ports":1500,"frames":10000,"startup_ms":...,"fps":...,...}
+# "threads" is the maximum number of threads of the openhatd process (Linux only).
+#
+# Defaults: 10000 frames; 500 files.
+
+BINARY=$1
+FRAMES=${2:-10000}
+COUNT=${3:-500}
+
+if [ -z "$BINARY" ]; then
+	echo "Usage: $0 <openhatd binary> [frames] [number of files]" >&2
+	exit 1
+fi
+
+DIR=$(mktemp -d /tmp/openhat_files_XXXXXX)
+CONFIG="$DIR/config.ini"
+OUTPUT="$DIR/output.txt"
+trap 'rm -rf "$DIR"' EXIT
+
+mkdir "$DIR/data"
+i=0
+while [ $i -lt $COUNT ]; do
+	echo "0" > "$DIR/data/value$i.txt"
+	i=$((i + 1))
+done
+
+{
+	printf "[General]\nSlaveName = File watch benchmark\n\n"
+	printf "[Connection]\nTransport = TCP\nPort = 13110\n\n"
+	echo "[Root]"
+	i=0
+	while [ $i -lt $COUNT ]; do
+		echo "File$i = 1"
+		i=$((i + 1))
+	done
+	echo ""
+	i=0
+	while [ $i -lt $COUNT ]; do
+		printf "[File$i]\nType = File\nFile = $DIR/data/value$i.txt\nPortNode = Value$i\n\n"
+		printf "[Value$i]\nType = DialPort\nMinimum = 0\nMaximum = 1000000\n\n"
+		i=$((i + 1))
+	done
+} > "$CONFIG"
+
+"$BINARY" -c "$CONFIG" -b $FRAMES -q > "$OUTPUT" &
+PID=$!
+
+# modify the files while openhatd is running and sample its number of threads
+modifications=0
+threads=0
+while kill -0 $PID 2>/dev/null; do
+	i=$((modifications % COUNT))
+	echo "$modifications" > "$DIR/data/value$i.txt"
+	modifications=$((modifications + 1))
+	if [ $((modifications % 50)) -eq 0 ] && [ -r /proc/$PID/status ]; then
+		t=$(awk '/^Threads:/ { print $2 }' /proc/$PID/status 2>/dev/null)
+		if [ -n "$t" ] && [ "$t" -gt "$threads" ]; then
+			threads=$t
+		fi
+	fi
+done
+
+wait $PID
+result=$?
+if [ $result -ne 0 ]; then
+	echo "openhatd exited with code $result" >&2
+	exit $result
+fi
+grep '^{"ports"' "$OUTPUT" | sed "s/^{/{\"files\":$COUNT,\"modifications\":$modifications,\"threads\":$threads,/"
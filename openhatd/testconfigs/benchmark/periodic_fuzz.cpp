@@ -0,0 +1,355 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Fuzz test for the search of the next occurrence of a periodic Timer port schedule.
+// Usage: openhat-periodic-fuzz [iterations] [seed]
+//
+// Generates random schedules and start times between the years 1600 and 2400 (biased towards
+// the ends of days and months) and compares TimerPort::findNextPeriodicMatch with
+// - a brute force search (day by day and second by second over 400 years) for every 20th case,
+// - the iterative search that was used before the bit mask implementation.
+// The previous search has known bugs; its differing results are classified and counted.
+// The result is printed as a JSON object, e.g.:
+// {"iterations":100000,"reference_checked":5000,"never":...,"same":...,"legacy_no_result":...,
+//  "legacy_invalid_date":...,"legacy_nomatch":...,"legacy_later":...}
+// Exits with code 1 if the new search disagrees with the brute force search, or if the previous
+// search finds an earlier matching point in time.
+// Build with "make periodic-fuzz".
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "Poco/DateTime.h"
+#include "Poco/Timespan.h"
+#include "Poco/Exception.h"
+
+#include "TimerPort.h"
+
+// defined by the main program of openhatd
+openhat::AbstractOpenHAT* Opdi = nullptr;
+
+namespace {
+
+// exposes the search of the Timer port
+class FuzzTimerPort : public openhat::TimerPort {
+public:
+	using TimerPort::ScheduleComponent;
+	using TimerPort::Schedule;
+	using TimerPort::findNextPeriodicMatch;
+};
+
+// the previous iterative search (values are stored in a std::vector<bool>)
+class LegacySearch {
+public:
+	class ScheduleComponent {
+	public:
+		std::vector<bool> values;
+		bool isDay;
+
+		bool getNextPossibleValue(int* currentValue, bool* rollover, bool* changed, int month, int year) {
+			*rollover = false;
+			*changed = false;
+			// find a match
+			for (int i = *currentValue; i < (int)this->values.size(); i++) {
+				if (this->values[i]) {
+					// for days, make a special check whether the month has as many days
+					if (!this->isDay || (i < Poco::DateTime::daysOfMonth(year, month))) {
+						*changed = *currentValue != i;
+						*currentValue = i;
+						return true;
+					}
+					// day is out of range; need to rollover
+					break;
+				}
+			}
+			// not found? rollover; return first possible value
+			*rollover = true;
+			return this->getFirstPossibleValue(currentValue);
+		}
+
+		bool getFirstPossibleValue(int* currentValue) {
+			for (int i = (this->isDay ? 1 : 0); i < (int)this->values.size(); i++) {
+				if (this->values[i]) {
+					*currentValue = i;
+					return true;
+				}
+			}
+			return false;
+		}
+	};
+
+	ScheduleComponent monthComponent;
+	ScheduleComponent dayComponent;
+	ScheduleComponent weekdayComponent;
+	ScheduleComponent hourComponent;
+	ScheduleComponent minuteComponent;
+	ScheduleComponent secondComponent;
+
+	// returns false if the previous search did not find a result
+	// (it returned the current time in this case)
+	bool find(int* r) {
+
+#define correctValues	if (second > 59) { second = 0; minute++; }                                \
+						if (minute > 59) { minute = 0; hour++; }                                  \
+						if (hour > 23) { hour = 0; day++; }                                       \
+						if (day > Poco::DateTime::daysOfMonth(year, month)) { day = 1; month++; } \
+						if (month > 12) { month = 1; year++; }
+
+		// start from the next second
+		int year = r[0], month = r[1], day = r[2], hour = r[3], minute = r[4], second = r[5] + 1;
+		correctValues;
+
+		bool rollover = false;
+		bool changed = false;
+		if (!this->secondComponent.getNextPossibleValue(&second, &rollover, &changed, month, year))
+			return false;
+		if (rollover) {
+			minute++;
+			correctValues;
+		}
+		if (!this->minuteComponent.getNextPossibleValue(&minute, &rollover, &changed, month, year))
+			return false;
+		if (rollover) {
+			hour++;
+			correctValues;
+		}
+		if (rollover || changed)
+			this->secondComponent.getFirstPossibleValue(&second);
+		if (!this->hourComponent.getNextPossibleValue(&hour, &rollover, &changed, month, year))
+			return false;
+		if (rollover) {
+			day++;
+			correctValues;
+		}
+		if (rollover || changed) {
+			this->secondComponent.getFirstPossibleValue(&second);
+			this->minuteComponent.getFirstPossibleValue(&minute);
+		}
+		int maxIter = 100;
+		do {
+			if (--maxIter < 0)
+				return false;
+			if (!this->dayComponent.getNextPossibleValue(&day, &rollover, &changed, month, year))
+				return false;
+			if (rollover) {
+				month++;
+				correctValues;
+			}
+			if (rollover || changed) {
+				this->secondComponent.getFirstPossibleValue(&second);
+				this->minuteComponent.getFirstPossibleValue(&minute);
+				this->hourComponent.getFirstPossibleValue(&hour);
+			}
+			if (!this->monthComponent.getNextPossibleValue(&month, &rollover, &changed, month, year))
+				return false;
+			if (rollover) {
+				year++;
+				correctValues;
+			}
+			if (rollover || changed) {
+				this->secondComponent.getFirstPossibleValue(&second);
+				this->minuteComponent.getFirstPossibleValue(&minute);
+				this->hourComponent.getFirstPossibleValue(&hour);
+				this->dayComponent.getFirstPossibleValue(&day);
+			}
+			// the previous implementation constructed a Poco::DateTime here which fails for invalid dates
+			if (!Poco::DateTime::isValid(year, month, day))
+				throw Poco::InvalidArgumentException("Invalid date");
+			if (this->weekdayComponent.values[Poco::DateTime(year, month, day).dayOfWeek()])
+				break;
+			day++;
+			correctValues;
+			this->secondComponent.getFirstPossibleValue(&second);
+			this->minuteComponent.getFirstPossibleValue(&minute);
+			this->hourComponent.getFirstPossibleValue(&hour);
+		} while (true);
+
+#undef correctValues
+
+		if (!Poco::DateTime::isValid(year, month, day, hour, minute, second))
+			throw Poco::InvalidArgumentException("Invalid date");
+		r[0] = year;
+		r[1] = month;
+		r[2] = day;
+		r[3] = hour;
+		r[4] = minute;
+		r[5] = second;
+		return true;
+	}
+};
+
+// component order: month, day, weekday, hour, minute, second
+const int minimums[6] = {1, 1, 0, 0, 0, 0};
+const int maximums[6] = {12, 31, 6, 23, 59, 59};
+
+bool matches(const uint64_t* masks, const int* r) {
+	return ((masks[0] >> r[1]) & 1) && ((masks[1] >> r[2]) & 1) && ((masks[2] >> Poco::DateTime(r[0], r[1], r[2]).dayOfWeek()) & 1)
+		&& ((masks[3] >> r[3]) & 1) && ((masks[4] >> r[4]) & 1) && ((masks[5] >> r[5]) & 1);
+}
+
+// brute force search starting at the specified second
+bool reference(const uint64_t* masks, const int* start, int* r) {
+	int y = start[0], m = start[1], d = start[2];
+	for (int days = 0; days <= 146097 + 31; days++) {
+		if (((masks[0] >> m) & 1) && ((masks[1] >> d) & 1) && ((masks[2] >> Poco::DateTime(y, m, d).dayOfWeek()) & 1)) {
+			for (int t = (days == 0 ? start[3] * 3600 + start[4] * 60 + start[5] : 0); t < 86400; t++) {
+				if (((masks[3] >> (t / 3600)) & 1) && ((masks[4] >> (t / 60 % 60)) & 1) && ((masks[5] >> (t % 60)) & 1)) {
+					r[0] = y;
+					r[1] = m;
+					r[2] = d;
+					r[3] = t / 3600;
+					r[4] = t / 60 % 60;
+					r[5] = t % 60;
+					return true;
+				}
+			}
+		}
+		if (++d > Poco::DateTime::daysOfMonth(y, m)) {
+			d = 1;
+			if (++m > 12) {
+				m = 1;
+				y++;
+			}
+		}
+	}
+	return false;
+}
+
+void printTime(const char* label, const int* r) {
+	printf(" %s %04d-%02d-%02d %02d:%02d:%02d", label, r[0], r[1], r[2], r[3], r[4], r[5]);
+}
+
+void printCase(const char* message, const uint64_t* masks, const int* now) {
+	printf("%s: masks %llx %llx %llx %llx %llx %llx", message,
+		(unsigned long long)masks[0], (unsigned long long)masks[1], (unsigned long long)masks[2],
+		(unsigned long long)masks[3], (unsigned long long)masks[4], (unsigned long long)masks[5]);
+	printTime("now", now);
+}
+
+}		// namespace
+
+int main(int argc, char** argv) {
+	long iterations = (argc > 1 ? atol(argv[1]) : 100000);
+	std::mt19937_64 random(argc > 2 ? atol(argv[2]) : 1);
+
+	long referenceChecked = 0, never = 0, same = 0, legacyNoResult = 0, legacyInvalidDate = 0, legacyNoMatch = 0, legacyLater = 0;
+	for (long i = 0; i < iterations; i++) {
+		// random allowed values: all, sparse, dense or a single value
+		uint64_t masks[6];
+		for (int c = 0; c < 6; c++) {
+			int mode = random() % 4;
+			int single = minimums[c] + random() % (maximums[c] - minimums[c] + 1);
+			masks[c] = 0;
+			for (int v = minimums[c]; v <= maximums[c]; v++) {
+				bool allowed = (mode == 0) || (mode == 1 && random() % 8 == 0) || (mode == 2 && random() % 2 == 0) || (mode == 3 && v == single);
+				if (allowed)
+					masks[c] |= (uint64_t)1 << v;
+			}
+			if (masks[c] == 0)
+				masks[c] = (uint64_t)1 << single;
+		}
+		// the current time
+		int now[6];
+		now[0] = 1600 + random() % 800;
+		now[1] = 1 + random() % 12;
+		now[2] = 1 + random() % Poco::DateTime::daysOfMonth(now[0], now[1]);
+		now[3] = random() % 24;
+		now[4] = random() % 60;
+		now[5] = random() % 60;
+		if (random() % 4 == 0) {
+			// the last seconds of a month
+			now[2] = Poco::DateTime::daysOfMonth(now[0], now[1]);
+			now[3] = 23;
+			now[4] = 59;
+			now[5] = 59 - random() % 3;
+		}
+
+		// build the schedule the same way as the configuration does
+		FuzzTimerPort::Schedule schedule;
+		FuzzTimerPort::ScheduleComponent* components[6] = {&schedule.monthComponent, &schedule.dayComponent, &schedule.weekdayComponent,
+			&schedule.hourComponent, &schedule.minuteComponent, &schedule.secondComponent};
+		LegacySearch legacy;
+		LegacySearch::ScheduleComponent* legacyComponents[6] = {&legacy.monthComponent, &legacy.dayComponent, &legacy.weekdayComponent,
+			&legacy.hourComponent, &legacy.minuteComponent, &legacy.secondComponent};
+		for (int c = 0; c < 6; c++) {
+			std::string def;
+			for (int v = minimums[c]; v <= maximums[c]; v++)
+				if ((masks[c] >> v) & 1)
+					def += (def.empty() ? "" : " ") + std::to_string(v);
+			*components[c] = FuzzTimerPort::ScheduleComponent::Parse((FuzzTimerPort::ScheduleComponent::Type)c, def, nullptr);
+			legacyComponents[c]->isDay = (c == 1);
+			legacyComponents[c]->values.resize(maximums[c] + 1);
+			for (int v = 0; v <= maximums[c]; v++)
+				legacyComponents[c]->values[v] = ((masks[c] >> v) & 1) != 0;
+		}
+
+		// the search starts at the next second (see TimerPort::calculateNextOccurrence)
+		Poco::DateTime startTime = Poco::DateTime(now[0], now[1], now[2], now[3], now[4], now[5]) + Poco::Timespan(1, 0);
+		int start[6] = {startTime.year(), startTime.month(), startTime.day(), startTime.hour(), startTime.minute(), startTime.second()};
+		int result[6];
+		std::copy(start, start + 6, result);
+		bool found = FuzzTimerPort::findNextPeriodicMatch(&schedule, &result[0], &result[1], &result[2], &result[3], &result[4], &result[5]);
+		if (!found)
+			never++;
+
+		if (i % 20 == 0) {
+			int expected[6];
+			bool expectedFound = reference(masks, start, expected);
+			referenceChecked++;
+			if ((found != expectedFound) || (found && !std::equal(result, result + 6, expected))) {
+				printCase("FAILED: brute force search differs", masks, now);
+				if (found)
+					printTime("result", result);
+				if (expectedFound)
+					printTime("expected", expected);
+				printf("\n");
+				return 1;
+			}
+		}
+
+		int legacyResult[6];
+		std::copy(now, now + 6, legacyResult);
+		try {
+			if (!legacy.find(legacyResult)) {
+				legacyNoResult++;
+				continue;
+			}
+		} catch (Poco::Exception&) {
+			legacyInvalidDate++;
+			continue;
+		}
+		if (found && std::equal(result, result + 6, legacyResult)) {
+			same++;
+			continue;
+		}
+		if (!matches(masks, legacyResult)) {
+			legacyNoMatch++;
+			continue;
+		}
+		// the previous search skipped a match unless it found an earlier one
+		if (found && std::lexicographical_compare(result, result + 6, legacyResult, legacyResult + 6)) {
+			legacyLater++;
+			continue;
+		}
+		printCase("FAILED: previous search found an earlier match", masks, now);
+		if (found)
+			printTime("result", result);
+		printTime("previous", legacyResult);
+		printf("\n");
+		return 1;
+	}
+
+	printf("{\"iterations\":%ld,\"reference_checked\":%ld,\"never\":%ld,\"same\":%ld,\"legacy_no_result\":%ld,"
+		"\"legacy_invalid_date\":%ld,\"legacy_nomatch\":%ld,\"legacy_later\":%ld}\n",
+		iterations, referenceChecked, never, same, legacyNoResult, legacyInvalidDate, legacyNoMatch, legacyLater);
+	return 0;
+}
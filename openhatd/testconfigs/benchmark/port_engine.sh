@@ -0,0 +1,114 @@
+#!/bin/sh
+# Benchmark suite for the port engine.
+# Usage: port_engine.sh <openhatd binary> [frames] [sizes] [types]
+#
+# For each port type and size a configuration is generated that contains <size> ports of
+# this type (plus the ports they operate on). openhatd runs the doWork loop for the
+# specified number of frames without a connection (-b) and prints its statistics.
+# Each result is written as one JSON object per line, e.g.:
+# {"type":"Logic","size":100,"ports":302,"frames":1000,"startup_ms":...,"fps":...,
+#  "frame_avg_us":...,"frame_p50_us":...,"frame_p99_us":...,"frame_max_us":...,"peak_rss_kb":...}
+#
+# Defaults: 1000 frames; sizes 100 1000 10000 50000;
+# types Logic Expression Aggregator Counter Trigger Timer Fader.
+
+BINARY=$1
+FRAMES=${2:-1000}
+SIZES=${3:-"100 1000 10000 50000"}
+TYPES=${4:-"Logic Expression Aggregator Counter Trigger Timer Fader"}
+
+if [ -z "$BINARY" ]; then
+	echo "Usage: $0 <openhatd binary> [frames] [sizes] [types]" >&2
+	exit 1
+fi
+
+CONFIG=$(mktemp /tmp/openhat_bench_XXXXXX)
+trap 'rm -f "$CONFIG" "$CONFIG.root" "$CONFIG.ports"' EXIT
+
+# writes the ports for one unit of the specified type
+# to $CONFIG.root (port order) and $CONFIG.ports (port sections)
+unit() {
+	type=$1
+	i=$2
+	case $type in
+	Logic)
+		echo "Logic$i = 10" >> "$CONFIG.root"
+		echo "Out$i = 10" >> "$CONFIG.root"
+		printf "[Logic$i]\nType = Logic\nFunction = OR\nInputPorts = ClockOut\nOutputPorts = Out$i\n\n" >> "$CONFIG.ports"
+		printf "[Out$i]\nType = DigitalPort\nMode = Output\n\n" >> "$CONFIG.ports"
+		;;
+	Expression)
+		echo "Expr$i = 10" >> "$CONFIG.root"
+		echo "Out$i = 10" >> "$CONFIG.root"
+		printf "[Expr$i]\nType = Expression\nExpression = Tick * $i + 1\nOutputPorts = Out$i\n\n" >> "$CONFIG.ports"
+		printf "[Out$i]\nType = DialPort\nMinimum = 0\nMaximum = 1000000000000\n\n" >> "$CONFIG.ports"
+		;;
+	Aggregator)
+		echo "Aggregator$i = 10" >> "$CONFIG.root"
+		printf "[Aggregator$i]\nType = Aggregator\nSourcePort = Tick\nInterval = 1\nValues = 60\n\n" >> "$CONFIG.ports"
+		printf "[Aggregator$i.Calculations]\nAverage$i = 1\n\n" >> "$CONFIG.ports"
+		printf "[Average$i]\nType = DialPort\nMinimum = 0\nMaximum = 1000000000000\nAlgorithm = Average\n\n" >> "$CONFIG.ports"
+		;;
+	Counter)
+		echo "Counter$i = 10" >> "$CONFIG.root"
+		printf "[Counter$i]\nType = Counter\nPeriod = 10\n\n" >> "$CONFIG.ports"
+		;;
+	Trigger)
+		echo "Trigger$i = 10" >> "$CONFIG.root"
+		echo "Out$i = 10" >> "$CONFIG.root"
+		printf "[Trigger$i]\nType = Trigger\nInputPorts = ClockOut\nOutputPorts = Out$i\nTrigger = Both\nChange = Toggle\n\n" >> "$CONFIG.ports"
+		printf "[Out$i]\nType = DigitalPort\nMode = Output\n\n" >> "$CONFIG.ports"
+		;;
+	Timer)
+		echo "Timer$i = 10" >> "$CONFIG.root"
+		echo "Out$i = 10" >> "$CONFIG.root"
+		printf "[Timer$i]\nType = Timer\nOutputPorts = Out$i\n\n" >> "$CONFIG.ports"
+		printf "[Timer$i.Schedules]\nSchedule$i = 1\n\n" >> "$CONFIG.ports"
+		printf "[Schedule$i]\nType = Periodic\nSecond = $((i % 60))\nDuration = 500\nAction = SetHigh\n\n" >> "$CONFIG.ports"
+		printf "[Out$i]\nType = DigitalPort\nMode = Output\n\n" >> "$CONFIG.ports"
+		;;
+	Fader)
+		echo "Fader$i = 10" >> "$CONFIG.root"
+		echo "Out$i = 10" >> "$CONFIG.root"
+		printf "[Fader$i]\nType = Fader\nLine = High\nFadeMode = Linear\nLeft = 0\nRight = 100\nDuration = 10000\nOutputPorts = Out$i\n\n" >> "$CONFIG.ports"
+		printf "[Out$i]\nType = AnalogPort\nMode = Output\n\n" >> "$CONFIG.ports"
+		;;
+	*)
+		echo "Unknown port type: $type" >> /dev/stderr
+		exit 1
+		;;
+	esac
+}
+
+for type in $TYPES; do
+	for size in $SIZES; do
+		# common ports: a clock that toggles a digital port and a counter that changes every frame
+		printf "Clock = 1\nClockOut = 1\nTick = 1\n" > "$CONFIG.root"
+		printf "[Clock]\nType = Pulse\nLine = High\nPeriod = 20\nOutputPorts = ClockOut\n\n" > "$CONFIG.ports"
+		printf "[ClockOut]\nType = DigitalPort\nMode = Output\n\n" >> "$CONFIG.ports"
+		printf "[Tick]\nType = Counter\nPeriod = 1\n\n" >> "$CONFIG.ports"
+
+		i=0
+		while [ $i -lt $size ]; do
+			unit $type $i
+			i=$((i + 1))
+		done
+
+		{
+			printf "[General]\nSlaveName = Port engine benchmark\n\n"
+			printf "[Connection]\nTransport = TCP\nPort = 13110\n\n"
+			echo "[Root]"
+			cat "$CONFIG.root"
+			echo ""
+			cat "$CONFIG.ports"
+		} > "$CONFIG"
+
+		output=$("$BINARY" -c "$CONFIG" -b $FRAMES -q)
+		result=$?
+		if [ $result -ne 0 ]; then
+			echo "openhatd exited with code $result for type $type, size $size" >&2
+			exit $result
+		fi
+		echo "$output" | grep '^{"ports"' | sed "s/^{/{\"type\":\"$type\",\"size\":$size,/"
+	done
+done
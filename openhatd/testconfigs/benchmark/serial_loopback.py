@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# Throughput benchmark for the SerialStreamingPort (Linux only).
+# Usage: serial_loopback.py <openhatd binary> [frames] [buffer size]
+#
+# A pseudo terminal pair is created; the generated configuration contains a SerialStreamingPort
+# in Loopback mode that opens the terminal side. While openhatd runs the doWork loop for the
+# specified number of frames without a connection (-b), data is written to the other side and
+# the echoed data is read back and verified.
+# The result is written as one JSON object, e.g.:
+# {"bytes":...,"bytes_per_second":...,"errors":0,"ports":1,"frames":10000,"startup_ms":...,"fps":...,...}
+#
+# Defaults: 10000 frames; buffer size 4096.
+
+import json
+import os
+import select
+import subprocess
+import sys
+import tempfile
+import time
+import tty
+
+if len(sys.argv) < 2:
+	sys.stderr.write("Usage: %s <openhatd binary> [frames] [buffer size]\n" % sys.argv[0])
+	sys.exit(1)
+
+binary = sys.argv[1]
+frames = int(sys.argv[2]) if len(sys.argv) > 2 else 10000
+bufferSize = int(sys.argv[3]) if len(sys.argv) > 3 else 4096
+
+master, slave = os.openpty()
+tty.setraw(slave)
+tty.setraw(master)
+os.set_blocking(master, False)
+
+directory = tempfile.mkdtemp(prefix="openhat_serial_")
+config = os.path.join(directory, "config.ini")
+with open(config, "w") as f:
+	f.write("[General]\nSlaveName = Serial loopback benchmark\n\n")
+	f.write("[Connection]\nTransport = TCP\nPort = 13111\n\n")
+	f.write("[Root]\nSerial = 1\n\n")
+	f.write("[Serial]\nType = SerialStreamingPort\nSerialPort = %s\nBaudRate = 115200\nMode = Loopback\nBufferSize = %d\n\n" % (os.ttyname(slave), bufferSize))
+
+process = subprocess.Popen([binary, "-c", config, "-b", str(frames), "-q"], stdout=subprocess.PIPE)
+
+# a repeating pattern allows to verify the echoed data
+pattern = bytes(range(256)) * 512
+sent = 0
+received = 0
+errors = 0
+start = time.time()
+while process.poll() is None:
+	readable, writable, _ = select.select([master], [master] if sent - received < 65536 else [], [], 0.1)
+	if writable:
+		try:
+			offset = sent % 256
+			sent += os.write(master, pattern[offset:offset + 4096])
+		except BlockingIOError:
+			pass
+	if readable:
+		try:
+			data = os.read(master, 65536)
+		except (BlockingIOError, OSError):
+			data = b""
+		offset = received % 256
+		if data != pattern[offset:offset + len(data)]:
+			errors += 1
+		received += len(data)
+duration = time.time() - start
+
+output = process.stdout.read().decode()
+os.close(master)
+os.close(slave)
+os.remove(config)
+os.rmdir(directory)
+
+if process.returncode != 0:
+	sys.stderr.write("openhatd exited with code %d\n" % process.returncode)
+	sys.exit(process.returncode)
+
+result = {"bytes": received, "bytes_per_second": received / duration if duration > 0 else 0, "errors": errors}
+for line in output.splitlines():
+	if line.startswith('{"ports"'):
+		result.update(json.loads(line))
+print(json.dumps(result, separators=(",", ":")))
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# Measures the response time of the JSON-RPC method getDeviceInfo of the WebServerPlugin.
+# Usage: webserver_deviceinfo.py <openhatd binary> <WebServerPlugin driver> [ports] [requests]
+#
+# The driver is specified like the Driver setting of the plugin, i.e. without the file extension
+# (e.g. ../plugins/WebServerPlugin/WebServerPlugin). The generated configuration contains the
+# specified number of ports (Digital, Dial and Select ports with labels, in equal parts) and the
+# WebServerPlugin. After the web server has started getDeviceInfo is requested repeatedly; the
+# first request is reported separately because it fills the cache of the port information.
+# The result is written as one JSON object, e.g.:
+# {"ports":5000,"requests":50,"bytes":...,"first_ms":...,"avg_ms":...,"p50_ms":...,"p95_ms":...,"max_ms":...}
+#
+# Defaults: 5000 ports; 50 requests.
+
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import urllib.request
+
+if len(sys.argv) < 3:
+	sys.stderr.write("Usage: %s <openhatd binary> <WebServerPlugin driver> [ports] [requests]\n" % sys.argv[0])
+	sys.exit(1)
+
+binary = sys.argv[1]
+driver = os.path.abspath(sys.argv[2])
+ports = int(sys.argv[3]) if len(sys.argv) > 3 else 5000
+requests = int(sys.argv[4]) if len(sys.argv) > 4 else 50
+httpPort = 18080
+
+directory = tempfile.mkdtemp(prefix="openhat_web_")
+config = os.path.join(directory, "config.ini")
+with open(config, "w") as f:
+	f.write("[General]\nSlaveName = WebServer benchmark\n\n")
+	f.write("[Connection]\nTransport = TCP\nPort = 13112\n\n")
+	f.write("[Root]\nWebServer = 1\n")
+	for i in range(ports):
+		f.write("Port%d = 2\n" % i)
+	f.write("\n[WebServer]\nType = Plugin\nDriver = %s\nRelativeTo = CWD\nPort = %d\nDocumentRoot = %s\nDocumentRootRelativeTo = CWD\n\n" % (driver, httpPort, directory))
+	for i in range(ports):
+		kind = i % 3
+		if kind == 0:
+			f.write("[Port%d]\nType = DigitalPort\nLabel = Digital port %d\nMode = Output\nLine = %s\n\n" % (i, i, ("Low", "High")[i % 2]))
+		elif kind == 1:
+			f.write("[Port%d]\nType = DialPort\nLabel = Dial port %d\nMinimum = 0\nMaximum = 10000\nStep = 1\nPosition = %d\nUnit = Watt\n\n" % (i, i, i % 10000))
+		else:
+			f.write("[Port%d]\nType = SelectPort\nLabel = Select port %d\nPosition = %d\n\n" % (i, i, i % 4))
+			f.write("[Port%d.Labels]\nOff = 0\nLow = 1\nMedium = 2\nHigh = 3\n\n" % i)
+
+process = subprocess.Popen([binary, "-c", config, "-q"], stdout=subprocess.DEVNULL)
+
+body = json.dumps({"jsonrpc": "2.0", "id": 1, "method": "getDeviceInfo", "params": {}}).encode()
+
+def request():
+	req = urllib.request.Request("http://localhost:%d/api/jsonrpc" % httpPort, data=body, headers={"Content-Type": "application/json"})
+	start = time.time()
+	with urllib.request.urlopen(req, timeout=30) as response:
+		data = response.read()
+	elapsed = (time.time() - start) * 1000
+	result = json.loads(data.decode())
+	if result.get("error") is not None or len(result["result"]["deviceInfo"]["ports"]) < ports:
+		raise Exception("Unexpected response: " + data[:200].decode())
+	return elapsed, len(data)
+
+try:
+	# wait for the web server
+	deadline = time.time() + 60
+	while True:
+		if process.poll() is not None:
+			sys.stderr.write("openhatd exited with code %d\n" % process.returncode)
+			sys.exit(1)
+		try:
+			first, size = request()
+			break
+		except OSError:
+			if time.time() > deadline:
+				raise
+			time.sleep(0.2)
+
+	times = []
+	for i in range(requests):
+		elapsed, size = request()
+		times.append(elapsed)
+finally:
+	process.terminate()
+	process.wait()
+	shutil.rmtree(directory)
+
+times.sort()
+result = {"ports": ports, "requests": requests, "bytes": size, "first_ms": round(first, 2),
+	"avg_ms": round(sum(times) / len(times), 2), "p50_ms": round(times[len(times) // 2], 2),
+	"p95_ms": round(times[min(len(times) - 1, len(times) * 95 // 100)], 2), "max_ms": round(times[-1], 2)}
+print(json.dumps(result, separators=(",", ":")))
@@ -0,0 +1,12 @@
+#!/bin/sh
+
+# Worker for the Exec port example (test_exec_worker.ini).
+# Reads one request per line and responds with the doubled value.
+
+echo "Starting execworker..." >&2
+
+while read value; do
+	echo $((value * 2))
+done
+
+echo "Terminating execworker..." >&2
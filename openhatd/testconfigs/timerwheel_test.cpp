@@ -0,0 +1,136 @@
+//    Copyright (C) 2011-2016 OpenHAT contributors (https://openhat.org, https://github.com/openhat-org)
+//    All rights reserved.
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Test for the timer wheel. Runs the wheel on a simulated clock with timers on both sides
+// of the level boundaries and checks after every step that getNextDueMs() returns the
+// earliest scheduled timer and that every timer expires exactly at its due time.
+// Build with "make timerwheel-test"; exits with code 1 on the first failure.
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "TimerWheel.h"
+#include "Clock.h"
+
+using namespace openhat;
+
+namespace {
+
+class TestTimer : public TimerWheel::Timer {
+public:
+	uint64_t expiredMs;
+
+	TestTimer() : expiredMs(0) {};
+
+protected:
+	virtual void expired(void) override {
+		this->expiredMs = opdi::Clock::get().getTimeMs();
+	};
+};
+
+// runs one scenario; the delays are relative to the start time
+bool runScenario(uint64_t startMs, const std::vector<uint64_t>& delays) {
+	opdi::SimulatedClock clock(Poco::Timestamp((Poco::Timestamp::TimeVal)startMs * 1000), 1000 * 60 * 60);
+	opdi::Clock::set(&clock);
+	TimerWheel& wheel = TimerWheel::get();
+	// synchronize the wheel with the new clock
+	wheel.advance();
+
+	std::vector<TestTimer> timers(delays.size());
+	for (size_t i = 0; i < delays.size(); i++)
+		wheel.schedule(&timers[i], startMs + delays[i]);
+
+	bool result = true;
+	while (result && (wheel.getTimerCount() > 0)) {
+		uint64_t nowMs = clock.getTimeMs();
+		uint64_t expected = UINT64_MAX;
+		for (auto it = timers.begin(), ite = timers.end(); it != ite; ++it)
+			if (it->isScheduled())
+				expected = std::min(expected, it->getDueMs());
+		uint64_t next = wheel.getNextDueMs();
+		if (next != expected) {
+			printf("FAILED: start %llu, now +%llu: next due at +%llu, expected +%llu\n",
+				(unsigned long long)startMs, (unsigned long long)(nowMs - startMs),
+				(unsigned long long)(next - startMs), (unsigned long long)(expected - startMs));
+			result = false;
+			break;
+		}
+		// stop at the next due time and just before and at the level boundaries on the way
+		// so that the wheel is checked in the states directly before and after cascading
+		// (the highest boundary before the due time is used to keep the number of steps low)
+		clock.addDeadlineMs(next);
+		for (int level = 3; level > 0; level--) {
+			uint64_t boundary = ((nowMs >> (8 * level)) + 1) << (8 * level);
+			if (boundary <= next) {
+				// the clock advances by at least one millisecond, so the next step reaches the boundary
+				clock.addDeadlineMs(boundary - 1);
+				break;
+			}
+		}
+		clock.advance();
+		wheel.advance();
+	}
+
+	for (size_t i = 0; result && (i < timers.size()); i++) {
+		if (timers[i].expiredMs != startMs + delays[i]) {
+			printf("FAILED: start %llu: timer due at +%llu expired at +%llu\n",
+				(unsigned long long)startMs, (unsigned long long)delays[i],
+				(unsigned long long)(timers[i].expiredMs - startMs));
+			result = false;
+		}
+	}
+	for (auto it = timers.begin(), ite = timers.end(); it != ite; ++it)
+		wheel.cancel(&*it);
+
+	opdi::Clock::set(nullptr);
+	return result;
+}
+
+}		// namespace
+
+int main(int /*argc*/, char** /*argv*/) {
+	// delays around the level boundaries; pairs with one delay on each side are tested
+	const uint64_t delays[] = {
+		1, 2, 255, 256, 257, 300, 511, 512,
+		65535, 65536, 65537, 65791,
+		((uint64_t)1 << 24) - 1, (uint64_t)1 << 24, ((uint64_t)1 << 24) + 1
+	};
+	const int delayCount = sizeof(delays) / sizeof(delays[0]);
+	// start times with different alignments; the wheel processes the millisecond after
+	// the start time next, so start times ending with all ones are aligned
+	const uint64_t base = (uint64_t)1500000000000 & ~(((uint64_t)1 << 24) - 1);
+	const uint64_t starts[] = {
+		base, base - 1, base + 5, base + 255, base + 0x105,
+		base + 65535, base + 65535 - 300, base + 0x12345, base + ((uint64_t)1 << 24) - 1 - 65536
+	};
+
+	int scenarios = 0;
+	int failed = 0;
+	for (auto start : starts) {
+		for (int i = 0; i < delayCount; i++) {
+			for (int k = i; k < delayCount; k++) {
+				// the order of scheduling must not matter
+				std::vector<uint64_t> scenario = {delays[i], delays[k]};
+				if (!runScenario(start, scenario))
+					failed++;
+				std::reverse(scenario.begin(), scenario.end());
+				if (!runScenario(start, scenario))
+					failed++;
+				scenarios += 2;
+			}
+		}
+		// timers on all levels at once
+		if (!runScenario(start, std::vector<uint64_t>(delays, delays + delayCount)))
+			failed++;
+		scenarios++;
+	}
+
+	printf("%d scenarios, %d failed\n", scenarios, failed);
+	return failed > 0 ? 1 : 0;
+}